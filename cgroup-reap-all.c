@@ -19,20 +19,44 @@
 
 #include "helpers.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
 int kill (pid_t pid, int signal);
 pid_t getpgid (pid_t);
 
-int
-main (int argc, char * argv[])
+/* How long to wait for the group to empty before looking again, when
+   we can't be told about it */
+#define REAP_WAIT_MS 100
+
+/* Kinds of cgroup hierarchies that we know how to freeze */
+typedef enum {
+	CGROUP_V1,
+	CGROUP_V2
+} cgroup_version_t;
+
+/* We don't want to kill ourselves, or if we're being executed by
+   a script, that script, either. We also don't want things in our
+   process group which we forked at the opening */
+static gboolean
+should_kill (GPid pid, GPid selfpid, GPid parentpid)
 {
-	/* Break off a new process group */
-	setpgid(0, 0);
+	return pid != selfpid && pid != parentpid && getpgid(pid) != selfpid;
+}
 
+/* Use CGManager to find the PIDs in our cgroup and kill them, over
+   and over until there are none left */
+static void
+reap_cgmanager (GPid selfpid, GPid parentpid)
+{
 	GDBusConnection * cgmanager = cgroup_manager_connection();
-	g_return_val_if_fail(cgmanager != NULL, -1);
-
-	GPid selfpid = getpid();
-	GPid parentpid = getppid();
+	g_return_if_fail(cgmanager != NULL);
 
 	/* We're gonna try to kill things forever, literally. It's important
 	   enough that we can't consider failure an option. */
@@ -46,10 +70,7 @@ main (int argc, char * argv[])
 		for (head = pidlist; head != NULL; head = g_list_next(head)) {
 			GPid pid = GPOINTER_TO_INT(head->data);
 
-			/* We don't want to kill ourselves, or if we're being executed by
-			   a script, that script, either. We also don't want things in our
-			   process group which we forked at the opening */
-			if (pid != selfpid && pid != parentpid && getpgid(pid) != selfpid) {
+			if (should_kill(pid, selfpid, parentpid)) {
 				g_debug("Killing pid: %d", pid);
 				kill(pid, SIGKILL);
 				killed = TRUE;
@@ -60,6 +81,271 @@ main (int argc, char * argv[])
 	}
 
 	cgroup_manager_unref(cgmanager);
+}
+
+/* Find the directory of the cgroup we're in on the cgroup filesystem,
+   only if it is an Upstart job's group, as we're about to kill everything
+   in it. Looks for the freezer hierarchy first, then the unified one. */
+static gchar *
+cgroup_self_dir (cgroup_version_t * version)
+{
+	const gchar * root = g_getenv("UBUNTU_APP_LAUNCH_CGROUP_ROOT");
+	if (root == NULL) {
+		root = "/sys/fs/cgroup";
+	}
+
+	/* Set by the test suite along with the root */
+	const gchar * self = g_getenv("UBUNTU_APP_LAUNCH_CGROUP_SELF");
+	if (self == NULL) {
+		self = "/proc/self/cgroup";
+	}
+
+	gchar * contents = NULL;
+	if (!g_file_get_contents(self, &contents, NULL, NULL)) {
+		return NULL;
+	}
+
+	gchar * freezerpath = NULL;
+	gchar * unifiedpath = NULL;
+	cgroup_paths_parse(contents, &freezerpath, &unifiedpath);
+	g_free(contents);
+
+	int i;
+	gchar * retval = NULL;
+
+	if (freezerpath != NULL && strstr(freezerpath, "/upstart/") != NULL) {
+		gchar * dir = g_build_filename(root, "freezer", freezerpath, NULL);
+		gchar * state = g_build_filename(dir, "freezer.state", NULL);
+
+		if (g_file_test(state, G_FILE_TEST_EXISTS)) {
+			*version = CGROUP_V1;
+			retval = dir;
+		} else {
+			g_free(dir);
+		}
+
+		g_free(state);
+	}
+
+	if (retval == NULL && unifiedpath != NULL && strstr(unifiedpath, "/upstart/") != NULL) {
+		/* Either the whole mount is unified or it is a hybrid setup
+		   with the unified hierarchy next to the v1 controllers */
+		const gchar * unifieds[] = { "", "unified", NULL };
+		for (i = 0; unifieds[i] != NULL && retval == NULL; i++) {
+			gchar * dir = g_build_filename(root, unifieds[i], unifiedpath, NULL);
+			gchar * freeze = g_build_filename(dir, "cgroup.freeze", NULL);
+
+			if (g_file_test(freeze, G_FILE_TEST_EXISTS)) {
+				*version = CGROUP_V2;
+				retval = dir;
+			} else {
+				g_free(dir);
+			}
+
+			g_free(freeze);
+		}
+	}
+
+	g_free(freezerpath);
+	g_free(unifiedpath);
+
+	return retval;
+}
+
+/* Write a value to a cgroup control file, they need to be written in
+   place and not replaced like g_file_set_contents() does */
+static gboolean
+cgroup_write (const gchar * dir, const gchar * file, const gchar * value)
+{
+	gchar * path = g_build_filename(dir, file, NULL);
+	int fd = open(path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+	gboolean retval = FALSE;
+
+	if (fd < 0) {
+		g_debug("Unable to open '%s': %s", path, strerror(errno));
+	} else {
+		size_t len = strlen(value);
+		retval = write(fd, value, len) == (ssize_t)len;
+		if (!retval) {
+			g_debug("Unable to write '%s' to '%s': %s", value, path, strerror(errno));
+		}
+		close(fd);
+	}
+
+	g_free(path);
+	return retval;
+}
+
+/* Check whether a cgroup file has a line in it */
+static gboolean
+cgroup_has_line (const gchar * dir, const gchar * file, const gchar * line)
+{
+	gchar * path = g_build_filename(dir, file, NULL);
+	gchar * contents = NULL;
+	gboolean retval = FALSE;
+
+	if (g_file_get_contents(path, &contents, NULL, NULL)) {
+		gchar ** lines = g_strsplit(contents, "\n", -1);
+		retval = g_strv_contains((const gchar * const *)lines, line);
+		g_strfreev(lines);
+		g_free(contents);
+	}
+
+	g_free(path);
+	return retval;
+}
+
+/* Send SIGKILL to all the processes in the group that we should,
+   returns how many there were */
+static guint
+cgroup_kill_all (const gchar * dir, GPid selfpid, GPid parentpid)
+{
+	gchar * path = g_build_filename(dir, "cgroup.procs", NULL);
+	gchar * contents = NULL;
+	guint killed = 0;
+
+	if (g_file_get_contents(path, &contents, NULL, NULL)) {
+		gchar ** lines = g_strsplit(contents, "\n", -1);
+		int i;
+
+		for (i = 0; lines[i] != NULL; i++) {
+			GPid pid = atoi(lines[i]);
+			if (pid > 0 && should_kill(pid, selfpid, parentpid)) {
+				g_debug("Killing pid: %d", pid);
+				kill(pid, SIGKILL);
+				killed++;
+			}
+		}
+
+		g_strfreev(lines);
+		g_free(contents);
+	}
+
+	g_free(path);
+	return killed;
+}
+
+/* Wait until a file in the cgroup has a line in it. On the unified
+   hierarchy the kernel tells us when cgroup.events changes, otherwise
+   we have to look every so often. Returns FALSE if it didn't happen
+   before the timeout. */
+static gboolean
+cgroup_wait_line (const gchar * dir, const gchar * file, const gchar * line, int inotifyfd, int timeout)
+{
+	gint64 end = g_get_monotonic_time() + timeout * G_TIME_SPAN_MILLISECOND;
+
+	while (!cgroup_has_line(dir, file, line)) {
+		gint64 remaining = (end - g_get_monotonic_time()) / G_TIME_SPAN_MILLISECOND;
+		if (remaining <= 0) {
+			return FALSE;
+		}
+
+		if (inotifyfd >= 0) {
+			struct pollfd pfd = { .fd = inotifyfd, .events = POLLIN, .revents = 0 };
+			if (poll(&pfd, 1, remaining) > 0) {
+				/* We only care that something changed, not what */
+				char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
+				while (read(inotifyfd, buffer, sizeof(buffer)) > 0);
+			}
+		} else {
+			g_usleep(MIN(remaining, 10) * G_TIME_SPAN_MILLISECOND);
+		}
+	}
+
+	return TRUE;
+}
+
+/* Freeze the group so nothing in it can fork, kill everything that
+   is there, and then thaw it so they can die. Then wait for the group
+   to be empty. Returns FALSE if the cgroup can't be used, and we should
+   go through CGManager instead. */
+static gboolean
+reap_cgroupfs (GPid selfpid, GPid parentpid)
+{
+	if (g_getenv("UBUNTU_APP_LAUNCH_DISABLE_FREEZER") != NULL) {
+		return FALSE;
+	}
+
+	cgroup_version_t version = CGROUP_V1;
+	gchar * dir = cgroup_self_dir(&version);
+	if (dir == NULL) {
+		return FALSE;
+	}
+
+	/* Move ourselves up a level so we don't freeze ourselves */
+	gchar * parentdir = g_path_get_dirname(dir);
+	gchar * selfstr = g_strdup_printf("%d", selfpid);
+	gboolean moved = cgroup_write(parentdir, "cgroup.procs", selfstr);
+	g_free(selfstr);
+	g_free(parentdir);
+
+	if (!moved) {
+		g_debug("Unable to leave cgroup '%s'", dir);
+		g_free(dir);
+		return FALSE;
+	}
+
+	const gchar * freezefile = version == CGROUP_V1 ? "freezer.state" : "cgroup.freeze";
+	const gchar * statusfile = version == CGROUP_V1 ? "freezer.state" : "cgroup.events";
+	const gchar * frozen = version == CGROUP_V1 ? "FROZEN" : "frozen 1";
+
+	int inotifyfd = -1;
+	if (version == CGROUP_V2) {
+		gchar * events = g_build_filename(dir, "cgroup.events", NULL);
+		inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyfd >= 0 && inotify_add_watch(inotifyfd, events, IN_MODIFY) < 0) {
+			close(inotifyfd);
+			inotifyfd = -1;
+		}
+		g_free(events);
+	}
+
+	g_debug("Reaping cgroup: %s", dir);
+
+	/* If there's still something around after we wait for it, which
+	   could happen if we weren't able to freeze, go around again */
+	gboolean killed = TRUE;
+	while (killed) {
+		if (cgroup_write(dir, freezefile, version == CGROUP_V1 ? "FROZEN" : "1")) {
+			if (!cgroup_wait_line(dir, statusfile, frozen, inotifyfd, 1000)) {
+				g_debug("Timeout waiting for cgroup '%s' to freeze", dir);
+			}
+		}
+
+		killed = cgroup_kill_all(dir, selfpid, parentpid) > 0;
+
+		cgroup_write(dir, freezefile, version == CGROUP_V1 ? "THAWED" : "0");
+
+		if (killed) {
+			/* The group is only empty if a script that ran us isn't in it,
+			   otherwise we'll look again after a bit. The v1 hierarchy
+			   can't tell us, so there we always look again. */
+			if (cgroup_wait_line(dir, "cgroup.events", "populated 0", inotifyfd, REAP_WAIT_MS)) {
+				killed = FALSE;
+			}
+		}
+	}
+
+	if (inotifyfd >= 0) {
+		close(inotifyfd);
+	}
+
+	g_free(dir);
+	return TRUE;
+}
+
+int
+main (int argc, char * argv[])
+{
+	/* Break off a new process group */
+	setpgid(0, 0);
+
+	GPid selfpid = getpid();
+	GPid parentpid = getppid();
+
+	if (!reap_cgroupfs(selfpid, parentpid)) {
+		reap_cgmanager(selfpid, parentpid);
+	}
 
 	return 0;
 }
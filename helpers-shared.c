@@ -294,6 +294,40 @@ pids_from_cgroup (GDBusConnection * cgmanager, const gchar * jobname, const gcha
 	return retval;
 }
 
+/* Find the paths of the freezer and unified hierarchies in the contents
+   of a /proc/<pid>/cgroup file. Lines are 'hierarchy-ID:controller-list:cgroup-path'
+   and the unified hierarchy has an ID of zero with no controllers. The
+   paths are set to NULL if they aren't there, free them with g_free() */
+void
+cgroup_paths_parse (const gchar * contents, gchar ** freezerpath, gchar ** unifiedpath)
+{
+	*freezerpath = NULL;
+	*unifiedpath = NULL;
+
+	gchar ** lines = g_strsplit(contents, "\n", -1);
+
+	int i;
+	for (i = 0; lines[i] != NULL; i++) {
+		gchar ** fields = g_strsplit(lines[i], ":", 3);
+		if (g_strv_length(fields) == 3) {
+			if (g_strcmp0(fields[0], "0") == 0 && fields[1][0] == '\0') {
+				g_free(*unifiedpath);
+				*unifiedpath = g_strdup(fields[2]);
+			} else {
+				gchar ** controllers = g_strsplit(fields[1], ",", -1);
+				if (g_strv_contains((const gchar * const *)controllers, "freezer")) {
+					g_free(*freezerpath);
+					*freezerpath = g_strdup(fields[2]);
+				}
+				g_strfreev(controllers);
+			}
+		}
+		g_strfreev(fields);
+	}
+
+	g_strfreev(lines);
+}
+
 /* Global markers for the ual_tracepoint macro */
 int _ual_tracepoints_env_checked = 0;
 int _ual_tracepoints_enabled = 0;
@@ -60,5 +60,9 @@ GList *   pids_from_cgroup       (GDBusConnection * cgmanager,
 gboolean   verify_keyfile        (GKeyFile *    inkeyfile,
                                   const gchar * desktop);
 
+void      cgroup_paths_parse     (const gchar *   contents,
+                                  gchar **        freezerpath,
+                                  gchar **        unifiedpath);
+
 G_END_DECLS
 
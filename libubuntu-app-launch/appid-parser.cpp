@@ -0,0 +1,238 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "appid-parser.h"
+
+namespace ubuntu
+{
+namespace app_launch
+{
+namespace appid_parser
+{
+
+static inline bool isLowerOrDigit(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+static inline bool isAlnum(char c)
+{
+    return isLowerOrDigit(c) || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool isPackageChar(char c)
+{
+    return isLowerOrDigit(c) || c == '+' || c == '.' || c == '-';
+}
+
+/* The regular expression had '+-.' in its character class, which is the
+   range from '+' to '.', so ',' is allowed as well */
+static inline bool isAppNameStart(char c)
+{
+    return isAlnum(c) || (c >= '+' && c <= '.') || c == ':' || c == '~';
+}
+
+static inline bool isAppNameChar(char c)
+{
+    return isAppNameStart(c) || c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool isVersionChar(char c)
+{
+    return isAlnum(c) || c == '.' || c == '+' || c == ':' || c == '~' || c == '-';
+}
+
+static bool validPackage(const std::string& str, const Range& range)
+{
+    if (range.length < 2 || !isLowerOrDigit(str[range.start]))
+    {
+        return false;
+    }
+
+    for (size_t i = range.start + 1; i < range.start + range.length; i++)
+    {
+        if (!isPackageChar(str[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool validAppName(const std::string& str, const Range& range)
+{
+    if (range.length < 2 || !isAppNameStart(str[range.start]))
+    {
+        return false;
+    }
+
+    for (size_t i = range.start + 1; i < range.start + range.length; i++)
+    {
+        if (!isAppNameChar(str[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool validVersion(const std::string& str, const Range& range)
+{
+    if (range.length < 1)
+    {
+        return false;
+    }
+
+    for (size_t i = range.start; i < range.start + range.length; i++)
+    {
+        if (!isVersionChar(str[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* None of the parts can have an underscore in them, so the underscores
+   are all that is needed to find the parts */
+Parts split(const std::string& sappid)
+{
+    Parts parts;
+
+    auto first = sappid.find('_');
+    if (first == std::string::npos)
+    {
+        Range appname{0, sappid.size()};
+        if (validAppName(sappid, appname))
+        {
+            parts.form = Form::LEGACY;
+            parts.appname = appname;
+        }
+        return parts;
+    }
+
+    Range package{0, first};
+    if (!validPackage(sappid, package))
+    {
+        return parts;
+    }
+
+    auto second = sappid.find('_', first + 1);
+    if (second == std::string::npos)
+    {
+        Range appname{first + 1, sappid.size() - first - 1};
+        if (validAppName(sappid, appname))
+        {
+            parts.form = Form::SHORT;
+            parts.package = package;
+            parts.appname = appname;
+        }
+        return parts;
+    }
+
+    Range appname{first + 1, second - first - 1};
+    Range version{second + 1, sappid.size() - second - 1};
+    if (validAppName(sappid, appname) && validVersion(sappid, version))
+    {
+        parts.form = Form::FULL;
+        parts.package = package;
+        parts.appname = appname;
+        parts.version = version;
+    }
+
+    return parts;
+}
+
+/* The instance ID is digits, so it is after the last dash */
+bool splitInstance(const std::string& instance, Range& appid)
+{
+    auto dash = instance.rfind('-');
+    if (dash == std::string::npos)
+    {
+        return false;
+    }
+
+    for (size_t i = dash + 1; i < instance.size(); i++)
+    {
+        if (instance[i] < '0' || instance[i] > '9')
+        {
+            return false;
+        }
+    }
+
+    /* The regular expression used '.' for the ID, which doesn't match
+       the end of a line */
+    for (size_t i = 0; i < dash; i++)
+    {
+        if (instance[i] == '\n' || instance[i] == '\r')
+        {
+            return false;
+        }
+    }
+
+    appid.start = 0;
+    appid.length = dash;
+    return true;
+}
+
+bool matchInstance(const std::string& instance, const std::string& appid, Range& instanceid)
+{
+    if (instance.size() <= appid.size() || instance.compare(0, appid.size(), appid) != 0 ||
+        instance[appid.size()] != '-')
+    {
+        return false;
+    }
+
+    for (size_t i = appid.size() + 1; i < instance.size(); i++)
+    {
+        if (instance[i] < '0' || instance[i] > '9')
+        {
+            return false;
+        }
+    }
+
+    instanceid.start = appid.size() + 1;
+    instanceid.length = instance.size() - instanceid.start;
+    return true;
+}
+
+bool validSnapAppName(const std::string& appname)
+{
+    if (appname.empty() || !isAlnum(appname.front()) || !isAlnum(appname.back()))
+    {
+        return false;
+    }
+
+    for (size_t i = 1; i < appname.size(); i++)
+    {
+        if (appname[i] == '-' ? appname[i - 1] == '-' : !isAlnum(appname[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}  // namespace appid_parser
+}  // namespace app_launch
+}  // namespace ubuntu
@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#pragma once
+
+#include <string>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/** \brief Splitting application IDs into their parts
+
+    Application IDs are split on every signal, every C API call and every
+    list, which used to be done by matching them against std::regex objects
+    that allocate on every match. These functions check the same rules in a
+    single pass over the string, and give the parts as ranges of it so that
+    nothing is copied until the caller asks for it.
+
+    The rules are the ones that the regular expressions had:
+
+     - A package is a lowercase letter or digit followed by one or more
+       lowercase letters, digits, '+', '.' or '-'.
+     - An application name is two or more letters, digits, '+', ',', '-',
+       '.', ':' or '~', and anything but the first can also be whitespace.
+     - A version is one or more letters, digits, '.', '+', ':', '~' or '-'.
+*/
+namespace appid_parser
+{
+
+/** A part of a string */
+struct Range
+{
+    size_t start;  /**< Offset of the first character */
+    size_t length; /**< Number of characters */
+
+    /** Copy the part out of the string it is a part of */
+    std::string of(const std::string& str) const
+    {
+        return str.substr(start, length);
+    }
+};
+
+/** Which form of application ID a string is */
+enum class Form
+{
+    INVALID, /**< Not an application ID */
+    LEGACY,  /**< Only an application name */
+    SHORT,   /**< $(package)_$(appname) */
+    FULL,    /**< $(package)_$(appname)_$(version) */
+};
+
+/** The parts of an application ID, the ranges are only set for
+    the parts that the form has */
+struct Parts
+{
+    Form form = Form::INVALID; /**< Form of the ID */
+    Range package{0, 0};       /**< Package name */
+    Range appname{0, 0};       /**< Application name */
+    Range version{0, 0};       /**< Version */
+};
+
+/** Splits an application ID into its parts
+
+    \param sappid Application ID string
+*/
+Parts split(const std::string& sappid);
+
+/** Finds the application ID in the name of an Upstart instance, which
+    is the ID followed by a dash and the instance ID, which can be empty.
+    Returns false if the name doesn't look like that.
+
+    \param instance Name of the instance
+    \param appid Range of the name that is the application ID
+*/
+bool splitInstance(const std::string& instance, Range& appid);
+
+/** Checks whether a string is the application ID followed by a dash
+    and an instance ID of digits, which can be empty.
+
+    \param instance Name of the instance
+    \param appid Application ID that it should have
+    \param instanceid Range of the name that is the instance ID
+*/
+bool matchInstance(const std::string& instance, const std::string& appid, Range& instanceid);
+
+/** Checks that a snap application name is letters and digits, with
+    single dashes between them
+
+    \param appname Application name
+*/
+bool validSnapAppName(const std::string& appname);
+
+}  // namespace appid_parser
+}  // namespace app_launch
+}  // namespace ubuntu
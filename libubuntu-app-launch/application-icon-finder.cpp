@@ -18,7 +18,9 @@
  */
 
 #include "application-icon-finder.h"
+#include <cstring>
 #include <regex>
+#include <sys/stat.h>
 
 namespace ubuntu
 {
@@ -30,6 +32,7 @@ constexpr auto ICONS_DIR = "/icons";
 constexpr auto HICOLOR_THEME_DIR = "/icons/hicolor";
 constexpr auto HUMANITY_THEME_DIR = "/icons/Humanity";
 constexpr auto THEME_INDEX_FILE = "index.theme";
+constexpr auto THEME_CACHE_FILE = "icon-theme.cache";
 constexpr auto APPLICATIONS_TYPE = "Applications";
 constexpr auto SIZE_PROPERTY = "Size";
 constexpr auto MAXSIZE_PROPERTY = "MaxSize";
@@ -45,12 +48,58 @@ constexpr auto PIXMAPS_PATH = "/pixmaps/";
 constexpr auto ICON_TYPES = {".png", ".svg", ".xpm"};
 
 static const std::regex iconSizeDirname = std::regex("^(\\d+)x\\1$");
+
+/* Flags on the images in the icon-theme.cache file */
+constexpr guint16 CACHE_HAS_SUFFIX_XPM = 1 << 0;
+constexpr guint16 CACHE_HAS_SUFFIX_SVG = 1 << 1;
+constexpr guint16 CACHE_HAS_SUFFIX_PNG = 1 << 2;
+/* Offset used in the icon-theme.cache file for no entry */
+constexpr guint32 CACHE_NO_OFFSET = 0xFFFFFFFF;
 }  // anonymous namespace
 
 IconFinder::IconFinder(std::string basePath)
-    : _searchPaths(getSearchPaths(basePath))
-    , _basePath(basePath)
+    : _basePath(basePath)
 {
+    auto searchPaths = getSearchPaths(basePath);
+    _searchPaths.assign(searchPaths.begin(), searchPaths.end());
+
+    buildIndex();
+
+    for (const auto& path : _searchPaths)
+    {
+        auto file = g_file_new_for_path(path.path.c_str());
+        GError* error = nullptr;
+        auto monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, nullptr, &error);
+        g_object_unref(file);
+
+        if (error != nullptr)
+        {
+            g_debug("Unable to monitor icon directory '%s': %s", path.path.c_str(), error->message);
+            g_error_free(error);
+        }
+        else
+        {
+            g_signal_connect(monitor, "changed", G_CALLBACK(directoryChanged), this);
+        }
+
+        /* Keep the same order as the search paths even if it is null */
+        _monitors.push_back(monitor);
+    }
+}
+
+IconFinder::~IconFinder()
+{
+    for (auto monitor : _monitors)
+    {
+        if (monitor == nullptr)
+        {
+            continue;
+        }
+
+        g_signal_handlers_disconnect_by_data(monitor, this);
+        g_file_monitor_cancel(monitor);
+        g_object_unref(monitor);
+    }
 }
 
 /** Finds an icon in the search paths that we have for this path */
@@ -61,8 +110,20 @@ Application::Info::IconPath IconFinder::find(const std::string& iconName)
         return Application::Info::IconPath::from_raw(iconName);
     }
 
-    /* Look in each directory slowly decreasing the size until we find
-       an icon */
+    if (iconName.find('/') == std::string::npos)
+    {
+        std::lock_guard<std::mutex> lock(_indexLock);
+        auto& index = hasImageExtension(iconName.c_str()) ? _filenameIndex : _nameIndex;
+        auto found = index.find(iconName);
+        if (found != index.end())
+        {
+            return Application::Info::IconPath::from_raw(found->second);
+        }
+        return Application::Info::IconPath::from_raw(std::string{});
+    }
+
+    /* Names with a subdirectory aren't in the index, so look in each
+       directory slowly decreasing the size until we find an icon */
     auto size = 0;
     std::string iconPath;
     for (const auto& path : _searchPaths)
@@ -81,6 +142,402 @@ Application::Info::IconPath IconFinder::find(const std::string& iconName)
     return Application::Info::IconPath::from_raw(iconPath);
 }
 
+/** Builds the index of all the icons in the search paths. The theme cache
+    is used for the theme directories that have one, everything else gets
+    its directory listed. */
+void IconFinder::buildIndex()
+{
+    std::map<std::string, std::map<std::string, std::set<std::string>>> themeCaches;
+    for (const auto& themeDir : {HICOLOR_THEME_DIR, HUMANITY_THEME_DIR})
+    {
+        auto cthemePath = g_build_filename(_basePath.c_str(), themeDir, nullptr);
+        std::string themePath(cthemePath);
+        g_free(cthemePath);
+
+        std::map<std::string, std::set<std::string>> dirImages;
+        if (imagesFromThemeCache(themePath, dirImages))
+        {
+            themeCaches[themePath + "/"] = dirImages;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_indexLock);
+
+    _dirImages.clear();
+    for (const auto& path : _searchPaths)
+    {
+        bool cached = false;
+        for (const auto& cache : themeCaches)
+        {
+            if (g_str_has_prefix(path.path.c_str(), cache.first.c_str()))
+            {
+                /* Directories without any icons aren't in the cache */
+                auto found = cache.second.find(path.path.substr(cache.first.size()));
+                _dirImages.push_back(found != cache.second.end() ? found->second : std::set<std::string>{});
+                cached = true;
+                break;
+            }
+        }
+
+        if (!cached)
+        {
+            _dirImages.push_back(imagesInDirectory(path.path));
+        }
+    }
+
+    _filenameIndex.clear();
+    _nameIndex.clear();
+    for (size_t i = 0; i < _dirImages.size(); i++)
+    {
+        if (_searchPaths[i].size <= 0)
+        {
+            continue;
+        }
+
+        for (const auto& image : _dirImages[i])
+        {
+            if (_filenameIndex.find(image) == _filenameIndex.end())
+            {
+                auto fullpath = g_build_filename(_searchPaths[i].path.c_str(), image.c_str(), nullptr);
+                _filenameIndex[image] = fullpath;
+                g_free(fullpath);
+            }
+
+            /* All of the extensions are the same length */
+            auto name = image.substr(0, image.size() - 4);
+            if (_nameIndex.find(name) != _nameIndex.end())
+            {
+                continue;
+            }
+
+            for (const auto& extension : ICON_TYPES)
+            {
+                if (_dirImages[i].find(name + extension) != _dirImages[i].end())
+                {
+                    auto fullpath =
+                        g_build_filename(_searchPaths[i].path.c_str(), (name + extension).c_str(), nullptr);
+                    _nameIndex[name] = fullpath;
+                    g_free(fullpath);
+                    break;
+                }
+            }
+        }
+    }
+
+    g_debug("Icon index for '%s' has %d icons in %d directories", _basePath.c_str(), int(_nameIndex.size()),
+            int(_searchPaths.size()));
+}
+
+/** Updates the index for an image file name, and the icon name that it
+    provides, by finding the best directory that has them. Expects the
+    index lock to be held.
+
+    \param filename Image file name with its extension
+*/
+void IconFinder::indexImage(const std::string& filename)
+{
+    /* All of the extensions are the same length */
+    auto name = filename.substr(0, filename.size() - 4);
+
+    _filenameIndex.erase(filename);
+    _nameIndex.erase(name);
+
+    bool foundFile = false;
+    bool foundName = false;
+    for (size_t i = 0; i < _dirImages.size() && !(foundFile && foundName); i++)
+    {
+        const auto& images = _dirImages[i];
+        if (_searchPaths[i].size <= 0)
+        {
+            continue;
+        }
+
+        if (!foundFile && images.find(filename) != images.end())
+        {
+            auto fullpath = g_build_filename(_searchPaths[i].path.c_str(), filename.c_str(), nullptr);
+            _filenameIndex[filename] = fullpath;
+            g_free(fullpath);
+            foundFile = true;
+        }
+
+        for (const auto& extension : ICON_TYPES)
+        {
+            if (foundName)
+            {
+                break;
+            }
+
+            if (images.find(name + extension) != images.end())
+            {
+                auto fullpath = g_build_filename(_searchPaths[i].path.c_str(), (name + extension).c_str(), nullptr);
+                _nameIndex[name] = fullpath;
+                g_free(fullpath);
+                foundName = true;
+            }
+        }
+    }
+}
+
+/** Gets the image files in a directory */
+std::set<std::string> IconFinder::imagesInDirectory(const std::string& path)
+{
+    std::set<std::string> images;
+    auto dir = g_dir_open(path.c_str(), 0, nullptr);
+    if (dir == nullptr)
+    {
+        return images;
+    }
+
+    const gchar* filename = nullptr;
+    while ((filename = g_dir_read_name(dir)) != nullptr)
+    {
+        if (hasImageExtension(filename))
+        {
+            images.insert(filename);
+        }
+    }
+
+    g_dir_close(dir);
+    return images;
+}
+
+/** Reads the images in each directory of a theme out of the icon-theme.cache
+    file that gtk-update-icon-cache builds. The format is described in the
+    GTK+ sources (gtk/gtkiconcache.c), all the values are big endian. Returns
+    false if there is no cache, if it is older than the theme directory or
+    if it isn't a format that we understand.
+
+    \param themePath Path to the theme directory
+    \param dirImages Image files by the directory relative to the theme
+*/
+bool IconFinder::imagesFromThemeCache(const std::string& themePath,
+                                      std::map<std::string, std::set<std::string>>& dirImages)
+{
+    auto cachePath = themePath + "/" + THEME_CACHE_FILE;
+    struct stat cachestat;
+    struct stat themestat;
+    if (stat(cachePath.c_str(), &cachestat) != 0 || stat(themePath.c_str(), &themestat) != 0)
+    {
+        return false;
+    }
+
+    if (cachestat.st_mtime < themestat.st_mtime)
+    {
+        g_debug("Icon theme cache '%s' is out of date", cachePath.c_str());
+        return false;
+    }
+
+    GError* error = nullptr;
+    auto mapped = g_mapped_file_new(cachePath.c_str(), FALSE, &error);
+    if (error != nullptr)
+    {
+        g_debug("Unable to map icon theme cache '%s': %s", cachePath.c_str(), error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    auto data = reinterpret_cast<const guint8*>(g_mapped_file_get_contents(mapped));
+    auto length = g_mapped_file_get_length(mapped);
+
+    auto read16 = [data, length](gsize offset, guint16& value) {
+        if (offset + 2 > length)
+        {
+            return false;
+        }
+        value = (guint16(data[offset]) << 8) | guint16(data[offset + 1]);
+        return true;
+    };
+    auto read32 = [data, length](gsize offset, guint32& value) {
+        if (offset + 4 > length)
+        {
+            return false;
+        }
+        value = (guint32(data[offset]) << 24) | (guint32(data[offset + 1]) << 16) |
+                (guint32(data[offset + 2]) << 8) | guint32(data[offset + 3]);
+        return true;
+    };
+    auto readString = [data, length](gsize offset, std::string& value) {
+        if (offset >= length || memchr(data + offset, '\0', length - offset) == nullptr)
+        {
+            return false;
+        }
+        value = reinterpret_cast<const char*>(data + offset);
+        return true;
+    };
+
+    auto parse = [&]() {
+        guint16 major = 0;
+        guint32 hashOffset = 0;
+        guint32 dirListOffset = 0;
+        if (!read16(0, major) || major != 1 || !read32(4, hashOffset) || !read32(8, dirListOffset))
+        {
+            return false;
+        }
+
+        guint32 dirCount = 0;
+        if (!read32(dirListOffset, dirCount) || gsize(dirListOffset) + 4 + gsize(dirCount) * 4 > length)
+        {
+            return false;
+        }
+
+        std::vector<std::string> dirs(dirCount);
+        for (guint32 i = 0; i < dirCount; i++)
+        {
+            guint32 nameOffset = 0;
+            if (!read32(dirListOffset + 4 + i * 4, nameOffset) || !readString(nameOffset, dirs[i]))
+            {
+                return false;
+            }
+        }
+
+        guint32 bucketCount = 0;
+        if (!read32(hashOffset, bucketCount) || gsize(hashOffset) + 4 + gsize(bucketCount) * 4 > length)
+        {
+            return false;
+        }
+
+        /* Each icon is at least 12 bytes, so a chain longer than that is corrupt */
+        gsize maxIcons = length / 12;
+        gsize icons = 0;
+
+        for (guint32 bucket = 0; bucket < bucketCount; bucket++)
+        {
+            guint32 iconOffset = CACHE_NO_OFFSET;
+            if (!read32(hashOffset + 4 + bucket * 4, iconOffset))
+            {
+                return false;
+            }
+
+            while (iconOffset != CACHE_NO_OFFSET)
+            {
+                guint32 chainOffset = 0;
+                guint32 nameOffset = 0;
+                guint32 imageListOffset = 0;
+                guint32 imageCount = 0;
+                std::string name;
+
+                if (++icons > maxIcons || !read32(iconOffset, chainOffset) || !read32(iconOffset + 4, nameOffset) ||
+                    !read32(iconOffset + 8, imageListOffset) || !readString(nameOffset, name) ||
+                    !read32(imageListOffset, imageCount) ||
+                    gsize(imageListOffset) + 4 + gsize(imageCount) * 8 > length)
+                {
+                    return false;
+                }
+
+                for (guint32 image = 0; image < imageCount; image++)
+                {
+                    guint16 dirIndex = 0;
+                    guint16 flags = 0;
+                    if (!read16(imageListOffset + 4 + image * 8, dirIndex) ||
+                        !read16(imageListOffset + 6 + image * 8, flags) || dirIndex >= dirCount)
+                    {
+                        return false;
+                    }
+
+                    auto& images = dirImages[dirs[dirIndex]];
+                    if (flags & CACHE_HAS_SUFFIX_PNG)
+                    {
+                        images.insert(name + ".png");
+                    }
+                    if (flags & CACHE_HAS_SUFFIX_SVG)
+                    {
+                        images.insert(name + ".svg");
+                    }
+                    if (flags & CACHE_HAS_SUFFIX_XPM)
+                    {
+                        images.insert(name + ".xpm");
+                    }
+                }
+
+                iconOffset = chainOffset;
+            }
+        }
+
+        return true;
+    };
+
+    auto valid = parse();
+    g_mapped_file_unref(mapped);
+
+    if (!valid)
+    {
+        g_warning("Icon theme cache '%s' is corrupt", cachePath.c_str());
+        dirImages.clear();
+    }
+
+    return valid;
+}
+
+/** Updates the index when a file in one of the search paths is added
+    or removed. Only the entries for that file are looked up again. */
+void IconFinder::directoryChanged(GFileMonitor* monitor,
+                                  GFile* file,
+                                  GFile* otherfile,
+                                  GFileMonitorEvent event,
+                                  gpointer user_data)
+{
+    auto finder = static_cast<IconFinder*>(user_data);
+
+    std::list<std::pair<GFile*, bool>> changes;
+    switch (event)
+    {
+        case G_FILE_MONITOR_EVENT_CREATED:
+            changes.emplace_back(file, true);
+            break;
+        case G_FILE_MONITOR_EVENT_DELETED:
+            changes.emplace_back(file, false);
+            break;
+        case G_FILE_MONITOR_EVENT_MOVED:
+            changes.emplace_back(file, false);
+            if (otherfile != nullptr)
+            {
+                changes.emplace_back(otherfile, true);
+            }
+            break;
+        default:
+            return;
+    }
+
+    std::lock_guard<std::mutex> lock(finder->_indexLock);
+
+    for (const auto& change : changes)
+    {
+        auto cdir = g_file_get_path(change.first);
+        auto cfilename = g_path_get_basename(cdir);
+        auto cdirname = g_path_get_dirname(cdir);
+        std::string filename(cfilename);
+        std::string dirname(cdirname);
+        g_free(cdirname);
+        g_free(cfilename);
+        g_free(cdir);
+
+        if (!hasImageExtension(filename.c_str()))
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < finder->_monitors.size() && i < finder->_dirImages.size(); i++)
+        {
+            if (finder->_monitors[i] != monitor && finder->_searchPaths[i].path != dirname)
+            {
+                continue;
+            }
+
+            if (change.second)
+            {
+                finder->_dirImages[i].insert(filename);
+            }
+            else
+            {
+                finder->_dirImages[i].erase(filename);
+            }
+        }
+
+        g_debug("Icon '%s' %s in '%s'", filename.c_str(), change.second ? "added" : "removed", dirname.c_str());
+        finder->indexImage(filename);
+    }
+}
+
 /** Check to see if this is an icon name or an icon filename */
 bool IconFinder::hasImageExtension(const char* filename)
 {
@@ -20,10 +20,14 @@
 #pragma once
 
 #include "application-info-desktop.h"
-#include <glib.h>
+#include <gio/gio.h>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 namespace ubuntu
 {
@@ -36,6 +40,12 @@ namespace app_launch
         https://standards.freedesktop.org/icon-theme-spec/icon-theme-spec-latest.html
     It parses the theme file for the hicolor theme and identifies all possible directories
     in the global scope and the local scope.
+
+    The contents of those directories are read once, from the theme's icon-theme.cache
+    when it is up to date or by listing the directories otherwise, to build an index of
+    the best path for each icon name. File monitors on the directories keep the index
+    up to date, they are dispatched on the thread default main context of the thread
+    that creates the IconFinder.
 */
 class IconFinder
 {
@@ -45,7 +55,7 @@ public:
         \param basePath the root directory to begin searching for themes
     */
     explicit IconFinder(std::string basePath);
-    virtual ~IconFinder() = default;
+    virtual ~IconFinder();
 
     /** Find the optimal icon for the given icon name.
 
@@ -62,10 +72,37 @@ private:
     };
 
     /** \private */
-    std::list<ThemeSubdirectory> _searchPaths;
+    std::vector<ThemeSubdirectory> _searchPaths;
     /** \private */
     std::string _basePath;
 
+    /** \private Protects the index, which the file monitors update */
+    std::mutex _indexLock;
+    /** \private The image files in each of the search paths, in the same order */
+    std::vector<std::set<std::string>> _dirImages;
+    /** \private Best path for each image file name */
+    std::unordered_map<std::string, std::string> _filenameIndex;
+    /** \private Best path for each icon name without an extension */
+    std::unordered_map<std::string, std::string> _nameIndex;
+    /** \private Monitors for each of the search paths, in the same order */
+    std::vector<GFileMonitor*> _monitors;
+
+    /** \private */
+    void buildIndex();
+    /** \private */
+    void indexImage(const std::string& filename);
+    /** \private */
+    static std::set<std::string> imagesInDirectory(const std::string& path);
+    /** \private */
+    static bool imagesFromThemeCache(const std::string& themePath,
+                                     std::map<std::string, std::set<std::string>>& dirImages);
+    /** \private */
+    static void directoryChanged(GFileMonitor* monitor,
+                                 GFile* file,
+                                 GFile* otherfile,
+                                 GFileMonitorEvent event,
+                                 gpointer user_data);
+
     /** \private */
     static bool hasImageExtension(const char* filename);
     /** \private */
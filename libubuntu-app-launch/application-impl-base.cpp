@@ -20,8 +20,11 @@
 #include <algorithm>
 #include <cerrno>
 #include <cstring>
+#include <future>
 #include <map>
 #include <numeric>
+#include <thread>
+#include <unistd.h>
 
 #include <upstart.h>
 
@@ -51,6 +54,76 @@ bool Base::hasInstances()
     return !instances().empty();
 }
 
+void Base::prepareLaunch()
+{
+}
+
+/** Resolves the environment for launching ahead of time so that it
+    doesn't need to be done when the launch happens. Also makes sure
+    that we know the Upstart job path so the launch doesn't need to
+    ask for it.
+
+    \param job Upstart job this application is launched with
+    \param desktopPath Desktop file the environment is built from
+    \param resolve Function to build the environment
+*/
+void Base::prepareEnv(const std::string& job,
+                      const std::string& desktopPath,
+                      std::function<std::list<std::pair<std::string, std::string>>()> resolve)
+{
+    _registry->impl->upstartJobPath(job);
+
+    /* Stamp first so that a change while resolving makes it stale */
+    auto stamp = ApplicationIndex::fileStamp(desktopPath);
+    auto env = std::make_shared<std::list<std::pair<std::string, std::string>>>(resolve());
+
+    std::lock_guard<std::mutex> lock(preparedLock_);
+    preparedEnv_ = env;
+    preparedPath_ = desktopPath;
+    preparedStamp_ = stamp;
+}
+
+/** Gets the environment for launching, using the one from
+    prepareLaunch() if there is one and otherwise resolving it
+    now. If the desktop file has changed since it was prepared
+    the desktop file is read again and the environment resolved
+    from that.
+
+    \param resolve Function to build the environment
+*/
+std::list<std::pair<std::string, std::string>> Base::preparedEnv(
+    std::function<std::list<std::pair<std::string, std::string>>()> resolve)
+{
+    bool stale = false;
+    {
+        std::lock_guard<std::mutex> lock(preparedLock_);
+        if (preparedEnv_)
+        {
+            if (ApplicationIndex::fileStamp(preparedPath_) == preparedStamp_)
+            {
+                return *preparedEnv_;
+            }
+
+            g_debug("Desktop file '%s' changed since the launch was prepared", preparedPath_.c_str());
+            preparedEnv_.reset();
+            stale = true;
+        }
+    }
+
+    if (stale)
+    {
+        reloadDesktop();
+    }
+
+    return resolve();
+}
+
+/** Backends that keep their desktop file loaded read it again here,
+    the default has nothing to reload */
+void Base::reloadDesktop()
+{
+}
+
 /** Function to create all the standard environment variables that we're
     building for everyone. Mostly stuff involving paths.
 
@@ -103,109 +176,34 @@ bool UpstartInstance::isRunning()
     return primaryPid() != 0;
 }
 
-/** Uses Upstart to get the primary PID of the instance using Upstart's
-    DBus interface */
+/** Gets the primary PID of the instance from the registry, which tracks
+    the instances using Upstart's DBus interface */
 pid_t UpstartInstance::primaryPid()
 {
-    auto jobpath = registry_->impl->upstartJobPath(job_);
-    if (jobpath.empty())
-    {
-        g_debug("Unable to get a valid job path");
-        return 0;
-    }
-
-    return registry_->impl->thread.executeOnThread<pid_t>([this, &jobpath]() -> pid_t {
-        GError* error = nullptr;
-
-        std::string instancename = std::string(appId_);
-        if (job_ != "application-click")
-        {
-            instancename += "-" + instance_;
-        }
-
-        g_debug("Getting instance by name: %s", instance_.c_str());
-        GVariant* vinstance_path =
-            g_dbus_connection_call_sync(registry_->impl->_dbus.get(),                   /* connection */
-                                        DBUS_SERVICE_UPSTART,                           /* service */
-                                        jobpath.c_str(),                                /* object path */
-                                        DBUS_INTERFACE_UPSTART_JOB,                     /* iface */
-                                        "GetInstanceByName",                            /* method */
-                                        g_variant_new("(s)", instancename.c_str()),     /* params */
-                                        G_VARIANT_TYPE("(o)"),                          /* return type */
-                                        G_DBUS_CALL_FLAGS_NONE,                         /* flags */
-                                        -1,                                             /* timeout: default */
-                                        registry_->impl->thread.getCancellable().get(), /* cancellable */
-                                        &error);
-
-        if (error != nullptr)
-        {
-            g_warning("Unable to get instance '%s' of job '%s': %s", instance_.c_str(), job_.c_str(), error->message);
-            g_error_free(error);
-            return 0;
-        }
-
-        /* Jump rope to make this into a C++ type */
-        std::string instance_path;
-        gchar* cinstance_path = nullptr;
-        g_variant_get(vinstance_path, "(o)", &cinstance_path);
-        g_variant_unref(vinstance_path);
-        if (cinstance_path != nullptr)
-        {
-            instance_path = cinstance_path;
-            g_free(cinstance_path);
-        }
-
-        if (instance_path.empty())
-        {
-            g_debug("No instance object for instance name: %s", instance_.c_str());
-            return 0;
-        }
-
-        GVariant* props_tuple =
-            g_dbus_connection_call_sync(registry_->impl->_dbus.get(),                          /* connection */
-                                        DBUS_SERVICE_UPSTART,                                  /* service */
-                                        instance_path.c_str(),                                 /* object path */
-                                        "org.freedesktop.DBus.Properties",                     /* interface */
-                                        "GetAll",                                              /* method */
-                                        g_variant_new("(s)", DBUS_INTERFACE_UPSTART_INSTANCE), /* params */
-                                        G_VARIANT_TYPE("(a{sv})"),                             /* return type */
-                                        G_DBUS_CALL_FLAGS_NONE,                                /* flags */
-                                        -1,                                                    /* timeout: default */
-                                        registry_->impl->thread.getCancellable().get(),        /* cancellable */
-                                        &error);
-
-        if (error != nullptr)
-        {
-            g_warning("Unable to name of properties '%s': %s", instance_path.c_str(), error->message);
-            g_error_free(error);
-            error = nullptr;
-            return 0;
-        }
-
-        GVariant* props_dict = g_variant_get_child_value(props_tuple, 0);
-
-        pid_t retval = 0;
-        GVariant* processes = g_variant_lookup_value(props_dict, "processes", G_VARIANT_TYPE("a(si)"));
-        if (processes != nullptr && g_variant_n_children(processes) > 0)
-        {
-
-            GVariant* first_entry = g_variant_get_child_value(processes, 0);
-            GVariant* pidv = g_variant_get_child_value(first_entry, 1);
+    return primaryPidAsync().get();
+}
 
-            retval = g_variant_get_int32(pidv);
+std::future<pid_t> UpstartInstance::primaryPidAsync()
+{
+    auto registry = registry_;
+    auto job = job_;
+    auto instancename = upstartInstanceName();
 
-            g_variant_unref(pidv);
-            g_variant_unref(first_entry);
-        }
-        else
-        {
-            g_debug("Unable to get 'processes' from properties of instance at path: %s", instance_path.c_str());
-        }
+    return registry->impl->thread.executeOnThreadAsync<pid_t>(
+        [registry, job, instancename]() { return registry->impl->upstartInstancePrimaryPid(job, instancename); });
+}
 
-        g_variant_unref(props_dict);
+/** The name of the instance as Upstart knows it, which is the
+    value of the instance stanza in the job. */
+std::string UpstartInstance::upstartInstanceName()
+{
+    std::string instancename = std::string(appId_);
+    if (job_ != "application-click")
+    {
+        instancename += "-" + instance_;
+    }
 
-        return retval;
-    });
+    return instancename;
 }
 
 /** Generate the full name of the Upstart job for the job, the
@@ -229,13 +227,22 @@ std::string UpstartInstance::upstartJobPath()
     return path;
 }
 
-/** Looks at the PIDs in the instance cgroup and checks to see if @pid
-    is in the set.
+/** Looks at the cgroup that @pid is in to see if it is our job, or
+    if that doesn't say, at the PIDs in the instance cgroup to see if
+    @pid is in the set.
 
     @param pid PID to look for
 */
 bool UpstartInstance::hasPid(pid_t pid)
 {
+    /* If we can see the job of the process in its cgroup that answers
+       it without getting all of our PIDs */
+    auto job = registry_->impl->getPidJobCache()->get(pid);
+    if (!job.empty())
+    {
+        return job == upstartJobPath();
+    }
+
     for (auto testpid : registry_->impl->pidsFromCgroup(upstartJobPath()))
         if (pid == testpid)
             return true;
@@ -257,7 +264,17 @@ std::string UpstartInstance::logPath()
 /** Returns all the PIDs that are in the cgroup for this application */
 std::vector<pid_t> UpstartInstance::pids()
 {
-    return pids(registry_, appId_, upstartJobPath());
+    return pidsAsync().get();
+}
+
+std::future<std::vector<pid_t>> UpstartInstance::pidsAsync()
+{
+    auto registry = registry_;
+    auto appid = appId_;
+    auto jobpath = upstartJobPath();
+
+    return registry->impl->thread.executeOnThreadAsync<std::vector<pid_t>>(
+        [registry, appid, jobpath]() { return pids(registry, appid, jobpath); });
 }
 
 std::vector<pid_t> UpstartInstance::pids(const std::shared_ptr<Registry>& reg,
@@ -269,9 +286,15 @@ std::vector<pid_t> UpstartInstance::pids(const std::shared_ptr<Registry>& reg,
     return pids;
 }
 
-/** Pauses this application by sending SIGSTOP to all the PIDs in the
-    cgroup and tells Zeitgeist that we've left the application. */
+/** Pauses this application by freezing its cgroup, or sending SIGSTOP
+    to all the PIDs in it, and tells Zeitgeist that we've left the application. */
 void UpstartInstance::pause()
+{
+    /* Callers that need to know when it is done use pauseAsync() */
+    pauseAsync();
+}
+
+std::future<void> UpstartInstance::pauseAsync()
 {
     g_debug("Pausing application: %s", std::string(appId_).c_str());
 
@@ -279,23 +302,27 @@ void UpstartInstance::pause()
     auto appid = appId_;
     auto jobpath = upstartJobPath();
 
-    registry->impl->thread.executeOnThread([registry, appid, jobpath] {
-        auto pids = forAllPids(registry, appid, jobpath, [](pid_t pid) {
-            auto oomval = oom::paused();
-            g_debug("Pausing PID: %d (%d)", pid, int(oomval));
-            signalToPid(pid, SIGSTOP);
-            oomValueToPid(pid, oomval);
-        });
+    auto retval = registry->impl->thread.executeOnThreadAsync([registry, appid, jobpath] {
+        auto pids = stopContPids(registry, appid, jobpath, SIGSTOP);
+        g_debug("Paused %d PIDs of '%s'", int(pids.size()), std::string(appid).c_str());
+        oomValueToPids(registry, pids, oom::paused());
 
         pidListToDbus(registry, appid, pids, "ApplicationPaused");
     });
 
     registry_->impl->zgSendEvent(appId_, ZEITGEIST_ZG_LEAVE_EVENT);
+
+    return retval;
 }
 
-/** Resumes this application by sending SIGCONT to all the PIDs in the
-    cgroup and tells Zeitgeist that we're accessing the application. */
+/** Resumes this application by thawing its cgroup, or sending SIGCONT
+    to all the PIDs in it, and tells Zeitgeist that we're accessing the application. */
 void UpstartInstance::resume()
+{
+    resumeAsync();
+}
+
+std::future<void> UpstartInstance::resumeAsync()
 {
     g_debug("Resuming application: %s", std::string(appId_).c_str());
 
@@ -303,80 +330,89 @@ void UpstartInstance::resume()
     auto appid = appId_;
     auto jobpath = upstartJobPath();
 
-    registry->impl->thread.executeOnThread([registry, appid, jobpath] {
-        auto pids = forAllPids(registry, appid, jobpath, [](pid_t pid) {
-            auto oomval = oom::focused();
-            g_debug("Resuming PID: %d (%d)", pid, int(oomval));
-            signalToPid(pid, SIGCONT);
-            oomValueToPid(pid, oomval);
-        });
+    auto retval = registry->impl->thread.executeOnThreadAsync([registry, appid, jobpath] {
+        auto pids = stopContPids(registry, appid, jobpath, SIGCONT);
+        g_debug("Resumed %d PIDs of '%s'", int(pids.size()), std::string(appid).c_str());
+        oomValueToPids(registry, pids, oom::focused());
 
         pidListToDbus(registry, appid, pids, "ApplicationResumed");
     });
 
     registry_->impl->zgSendEvent(appId_, ZEITGEIST_ZG_ACCESS_EVENT);
+
+    return retval;
 }
 
 /** Stops this instance by asking Upstart to stop it. Upstart will then
     send a SIGTERM and five seconds later start killing things. */
 void UpstartInstance::stop()
 {
-    if (!registry_->impl->thread.executeOnThread<bool>([this]() {
+    try
+    {
+        stopAsync().get();
+    }
+    catch (std::runtime_error& e)
+    {
+        g_warning("Unable to stop Upstart instance: %s", e.what());
+    }
+}
 
-            g_debug("Stopping job %s app_id %s instance_id %s", job_.c_str(), std::string(appId_).c_str(),
-                    instance_.c_str());
+std::future<void> UpstartInstance::stopAsync()
+{
+    auto registry = registry_;
+    auto appid = appId_;
+    auto job = job_;
+    auto instance = instance_;
 
-            auto jobpath = registry_->impl->upstartJobPath(job_);
-            if (jobpath.empty())
-            {
-                throw new std::runtime_error("Unable to get job path for Upstart job '" + job_ + "'");
-            }
+    return registry->impl->thread.executeOnThreadAsync([registry, appid, job, instance]() {
+        g_debug("Stopping job %s app_id %s instance_id %s", job.c_str(), std::string(appid).c_str(),
+                instance.c_str());
 
-            GVariantBuilder builder;
-            g_variant_builder_init(&builder, G_VARIANT_TYPE_TUPLE);
-            g_variant_builder_open(&builder, G_VARIANT_TYPE_ARRAY);
+        auto jobpath = registry->impl->upstartJobPath(job);
+        if (jobpath.empty())
+        {
+            throw std::runtime_error("Unable to get job path for Upstart job '" + job + "'");
+        }
 
-            g_variant_builder_add_value(
-                &builder, g_variant_new_take_string(g_strdup_printf("APP_ID=%s", std::string(appId_).c_str())));
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_TUPLE);
+        g_variant_builder_open(&builder, G_VARIANT_TYPE_ARRAY);
 
-            if (!instance_.empty())
-            {
-                g_variant_builder_add_value(
-                    &builder, g_variant_new_take_string(g_strdup_printf("INSTANCE_ID=%s", instance_.c_str())));
-            }
+        g_variant_builder_add_value(
+            &builder, g_variant_new_take_string(g_strdup_printf("APP_ID=%s", std::string(appid).c_str())));
 
-            g_variant_builder_close(&builder);
-            g_variant_builder_add_value(&builder, g_variant_new_boolean(FALSE)); /* wait */
+        if (!instance.empty())
+        {
+            g_variant_builder_add_value(
+                &builder, g_variant_new_take_string(g_strdup_printf("INSTANCE_ID=%s", instance.c_str())));
+        }
 
-            GError* error = nullptr;
-            GVariant* stop_variant =
-                g_dbus_connection_call_sync(registry_->impl->_dbus.get(),                   /* Dbus */
-                                            DBUS_SERVICE_UPSTART,                           /* Upstart name */
-                                            jobpath.c_str(),                                /* path */
-                                            DBUS_INTERFACE_UPSTART_JOB,                     /* interface */
-                                            "Stop",                                         /* method */
-                                            g_variant_builder_end(&builder),                /* params */
-                                            nullptr,                                        /* return */
-                                            G_DBUS_CALL_FLAGS_NONE,                         /* flags */
-                                            -1,                                             /* timeout: default */
-                                            registry_->impl->thread.getCancellable().get(), /* cancellable */
-                                            &error);                                        /* error (hopefully not) */
-
-            g_clear_pointer(&stop_variant, g_variant_unref);
+        g_variant_builder_close(&builder);
+        g_variant_builder_add_value(&builder, g_variant_new_boolean(FALSE)); /* wait */
 
-            if (error != nullptr)
-            {
-                g_warning("Unable to stop job %s app_id %s instance_id %s: %s", job_.c_str(),
-                          std::string(appId_).c_str(), instance_.c_str(), error->message);
-                g_error_free(error);
-                return false;
-            }
+        GError* error = nullptr;
+        GVariant* stop_variant =
+            g_dbus_connection_call_sync(registry->impl->_dbus.get(),                   /* Dbus */
+                                        DBUS_SERVICE_UPSTART,                          /* Upstart name */
+                                        jobpath.c_str(),                               /* path */
+                                        DBUS_INTERFACE_UPSTART_JOB,                    /* interface */
+                                        "Stop",                                        /* method */
+                                        g_variant_builder_end(&builder),               /* params */
+                                        nullptr,                                       /* return */
+                                        G_DBUS_CALL_FLAGS_NONE,                        /* flags */
+                                        -1,                                            /* timeout: default */
+                                        registry->impl->thread.getCancellable().get(), /* cancellable */
+                                        &error);                                       /* error (hopefully not) */
+
+        g_clear_pointer(&stop_variant, g_variant_unref);
 
-            return true;
-        }))
-    {
-        g_warning("Unable to stop Upstart instance");
-    }
+        if (error != nullptr)
+        {
+            g_warning("Unable to stop job %s app_id %s instance_id %s: %s", job.c_str(), std::string(appid).c_str(),
+                      instance.c_str(), error->message);
+            g_error_free(error);
+        }
+    });
 }
 
 /** Sets the OOM adjustment by getting the list of PIDs and writing
@@ -386,7 +422,19 @@ void UpstartInstance::stop()
 */
 void UpstartInstance::setOomAdjustment(const oom::Score score)
 {
-    forAllPids(registry_, appId_, upstartJobPath(), [score](pid_t pid) { oomValueToPid(pid, score); });
+    setOomAdjustmentAsync(score).get();
+}
+
+std::future<void> UpstartInstance::setOomAdjustmentAsync(const oom::Score score)
+{
+    auto registry = registry_;
+    auto appid = appId_;
+    auto jobpath = upstartJobPath();
+
+    return registry->impl->thread.executeOnThreadAsync([registry, appid, jobpath, score]() {
+        auto pids = forAllPids(registry, appid, jobpath, [](pid_t) {});
+        oomValueToPids(registry, pids, score);
+    });
 }
 
 /** Figures out the path to the primary PID of the application and
@@ -450,6 +498,44 @@ std::vector<pid_t> UpstartInstance::forAllPids(const std::shared_ptr<Registry>&
     return std::vector<pid_t>(seenPids.begin(), seenPids.end());
 }
 
+/** Stops or continues all the processes in a job. When we can use the
+    freezer cgroup that is a single write that catches processes as they
+    fork, so the PIDs only need to be listed once for the OOM values and
+    the DBus signal. Otherwise each process is sent the signal, going
+    over the list again until no new PIDs show up.
+
+    \param signal SIGSTOP or SIGCONT, or zero to only get the PIDs
+*/
+std::vector<pid_t> UpstartInstance::stopContPids(const std::shared_ptr<Registry>& reg,
+                                                 const AppID& appid,
+                                                 const std::string& jobpath,
+                                                 int signal)
+{
+    if ((signal == SIGSTOP || signal == SIGCONT) && reg->impl->freezeCgroup(jobpath, signal == SIGSTOP))
+    {
+        g_debug("%s cgroup for AppID '%s'", signal == SIGSTOP ? "Froze" : "Thawed", std::string(appid).c_str());
+        auto thawed = pids(reg, appid, jobpath);
+
+        /* If freezing timed out they were stopped with signals instead */
+        if (signal == SIGCONT)
+        {
+            for (auto pid : thawed)
+            {
+                signalToPid(pid, SIGCONT);
+            }
+        }
+
+        return thawed;
+    }
+
+    return forAllPids(reg, appid, jobpath, [signal](pid_t pid) {
+        if (signal != 0)
+        {
+            signalToPid(pid, signal);
+        }
+    });
+}
+
 /** Sends a signal to a PID with a warning if we can't send it.
     We could throw an exception, but we can't handle it usefully anyway
 
@@ -490,104 +576,126 @@ std::string UpstartInstance::pidToOomPath(pid_t pid)
     return path;
 }
 
-/** Writes an OOM value to proc, assuming we have a string
-    in the outer loop
+/** Writes an OOM value to a set of PIDs through the registry's
+    cache of open files, skipping any that already have the value.
+    Any that we can't write ourselves are all sent to the helper
+    together.
 
-    \param pid PID to change the OOM value of
+    \param reg Registry to get the cache from
+    \param pids PIDs to change the OOM value of
     \param oomvalue OOM value to set
 */
-void UpstartInstance::oomValueToPid(pid_t pid, const oom::Score oomvalue)
+void UpstartInstance::oomValueToPids(const std::shared_ptr<Registry>& reg,
+                                     const std::vector<pid_t>& pids,
+                                     const oom::Score oomvalue)
 {
-    auto oomstr = std::to_string(static_cast<std::int32_t>(oomvalue));
-    auto path = pidToOomPath(pid);
-    FILE* adj = fopen(path.c_str(), "w");
-    int openerr = errno;
+    auto cache = reg->impl->getOomFdCache();
+    std::vector<pid_t> helperPids;
+    int written = 0;
 
-    if (adj == nullptr)
+    for (auto pid : pids)
     {
-        switch (openerr)
+        switch (cache->set(pid, static_cast<std::int32_t>(oomvalue)))
         {
-            case ENOENT:
-                /* ENOENT happens a fair amount because of races, so it's not
-                   worth printing a warning about */
-                return;
-            case EACCES:
-            {
+            case OomFdCache::Result::WRITTEN:
+                written++;
+                break;
+            case OomFdCache::Result::NO_ACCESS:
                 /* We can get this error when trying to set the OOM value on
                    Oxide renderers because they're started by the sandbox and
                    don't have their adjustment value available for us to write.
                    We have a helper to deal with this, but it's kinda expensive
                    so we only use it when we have to. */
-                oomValueToPidHelper(pid, oomvalue);
-                return;
-            }
-            default:
-                g_warning("Unable to set OOM value for '%d' to '%s': %s", int(pid), oomstr.c_str(),
-                          std::strerror(openerr));
-                return;
+                helperPids.push_back(pid);
+                break;
+            case OomFdCache::Result::UNCHANGED:
+            case OomFdCache::Result::GONE:
+            case OomFdCache::Result::FAILED:
+                break;
         }
     }
 
-    size_t writesize = fwrite(oomstr.c_str(), 1, oomstr.size(), adj);
-    int writeerr = errno;
-    fclose(adj);
-
-    if (writesize == oomstr.size())
-        return;
+    g_debug("Set OOM value %d on %d of %d PIDs", int(oomvalue), written, int(pids.size()));
 
-    if (writeerr != 0)
-        g_warning("Unable to set OOM value for '%d' to '%s': %s", int(pid), oomstr.c_str(), strerror(writeerr));
-    else
-        /* No error, but yet, wrong size. Not sure, what could cause this. */
-        g_debug("Unable to set OOM value for '%d' to '%s': Wrote %d bytes", int(pid), oomstr.c_str(), int(writesize));
+    oomValueToPidHelper(helperPids, oomvalue);
 }
 
 /** Use a setuid root helper for setting the oom value of
-    Chromium instances
+    Chromium instances. All the PIDs are passed to a single
+    instance of the helper as "pid value" lines on its stdin
+    so that we don't spawn a process per PID. The test suite can
+    replace the helper with UBUNTU_APP_LAUNCH_OOM_HELPER.
 
-    \param pid PID to change the OOM value of
+    \param pids PIDs to change the OOM value of
     \param oomvalue OOM value to set
 */
-void UpstartInstance::oomValueToPidHelper(pid_t pid, const oom::Score oomvalue)
+void UpstartInstance::oomValueToPidHelper(const std::vector<pid_t>& pids, const oom::Score oomvalue)
 {
+    if (pids.empty())
+    {
+        return;
+    }
+
     GError* error = nullptr;
     std::string oomstr = std::to_string(static_cast<std::int32_t>(oomvalue));
-    std::string pidstr = std::to_string(pid);
-    std::array<const char*, 4> args = {OOM_HELPER, pidstr.c_str(), oomstr.c_str(), nullptr};
-
-    g_debug("Excuting OOM Helper (pid: %d, score: %d): %s", int(pid), int(oomvalue),
-            std::accumulate(args.begin(), args.end(), std::string{},
-                            [](const std::string& instr, const char* output) -> std::string {
-                                if (instr.empty())
-                                {
-                                    return output;
-                                }
-                                else if (output != nullptr)
-                                {
-                                    return instr + " " + std::string(output);
-                                }
-                                else
-                                {
-                                    return instr;
-                                }
-                            })
-                .c_str());
-
-    g_spawn_async(nullptr,               /* working dir */
-                  (char**)(args.data()), /* args */
-                  nullptr,               /* env */
-                  G_SPAWN_DEFAULT,       /* flags */
-                  nullptr,               /* child setup */
-                  nullptr,               /* child setup userdata*/
-                  nullptr,               /* pid */
-                  &error);               /* error */
+    const gchar* helper = g_getenv("UBUNTU_APP_LAUNCH_OOM_HELPER");
+    if (G_LIKELY(helper == nullptr))
+    {
+        helper = OOM_HELPER;
+    }
+    std::array<const char*, 2> args = {helper, nullptr};
+    gint stdinfd = -1;
+
+    std::string input;
+    for (auto pid : pids)
+    {
+        input += std::to_string(pid) + " " + oomstr + "\n";
+    }
+
+    g_debug("Excuting OOM Helper (pids: %d, score: %d): %s", int(pids.size()), int(oomvalue), helper);
+
+    g_spawn_async_with_pipes(nullptr,               /* working dir */
+                             (char**)(args.data()), /* args */
+                             nullptr,               /* env */
+                             G_SPAWN_DEFAULT,       /* flags */
+                             nullptr,               /* child setup */
+                             nullptr,               /* child setup userdata*/
+                             nullptr,               /* pid */
+                             &stdinfd,              /* stdin */
+                             nullptr,               /* stdout */
+                             nullptr,               /* stderr */
+                             &error);               /* error */
 
     if (error != nullptr)
     {
-        g_warning("Unable to launch OOM helper '" OOM_HELPER "' on PID '%d': %s", pid, error->message);
+        g_warning("Unable to launch OOM helper '%s' on %d PIDs: %s", helper, int(pids.size()), error->message);
         g_error_free(error);
         return;
     }
+
+    /* The helper reads all of its input before doing any work, and GIO
+       ignores SIGPIPE, so a helper that dies early only gets us an error */
+    const char* data = input.c_str();
+    size_t remaining = input.size();
+    while (remaining > 0)
+    {
+        auto written = write(stdinfd, data, remaining);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            g_warning("Unable to write PIDs to OOM helper: %s", std::strerror(errno));
+            break;
+        }
+
+        data += written;
+        remaining -= written;
+    }
+
+    close(stdinfd);
 }
 
 /** Send a signal that we've change the application. Do this on the
@@ -651,6 +759,127 @@ void UpstartInstance::pidListToDbus(const std::shared_ptr<Registry>& reg,
     }
 }
 
+/** Send a single signal for changes to many applications, in the same
+    way as pidListToDbus() but with an array of the application IDs and
+    their PIDs.
+
+    \param apppids Application IDs and the PIDs of each
+    \param signal Name of the DBus signal to send
+*/
+void UpstartInstance::pidListsToDbus(const std::shared_ptr<Registry>& reg,
+                                     const std::vector<std::pair<AppID, std::vector<pid_t>>>& apppids,
+                                     const std::string& signal)
+{
+    GVariantBuilder apps;
+    g_variant_builder_init(&apps, G_VARIANT_TYPE("a(sat)"));
+    for (const auto& app : apppids)
+    {
+        g_variant_builder_open(&apps, G_VARIANT_TYPE("(sat)"));
+        g_variant_builder_add(&apps, "s", std::string(app.first).c_str());
+        g_variant_builder_open(&apps, G_VARIANT_TYPE("at"));
+        for (auto pid : app.second)
+        {
+            g_variant_builder_add(&apps, "t", guint64(pid));
+        }
+        g_variant_builder_close(&apps);
+        g_variant_builder_close(&apps);
+    }
+
+    GError* error = nullptr;
+    g_dbus_connection_emit_signal(reg->impl->_dbus.get(),           /* bus */
+                                  nullptr,                          /* destination */
+                                  "/",                              /* path */
+                                  "com.canonical.UbuntuAppLaunch",  /* interface */
+                                  signal.c_str(),                   /* signal */
+                                  g_variant_new("(a(sat))", &apps), /* params */
+                                  &error);                          /* error */
+
+    if (error != nullptr)
+    {
+        g_warning("Unable to emit signal '%s' for %d apps: %s", signal.c_str(), int(apppids.size()), error->message);
+        g_error_free(error);
+    }
+    else
+    {
+        g_debug("Emmitted '%s' for %d apps to DBus", signal.c_str(), int(apppids.size()));
+    }
+}
+
+/** Does the work of pause(), resume() or setOomAdjustment() for a set of
+    instances in a single pass on the registry thread. Every PID gets its
+    signal before any of the OOM values are written so that stopping the
+    applications isn't delayed by the slower writes. There is one DBus
+    signal for all of the instances, followed by the signal for each
+    instance that listeners from before the bulk signals expect.
+
+    \param registry Registry to use for the thread and connections
+    \param instances Instances to change
+    \param signal Signal to send to each PID, zero for none
+    \param score OOM score to set on each PID
+    \param dbusSignal Name of the DBus signal for all of them, empty for none
+    \param appSignal Name of the DBus signal for each of them, empty for none
+    \param zgEvent Zeitgeist event to log for each application, null for none
+*/
+void UpstartInstance::bulkLifecycle(const std::shared_ptr<Registry>& registry,
+                                    const std::vector<std::shared_ptr<UpstartInstance>>& instances,
+                                    int signal,
+                                    const oom::Score score,
+                                    const std::string& dbusSignal,
+                                    const std::string& appSignal,
+                                    const char* zgEvent)
+{
+    if (instances.empty())
+    {
+        return;
+    }
+
+    std::vector<std::pair<AppID, std::string>> jobs;
+    for (const auto& instance : instances)
+    {
+        jobs.emplace_back(instance->appId_, instance->upstartJobPath());
+    }
+
+    g_debug("Bulk lifecycle change on %d instances (signal: %d, oom: %d)", int(jobs.size()), signal, int(score));
+
+    auto done = registry->impl->thread.executeOnThreadAsync([registry, jobs, signal, score, dbusSignal, appSignal]() {
+        std::vector<std::pair<AppID, std::vector<pid_t>>> apppids;
+        for (const auto& job : jobs)
+        {
+            apppids.emplace_back(job.first, stopContPids(registry, job.first, job.second, signal));
+        }
+
+        std::vector<pid_t> allpids;
+        for (const auto& app : apppids)
+        {
+            allpids.insert(allpids.end(), app.second.begin(), app.second.end());
+        }
+        oomValueToPids(registry, allpids, score);
+
+        if (!dbusSignal.empty())
+        {
+            pidListsToDbus(registry, apppids, dbusSignal);
+        }
+
+        if (!appSignal.empty())
+        {
+            for (const auto& app : apppids)
+            {
+                pidListToDbus(registry, app.first, app.second, appSignal);
+            }
+        }
+    });
+
+    if (zgEvent != nullptr)
+    {
+        for (const auto& job : jobs)
+        {
+            registry->impl->zgSendEvent(job.first, zgEvent);
+        }
+    }
+
+    done.get();
+}
+
 /** Create a new Upstart Instance object that can track the job and
     get information about it.
 
@@ -734,11 +963,35 @@ void UpstartInstance::application_start_cb(GObject* obj, GAsyncResult* res, gpoi
             if (g_strcmp0(remote_error, "com.ubuntu.Upstart0_6.Error.AlreadyStarted") == 0)
             {
                 auto urls = urlsToStrv(data->ptr->urls_);
-                second_exec(data->ptr->registry_->impl->_dbus.get(),                   /* DBus */
-                            data->ptr->registry_->impl->thread.getCancellable().get(), /* cancellable */
-                            data->ptr->primaryPid(),                                   /* primary pid */
-                            std::string(data->ptr->appId_).c_str(),                    /* appid */
-                            urls.get());                                               /* urls */
+                auto ptr = data->ptr;
+
+                auto send = [ptr, urls](const std::vector<std::string>& names) {
+                    std::vector<const gchar*> cnames;
+                    for (const auto& name : names)
+                    {
+                        cnames.push_back(name.c_str());
+                    }
+                    cnames.push_back(nullptr);
+
+                    second_exec(ptr->registry_->impl->_dbus.get(),                   /* DBus */
+                                ptr->registry_->impl->thread.getCancellable().get(), /* cancellable */
+                                cnames.data(),                                       /* bus names */
+                                std::string(ptr->appId_).c_str(),                    /* appid */
+                                urls.get());                                         /* urls */
+                };
+
+                /* Only the connections of the app's processes get the URLs,
+                   finding them needs the bus so we send when they come back */
+                if (!data->ptr->urls_.empty())
+                {
+                    auto pids = data->ptr->pids();
+                    pids.push_back(data->ptr->primaryPid());
+                    data->ptr->registry_->impl->busNamesForPids(pids, send);
+                }
+                else
+                {
+                    send({});
+                }
             }
 
             g_free(remote_error);
@@ -753,6 +1006,80 @@ void UpstartInstance::application_start_cb(GObject* obj, GAsyncResult* res, gpoi
     delete data;
 }
 
+/** Tracks the starting handshake with Unity for a single launch. We
+    broadcast that the application is starting and then wait for Unity
+    to respond, or for the timeout, before asking Upstart to start the
+    job. It is driven entirely by callbacks on the registry thread so
+    that other launches and queries aren't blocked behind it. The
+    object is owned by the timeout source and free'd when it is
+    destroyed. */
+struct StartingHandshake
+{
+    std::string appId;                    /**< Application ID as a string for the tracepoints */
+    std::shared_ptr<GDBusConnection> bus; /**< Connection the signal subscription is on */
+    guint signalSubscribe{0};             /**< Subscription to UnityStartingSignal */
+    GSource* timeout{nullptr};            /**< Source that fires if Unity is too slow */
+    std::function<void()> startJob;       /**< Asks Upstart to start the job */
+    std::promise<void> started;           /**< Set once the job start has been sent */
+    bool finished{false};                 /**< Whether we've moved on from the handshake */
+
+    /** Stop listening for Unity and send the start on to Upstart */
+    void finish()
+    {
+        if (finished)
+        {
+            return;
+        }
+        finished = true;
+
+        g_dbus_connection_signal_unsubscribe(bus.get(), signalSubscribe);
+        signalSubscribe = 0;
+
+        tracepoint(ubuntu_app_launch, handshake_complete, appId.c_str());
+        startJob();
+        started.set_value();
+    }
+
+    /** Unity has responded, we can start the job */
+    static void unitySignal(GDBusConnection* con,
+                            const gchar* sender,
+                            const gchar* path,
+                            const gchar* interface,
+                            const gchar* signal,
+                            GVariant* params,
+                            gpointer user_data)
+    {
+        auto handshake = static_cast<StartingHandshake*>(user_data);
+        handshake->finish();
+        /* Free's the handshake */
+        g_source_destroy(handshake->timeout);
+    }
+
+    /** Unity didn't respond in time, start anyway */
+    static gboolean unityTooSlow(gpointer user_data)
+    {
+        auto handshake = static_cast<StartingHandshake*>(user_data);
+        g_debug("Timeout waiting for Unity to respond to starting: %s", handshake->appId.c_str());
+        handshake->finish();
+        return G_SOURCE_REMOVE;
+    }
+
+    /** Timeout source is gone, which is normally because we're done. If
+        not the registry thread is shutting down underneath us so we let
+        the launcher go without starting the job. */
+    static void destroy(gpointer user_data)
+    {
+        auto handshake = static_cast<StartingHandshake*>(user_data);
+        if (!handshake->finished)
+        {
+            g_warning("Starting handshake for '%s' abandoned on shutdown", handshake->appId.c_str());
+            g_dbus_connection_signal_unsubscribe(handshake->bus.get(), handshake->signalSubscribe);
+            handshake->started.set_value();
+        }
+        delete handshake;
+    }
+};
+
 /** Launch an application and create a new UpstartInstance object to track
     its progress.
 
@@ -776,25 +1103,25 @@ std::shared_ptr<UpstartInstance> UpstartInstance::launch(
     if (appId.empty())
         return {};
 
-    return registry->impl->thread.executeOnThread<std::shared_ptr<UpstartInstance>>(
+    auto caller = std::this_thread::get_id();
+    bool onThread = false;
+    std::future<void> started;
+
+    auto launched = registry->impl->thread.executeOnThread<std::shared_ptr<UpstartInstance>>(
         [&]() -> std::shared_ptr<UpstartInstance> {
             std::string appIdStr{appId};
             g_debug("Initializing params for an new UpstartInstance for: %s", appIdStr.c_str());
 
             tracepoint(ubuntu_app_launch, libual_start, appIdStr.c_str());
 
+            onThread = (std::this_thread::get_id() == caller);
+
             int timeout = 1;
             if (ubuntu::app_launch::Registry::Impl::isWatchingAppStarting())
             {
                 timeout = 0;
             }
 
-            auto handshake = starting_handshake_start(appIdStr.c_str(), timeout);
-            if (handshake == nullptr)
-            {
-                g_warning("Unable to setup starting handshake");
-            }
-
             /* Figure out the DBus path for the job */
             auto jobpath = registry->impl->upstartJobPath(job);
 
@@ -854,33 +1181,86 @@ std::shared_ptr<UpstartInstance> UpstartInstance::launch(
             g_variant_builder_add_value(&builder, g_variant_new_boolean(TRUE));
 
             auto retval = std::make_shared<UpstartInstance>(appId, job, instance, urls, registry);
-            auto chelper = new StartCHelper{};
-            chelper->ptr = retval;
+            std::shared_ptr<GVariant> params(g_variant_ref_sink(g_variant_builder_end(&builder)), g_variant_unref);
+
+            auto handshake = new StartingHandshake{};
+            handshake->appId = appIdStr;
+            handshake->bus = registry->impl->_dbus;
+            handshake->startJob = [retval, registry, jobpath, params]() {
+                auto chelper = new StartCHelper{};
+                chelper->ptr = retval;
+
+                /* Call the job start function */
+                g_debug("Asking Upstart to start task for: %s", std::string(retval->appId_).c_str());
+                g_dbus_connection_call(registry->impl->_dbus.get(),                   /* bus */
+                                       DBUS_SERVICE_UPSTART,                          /* service name */
+                                       jobpath.c_str(),                               /* Path */
+                                       DBUS_INTERFACE_UPSTART_JOB,                    /* interface */
+                                       "Start",                                       /* method */
+                                       params.get(),                                  /* params */
+                                       nullptr,                                       /* return */
+                                       G_DBUS_CALL_FLAGS_NONE,                        /* flags */
+                                       -1,                                            /* default timeout */
+                                       registry->impl->thread.getCancellable().get(), /* cancellable */
+                                       application_start_cb,                          /* callback */
+                                       chelper                                        /* object */
+                                       );
+
+                tracepoint(ubuntu_app_launch, libual_start_message_sent, std::string(retval->appId_).c_str());
+            };
+            started = handshake->started.get_future();
+
+            /* Set up listening for the unfrozen signal from Unity */
+            handshake->signalSubscribe =
+                g_dbus_connection_signal_subscribe(registry->impl->_dbus.get(),     /* bus */
+                                                   nullptr,                         /* sender */
+                                                   "com.canonical.UbuntuAppLaunch", /* interface */
+                                                   "UnityStartingSignal",           /* signal */
+                                                   "/",                             /* path */
+                                                   appIdStr.c_str(),                /* arg0 */
+                                                   G_DBUS_SIGNAL_FLAGS_NONE,        /* flags */
+                                                   StartingHandshake::unitySignal,  /* callback */
+                                                   handshake,                       /* user data */
+                                                   nullptr);                        /* user data destroy */
+
+            /* Send unfreeze to to Unity */
+            GError* error = nullptr;
+            g_dbus_connection_emit_signal(registry->impl->_dbus.get(),            /* bus */
+                                          nullptr,                                /* destination */
+                                          "/",                                    /* path */
+                                          "com.canonical.UbuntuAppLaunch",        /* interface */
+                                          "UnityStartingBroadcast",               /* signal */
+                                          g_variant_new("(s)", appIdStr.c_str()), /* params */
+                                          &error);                                /* error */
+
+            if (error != nullptr)
+            {
+                g_warning("Unable to emit starting broadcast for '%s': %s", appIdStr.c_str(), error->message);
+                g_error_free(error);
+            }
+
+            /* Really, Unity? */
+            handshake->timeout = g_timeout_source_new_seconds(timeout);
+            g_source_set_callback(handshake->timeout, StartingHandshake::unityTooSlow, handshake,
+                                  StartingHandshake::destroy);
+            g_source_attach(handshake->timeout, g_main_context_get_thread_default());
+            g_source_unref(handshake->timeout);
 
             tracepoint(ubuntu_app_launch, handshake_wait, appIdStr.c_str());
-            starting_handshake_wait(handshake);
-            tracepoint(ubuntu_app_launch, handshake_complete, appIdStr.c_str());
-
-            /* Call the job start function */
-            g_debug("Asking Upstart to start task for: %s", appIdStr.c_str());
-            g_dbus_connection_call(registry->impl->_dbus.get(),                   /* bus */
-                                   DBUS_SERVICE_UPSTART,                          /* service name */
-                                   jobpath.c_str(),                               /* Path */
-                                   DBUS_INTERFACE_UPSTART_JOB,                    /* interface */
-                                   "Start",                                       /* method */
-                                   g_variant_builder_end(&builder),               /* params */
-                                   nullptr,                                       /* return */
-                                   G_DBUS_CALL_FLAGS_NONE,                        /* flags */
-                                   -1,                                            /* default timeout */
-                                   registry->impl->thread.getCancellable().get(), /* cancellable */
-                                   application_start_cb,                          /* callback */
-                                   chelper                                        /* object */
-                                   );
-
-            tracepoint(ubuntu_app_launch, libual_start_message_sent, appIdStr.c_str());
 
             return retval;
         });
+
+    /* Wait until Upstart has been asked to start the job so that launch
+       keeps meaning that the start has been sent. The registry thread is
+       free while we wait, but if we are the registry thread there is
+       nothing that could finish the handshake. */
+    if (!onThread)
+    {
+        started.wait();
+    }
+
+    return launched;
 }
 
 }  // namespace app_impls
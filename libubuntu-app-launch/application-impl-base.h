@@ -19,6 +19,8 @@
 
 #include "application.h"
 
+#include <mutex>
+
 extern "C" {
 #include "ubuntu-app-launch.h"
 #include <gio/gio.h>
@@ -43,12 +45,36 @@ public:
 
     bool hasInstances() override;
 
+    /** Resolves the launch ahead of time, called by
+        Application::prepareLaunch() */
+    virtual void prepareLaunch();
+
 protected:
     /** Pointer to the registry so we can ask it for things */
     std::shared_ptr<Registry> _registry;
 
     static std::list<std::pair<std::string, std::string>> confinedEnv(const std::string& package,
                                                                       const std::string& pkgdir);
+
+    void prepareEnv(const std::string& job,
+                    const std::string& desktopPath,
+                    std::function<std::list<std::pair<std::string, std::string>>()> resolve);
+    std::list<std::pair<std::string, std::string>> preparedEnv(
+        std::function<std::list<std::pair<std::string, std::string>>()> resolve);
+
+    /** Read the desktop file again, called when it has changed since
+        the launch was prepared */
+    virtual void reloadDesktop();
+
+private:
+    /** Protects the prepared environment, launches can come from any thread */
+    std::mutex preparedLock_;
+    /** Environment resolved by prepareLaunch(), nullptr if it hasn't been */
+    std::shared_ptr<std::list<std::pair<std::string, std::string>>> preparedEnv_;
+    /** Desktop file the prepared environment was resolved from */
+    std::string preparedPath_;
+    /** Stamp of the desktop file when the environment was resolved */
+    std::string preparedStamp_;
 };
 
 /** An object that represents an instance of a job on Upstart. This
@@ -80,12 +106,28 @@ public:
     void setOomAdjustment(const oom::Score score) override;
     const oom::Score getOomAdjustment() override;
 
+    /* Asynchronous, called by the ones in Application::Instance */
+    std::future<pid_t> primaryPidAsync();
+    std::future<std::vector<pid_t>> pidsAsync();
+    std::future<void> setOomAdjustmentAsync(const oom::Score score);
+    std::future<void> pauseAsync();
+    std::future<void> resumeAsync();
+    std::future<void> stopAsync();
+
     /** Flag for whether we should include the testing environment variables */
     enum class launchMode
     {
         STANDARD, /**< Standard variable set */
         TEST      /**< Include testing environment vars */
     };
+    static void bulkLifecycle(const std::shared_ptr<Registry>& registry,
+                              const std::vector<std::shared_ptr<UpstartInstance>>& instances,
+                              int signal,
+                              const oom::Score score,
+                              const std::string& dbusSignal,
+                              const std::string& appSignal,
+                              const char* zgEvent);
+
     static std::shared_ptr<UpstartInstance> launch(
         const AppID& appId,
         const std::string& job,
@@ -109,11 +151,16 @@ private:
     std::shared_ptr<Registry> registry_;
 
     std::string upstartJobPath();
+    std::string upstartInstanceName();
 
     static std::vector<pid_t> forAllPids(const std::shared_ptr<Registry>& reg,
                                          const AppID& appid,
                                          const std::string& jobpath,
                                          std::function<void(pid_t)> eachPid);
+    static std::vector<pid_t> stopContPids(const std::shared_ptr<Registry>& reg,
+                                           const AppID& appid,
+                                           const std::string& jobpath,
+                                           int signal);
     static std::vector<pid_t> pids(const std::shared_ptr<Registry>& reg,
                                    const AppID& appid,
                                    const std::string& jobpath);
@@ -121,9 +168,14 @@ private:
                               const AppID& appid,
                               const std::vector<pid_t>& pids,
                               const std::string& signal);
+    static void pidListsToDbus(const std::shared_ptr<Registry>& reg,
+                               const std::vector<std::pair<AppID, std::vector<pid_t>>>& apppids,
+                               const std::string& signal);
     static void signalToPid(pid_t pid, int signal);
-    static void oomValueToPid(pid_t pid, const oom::Score oomvalue);
-    static void oomValueToPidHelper(pid_t pid, const oom::Score oomvalue);
+    static void oomValueToPids(const std::shared_ptr<Registry>& reg,
+                               const std::vector<pid_t>& pids,
+                               const oom::Score oomvalue);
+    static void oomValueToPidHelper(const std::vector<pid_t>& pids, const oom::Score oomvalue);
     static std::string pidToOomPath(pid_t pid);
     static std::shared_ptr<gchar*> urlsToStrv(const std::vector<Application::URL>& urls);
     static void application_start_cb(GObject* obj, GAsyncResult* res, gpointer user_data);
@@ -321,21 +321,55 @@ std::list<std::shared_ptr<Application>> Click::list(const std::shared_ptr<Regist
     return applist;
 }
 
+/** Builds the application for a single AppID in the same way list()
+    would, or returns nullptr if list() wouldn't include it. Throws if
+    the Click database can't be read for the package.
+
+    \param appid Application ID to look up
+    \param registry Persistent connections to use
+*/
+std::shared_ptr<Application> Click::listed(const AppID& appid, const std::shared_ptr<Registry>& registry)
+{
+    if (!hasAppId(appid, registry))
+    {
+        return {};
+    }
+
+    auto manifest = registry->impl->getClickManifest(appid.package);
+    if (manifestVersion(manifest).value() != appid.version.value())
+    {
+        return {};
+    }
+
+    auto apps = manifestApps(manifest);
+    if (std::find_if(apps.begin(), apps.end(), [&appid](const AppID::AppName& listApp) -> bool {
+            return appid.appname.value() == listApp.value();
+        }) == apps.end())
+    {
+        return {};
+    }
+
+    try
+    {
+        return std::make_shared<Click>(appid, manifest, registry);
+    }
+    catch (std::runtime_error& e)
+    {
+        g_debug("Unable to create Click for application '%s': %s", std::string(appid).c_str(), e.what());
+        return {};
+    }
+}
+
 std::vector<std::shared_ptr<Application::Instance>> Click::instances()
 {
     std::vector<std::shared_ptr<Instance>> vect;
-    std::string sappid = appId();
 
-    for (auto instancename : _registry->impl->upstartInstancesForJob("application-click"))
+    /* There can be only one, and its name is the AppID, so we only
+       need to ask about that one instead of listing them all */
+    if (_registry->impl->upstartHasInstance("application-click", appId()))
     {
-        /* There an be only one, but we want to make sure it is
-           there or return an empty vector */
-        if (sappid == instancename)
-        {
-            vect.emplace_back(std::make_shared<UpstartInstance>(appId(), "application-click", std::string{},
-                                                                std::vector<Application::URL>{}, _registry));
-            break;
-        }
+        vect.emplace_back(std::make_shared<UpstartInstance>(appId(), "application-click", std::string{},
+                                                            std::vector<Application::URL>{}, _registry));
     }
     return vect;
 }
@@ -360,18 +394,54 @@ std::list<std::pair<std::string, std::string>> Click::launchEnv()
 
 std::shared_ptr<Application::Instance> Click::launch(const std::vector<Application::URL>& urls)
 {
-    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() { return launchEnv(); };
+    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() {
+        return preparedEnv([this]() { return launchEnv(); });
+    };
     return UpstartInstance::launch(appId(), "application-click", {}, urls, _registry,
                                    UpstartInstance::launchMode::STANDARD, envfunc);
 }
 
 std::shared_ptr<Application::Instance> Click::launchTest(const std::vector<Application::URL>& urls)
 {
-    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() { return launchEnv(); };
+    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() {
+        return preparedEnv([this]() { return launchEnv(); });
+    };
     return UpstartInstance::launch(appId(), "application-click", {}, urls, _registry, UpstartInstance::launchMode::TEST,
                                    envfunc);
 }
 
+/** Resolve the launch environment ahead of time so that launching
+    only needs to ask Upstart to start the job. */
+void Click::prepareLaunch()
+{
+    prepareEnv("application-click", desktopPath_, [this]() { return launchEnv(); });
+}
+
+/** Reads the desktop file from the package again */
+void Click::reloadDesktop()
+{
+    std::shared_ptr<GKeyFile> keyfile;
+    std::string desktopPath;
+    try
+    {
+        std::tie(keyfile, desktopPath) = manifestAppDesktop(_manifest, _appid.package, _appid.appname, _clickDir);
+    }
+    catch (std::runtime_error& e)
+    {
+        g_warning("Unable to read desktop file for '%s': %s", std::string(_appid).c_str(), e.what());
+    }
+
+    if (!keyfile)
+    {
+        g_warning("Desktop file for '%s' is gone, using the one we have", std::string(_appid).c_str());
+        return;
+    }
+
+    _keyfile = keyfile;
+    desktopPath_ = desktopPath;
+    _info.reset();
+}
+
 }  // namespace app_impls
 }  // namespace app_launch
 }  // namespace ubuntu
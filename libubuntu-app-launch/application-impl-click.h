@@ -53,6 +53,7 @@ public:
     Click(const AppID& appid, const std::shared_ptr<JsonObject>& manifest, const std::shared_ptr<Registry>& registry);
 
     static std::list<std::shared_ptr<Application>> list(const std::shared_ptr<Registry>& registry);
+    static std::shared_ptr<Application> listed(const AppID& appid, const std::shared_ptr<Registry>& registry);
 
     AppID appId() override;
 
@@ -62,6 +63,7 @@ public:
 
     std::shared_ptr<Instance> launch(const std::vector<Application::URL>& urls = {}) override;
     std::shared_ptr<Instance> launchTest(const std::vector<Application::URL>& urls = {}) override;
+    void prepareLaunch() override;
 
     static bool hasAppId(const AppID& appId, const std::shared_ptr<Registry>& registry);
 
@@ -88,6 +90,9 @@ private:
     std::shared_ptr<app_info::Desktop> _info;
 
     std::list<std::pair<std::string, std::string>> launchEnv();
+
+protected:
+    void reloadDesktop() override;
 };
 
 }  // namespace app_impls
@@ -18,11 +18,10 @@
  */
 
 #include "application-impl-legacy.h"
+#include "appid-parser.h"
 #include "application-info-desktop.h"
 #include "registry-impl.h"
 
-#include <regex>
-
 namespace ubuntu
 {
 namespace app_launch
@@ -33,29 +32,42 @@ namespace app_impls
 /** Path that snapd puts desktop files, we don't want to read those directly
     in the Legacy backend. We want to use the snap backend. */
 const std::string snappyDesktopPath{"/var/lib/snapd"};
-/** Special characters that could be an application name that
-    would activate in a regex */
-const static std::regex regexCharacters("([\\.\\-])");
 
 /***********************************
    Prototypes
  ***********************************/
-std::tuple<std::string, std::shared_ptr<GKeyFile>, std::string> keyfileForApp(const AppID::AppName& name);
+std::tuple<std::string, std::shared_ptr<GKeyFile>, std::string> keyfileForApp(const AppID::AppName& name,
+                                                                             const std::shared_ptr<Registry>& registry);
 
-/** Helper function to put on shared_ptr's for keyfiles */
-void clear_keyfile(GKeyFile* keyfile)
+Legacy::Legacy(const AppID::AppName& appname, const std::shared_ptr<Registry>& registry)
+    : Base(registry)
+    , _appname(appname)
 {
-    if (keyfile != nullptr)
+    std::shared_ptr<GKeyFile> keyfile;
+    std::string basedir;
+    std::tie(basedir, keyfile, desktopPath_) = keyfileForApp(appname, registry);
+    loadDesktop(basedir, keyfile);
+
+    if (!_keyfile)
+    {
+        throw std::runtime_error{"Unable to find keyfile for legacy application: " + appname.value()};
+    }
+
+    if (std::equal(snappyDesktopPath.begin(), snappyDesktopPath.end(), _basedir.begin()))
     {
-        g_key_file_free(keyfile);
+        throw std::runtime_error{"Looking like a legacy app, but should be a Snap: " + appname.value()};
     }
 }
 
-Legacy::Legacy(const AppID::AppName& appname, const std::shared_ptr<Registry>& registry)
-    : Base(registry)
-    , _appname(appname)
+/** Sets up the application info from a desktop file
+
+    \param basedir Data directory the desktop file was found in
+    \param keyfile The parsed desktop file
+*/
+void Legacy::loadDesktop(const std::string& basedir, const std::shared_ptr<GKeyFile>& keyfile)
 {
-    std::tie(_basedir, _keyfile, desktopPath_) = keyfileForApp(appname);
+    _basedir = basedir;
+    _keyfile = keyfile;
 
     std::string rootDir = "";
     auto rootenv = g_getenv("UBUNTU_APP_LAUNCH_LEGACY_ROOT");
@@ -67,50 +79,43 @@ Legacy::Legacy(const AppID::AppName& appname, const std::shared_ptr<Registry>& r
 
     appinfo_ = std::make_shared<app_info::Desktop>(_keyfile, _basedir, rootDir,
                                                    app_info::DesktopFlags::ALLOW_NO_DISPLAY, _registry);
+}
 
-    if (!_keyfile)
-    {
-        throw std::runtime_error{"Unable to find keyfile for legacy application: " + appname.value()};
-    }
+/** Looks for the desktop file again, keeping the one we have if it
+    has gone away */
+void Legacy::reloadDesktop()
+{
+    std::shared_ptr<GKeyFile> keyfile;
+    std::string basedir;
+    std::string desktopPath;
+    std::tie(basedir, keyfile, desktopPath) = keyfileForApp(_appname, _registry);
 
-    if (std::equal(snappyDesktopPath.begin(), snappyDesktopPath.end(), _basedir.begin()))
+    if (!keyfile)
     {
-        throw std::runtime_error{"Looking like a legacy app, but should be a Snap: " + appname.value()};
+        g_warning("Desktop file for '%s' is gone, using the one we have", _appname.value().c_str());
+        return;
     }
 
-    /* Build a regex that'll match instances of the applications which
-       roughly looks like: $(appid)-2345345
-
-       It is important to filter out the special characters that are in
-       the appid.
-    */
-    instanceRegex_ = std::regex("^(?:" + std::regex_replace(_appname.value(), regexCharacters, "\\$&") + ")\\-(\\d*)$");
+    desktopPath_ = desktopPath;
+    loadDesktop(basedir, keyfile);
 }
 
-std::tuple<std::string, std::shared_ptr<GKeyFile>, std::string> keyfileForApp(const AppID::AppName& name)
+std::tuple<std::string, std::shared_ptr<GKeyFile>, std::string> keyfileForApp(const AppID::AppName& name,
+                                                                             const std::shared_ptr<Registry>& registry)
 {
     auto desktopName = name.value() + ".desktop";
     std::string desktopPath;
-    auto keyfilecheck = [desktopName, &desktopPath](const std::string& dir) -> std::shared_ptr<GKeyFile> {
+    auto cache = registry->impl->getKeyfileCache();
+    auto keyfilecheck = [desktopName, &desktopPath, cache](const std::string& dir) -> std::shared_ptr<GKeyFile> {
         auto fullname = g_build_filename(dir.c_str(), "applications", desktopName.c_str(), nullptr);
-        if (!g_file_test(fullname, G_FILE_TEST_EXISTS))
-        {
-            g_free(fullname);
-            return {};
-        }
-        desktopPath = fullname;
-
-        auto keyfile = std::shared_ptr<GKeyFile>(g_key_file_new(), clear_keyfile);
-
-        GError* error = nullptr;
-        g_key_file_load_from_file(keyfile.get(), fullname, G_KEY_FILE_NONE, &error);
+        std::string sfullname(fullname);
         g_free(fullname);
 
-        if (error != nullptr)
+        /* The cache returns null when the file doesn't exist */
+        auto keyfile = cache->get(sfullname);
+        if (keyfile)
         {
-            g_debug("Unable to load keyfile '%s' becuase: %s", desktopName.c_str(), error->message);
-            g_error_free(error);
-            return {};
+            desktopPath = sfullname;
         }
 
         return keyfile;
@@ -235,7 +240,34 @@ AppID::Version Legacy::findVersion(const AppID::Package& package,
     return AppID::Version::from_raw({});
 }
 
-static const std::regex desktop_remover("^(.*)\\.desktop$");
+/** Gets the application name of a desktop file that should be listed as
+    a legacy application, or an empty string if it shouldn't be */
+static std::string listedAppname(GDesktopAppInfo* appinfo)
+{
+    if (appinfo == nullptr)
+    {
+        return {};
+    }
+
+    if (g_app_info_should_show(G_APP_INFO(appinfo)) == FALSE)
+    {
+        return {};
+    }
+
+    auto desktopappid = g_app_info_get_id(G_APP_INFO(appinfo));
+    if (desktopappid == nullptr || !g_str_has_suffix(desktopappid, ".desktop"))
+    {
+        return {};
+    }
+
+    /* Remove entries generated by the desktop hook in .local */
+    if (g_desktop_app_info_has_key(appinfo, "X-Ubuntu-Application-ID"))
+    {
+        return {};
+    }
+
+    return std::string(desktopappid, strlen(desktopappid) - strlen(".desktop"));
+}
 
 std::list<std::shared_ptr<Application>> Legacy::list(const std::shared_ptr<Registry>& registry)
 {
@@ -243,32 +275,8 @@ std::list<std::shared_ptr<Application>> Legacy::list(const std::shared_ptr<Regis
     GList* head = g_app_info_get_all();
     for (GList* item = head; item != nullptr; item = g_list_next(item))
     {
-        GDesktopAppInfo* appinfo = G_DESKTOP_APP_INFO(item->data);
-
-        if (appinfo == nullptr)
-        {
-            continue;
-        }
-
-        if (g_app_info_should_show(G_APP_INFO(appinfo)) == FALSE)
-        {
-            continue;
-        }
-
-        auto desktopappid = std::string(g_app_info_get_id(G_APP_INFO(appinfo)));
-        std::string appname;
-        std::smatch match;
-        if (std::regex_match(desktopappid, match, desktop_remover))
-        {
-            appname = match[1].str();
-        }
-        else
-        {
-            continue;
-        }
-
-        /* Remove entries generated by the desktop hook in .local */
-        if (g_desktop_app_info_has_key(appinfo, "X-Ubuntu-Application-ID"))
+        auto appname = listedAppname(G_DESKTOP_APP_INFO(item->data));
+        if (appname.empty())
         {
             continue;
         }
@@ -289,18 +297,45 @@ std::list<std::shared_ptr<Application>> Legacy::list(const std::shared_ptr<Regis
     return list;
 }
 
+std::shared_ptr<Application> Legacy::listed(const AppID& appid, const std::shared_ptr<Registry>& registry)
+{
+    if (!appid.package.value().empty() || appid.appname.value().empty())
+    {
+        return {};
+    }
+
+    auto desktopid = appid.appname.value() + ".desktop";
+    auto appinfo = std::shared_ptr<GDesktopAppInfo>(g_desktop_app_info_new(desktopid.c_str()),
+                                                    [](GDesktopAppInfo* info) { g_clear_object(&info); });
+
+    if (listedAppname(appinfo.get()) != appid.appname.value())
+    {
+        return {};
+    }
+
+    try
+    {
+        return std::make_shared<Legacy>(appid.appname, registry);
+    }
+    catch (std::runtime_error& e)
+    {
+        g_debug("Unable to create application for legacy appname '%s': %s", appid.appname.value().c_str(), e.what());
+        return {};
+    }
+}
+
 std::vector<std::shared_ptr<Application::Instance>> Legacy::instances()
 {
     std::vector<std::shared_ptr<Instance>> vect;
-    auto startsWith = std::string(appId()) + "-";
 
+    /* Instances look like: $(appid)-2345345 */
     for (auto instance : _registry->impl->upstartInstancesForJob("application-legacy"))
     {
-        std::smatch instanceMatch;
+        appid_parser::Range instanceid{0, 0};
         g_debug("Looking at legacy instance: %s", instance.c_str());
-        if (std::regex_match(instance, instanceMatch, instanceRegex_))
+        if (appid_parser::matchInstance(instance, _appname.value(), instanceid))
         {
-            vect.emplace_back(std::make_shared<UpstartInstance>(appId(), "application-legacy", instanceMatch[1].str(),
+            vect.emplace_back(std::make_shared<UpstartInstance>(appId(), "application-legacy", instanceid.of(instance),
                                                                 std::vector<Application::URL>{}, _registry));
         }
     }
@@ -314,7 +349,7 @@ std::vector<std::shared_ptr<Application::Instance>> Legacy::instances()
     the exec line and whether it needs XMir. Also we set the path if that
     is specified in the desktop file. We can also set an AppArmor profile
     if requested. */
-std::list<std::pair<std::string, std::string>> Legacy::launchEnv(const std::string& instance)
+std::list<std::pair<std::string, std::string>> Legacy::launchEnv()
 {
     std::list<std::pair<std::string, std::string>> retval;
 
@@ -363,8 +398,6 @@ std::list<std::pair<std::string, std::string>> Legacy::launchEnv(const std::stri
         retval.emplace_back(std::make_pair("APP_EXEC_POLICY", "unconfined"));
     }
 
-    retval.emplace_back(std::make_pair("INSTANCE_ID", instance));
-
     return retval;
 }
 
@@ -392,7 +425,9 @@ std::shared_ptr<Application::Instance> Legacy::launch(const std::vector<Applicat
 {
     std::string instance = getInstance();
     std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this, instance]() {
-        return launchEnv(instance);
+        auto env = preparedEnv([this]() { return launchEnv(); });
+        env.emplace_back(std::make_pair("INSTANCE_ID", instance));
+        return env;
     };
     return UpstartInstance::launch(appId(), "application-legacy", instance, urls, _registry,
                                    UpstartInstance::launchMode::STANDARD, envfunc);
@@ -407,12 +442,21 @@ std::shared_ptr<Application::Instance> Legacy::launchTest(const std::vector<Appl
 {
     std::string instance = getInstance();
     std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this, instance]() {
-        return launchEnv(instance);
+        auto env = preparedEnv([this]() { return launchEnv(); });
+        env.emplace_back(std::make_pair("INSTANCE_ID", instance));
+        return env;
     };
     return UpstartInstance::launch(appId(), "application-legacy", instance, urls, _registry,
                                    UpstartInstance::launchMode::TEST, envfunc);
 }
 
+/** Resolve the launch environment ahead of time so that launching
+    only needs to ask Upstart to start the job. */
+void Legacy::prepareLaunch()
+{
+    prepareEnv("application-legacy", desktopPath_, [this]() { return launchEnv(); });
+}
+
 }  // namespace app_impls
 }  // namespace app_launch
 }  // namespace ubuntu
@@ -18,7 +18,6 @@
  */
 
 #include <gio/gdesktopappinfo.h>
-#include <regex>
 
 #include "application-impl-base.h"
 #include "application-info-desktop.h"
@@ -58,11 +57,13 @@ public:
     std::shared_ptr<Info> info() override;
 
     static std::list<std::shared_ptr<Application>> list(const std::shared_ptr<Registry>& registry);
+    static std::shared_ptr<Application> listed(const AppID& appid, const std::shared_ptr<Registry>& registry);
 
     std::vector<std::shared_ptr<Instance>> instances() override;
 
     std::shared_ptr<Instance> launch(const std::vector<Application::URL>& urls = {}) override;
     std::shared_ptr<Instance> launchTest(const std::vector<Application::URL>& urls = {}) override;
+    void prepareLaunch() override;
 
     static bool hasAppId(const AppID& appId, const std::shared_ptr<Registry>& registry);
 
@@ -83,10 +84,13 @@ private:
     std::shared_ptr<GKeyFile> _keyfile;
     std::shared_ptr<app_info::Desktop> appinfo_;
     std::string desktopPath_;
-    std::regex instanceRegex_;
 
-    std::list<std::pair<std::string, std::string>> launchEnv(const std::string& instance);
+    std::list<std::pair<std::string, std::string>> launchEnv();
     std::string getInstance();
+    void loadDesktop(const std::string& basedir, const std::shared_ptr<GKeyFile>& keyfile);
+
+protected:
+    void reloadDesktop() override;
 };
 
 }  // namespace app_impls
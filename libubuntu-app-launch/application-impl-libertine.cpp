@@ -48,7 +48,7 @@ Libertine::Libertine(const AppID::Package& container,
         _basedir = system_app_path;
         g_free(system_app_path);
 
-        _keyfile = findDesktopFile(_basedir, "applications", appname.value() + ".desktop");
+        _keyfile = findDesktopFile(_basedir, "applications", appname.value() + ".desktop", registry);
     }
 
     if (!_keyfile)
@@ -59,7 +59,7 @@ Libertine::Libertine(const AppID::Package& container,
         g_free(local_app_path);
         g_free(container_home_path);
 
-        _keyfile = findDesktopFile(_basedir, "applications", appname.value() + ".desktop");
+        _keyfile = findDesktopFile(_basedir, "applications", appname.value() + ".desktop", registry);
     }
 
     if (!_keyfile)
@@ -67,30 +67,16 @@ Libertine::Libertine(const AppID::Package& container,
                                  container.value() + "'"};
 }
 
-std::shared_ptr<GKeyFile> Libertine::keyfileFromPath(const std::string& pathname)
+std::shared_ptr<GKeyFile> Libertine::keyfileFromPath(const std::string& pathname,
+                                                     const std::shared_ptr<Registry>& registry)
 {
-    std::shared_ptr<GKeyFile> keyfile(g_key_file_new(), [](GKeyFile* keyfile) {
-        if (keyfile != nullptr)
-        {
-            g_key_file_free(keyfile);
-        }
-    });
-    GError* error = nullptr;
-
-    g_key_file_load_from_file(keyfile.get(), pathname.c_str(), G_KEY_FILE_NONE, &error);
-
-    if (error != nullptr)
-    {
-        g_error_free(error);
-        return {};
-    }
-
-    return keyfile;
+    return registry->impl->getKeyfileCache()->get(pathname);
 }
 
 std::shared_ptr<GKeyFile> Libertine::findDesktopFile(const std::string& basepath,
                                                      const std::string& subpath,
-                                                     const std::string& filename)
+                                                     const std::string& filename,
+                                                     const std::shared_ptr<Registry>& registry)
 {
     auto fullpath = g_build_filename(basepath.c_str(), subpath.c_str(), filename.c_str(), nullptr);
     std::string sfullpath(fullpath);
@@ -98,7 +84,7 @@ std::shared_ptr<GKeyFile> Libertine::findDesktopFile(const std::string& basepath
 
     if (g_file_test(sfullpath.c_str(), G_FILE_TEST_IS_REGULAR))
     {
-        return keyfileFromPath(sfullpath);
+        return keyfileFromPath(sfullpath, registry);
     }
 
     GError* error = nullptr;
@@ -119,7 +105,7 @@ std::shared_ptr<GKeyFile> Libertine::findDesktopFile(const std::string& basepath
         auto new_fullpath = g_build_filename(basepath.c_str(), new_subpath, nullptr);
         if (g_file_test(new_fullpath, G_FILE_TEST_IS_DIR))
         {
-            auto desktop_file = findDesktopFile(basepath, new_subpath, filename);
+            auto desktop_file = findDesktopFile(basepath, new_subpath, filename, registry);
 
             if (desktop_file)
             {
@@ -263,6 +249,24 @@ std::list<std::shared_ptr<Application>> Libertine::list(const std::shared_ptr<Re
     return applist;
 }
 
+std::shared_ptr<Application> Libertine::listed(const AppID& appid, const std::shared_ptr<Registry>& registry)
+{
+    if (!verifyAppname(appid.package, appid.appname, registry))
+    {
+        return {};
+    }
+
+    try
+    {
+        return std::make_shared<Libertine>(appid.package, appid.appname, registry);
+    }
+    catch (std::runtime_error& e)
+    {
+        g_debug("Unable to create application for libertine appid '%s': %s", std::string(appid).c_str(), e.what());
+        return {};
+    }
+}
+
 std::shared_ptr<Application::Info> Libertine::info()
 {
     if (!appinfo_)
@@ -276,13 +280,13 @@ std::shared_ptr<Application::Info> Libertine::info()
 std::vector<std::shared_ptr<Application::Instance>> Libertine::instances()
 {
     std::vector<std::shared_ptr<Instance>> vect;
-    std::string sappid = appId();
 
-    for (auto instancename : _registry->impl->upstartInstancesForJob("application-legacy"))
+    /* We always launch with an empty instance ID, so there is only
+       one name to ask about instead of listing all the legacy jobs */
+    if (_registry->impl->upstartHasInstance("application-legacy", std::string(appId()) + "-"))
     {
-        if (std::equal(sappid.begin(), sappid.end(), instancename.begin()))
-            vect.emplace_back(std::make_shared<UpstartInstance>(appId(), "application-legacy", std::string{},
-                                                                std::vector<Application::URL>{}, _registry));
+        vect.emplace_back(std::make_shared<UpstartInstance>(appId(), "application-legacy", std::string{},
+                                                            std::vector<Application::URL>{}, _registry));
     }
 
     return vect;
@@ -326,18 +330,53 @@ std::list<std::pair<std::string, std::string>> Libertine::launchEnv()
 
 std::shared_ptr<Application::Instance> Libertine::launch(const std::vector<Application::URL>& urls)
 {
-    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() { return launchEnv(); };
+    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() {
+        return preparedEnv([this]() { return launchEnv(); });
+    };
     return UpstartInstance::launch(appId(), "application-legacy", {}, urls, _registry,
                                    UpstartInstance::launchMode::STANDARD, envfunc);
 }
 
 std::shared_ptr<Application::Instance> Libertine::launchTest(const std::vector<Application::URL>& urls)
 {
-    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() { return launchEnv(); };
+    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() {
+        return preparedEnv([this]() { return launchEnv(); });
+    };
     return UpstartInstance::launch(appId(), "application-legacy", {}, urls, _registry,
                                    UpstartInstance::launchMode::TEST, envfunc);
 }
 
+/** Resolve the launch environment ahead of time so that launching
+    only needs to ask Upstart to start the job. */
+void Libertine::prepareLaunch()
+{
+    prepareEnv("application-legacy", desktopPath(), [this]() { return launchEnv(); });
+}
+
+/** Path to the desktop file that we found in the container */
+std::string Libertine::desktopPath()
+{
+    auto cpath = g_build_filename(_basedir.c_str(), "applications", (_appname.value() + ".desktop").c_str(), nullptr);
+    std::string path(cpath);
+    g_free(cpath);
+    return path;
+}
+
+/** Reads the desktop file in the container again */
+void Libertine::reloadDesktop()
+{
+    auto keyfile = keyfileFromPath(desktopPath(), _registry);
+
+    if (!keyfile)
+    {
+        g_warning("Desktop file for '%s' is gone, using the one we have", std::string(appId()).c_str());
+        return;
+    }
+
+    _keyfile = keyfile;
+    appinfo_.reset();
+}
+
 }  // namespace app_impls
 }  // namespace app_launch
 }  // namespace ubuntu
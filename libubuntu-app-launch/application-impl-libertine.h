@@ -55,6 +55,7 @@ public:
               const std::shared_ptr<Registry>& registry);
 
     static std::list<std::shared_ptr<Application>> list(const std::shared_ptr<Registry>& registry);
+    static std::shared_ptr<Application> listed(const AppID& appid, const std::shared_ptr<Registry>& registry);
 
     AppID appId() override
     {
@@ -67,6 +68,7 @@ public:
 
     std::shared_ptr<Instance> launch(const std::vector<Application::URL>& urls = {}) override;
     std::shared_ptr<Instance> launchTest(const std::vector<Application::URL>& urls = {}) override;
+    void prepareLaunch() override;
 
     static bool hasAppId(const AppID& appId, const std::shared_ptr<Registry>& registry);
 
@@ -90,10 +92,16 @@ private:
     std::shared_ptr<app_info::Desktop> appinfo_;
 
     std::list<std::pair<std::string, std::string>> launchEnv();
-    static std::shared_ptr<GKeyFile> keyfileFromPath(const std::string& pathname);
+    static std::shared_ptr<GKeyFile> keyfileFromPath(const std::string& pathname,
+                                                     const std::shared_ptr<Registry>& registry);
     static std::shared_ptr<GKeyFile> findDesktopFile(const std::string& basepath,
                                                      const std::string& subpath,
-                                                     const std::string& filename);
+                                                     const std::string& filename,
+                                                     const std::shared_ptr<Registry>& registry);
+    std::string desktopPath();
+
+protected:
+    void reloadDesktop() override;
 };
 
 }  // namespace app_impls
@@ -17,9 +17,8 @@
  *     Ted Gould <ted.gould@canonical.com>
  */
 
-#include <regex>
-
 #include "application-impl-snap.h"
+#include "appid-parser.h"
 #include "application-info-desktop.h"
 #include "registry-impl.h"
 
@@ -40,8 +39,6 @@ const std::set<std::string> SUPPORTED_INTERFACES{"unity8", "unity7", "x11"};
 const std::set<std::string> XMIR_INTERFACES{"unity7", "x11"};
 /** All the interfaces that we tell Unity support lifecycle */
 const std::set<std::string> LIFECYCLE_INTERFACES{"unity8"};
-/** Snappy has more restrictive appnames than everyone else */
-const std::regex appnameRegex{"^[a-zA-Z0-9](?:-?[a-zA-Z0-9])*$"};
 
 /************************
  ** Info support
@@ -180,11 +177,27 @@ public:
     \param interface Primary interface that we found this snap for
 */
 Snap::Snap(const AppID& appid, const std::shared_ptr<Registry>& registry, const std::string& interface)
+    : Snap(appid, registry, interface, registry->impl->snapdInfo.pkgInfo(appid.package))
+{
+}
+
+/** Creates a Snap object with package information that has already
+    been retrieved from snapd, so that we don't need to ask again.
+
+    \param appid Application ID of the snap
+    \param registry Registry to use for persistent connections
+    \param interface Primary interface that we found this snap for
+    \param pkginfo Information on the package from snapd
+*/
+Snap::Snap(const AppID& appid,
+           const std::shared_ptr<Registry>& registry,
+           const std::string& interface,
+           const std::shared_ptr<snapd::Info::PkgInfo>& pkginfo)
     : Base(registry)
     , appid_(appid)
     , interface_(interface)
+    , pkgInfo_(pkginfo)
 {
-    pkgInfo_ = registry->impl->snapdInfo.pkgInfo(appid.package);
     if (!pkgInfo_)
     {
         throw std::runtime_error("Unable to get snap package info for AppID: " + std::string(appid));
@@ -218,13 +231,17 @@ std::list<std::shared_ptr<Application>> Snap::list(const std::shared_ptr<Registr
 {
     std::list<std::shared_ptr<Application>> apps;
 
+    /* One look at the interfaces, and one request for each package */
+    std::map<std::string, std::shared_ptr<snapd::Info::PkgInfo>> pkginfos;
+    auto ifaceapps = registry->impl->snapdInfo.appsForInterfaces(SUPPORTED_INTERFACES, pkginfos);
+
     for (const auto& interface : SUPPORTED_INTERFACES)
     {
-        for (const auto& id : registry->impl->snapdInfo.appsForInterface(interface))
+        for (const auto& id : ifaceapps[interface])
         {
             try
             {
-                auto app = std::make_shared<Snap>(id, registry, interface);
+                auto app = std::make_shared<Snap>(id, registry, interface, pkginfos[id.package.value()]);
                 apps.emplace_back(app);
             }
             catch (std::runtime_error& e)
@@ -291,7 +308,8 @@ bool Snap::hasAppId(const AppID& appId, const std::shared_ptr<Registry>& registr
         return false;
     }
 
-    if (!std::regex_match(appId.appname.value(), appnameRegex))
+    /* Snappy has more restrictive appnames than everyone else */
+    if (!appid_parser::validSnapAppName(appId.appname.value()))
     {
         return false;
     }
@@ -328,7 +346,7 @@ bool Snap::verifyAppname(const AppID::Package& package,
                          const AppID::AppName& appname,
                          const std::shared_ptr<Registry>& registry)
 {
-    if (!std::regex_match(appname.value(), appnameRegex))
+    if (!appid_parser::validSnapAppName(appname.value()))
     {
         return false;
     }
@@ -447,7 +465,9 @@ std::list<std::pair<std::string, std::string>> Snap::launchEnv()
 */
 std::shared_ptr<Application::Instance> Snap::launch(const std::vector<Application::URL>& urls)
 {
-    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() { return launchEnv(); };
+    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() {
+        return preparedEnv([this]() { return launchEnv(); });
+    };
     return UpstartInstance::launch(appid_, "application-snap", {}, urls, _registry,
                                    UpstartInstance::launchMode::STANDARD, envfunc);
 }
@@ -459,11 +479,35 @@ std::shared_ptr<Application::Instance> Snap::launch(const std::vector<Applicatio
 */
 std::shared_ptr<Application::Instance> Snap::launchTest(const std::vector<Application::URL>& urls)
 {
-    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() { return launchEnv(); };
+    std::function<std::list<std::pair<std::string, std::string>>(void)> envfunc = [this]() {
+        return preparedEnv([this]() { return launchEnv(); });
+    };
     return UpstartInstance::launch(appid_, "application-snap", {}, urls, _registry, UpstartInstance::launchMode::TEST,
                                    envfunc);
 }
 
+/** Resolve the launch environment ahead of time so that launching
+    only needs to ask Upstart to start the job. */
+void Snap::prepareLaunch()
+{
+    prepareEnv("application-snap", pkgInfo_->directory + "/meta/gui/" + appid_.appname.value() + ".desktop",
+               [this]() { return launchEnv(); });
+}
+
+/** Reads the desktop file in the snap again */
+void Snap::reloadDesktop()
+{
+    try
+    {
+        info_ = std::make_shared<SnapInfo>(appid_, _registry, interface_, pkgInfo_->directory);
+    }
+    catch (std::runtime_error& e)
+    {
+        g_warning("Unable to read desktop file for '%s', using the one we have: %s", std::string(appid_).c_str(),
+                  e.what());
+    }
+}
+
 }  // namespace app_impls
 }  // namespace app_launch
 }  // namespace ubuntu
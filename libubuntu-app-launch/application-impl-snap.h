@@ -50,6 +50,10 @@ class Snap : public Base
 public:
     Snap(const AppID& appid, const std::shared_ptr<Registry>& registry);
     Snap(const AppID& appid, const std::shared_ptr<Registry>& registry, const std::string& interface);
+    Snap(const AppID& appid,
+         const std::shared_ptr<Registry>& registry,
+         const std::string& interface,
+         const std::shared_ptr<snapd::Info::PkgInfo>& pkginfo);
 
     static std::list<std::shared_ptr<Application>> list(const std::shared_ptr<Registry>& registry);
 
@@ -57,10 +61,17 @@ public:
 
     std::shared_ptr<Info> info() override;
 
+    /** Which interface this snap was found with */
+    const std::string& interface() const
+    {
+        return interface_;
+    }
+
     std::vector<std::shared_ptr<Instance>> instances() override;
 
     std::shared_ptr<Instance> launch(const std::vector<Application::URL>& urls = {}) override;
     std::shared_ptr<Instance> launchTest(const std::vector<Application::URL>& urls = {}) override;
+    void prepareLaunch() override;
 
     static bool hasAppId(const AppID& appId, const std::shared_ptr<Registry>& registry);
 
@@ -91,6 +102,9 @@ private:
     std::list<std::pair<std::string, std::string>> launchEnv();
     static std::string findInterface(const AppID& appid, const std::shared_ptr<Registry>& registry);
     static bool checkPkgInfo(const std::shared_ptr<snapd::Info::PkgInfo>& pkginfo, const AppID& appid);
+
+protected:
+    void reloadDesktop() override;
 };
 
 }  // namespace app_impls
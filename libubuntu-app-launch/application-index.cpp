@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "application-index.h"
+
+#include <cerrno>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <memory>
+#include <sys/stat.h>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/** Version of the file format, needs to be changed any time that
+    the GVariant type or the meaning of the fields changes. */
+static const guint32 INDEX_VERSION = 1;
+/** Type of the serialized GVariant: version, stamps and then the
+    entries as (backend, package, appname, version, interface) */
+static const gchar* INDEX_TYPE = "(ua{ss}a(yssss))";
+
+ApplicationIndex::ApplicationIndex(const std::string& path)
+    : path_(path)
+{
+}
+
+bool ApplicationIndex::read(const Stamps& stamps, std::list<Entry>& entries)
+{
+    GError* error = nullptr;
+    auto mapped = g_mapped_file_new(path_.c_str(), FALSE, &error);
+
+    if (error != nullptr)
+    {
+        g_debug("Unable to map application index '%s': %s", path_.c_str(), error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    /* The bytes hold a reference to the mapping, so the variant
+       is reading directly out of the mapped file */
+    auto bytes = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    auto index = std::shared_ptr<GVariant>(
+        g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(INDEX_TYPE), /* type */
+                                                    bytes,                      /* data */
+                                                    FALSE)),                    /* trusted */
+        g_variant_unref);
+    g_bytes_unref(bytes);
+
+    guint32 version = 0;
+    g_variant_get_child(index.get(), 0, "u", &version);
+    if (version != INDEX_VERSION)
+    {
+        g_debug("Application index '%s' is version %d, expecting %d", path_.c_str(), int(version),
+                int(INDEX_VERSION));
+        return false;
+    }
+
+    Stamps filestamps;
+    auto vstamps = g_variant_get_child_value(index.get(), 1);
+    GVariantIter stampiter;
+    g_variant_iter_init(&stampiter, vstamps);
+    const gchar* key = nullptr;
+    const gchar* value = nullptr;
+    while (g_variant_iter_loop(&stampiter, "{&s&s}", &key, &value))
+    {
+        filestamps[key] = value;
+    }
+    g_variant_unref(vstamps);
+
+    if (filestamps != stamps)
+    {
+        g_debug("Application index '%s' is out of date", path_.c_str());
+        return false;
+    }
+
+    std::list<Entry> fileentries;
+    auto ventries = g_variant_get_child_value(index.get(), 2);
+    GVariantIter entryiter;
+    g_variant_iter_init(&entryiter, ventries);
+    guchar backend = 0;
+    const gchar* package = nullptr;
+    const gchar* appname = nullptr;
+    const gchar* appversion = nullptr;
+    const gchar* interface = nullptr;
+    bool valid = true;
+    while (g_variant_iter_loop(&entryiter, "(y&s&s&s&s)", &backend, &package, &appname, &appversion, &interface))
+    {
+        switch (static_cast<Backend>(backend))
+        {
+            case Backend::CLICK:
+            case Backend::LEGACY:
+            case Backend::LIBERTINE:
+            case Backend::SNAP:
+                break;
+            default:
+                valid = false;
+                continue;
+        }
+
+        fileentries.emplace_back(Entry{static_cast<Backend>(backend),
+                                       AppID{AppID::Package::from_raw(package), AppID::AppName::from_raw(appname),
+                                             AppID::Version::from_raw(appversion)},
+                                       interface});
+    }
+    g_variant_unref(ventries);
+
+    if (!valid)
+    {
+        g_warning("Application index '%s' has entries with an unknown backend", path_.c_str());
+        return false;
+    }
+
+    g_debug("Read %d entries from application index '%s'", int(fileentries.size()), path_.c_str());
+    entries.splice(entries.end(), fileentries);
+    return true;
+}
+
+void ApplicationIndex::write(const Stamps& stamps, const std::list<Entry>& entries)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE(INDEX_TYPE));
+
+    g_variant_builder_add(&builder, "u", INDEX_VERSION);
+
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("a{ss}"));
+    for (const auto& stamp : stamps)
+    {
+        g_variant_builder_add(&builder, "{ss}", stamp.first.c_str(), stamp.second.c_str());
+    }
+    g_variant_builder_close(&builder);
+
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("a(yssss)"));
+    for (const auto& entry : entries)
+    {
+        g_variant_builder_add(&builder, "(yssss)", static_cast<guchar>(entry.backend),
+                              entry.appid.package.value().c_str(), entry.appid.appname.value().c_str(),
+                              entry.appid.version.value().c_str(), entry.interface.c_str());
+    }
+    g_variant_builder_close(&builder);
+
+    auto index = std::shared_ptr<GVariant>(g_variant_ref_sink(g_variant_builder_end(&builder)), g_variant_unref);
+
+    auto dirname = g_path_get_dirname(path_.c_str());
+    if (g_mkdir_with_parents(dirname, 0700) != 0)
+    {
+        g_warning("Unable to create directory for application index: %s", dirname);
+        g_free(dirname);
+        return;
+    }
+    g_free(dirname);
+
+    GError* error = nullptr;
+    g_file_set_contents(path_.c_str(),                                               /* filename */
+                        static_cast<const gchar*>(g_variant_get_data(index.get())), /* data */
+                        g_variant_get_size(index.get()),                             /* length */
+                        &error);                                                     /* error */
+
+    if (error != nullptr)
+    {
+        g_warning("Unable to write application index '%s': %s", path_.c_str(), error->message);
+        g_error_free(error);
+        return;
+    }
+
+    g_debug("Wrote %d entries to application index '%s'", int(entries.size()), path_.c_str());
+}
+
+void ApplicationIndex::invalidate()
+{
+    if (g_unlink(path_.c_str()) != 0 && errno != ENOENT)
+    {
+        g_warning("Unable to remove application index '%s'", path_.c_str());
+    }
+}
+
+std::string ApplicationIndex::fileStamp(const std::string& path)
+{
+    struct stat buf;
+    if (stat(path.c_str(), &buf) != 0)
+    {
+        return "none";
+    }
+
+    return std::to_string(buf.st_ino) + ":" + std::to_string(buf.st_mtim.tv_sec) + "." +
+           std::to_string(buf.st_mtim.tv_nsec);
+}
+
+std::string ApplicationIndex::directoryStamp(const std::string& path)
+{
+    auto stamp = fileStamp(path);
+
+    auto dir = g_dir_open(path.c_str(), 0, nullptr);
+    if (dir == nullptr)
+    {
+        return stamp;
+    }
+
+    /* Links are followed, the Click link farm changes with what it points to */
+    struct timespec newest = {0, 0};
+    const gchar* name;
+    while ((name = g_dir_read_name(dir)) != nullptr)
+    {
+        if (!g_str_has_suffix(name, ".desktop"))
+        {
+            continue;
+        }
+
+        struct stat buf;
+        if (stat((path + "/" + name).c_str(), &buf) != 0)
+        {
+            continue;
+        }
+
+        if (buf.st_mtim.tv_sec > newest.tv_sec ||
+            (buf.st_mtim.tv_sec == newest.tv_sec && buf.st_mtim.tv_nsec > newest.tv_nsec))
+        {
+            newest = buf.st_mtim;
+        }
+    }
+
+    g_dir_close(dir);
+
+    return stamp + "/" + std::to_string(newest.tv_sec) + "." + std::to_string(newest.tv_nsec);
+}
+
+std::string ApplicationIndex::defaultPath()
+{
+    if (g_getenv("UBUNTU_APP_LAUNCH_DISABLE_APP_INDEX") != nullptr)
+    {
+        return {};
+    }
+
+    auto envpath = g_getenv("UBUNTU_APP_LAUNCH_APP_INDEX");
+    if (G_UNLIKELY(envpath != nullptr))
+    {
+        return envpath;
+    }
+
+    auto cpath = g_build_filename(g_get_user_cache_dir(), "ubuntu-app-launch", "installed-apps.index", nullptr);
+    std::string path(cpath);
+    g_free(cpath);
+    return path;
+}
+
+}  // namespace app_launch
+}  // namespace ubuntu
@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#pragma once
+
+#include "appid.h"
+#include <list>
+#include <map>
+#include <string>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/** \brief On disk index of the installed applications
+
+    Building the list of installed applications requires looking at every
+    Click manifest, every desktop file in the XDG data directories, every
+    Libertine container and asking snapd about all of its interfaces. This
+    object stores the result of that in a single file in the user's cache
+    directory so that a later request can read that one file instead.
+
+    The file is a serialized GVariant so it is memory mapped on read. Along
+    with the entries it stores a set of stamps (directory modification times,
+    the snapd change ID, etc.) which are compared to the current stamps
+    to see whether the index is still valid. The Desktop information itself
+    is not stored, it is loaded by the application objects as they're created
+    so changes to the contents of a desktop file are always picked up.
+*/
+class ApplicationIndex
+{
+public:
+    /** Which application implementation the entry should be created with */
+    enum class Backend : unsigned char
+    {
+        CLICK = 'c',     /**< Click package, see app_impls::Click */
+        LEGACY = 'l',    /**< Legacy desktop file, see app_impls::Legacy */
+        LIBERTINE = 'b', /**< Libertine container, see app_impls::Libertine */
+        SNAP = 's',      /**< Snap package, see app_impls::Snap */
+    };
+
+    /** A single application in the index */
+    struct Entry
+    {
+        Backend backend;       /**< Implementation to use for the application */
+        AppID appid;           /**< Application ID */
+        std::string interface; /**< Interface for snaps, empty otherwise */
+    };
+
+    /** Values that describe the state of the system that the index was built
+        for. The key is typically a path and the value its modification time. */
+    typedef std::map<std::string, std::string> Stamps;
+
+    /** Create an index stored in a file
+
+        \param path Full path of the index file
+    */
+    explicit ApplicationIndex(const std::string& path);
+    virtual ~ApplicationIndex() = default;
+
+    /** Read the entries from the index file. Returns false if the
+        file doesn't exist, is of a different version or was built
+        with stamps that do not match the ones passed in.
+
+        \param stamps The current stamps of the system
+        \param entries List to put the entries into
+    */
+    bool read(const Stamps& stamps, std::list<Entry>& entries);
+
+    /** Write a new index file, replacing the current one atomically.
+
+        \param stamps The stamps of the system the entries were found with
+        \param entries The entries to store
+    */
+    void write(const Stamps& stamps, const std::list<Entry>& entries);
+
+    /** Remove the index file so that it is rebuilt on the next request */
+    void invalidate();
+
+    /** Helper to build a stamp for a file or directory out of its
+        modification time. Returns a constant value if the path
+        doesn't exist so that it being created later is noticed.
+
+        \param path Path to stat
+    */
+    static std::string fileStamp(const std::string& path);
+
+    /** Helper to build a stamp for a directory of desktop files. Along
+        with the directory's own stamp it has the newest modification
+        time of the desktop files in it, so that editing one in place
+        is noticed as well as adding or removing one.
+
+        \param path Path of the directory
+    */
+    static std::string directoryStamp(const std::string& path);
+
+    /** Default path for the index in the user's cache directory, or
+        empty if the index has been disabled in the environment. */
+    static std::string defaultPath();
+
+private:
+    /** Full path to the index file */
+    std::string path_;
+};
+
+}  // namespace app_launch
+}  // namespace ubuntu
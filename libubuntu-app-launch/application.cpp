@@ -21,6 +21,8 @@ extern "C" {
 #include "ubuntu-app-launch.h"
 }
 
+#include "appid-parser.h"
+#include "application-impl-base.h"
 #include "application-impl-click.h"
 #include "application-impl-legacy.h"
 #include "application-impl-libertine.h"
@@ -32,7 +34,6 @@ extern "C" {
 
 #include <functional>
 #include <iostream>
-#include <regex>
 
 namespace ubuntu
 {
@@ -70,6 +71,15 @@ std::shared_ptr<Application> Application::create(const AppID& appid, const std::
     }
 }
 
+void Application::prepareLaunch()
+{
+    auto base = dynamic_cast<app_impls::Base*>(this);
+    if (base != nullptr)
+    {
+        base->prepareLaunch();
+    }
+}
+
 AppID::AppID()
     : package(Package::from_raw({}))
     , appname(AppName::from_raw({}))
@@ -84,22 +94,14 @@ AppID::AppID(Package pkg, AppName app, Version ver)
 {
 }
 
-#define REGEX_PKGNAME "([a-z0-9][a-z0-9+.-]+)"
-#define REGEX_APPNAME "([A-Za-z0-9+-.:~-][\\sA-Za-z0-9+-.:~-]+)"
-#define REGEX_VERSION "([\\d+:]?[A-Za-z0-9.+:~-]+?(?:-[A-Za-z0-9+.~]+)?)"
-
-const std::regex full_appid_regex("^" REGEX_PKGNAME "_" REGEX_APPNAME "_" REGEX_VERSION "$");
-const std::regex short_appid_regex("^" REGEX_PKGNAME "_" REGEX_APPNAME "$");
-const std::regex legacy_appid_regex("^" REGEX_APPNAME "$");
-
 AppID AppID::parse(const std::string& sappid)
 {
-    std::smatch match;
+    auto parts = appid_parser::split(sappid);
 
-    if (std::regex_match(sappid, match, full_appid_regex))
+    if (parts.form == appid_parser::Form::FULL)
     {
-        return {AppID::Package::from_raw(match[1].str()), AppID::AppName::from_raw(match[2].str()),
-                AppID::Version::from_raw(match[3].str())};
+        return {AppID::Package::from_raw(parts.package.of(sappid)), AppID::AppName::from_raw(parts.appname.of(sappid)),
+                AppID::Version::from_raw(parts.version.of(sappid))};
     }
     else
     {
@@ -110,7 +112,7 @@ AppID AppID::parse(const std::string& sappid)
 
 bool AppID::valid(const std::string& sappid)
 {
-    return std::regex_match(sappid, full_appid_regex);
+    return appid_parser::split(sappid).form == appid_parser::Form::FULL;
 }
 
 AppID AppID::find(const std::string& sappid)
@@ -121,25 +123,23 @@ AppID AppID::find(const std::string& sappid)
 
 AppID AppID::find(const std::shared_ptr<Registry>& registry, const std::string& sappid)
 {
-    std::smatch match;
+    auto parts = appid_parser::split(sappid);
 
-    if (std::regex_match(sappid, match, full_appid_regex))
-    {
-        return {AppID::Package::from_raw(match[1].str()), AppID::AppName::from_raw(match[2].str()),
-                AppID::Version::from_raw(match[3].str())};
-    }
-    else if (std::regex_match(sappid, match, short_appid_regex))
+    switch (parts.form)
     {
-        return discover(registry, match[1].str(), match[2].str());
-    }
-    else if (std::regex_match(sappid, match, legacy_appid_regex))
-    {
-        return {AppID::Package::from_raw({}), AppID::AppName::from_raw(sappid), AppID::Version::from_raw({})};
-    }
-    else
-    {
-        return {AppID::Package::from_raw({}), AppID::AppName::from_raw({}), AppID::Version::from_raw({})};
+        case appid_parser::Form::FULL:
+            return {AppID::Package::from_raw(parts.package.of(sappid)),
+                    AppID::AppName::from_raw(parts.appname.of(sappid)),
+                    AppID::Version::from_raw(parts.version.of(sappid))};
+        case appid_parser::Form::SHORT:
+            return discover(registry, parts.package.of(sappid), parts.appname.of(sappid));
+        case appid_parser::Form::LEGACY:
+            return {AppID::Package::from_raw({}), AppID::AppName::from_raw(sappid), AppID::Version::from_raw({})};
+        case appid_parser::Form::INVALID:
+            break;
     }
+
+    return {AppID::Package::from_raw({}), AppID::AppName::from_raw({}), AppID::Version::from_raw({})};
 }
 
 AppID::operator std::string() const
@@ -355,6 +355,104 @@ AppID AppID::discover(const std::string& package, const std::string& appname, Ve
     return discover(registry, package, appname, versionwildcard);
 }
 
+/** Runs the work now and puts its result, or the exception it threw,
+    in an already satisfied future */
+template <typename T>
+static std::future<T> readyFuture(std::function<T()> work)
+{
+    std::promise<T> promise;
+    try
+    {
+        promise.set_value(work());
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+    return promise.get_future();
+}
+
+static std::future<void> readyFuture(std::function<void()> work)
+{
+    std::promise<void> promise;
+    try
+    {
+        work();
+        promise.set_value();
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+    }
+    return promise.get_future();
+}
+
+std::future<pid_t> Application::Instance::primaryPidAsync()
+{
+    auto upstart = dynamic_cast<app_impls::UpstartInstance*>(this);
+    if (upstart != nullptr)
+    {
+        return upstart->primaryPidAsync();
+    }
+
+    return readyFuture<pid_t>([this]() { return primaryPid(); });
+}
+
+std::future<std::vector<pid_t>> Application::Instance::pidsAsync()
+{
+    auto upstart = dynamic_cast<app_impls::UpstartInstance*>(this);
+    if (upstart != nullptr)
+    {
+        return upstart->pidsAsync();
+    }
+
+    return readyFuture<std::vector<pid_t>>([this]() { return pids(); });
+}
+
+std::future<void> Application::Instance::setOomAdjustmentAsync(const oom::Score score)
+{
+    auto upstart = dynamic_cast<app_impls::UpstartInstance*>(this);
+    if (upstart != nullptr)
+    {
+        return upstart->setOomAdjustmentAsync(score);
+    }
+
+    return readyFuture([this, score]() { setOomAdjustment(score); });
+}
+
+std::future<void> Application::Instance::pauseAsync()
+{
+    auto upstart = dynamic_cast<app_impls::UpstartInstance*>(this);
+    if (upstart != nullptr)
+    {
+        return upstart->pauseAsync();
+    }
+
+    return readyFuture([this]() { pause(); });
+}
+
+std::future<void> Application::Instance::resumeAsync()
+{
+    auto upstart = dynamic_cast<app_impls::UpstartInstance*>(this);
+    if (upstart != nullptr)
+    {
+        return upstart->resumeAsync();
+    }
+
+    return readyFuture([this]() { resume(); });
+}
+
+std::future<void> Application::Instance::stopAsync()
+{
+    auto upstart = dynamic_cast<app_impls::UpstartInstance*>(this);
+    if (upstart != nullptr)
+    {
+        return upstart->stopAsync();
+    }
+
+    return readyFuture([this]() { stop(); });
+}
+
 enum class oom::Score : std::int32_t
 {
     FOCUSED = 100,
@@ -17,6 +17,7 @@
  *     Ted Gould <ted.gould@canonical.com>
  */
 
+#include <future>
 #include <list>
 #include <memory>
 #include <sys/types.h>
@@ -251,6 +252,30 @@ public:
         /** Stop, or send SIGTERM, to the PIDs in this Application::Instance, if
             the PIDs do not respond to the SIGTERM they will be SIGKILL'd */
         virtual void stop() = 0;
+
+        /* Asynchronous versions */
+        /* These aren't virtual so that the layout of the class stays the
+           same. The instances the library makes do them without blocking,
+           other implementations get the synchronous function called and a
+           ready future returned. */
+        /** Get the primary PID without blocking, see primaryPid() */
+        std::future<pid_t> primaryPidAsync();
+        /** Get the PIDs without blocking, see pids() */
+        std::future<std::vector<pid_t>> pidsAsync();
+        /** Set the OOM Adjust value without blocking, the future is ready
+            once all of the processes have been adjusted. See setOomAdjustment() */
+        std::future<void> setOomAdjustmentAsync(const oom::Score score);
+        /** Pause without blocking, the future is ready once all of the PIDs
+            have been sent SIGSTOP. Many instances can be paused at once by
+            calling this on each of them before waiting on any. See pause() */
+        std::future<void> pauseAsync();
+        /** Resume without blocking, the future is ready once all of the PIDs
+            have been sent SIGCONT. See resume() */
+        std::future<void> resumeAsync();
+        /** Stop without blocking, the future is ready once the request
+            has been sent to the job system. The future holds an exception
+            if the request could not be sent. See stop() */
+        std::future<void> stopAsync();
     };
 
     /** A quick check to see if this application has any running instances */
@@ -269,6 +294,18 @@ public:
         \param urls A list of URLs to pass to the application command line
     */
     virtual std::shared_ptr<Instance> launchTest(const std::vector<URL>& urls = {}) = 0;
+
+    /** Resolve everything needed to launch the application ahead of
+        time, so that a later launch() or launchTest() only has to ask
+        the job system to start it. Useful to call when the application
+        is shown to the user, for instance as an icon in a launcher.
+        If the desktop file changes before the launch it is resolved
+        again. Does nothing for applications the library didn't make.
+
+        \note This blocks while the desktop file is read, it should not
+              be called on a latency sensitive thread.
+    */
+    void prepareLaunch();
 };
 
 }  // namespace app_launch
@@ -114,6 +114,11 @@ bool ContextThread::isCancelled()
     return g_cancellable_is_cancelled(_cancel.get()) == TRUE;
 }
 
+bool ContextThread::isCurrentThread()
+{
+    return std::this_thread::get_id() == _thread.get_id();
+}
+
 std::shared_ptr<GCancellable> ContextThread::getCancellable()
 {
     return _cancel;
@@ -152,6 +157,35 @@ void ContextThread::executeOnThread(std::function<void()> work)
     simpleSource(g_idle_source_new, work);
 }
 
+std::future<void> ContextThread::executeOnThreadAsync(std::function<void()> work)
+{
+    auto promise = std::make_shared<std::promise<void>>();
+    auto future = promise->get_future();
+    std::function<void()> magicFunc = [promise, work]() {
+        try
+        {
+            work();
+            promise->set_value();
+        }
+        catch (...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    };
+
+    if (std::this_thread::get_id() == _thread.get_id())
+    {
+        /* Callers may wait on the future, which would block us forever */
+        magicFunc();
+    }
+    else
+    {
+        executeOnThread(magicFunc);
+    }
+
+    return future;
+}
+
 void ContextThread::timeout(const std::chrono::milliseconds& length, std::function<void()> work)
 {
     simpleSource([length]() { return g_timeout_source_new(length.count()); }, work);
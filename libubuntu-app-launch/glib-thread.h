@@ -44,6 +44,7 @@ public:
 
     void quit();
     bool isCancelled();
+    bool isCurrentThread();
     std::shared_ptr<GCancellable> getCancellable();
 
     void executeOnThread(std::function<void()> work);
@@ -75,6 +76,36 @@ public:
         return future.get();
     }
 
+    std::future<void> executeOnThreadAsync(std::function<void()> work);
+    template <typename T>
+    auto executeOnThreadAsync(std::function<T()> work) -> std::future<T>
+    {
+        auto promise = std::make_shared<std::promise<T>>();
+        auto future = promise->get_future();
+        std::function<void()> magicFunc = [promise, work]() {
+            try
+            {
+                promise->set_value(work());
+            }
+            catch (...)
+            {
+                promise->set_exception(std::current_exception());
+            }
+        };
+
+        if (std::this_thread::get_id() == _thread.get_id())
+        {
+            /* Callers may wait on the future, which would block us forever */
+            magicFunc();
+        }
+        else
+        {
+            executeOnThread(magicFunc);
+        }
+
+        return future;
+    }
+
     void timeout(const std::chrono::milliseconds& length, std::function<void()> work);
     template <class Rep, class Period>
     void timeout(const std::chrono::duration<Rep, Period>& length, std::function<void()> work)
@@ -0,0 +1,126 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "keyfile-cache.h"
+
+#include <sys/stat.h>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+KeyfileCache::KeyfileCache(size_t maxEntries)
+    : maxEntries_(maxEntries)
+{
+}
+
+std::shared_ptr<GKeyFile> KeyfileCache::get(const std::string& path)
+{
+    struct stat buf;
+    if (stat(path.c_str(), &buf) != 0)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = entries_.find(path);
+        if (found != entries_.end())
+        {
+            lru_.erase(found->second.lruentry);
+            entries_.erase(found);
+        }
+        return {};
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = entries_.find(path);
+        if (found != entries_.end())
+        {
+            auto& entry = found->second;
+            if (entry.inode == buf.st_ino && entry.device == buf.st_dev && entry.size == buf.st_size &&
+                entry.mtime.tv_sec == buf.st_mtim.tv_sec && entry.mtime.tv_nsec == buf.st_mtim.tv_nsec)
+            {
+                hits_++;
+                lru_.splice(lru_.begin(), lru_, entry.lruentry);
+                return entry.keyfile;
+            }
+
+            lru_.erase(entry.lruentry);
+            entries_.erase(found);
+        }
+
+        misses_++;
+    }
+
+    /* Load without holding the lock, the worst case is that two threads
+       load the same file and one of them replaces the other's entry */
+    auto keyfile = std::shared_ptr<GKeyFile>(g_key_file_new(), g_key_file_free);
+    GError* error = nullptr;
+    g_key_file_load_from_file(keyfile.get(), path.c_str(), G_KEY_FILE_NONE, &error);
+
+    if (error != nullptr)
+    {
+        g_debug("Unable to load keyfile '%s' because: %s", path.c_str(), error->message);
+        g_error_free(error);
+        return {};
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+
+    auto found = entries_.find(path);
+    if (found != entries_.end())
+    {
+        lru_.erase(found->second.lruentry);
+        entries_.erase(found);
+    }
+
+    lru_.push_front(path);
+    entries_[path] = Entry{buf.st_ino, buf.st_dev, buf.st_size, buf.st_mtim, keyfile, lru_.begin()};
+
+    while (entries_.size() > maxEntries_)
+    {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+
+    g_debug("Keyfile cache loaded '%s' (hits: %lu, misses: %lu)", path.c_str(), hits_, misses_);
+
+    return keyfile;
+}
+
+void KeyfileCache::clear()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    entries_.clear();
+    lru_.clear();
+}
+
+unsigned long KeyfileCache::hits()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return hits_;
+}
+
+unsigned long KeyfileCache::misses()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return misses_;
+}
+
+}  // namespace app_launch
+}  // namespace ubuntu
@@ -0,0 +1,101 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/** \brief Cache of parsed desktop files
+
+    Application objects get created a lot, and each of them parses its
+    desktop file. This keeps the parsed GKeyFile objects around so that
+    creating the same application again only needs a stat() to check
+    that the file hasn't changed, which is done by comparing the inode,
+    size and modification time.
+
+    The keyfiles that are returned are shared, so they must not be
+    modified. The cache only holds a limited number of them, dropping
+    the ones that were used least recently. It can be used from any
+    thread.
+*/
+class KeyfileCache
+{
+public:
+    /** Create a cache
+
+        \param maxEntries Maximum number of keyfiles to hold on to
+    */
+    explicit KeyfileCache(size_t maxEntries);
+    virtual ~KeyfileCache() = default;
+
+    /** Get the parsed keyfile for a path, loading it if it isn't in the
+        cache or has changed since it was loaded. Returns null if the file
+        doesn't exist or can't be parsed.
+
+        \param path Full path to the keyfile
+    */
+    std::shared_ptr<GKeyFile> get(const std::string& path);
+
+    /** Drop all of the keyfiles */
+    void clear();
+
+    /** Number of requests that were answered from the cache */
+    unsigned long hits();
+    /** Number of requests that required loading the file */
+    unsigned long misses();
+
+private:
+    /** A keyfile along with what the file looked like when it was loaded */
+    struct Entry
+    {
+        ino_t inode;                               /**< Inode of the file */
+        dev_t device;                              /**< Device the file is on */
+        off_t size;                                /**< Size of the file */
+        struct timespec mtime;                     /**< Modification time of the file */
+        std::shared_ptr<GKeyFile> keyfile;         /**< The parsed file */
+        std::list<std::string>::iterator lruentry; /**< Position in the LRU list */
+    };
+
+    /** Protects everything below */
+    std::mutex lock_;
+    /** Most entries we'll keep */
+    size_t maxEntries_;
+    /** Cached keyfiles by path */
+    std::unordered_map<std::string, Entry> entries_;
+    /** Paths of the entries with the most recently used first */
+    std::list<std::string> lru_;
+    /** Count of cache hits */
+    unsigned long hits_ = 0;
+    /** Count of cache misses */
+    unsigned long misses_ = 0;
+};
+
+}  // namespace app_launch
+}  // namespace ubuntu
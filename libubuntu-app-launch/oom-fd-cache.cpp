@@ -0,0 +1,234 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+
+#include "oom-fd-cache.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <glib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+OomFdCache::OomFdCache(size_t maxEntries, const std::string& procdir)
+    : maxEntries_(maxEntries)
+    , procdir_(procdir)
+{
+}
+
+OomFdCache::~OomFdCache()
+{
+    clear();
+
+    if (procfd_ >= 0)
+    {
+        close(procfd_);
+    }
+}
+
+OomFdCache::Result OomFdCache::set(pid_t pid, std::int32_t value)
+{
+    if (pid <= 0)
+    {
+        return Result::GONE;
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+
+    auto found = entries_.find(pid);
+    if (found != entries_.end())
+    {
+        auto result = write(pid, found->second, value);
+        if (result != Result::GONE)
+        {
+            lru_.splice(lru_.begin(), lru_, found->second.lruentry);
+            return result;
+        }
+
+        /* The process we had open exited, but the PID could
+           belong to a new one by now */
+        drop(pid);
+    }
+
+    Entry entry;
+    auto result = open(pid, entry);
+    if (result != Result::WRITTEN)
+    {
+        return result;
+    }
+
+    lru_.push_front(pid);
+    entry.lruentry = lru_.begin();
+    entries_[pid] = entry;
+
+    result = write(pid, entry, value);
+    if (result == Result::GONE)
+    {
+        drop(pid);
+    }
+
+    while (entries_.size() > maxEntries_)
+    {
+        drop(lru_.back());
+    }
+
+    return result;
+}
+
+void OomFdCache::clear()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+
+    for (const auto& entry : entries_)
+    {
+        close(entry.second.fd);
+    }
+    entries_.clear();
+    lru_.clear();
+}
+
+size_t OomFdCache::size()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return entries_.size();
+}
+
+/** Opens the adjustment file of a process, returns WRITTEN when the
+    entry is ready to be used. Assumes the lock is held. */
+OomFdCache::Result OomFdCache::open(pid_t pid, Entry& entry)
+{
+    if (procfd_ < 0)
+    {
+        procfd_ = ::open(procdir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (procfd_ < 0)
+        {
+            g_debug("Unable to open proc directory '%s': %s", procdir_.c_str(), std::strerror(errno));
+            return Result::GONE;
+        }
+    }
+
+    auto path = std::to_string(pid) + "/oom_score_adj";
+    entry.fd = openat(procfd_, path.c_str(), O_RDWR | O_CLOEXEC);
+    if (entry.fd < 0)
+    {
+        int openerr = errno;
+        switch (openerr)
+        {
+            case ENOENT:
+                /* ENOENT happens a fair amount because of races, so it's not
+                   worth printing a warning about */
+                return Result::GONE;
+            case EACCES:
+                return Result::NO_ACCESS;
+            default:
+                g_warning("Unable to open OOM value for '%d': %s", int(pid), std::strerror(openerr));
+                return Result::FAILED;
+        }
+    }
+
+    /* Files in proc don't have a size, but regular files, like the
+       ones the test suite uses, need to be truncated or writing a
+       shorter value leaves the end of the old one behind */
+    struct stat filestat;
+    entry.truncate = fstat(entry.fd, &filestat) == 0 && S_ISREG(filestat.st_mode) && filestat.st_size > 0;
+
+    return Result::WRITTEN;
+}
+
+/** Reads the current value and writes the new one if it is different.
+    Assumes the lock is held. */
+OomFdCache::Result OomFdCache::write(pid_t pid, const Entry& entry, std::int32_t value)
+{
+    char current[16];
+    auto readsize = pread(entry.fd, current, sizeof(current) - 1, 0);
+    if (readsize < 0 && errno == ESRCH)
+    {
+        return Result::GONE;
+    }
+
+    if (readsize > 0)
+    {
+        current[readsize] = '\0';
+        char* end = nullptr;
+        auto currentval = strtol(current, &end, 10);
+        if (end != current && currentval == value)
+        {
+            return Result::UNCHANGED;
+        }
+    }
+
+    auto valuestr = std::to_string(value);
+    auto writesize = pwrite(entry.fd, valuestr.c_str(), valuestr.size(), 0);
+    if (writesize < 0)
+    {
+        int writeerr = errno;
+        switch (writeerr)
+        {
+            case ESRCH:
+                return Result::GONE;
+            case EACCES:
+                /* Lowering the value below the minimum for the process
+                   needs privileges that the helper has */
+                return Result::NO_ACCESS;
+            default:
+                g_warning("Unable to set OOM value for '%d' to '%s': %s", int(pid), valuestr.c_str(),
+                          std::strerror(writeerr));
+                return Result::FAILED;
+        }
+    }
+
+    if (size_t(writesize) != valuestr.size())
+    {
+        /* No error, but yet, wrong size. Not sure, what could cause this. */
+        g_debug("Unable to set OOM value for '%d' to '%s': Wrote %d bytes", int(pid), valuestr.c_str(),
+                int(writesize));
+        return Result::FAILED;
+    }
+
+    if (entry.truncate && ftruncate(entry.fd, writesize) != 0)
+    {
+        g_debug("Unable to truncate OOM value for '%d': %s", int(pid), std::strerror(errno));
+    }
+
+    return Result::WRITTEN;
+}
+
+/** Closes the file for a PID. Assumes the lock is held. */
+void OomFdCache::drop(pid_t pid)
+{
+    auto found = entries_.find(pid);
+    if (found == entries_.end())
+    {
+        return;
+    }
+
+    close(found->second.fd);
+    lru_.erase(found->second.lruentry);
+    entries_.erase(found);
+}
+
+}  // namespace app_launch
+}  // namespace ubuntu
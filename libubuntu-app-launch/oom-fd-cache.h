@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/** \brief Open OOM adjustment files of processes
+
+    The shell sets the OOM score of all the background applications
+    each time the focus changes, so opening /proc/<pid>/oom_score_adj
+    for every process every time adds up. This keeps the files open for
+    the processes that were set most recently, opened relative to a
+    handle on the proc directory.
+
+    A file in /proc belongs to the process it was opened for, not the
+    PID. When the process exits using it fails with ESRCH, even if the
+    PID has been reused, and the entry is dropped. The current value is
+    read before writing so processes already at the score are skipped.
+    It can be used from any thread.
+*/
+class OomFdCache
+{
+public:
+    /** What happened when setting a value */
+    enum class Result
+    {
+        WRITTEN,   /**< The new value was written */
+        UNCHANGED, /**< The process already had the value */
+        GONE,      /**< The process doesn't exist */
+        NO_ACCESS, /**< We're not allowed to change it, the helper is needed */
+        FAILED     /**< Some other error, which has been logged */
+    };
+
+    /** Create a cache
+
+        \param maxEntries Maximum number of files to keep open
+        \param procdir Where the proc filesystem is mounted
+    */
+    explicit OomFdCache(size_t maxEntries, const std::string& procdir = "/proc");
+    virtual ~OomFdCache();
+
+    /** Set the OOM score adjustment of a process
+
+        \param pid Process to change
+        \param value Value to set it to
+    */
+    Result set(pid_t pid, std::int32_t value);
+
+    /** Close all of the files */
+    void clear();
+
+    /** Number of files that are open */
+    size_t size();
+
+private:
+    /** An open adjustment file */
+    struct Entry
+    {
+        int fd;                              /**< File descriptor, read and write */
+        bool truncate;                       /**< Whether writes need to truncate, see open() */
+        std::list<pid_t>::iterator lruentry; /**< Position in the LRU list */
+    };
+
+    /** Protects everything below */
+    std::mutex lock_;
+    /** Most files we'll keep open */
+    size_t maxEntries_;
+    /** Where the proc filesystem is */
+    std::string procdir_;
+    /** Handle on the proc directory, -1 if it couldn't be opened */
+    int procfd_ = -1;
+    /** Open files by PID */
+    std::unordered_map<pid_t, Entry> entries_;
+    /** PIDs of the entries with the most recently used first */
+    std::list<pid_t> lru_;
+
+    Result open(pid_t pid, Entry& entry);
+    Result write(pid_t pid, const Entry& entry, std::int32_t value);
+    void drop(pid_t pid);
+};
+
+}  // namespace app_launch
+}  // namespace ubuntu
@@ -0,0 +1,225 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+
+#include "pid-job-cache.h"
+#include "helpers.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <glib.h>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+PidJobCache::PidJobCache(size_t maxEntries, const std::string& procdir)
+    : maxEntries_(maxEntries)
+    , procdir_(procdir)
+{
+}
+
+std::string PidJobCache::get(pid_t pid)
+{
+    unsigned long long starttime = 0;
+    if (pid <= 0 || !startTime(pid, starttime))
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = entries_.find(pid);
+        if (found != entries_.end())
+        {
+            lru_.erase(found->second.lruentry);
+            entries_.erase(found);
+        }
+        return {};
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto found = entries_.find(pid);
+        if (found != entries_.end())
+        {
+            auto& entry = found->second;
+            if (entry.starttime == starttime)
+            {
+                hits_++;
+                lru_.splice(lru_.begin(), lru_, entry.lruentry);
+                return entry.job;
+            }
+
+            lru_.erase(entry.lruentry);
+            entries_.erase(found);
+        }
+
+        misses_++;
+    }
+
+    gchar* contents = nullptr;
+    auto cgroupfile = procdir_ + "/" + std::to_string(pid) + "/cgroup";
+    if (!g_file_get_contents(cgroupfile.c_str(), &contents, nullptr, nullptr))
+    {
+        g_debug("Unable to read cgroups from '%s'", cgroupfile.c_str());
+        return {};
+    }
+
+    auto job = jobFromCgroups(contents);
+    g_free(contents);
+
+    /* The process could have exited and the PID been reused while we
+       were reading, in which case the start time won't match */
+    unsigned long long afterstart = 0;
+    if (!startTime(pid, afterstart) || afterstart != starttime)
+    {
+        return {};
+    }
+
+    std::lock_guard<std::mutex> guard(lock_);
+
+    auto found = entries_.find(pid);
+    if (found != entries_.end())
+    {
+        lru_.erase(found->second.lruentry);
+        entries_.erase(found);
+    }
+
+    lru_.push_front(pid);
+    entries_[pid] = Entry{starttime, job, lru_.begin()};
+
+    while (entries_.size() > maxEntries_)
+    {
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+
+    return job;
+}
+
+void PidJobCache::clear()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    entries_.clear();
+    lru_.clear();
+}
+
+unsigned long PidJobCache::hits()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return hits_;
+}
+
+unsigned long PidJobCache::misses()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    return misses_;
+}
+
+std::string PidJobCache::jobFromCgroups(const std::string& cgroups)
+{
+    gchar* cfreezerpath = nullptr;
+    gchar* cunifiedpath = nullptr;
+    cgroup_paths_parse(cgroups.c_str(), &cfreezerpath, &cunifiedpath);
+
+    std::string freezerpath = cfreezerpath != nullptr ? cfreezerpath : "";
+    std::string unifiedpath = cunifiedpath != nullptr ? cunifiedpath : "";
+    g_free(cfreezerpath);
+    g_free(cunifiedpath);
+
+    /* The job is the group right below 'upstart', anything under
+       that is a child group that the job made */
+    for (const auto& path : {freezerpath, unifiedpath})
+    {
+        auto upstart = path.find("/upstart/");
+        if (upstart == std::string::npos)
+        {
+            continue;
+        }
+
+        auto start = upstart + strlen("/upstart/");
+        auto end = path.find('/', start);
+        return path.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    }
+
+    return {};
+}
+
+/** Click jobs are the application ID, legacy and snap jobs have the
+    instance ID split off by the last dash. */
+std::string PidJobCache::appIdFromJob(const std::string& job)
+{
+    static const std::string click{"application-click-"};
+    if (job.compare(0, click.size(), click) == 0)
+    {
+        return job.substr(click.size());
+    }
+
+    for (const std::string multi : {"application-legacy-", "application-snap-"})
+    {
+        if (job.compare(0, multi.size(), multi) == 0)
+        {
+            auto dash = job.rfind('-');
+            if (dash < multi.size())
+            {
+                return {};
+            }
+            return job.substr(multi.size(), dash - multi.size());
+        }
+    }
+
+    return {};
+}
+
+/** Reads the start time of a process from its stat file. The name of
+    the process is in parentheses and can have spaces in it, so we count
+    the fields from the last parenthesis. */
+bool PidJobCache::startTime(pid_t pid, unsigned long long& starttime)
+{
+    gchar* contents = nullptr;
+    auto statfile = procdir_ + "/" + std::to_string(pid) + "/stat";
+    if (!g_file_get_contents(statfile.c_str(), &contents, nullptr, nullptr))
+    {
+        return false;
+    }
+
+    bool found = false;
+    auto fields = strrchr(contents, ')');
+    if (fields != nullptr)
+    {
+        /* The start time is the 22nd field and the name is the 2nd, so
+           it is after the 19th space following the parenthesis */
+        auto field = fields + 1;
+        for (int i = 0; i < 19 && field != nullptr; i++)
+        {
+            field = strchr(field + 1, ' ');
+        }
+
+        if (field != nullptr)
+        {
+            gchar* end = nullptr;
+            starttime = strtoull(field + 1, &end, 10);
+            found = end != field + 1;
+        }
+    }
+
+    g_free(contents);
+    return found;
+}
+
+}  // namespace app_launch
+}  // namespace ubuntu
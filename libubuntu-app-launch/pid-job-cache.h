@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/** \brief Cache of the Upstart job each process is in
+
+    Finding the application that owns a process used to mean getting
+    the PIDs of every application and looking through them. Instead
+    this reads /proc/<pid>/cgroup, which names the Upstart job's cgroup
+    in the freezer or unified hierarchy, so one small file tells us.
+
+    The answers are kept for the processes that were asked about most
+    recently. An entry is checked against the start time of the process
+    each time it is used, so when the process exits, or the PID is reused,
+    the entry is dropped. It can be used from any thread.
+*/
+class PidJobCache
+{
+public:
+    /** Create a cache
+
+        \param maxEntries Maximum number of processes to remember
+        \param procdir Where the proc filesystem is mounted
+    */
+    explicit PidJobCache(size_t maxEntries, const std::string& procdir = "/proc");
+    virtual ~PidJobCache() = default;
+
+    /** Get the name of the Upstart job that a process is in, which is
+        the name of its cgroup under 'upstart', for instance
+        'application-click-com.test.good_application_1.2.3'. Returns an
+        empty string if the process doesn't exist or isn't in a job.
+
+        \param pid Process to look up
+    */
+    std::string get(pid_t pid);
+
+    /** Drop all of the entries */
+    void clear();
+
+    /** Number of requests that were answered from the cache */
+    unsigned long hits();
+    /** Number of requests that required reading the cgroups */
+    unsigned long misses();
+
+    /** Find the Upstart job in the contents of a cgroup file. The
+        freezer hierarchy is preferred, then the unified one.
+
+        \param cgroups Contents of a /proc/<pid>/cgroup file
+    */
+    static std::string jobFromCgroups(const std::string& cgroups);
+
+    /** Get the application ID from the name of an Upstart job. Click
+        jobs are just the application ID, the others have the instance
+        ID after it. Returns an empty string for jobs that aren't
+        applications.
+
+        \param job Name of the job, as returned by get()
+    */
+    static std::string appIdFromJob(const std::string& job);
+
+    /** Get when a process started, in clock ticks after boot. Returns
+        false if the process doesn't exist.
+
+        \param pid Process to look up
+        \param starttime Set to the start time of the process
+    */
+    bool startTime(pid_t pid, unsigned long long& starttime);
+
+private:
+    /** The job of a process along with when the process started */
+    struct Entry
+    {
+        unsigned long long starttime;        /**< Start time of the process in clock ticks after boot */
+        std::string job;                     /**< Name of the job, empty if it isn't in one */
+        std::list<pid_t>::iterator lruentry; /**< Position in the LRU list */
+    };
+
+    /** Protects everything below */
+    std::mutex lock_;
+    /** Most entries we'll keep */
+    size_t maxEntries_;
+    /** Where the proc filesystem is */
+    std::string procdir_;
+    /** Cached jobs by PID */
+    std::unordered_map<pid_t, Entry> entries_;
+    /** PIDs of the entries with the most recently used first */
+    std::list<pid_t> lru_;
+    /** Count of cache hits */
+    unsigned long hits_ = 0;
+    /** Count of cache misses */
+    unsigned long misses_ = 0;
+};
+
+}  // namespace app_launch
+}  // namespace ubuntu
@@ -0,0 +1,374 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "pid-source.h"
+#include "helpers.h"
+
+#include <cerrno>
+#include <cgmanager/cgmanager.h>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/************************
+ ** Cgroup filesystem
+ ************************/
+
+CgroupfsPidSource::CgroupfsPidSource(const std::string& basedir)
+    : basedir_(basedir)
+{
+}
+
+bool CgroupfsPidSource::pidsForGroup(const std::string& group, std::vector<pid_t>& pids)
+{
+    std::string dir = basedir_;
+    if (!group.empty())
+    {
+        dir += "/" + group;
+    }
+
+    /* The job may not be running, or may be in a group we can't see,
+       so let the next source have a go */
+    if (!g_file_test(dir.c_str(), G_FILE_TEST_IS_DIR))
+    {
+        return false;
+    }
+
+    pidsForDir(dir, pids);
+    return true;
+}
+
+bool CgroupfsPidSource::freezeGroup(const std::string& group, bool freeze, bool wait)
+{
+    std::string dir = basedir_;
+    if (!group.empty())
+    {
+        dir += "/" + group;
+    }
+
+    /* The file to write, and the file and line that say when it is done */
+    std::string control;
+    std::string value;
+    std::string status;
+    std::string done;
+
+    if (g_file_test((dir + "/freezer.state").c_str(), G_FILE_TEST_EXISTS))
+    {
+        control = status = dir + "/freezer.state";
+        value = done = freeze ? "FROZEN" : "THAWED";
+    }
+    else if (g_file_test((dir + "/cgroup.freeze").c_str(), G_FILE_TEST_EXISTS))
+    {
+        control = dir + "/cgroup.freeze";
+        value = freeze ? "1" : "0";
+        status = dir + "/cgroup.events";
+        done = freeze ? "frozen 1" : "frozen 0";
+    }
+    else
+    {
+        return false;
+    }
+
+    if (!writeValue(control, value))
+    {
+        return false;
+    }
+
+    if (!wait)
+    {
+        return true;
+    }
+
+    /* Freezing can take a moment as each process has to get to a point
+       where it can be frozen, thawing is immediate */
+    for (int i = 0; i < 100; i++)
+    {
+        gchar* contents = nullptr;
+        if (!g_file_get_contents(status.c_str(), &contents, nullptr, nullptr))
+        {
+            break;
+        }
+
+        auto lines = g_strsplit(contents, "\n", -1);
+        g_free(contents);
+        bool found = g_strv_contains(lines, done.c_str());
+        g_strfreev(lines);
+
+        if (found)
+        {
+            return true;
+        }
+
+        g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+    }
+
+    /* Don't leave it half frozen when the processes get signaled instead */
+    g_warning("Timeout waiting for cgroup '%s' to be %s", dir.c_str(), freeze ? "frozen" : "thawed");
+    if (freeze)
+    {
+        writeValue(control, status == control ? "THAWED" : "0");
+    }
+    return false;
+}
+
+/** Writes a value to a cgroup control file. These have to be written
+    in place, not with a temporary file like g_file_set_contents() does. */
+bool CgroupfsPidSource::writeValue(const std::string& path, const std::string& value)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+    if (fd < 0)
+    {
+        g_debug("Unable to open '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool written = write(fd, value.c_str(), value.size()) == ssize_t(value.size());
+    if (!written)
+    {
+        g_debug("Unable to write '%s' to '%s': %s", value.c_str(), path.c_str(), strerror(errno));
+    }
+
+    close(fd);
+    return written;
+}
+
+/** Reads the cgroup.procs file in a directory and then looks for child
+    groups to read as well. */
+void CgroupfsPidSource::pidsForDir(const std::string& dir, std::vector<pid_t>& pids)
+{
+    gchar* procs = nullptr;
+    if (g_file_get_contents((dir + "/cgroup.procs").c_str(), &procs, nullptr, nullptr))
+    {
+        gchar* line = procs;
+        while (*line != '\0')
+        {
+            gchar* end = nullptr;
+            auto pid = strtol(line, &end, 10);
+            if (end == line)
+            {
+                break;
+            }
+            if (pid > 0)
+            {
+                pids.push_back(pid_t(pid));
+            }
+            line = end;
+            while (*line == '\n')
+            {
+                line++;
+            }
+        }
+        g_free(procs);
+    }
+
+    auto pdir = opendir(dir.c_str());
+    if (pdir == nullptr)
+    {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(pdir)) != nullptr)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        std::string child = dir + "/" + entry->d_name;
+
+        bool isdir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN)
+        {
+            struct stat buf;
+            isdir = lstat(child.c_str(), &buf) == 0 && S_ISDIR(buf.st_mode);
+        }
+
+        if (isdir)
+        {
+            pidsForDir(child, pids);
+        }
+    }
+
+    closedir(pdir);
+}
+
+std::shared_ptr<CgroupfsPidSource> CgroupfsPidSource::forSelf(const std::string& mountpoint,
+                                                              const std::string& selfcgroup)
+{
+    gchar* contents = nullptr;
+    if (!g_file_get_contents(selfcgroup.c_str(), &contents, nullptr, nullptr))
+    {
+        g_debug("Unable to read cgroups from '%s'", selfcgroup.c_str());
+        return {};
+    }
+
+    gchar* cfreezerpath = nullptr;
+    gchar* cunifiedpath = nullptr;
+    cgroup_paths_parse(contents, &cfreezerpath, &cunifiedpath);
+    g_free(contents);
+
+    std::string freezerpath = cfreezerpath != nullptr ? cfreezerpath : "";
+    std::string unifiedpath = cunifiedpath != nullptr ? cunifiedpath : "";
+    g_free(cfreezerpath);
+    g_free(cunifiedpath);
+
+    auto isDir = [](const std::string& path) { return g_file_test(path.c_str(), G_FILE_TEST_IS_DIR); };
+
+    if (!freezerpath.empty() && isDir(mountpoint + "/freezer" + freezerpath))
+    {
+        g_debug("Using cgroup v1 freezer hierarchy at '%s'", (mountpoint + "/freezer" + freezerpath).c_str());
+        return std::make_shared<CgroupfsPidSource>(mountpoint + "/freezer" + freezerpath);
+    }
+
+    if (!unifiedpath.empty())
+    {
+        /* Either the whole mount is unified or it is a hybrid setup
+           with the unified hierarchy next to the v1 controllers */
+        for (const auto& unified : {mountpoint, mountpoint + "/unified"})
+        {
+            if (g_file_test((unified + "/cgroup.controllers").c_str(), G_FILE_TEST_EXISTS) &&
+                isDir(unified + unifiedpath))
+            {
+                g_debug("Using cgroup v2 unified hierarchy at '%s'", (unified + unifiedpath).c_str());
+                return std::make_shared<CgroupfsPidSource>(unified + unifiedpath);
+            }
+        }
+    }
+
+    g_debug("No usable cgroup hierarchy under '%s'", mountpoint.c_str());
+    return {};
+}
+
+/************************
+ ** CGManager
+ ************************/
+
+CGManagerPidSource::CGManagerPidSource(GLib::ContextThread& thread, const std::shared_ptr<GDBusConnection>& session)
+    : thread_(thread)
+    , session_(session)
+{
+}
+
+/** Initialize the CGManager connection, including a timeout to disconnect
+    as CGManager doesn't free resources entirely well. So it's better if
+    we connect and disconnect occationally */
+void CGManagerPidSource::initCGManager()
+{
+    if (cgManager_)
+        return;
+
+    cgManager_ = thread_.executeOnThread<std::shared_ptr<GDBusConnection>>([this]() {
+        bool use_session_bus = g_getenv("UBUNTU_APP_LAUNCH_CG_MANAGER_SESSION_BUS") != nullptr;
+        if (use_session_bus)
+        {
+            /* For working dbusmock */
+            g_debug("Connecting to CG Manager on session bus");
+            return session_;
+        }
+
+        auto cancel =
+            std::shared_ptr<GCancellable>(g_cancellable_new(), [](GCancellable* cancel) { g_clear_object(&cancel); });
+
+        /* Ensure that we do not wait for more than a second */
+        thread_.timeoutSeconds(std::chrono::seconds{1}, [cancel]() { g_cancellable_cancel(cancel.get()); });
+
+        GError* error = nullptr;
+        auto retval = std::shared_ptr<GDBusConnection>(
+            g_dbus_connection_new_for_address_sync(CGMANAGER_DBUS_PATH,                           /* cgmanager path */
+                                                   G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, /* flags */
+                                                   nullptr,                                       /* Auth Observer */
+                                                   cancel.get(),                                  /* Cancellable */
+                                                   &error),
+            [](GDBusConnection* con) { g_clear_object(&con); });
+
+        if (error != nullptr)
+        {
+            g_warning("Unable to get CGManager connection: %s", error->message);
+            g_error_free(error);
+        }
+
+        return retval;
+    });
+
+    /* NOTE: This will execute on the thread */
+    thread_.timeoutSeconds(std::chrono::seconds{10}, [this]() { cgManager_.reset(); });
+}
+
+/** Uses the CGManager connection to list all of the PIDs. It is important to
+    note that this is an IPC call, so it can by its nature, be racy. Once the
+    message has been sent the group can change. */
+bool CGManagerPidSource::pidsForGroup(const std::string& group, std::vector<pid_t>& pids)
+{
+    initCGManager();
+    auto lmanager = cgManager_; /* Grab a local copy so we ensure it lasts through our lifetime */
+
+    return thread_.executeOnThread<bool>([&group, &pids, lmanager]() {
+        GError* error = nullptr;
+        const gchar* name = g_getenv("UBUNTU_APP_LAUNCH_CG_MANAGER_NAME");
+
+        g_debug("Looking for cg manager '%s' group '%s'", name, group.c_str());
+
+        GVariant* vtpids = g_dbus_connection_call_sync(
+            lmanager.get(),                                     /* connection */
+            name,                                               /* bus name for direct connection is NULL */
+            "/org/linuxcontainers/cgmanager",                   /* object */
+            "org.linuxcontainers.cgmanager0_0",                 /* interface */
+            "GetTasksRecursive",                                /* method */
+            g_variant_new("(ss)", "freezer", group.c_str()),    /* params */
+            G_VARIANT_TYPE("(ai)"),                             /* output */
+            G_DBUS_CALL_FLAGS_NONE,                             /* flags */
+            -1,                                                 /* default timeout */
+            nullptr,                                            /* cancellable */
+            &error);                                            /* error */
+
+        if (error != nullptr)
+        {
+            g_warning("Unable to get PID list from cgroup manager: %s", error->message);
+            g_error_free(error);
+            return false;
+        }
+
+        GVariant* vpids = g_variant_get_child_value(vtpids, 0);
+        GVariantIter iter;
+        g_variant_iter_init(&iter, vpids);
+        gint32 pid;
+
+        while (g_variant_iter_loop(&iter, "i", &pid))
+        {
+            pids.push_back(pid);
+        }
+
+        g_variant_unref(vpids);
+        g_variant_unref(vtpids);
+
+        return true;
+    });
+}
+
+}  // namespace app_launch
+}  // namespace ubuntu
@@ -0,0 +1,141 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#pragma once
+
+#include "glib-thread.h"
+#include <gio/gio.h>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace ubuntu
+{
+namespace app_launch
+{
+
+/** \brief Source for the PIDs that are in a cgroup
+
+    Group names are relative to the cgroup of the calling process, as
+    CGManager has always treated them, so an empty group name is our
+    own cgroup. The PIDs of all the child groups are included.
+*/
+class PidSource
+{
+public:
+    virtual ~PidSource() = default;
+
+    /** Get the PIDs in a group. Returns false if the source is unable
+        to answer for the group so that another source can be tried.
+
+        \param group Name of the group relative to ours
+        \param pids Vector to add the PIDs to
+    */
+    virtual bool pidsForGroup(const std::string& group, std::vector<pid_t>& pids) = 0;
+
+    /** Freeze or thaw all the processes in a group with the freezer
+        controller. Returns false if the source is unable to do that for
+        the group, in which case the processes need to be signaled instead.
+
+        \param group Name of the group relative to ours
+        \param freeze Whether to freeze or thaw the group
+        \param wait Whether to wait for all the processes to be frozen
+    */
+    virtual bool freezeGroup(const std::string& group, bool freeze, bool wait)
+    {
+        return false;
+    }
+};
+
+/** \brief Reads PIDs directly from the cgroup filesystem
+
+    Looks at the cgroup.procs files in the freezer hierarchy for cgroup v1,
+    or in the unified hierarchy for cgroup v2. No IPC is involved so this
+    is a couple of file reads instead of a round trip to CGManager.
+*/
+class CgroupfsPidSource : public PidSource
+{
+public:
+    /** Create a source that looks for groups in a directory
+
+        \param basedir Directory of our own cgroup in the hierarchy
+    */
+    explicit CgroupfsPidSource(const std::string& basedir);
+
+    /** Reads the PIDs of the group and its children. Returns false if
+        there is no directory for the group. */
+    bool pidsForGroup(const std::string& group, std::vector<pid_t>& pids) override;
+    /** Writes freezer.state for cgroup v1 or cgroup.freeze for cgroup v2.
+        Waiting polls freezer.state or cgroup.events until the kernel says
+        the group is frozen, for up to a second. If it isn't by then the
+        group is thawed again and false is returned. */
+    bool freezeGroup(const std::string& group, bool freeze, bool wait) override;
+
+    /** Find the directory of our own cgroup by looking at the cgroups we're
+        in and the hierarchies mounted. The freezer hierarchy is preferred
+        as that is the one Upstart puts jobs in. Returns null if neither
+        a freezer or unified hierarchy can be found.
+
+        \param mountpoint Where the cgroup hierarchies are mounted
+        \param selfcgroup File listing the cgroups of this process
+    */
+    static std::shared_ptr<CgroupfsPidSource> forSelf(const std::string& mountpoint,
+                                                      const std::string& selfcgroup = "/proc/self/cgroup");
+
+private:
+    /** Directory of our cgroup in the hierarchy */
+    std::string basedir_;
+
+    static void pidsForDir(const std::string& dir, std::vector<pid_t>& pids);
+    static bool writeValue(const std::string& path, const std::string& value);
+};
+
+/** \brief Asks CGManager over DBus for the PIDs
+
+    This is the way it has always been done, and is kept as a fallback
+    for when the cgroup filesystem isn't available to us. The connection
+    is dropped after ten seconds as CGManager doesn't free its resources
+    entirely well, so it is better to reconnect occasionally.
+*/
+class CGManagerPidSource : public PidSource
+{
+public:
+    /** Create a source that uses CGManager
+
+        \param thread Thread to make the DBus calls on
+        \param session Session bus to use when testing with a mock
+    */
+    CGManagerPidSource(GLib::ContextThread& thread, const std::shared_ptr<GDBusConnection>& session);
+
+    bool pidsForGroup(const std::string& group, std::vector<pid_t>& pids) override;
+
+private:
+    /** Thread that is shared with the registry */
+    GLib::ContextThread& thread_;
+    /** Session bus for talking to a mock CGManager */
+    std::shared_ptr<GDBusConnection> session_;
+    /** Connection to CGManager, null if we're not connected */
+    std::shared_ptr<GDBusConnection> cgManager_;
+
+    void initCGManager();
+};
+
+}  // namespace app_launch
+}  // namespace ubuntu
@@ -19,7 +19,19 @@
 
 #include "registry-impl.h"
 #include "application-icon-finder.h"
-#include <cgmanager/cgmanager.h>
+#include "application-impl-base.h"
+#include "application-impl-click.h"
+#include "application-impl-legacy.h"
+#include "application-impl-libertine.h"
+#ifdef ENABLE_SNAPPY
+#include "application-impl-snap.h"
+#endif
+#include "libertine.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <future>
+#include <unistd.h>
 #include <upstart.h>
 
 namespace ubuntu
@@ -27,6 +39,22 @@ namespace ubuntu
 namespace app_launch
 {
 
+/** Number of desktop files to keep parsed, enough for all the applications
+    on a typical phone to not need reloading */
+static const size_t KEYFILE_CACHE_SIZE = 128;
+
+/** Number of processes to remember the job of, enough for all the
+    clients that connect to the shell at once */
+static const size_t PID_JOB_CACHE_SIZE = 64;
+
+/** Number of OOM adjustment files to keep open, enough for the processes
+    of all the applications that the shell keeps in the background */
+static const size_t OOM_FD_CACHE_SIZE = 128;
+
+/** How long to wait after an application directory changes before
+    looking at it, as installing a package makes a burst of changes */
+static const std::chrono::milliseconds INSTALLED_SETTLE_TIME{500};
+
 Registry::Impl::Impl(Registry* registry)
     : thread([]() {},
              [this]() {
@@ -34,7 +62,45 @@ Registry::Impl::Impl(Registry* registry)
                  _clickDB.reset();
 
                  zgLog_.reset();
-                 cgManager_.reset();
+                 oomFdCache_.reset();
+                 pidSources_.clear();
+                 _iconFinders.clear();
+
+                 if (_dbus)
+                 {
+                     clearUpstartInstances();
+                     for (auto signal : upstartInstanceSignals_)
+                     {
+                         g_dbus_connection_signal_unsubscribe(_dbus.get(), signal);
+                     }
+                     upstartInstanceSignals_.clear();
+
+                     if (busNameSignal_ != 0)
+                     {
+                         g_dbus_connection_signal_unsubscribe(_dbus.get(), busNameSignal_);
+                         busNameSignal_ = 0;
+                     }
+                     busNamePids_.clear();
+                     busNamesUnresolved_.clear();
+                     busNamesWaiting_.clear();
+                     busNamesListing_ = false;
+                     busNamesLookups_ = 0;
+
+                     for (auto signal : lifecycleSignals_)
+                     {
+                         g_dbus_connection_signal_unsubscribe(_dbus.get(), signal);
+                     }
+                     lifecycleSignals_.clear();
+                     lifecyclePending_.clear();
+                 }
+
+                 installedWatching_ = false;
+                 installedMonitors_.clear();
+                 installedStates_.clear();
+                 if (installedRescan_.valid())
+                 {
+                     installedRescan_.wait();
+                 }
 
                  if (_dbus)
                      g_dbus_connection_flush_sync(_dbus.get(), nullptr, nullptr);
@@ -44,11 +110,33 @@ Registry::Impl::Impl(Registry* registry)
     , _iconFinders()
 // _manager(nullptr)
 {
+    keyfileCache_ = std::make_shared<KeyfileCache>(KEYFILE_CACHE_SIZE);
+    /* Set by the test suite, probably not anyone else */
+    auto procpath = g_getenv("UBUNTU_APP_LAUNCH_PID_PROC_PATH");
+    pidJobCache_ = std::make_shared<PidJobCache>(PID_JOB_CACHE_SIZE, procpath != nullptr ? procpath : "/proc");
+
+    auto indexpath = ApplicationIndex::defaultPath();
+    if (!indexpath.empty())
+    {
+        appIndex_ = std::make_shared<ApplicationIndex>(indexpath);
+    }
+
     auto cancel = thread.getCancellable();
     _dbus = thread.executeOnThread<std::shared_ptr<GDBusConnection>>([cancel]() {
         return std::shared_ptr<GDBusConnection>(g_bus_get_sync(G_BUS_TYPE_SESSION, cancel.get(), nullptr),
                                                 [](GDBusConnection* bus) { g_clear_object(&bus); });
     });
+
+    const gchar* cgroupRoot = g_getenv("UBUNTU_APP_LAUNCH_CGROUP_ROOT");
+    auto cgroupfs = CgroupfsPidSource::forSelf(cgroupRoot != nullptr ? cgroupRoot : "/sys/fs/cgroup");
+    if (cgroupfs)
+    {
+        pidSources_.push_back(cgroupfs);
+    }
+    pidSources_.push_back(std::make_shared<CGManagerPidSource>(thread, _dbus));
+
+    useFreezer_ = g_getenv("UBUNTU_APP_LAUNCH_DISABLE_FREEZER") == nullptr;
+    waitFreezer_ = g_getenv("UBUNTU_APP_LAUNCH_FREEZER_WAIT") != nullptr;
 }
 
 void Registry::Impl::initClick()
@@ -214,107 +302,55 @@ std::string Registry::Impl::getClickDir(const std::string& package)
     });
 }
 
-/** Initialize the CGManager connection, including a timeout to disconnect
-    as CGManager doesn't free resources entirely well. So it's better if
-    we connect and disconnect occationally */
-void Registry::Impl::initCGManager()
-{
-    if (cgManager_)
-        return;
-
-    cgManager_ = thread.executeOnThread<std::shared_ptr<GDBusConnection>>([this]() {
-        bool use_session_bus = g_getenv("UBUNTU_APP_LAUNCH_CG_MANAGER_SESSION_BUS") != nullptr;
-        if (use_session_bus)
-        {
-            /* For working dbusmock */
-            g_debug("Connecting to CG Manager on session bus");
-            return _dbus;
-        }
-
-        auto cancel =
-            std::shared_ptr<GCancellable>(g_cancellable_new(), [](GCancellable* cancel) { g_clear_object(&cancel); });
-
-        /* Ensure that we do not wait for more than a second */
-        thread.timeoutSeconds(std::chrono::seconds{1}, [cancel]() { g_cancellable_cancel(cancel.get()); });
-
-        GError* error = nullptr;
-        auto retval = std::shared_ptr<GDBusConnection>(
-            g_dbus_connection_new_for_address_sync(CGMANAGER_DBUS_PATH,                           /* cgmanager path */
-                                                   G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT, /* flags */
-                                                   nullptr,                                       /* Auth Observer */
-                                                   cancel.get(),                                  /* Cancellable */
-                                                   &error),
-            [](GDBusConnection* con) { g_clear_object(&con); });
-
-        if (error != nullptr)
-        {
-            g_warning("Unable to get CGManager connection: %s", error->message);
-            g_error_free(error);
-        }
-
-        return retval;
-    });
-
-    /* NOTE: This will execute on the thread */
-    thread.timeoutSeconds(std::chrono::seconds{10}, [this]() { cgManager_.reset(); });
-}
-
-/** Get a list of PIDs from a CGroup, uses the CGManager connection to list
-    all of the PIDs. It is important to note that this is an IPC call, so it can
-    by its nature, be racy. Once the message has been sent the group can change.
-    You should take that into account in your usage of it. */
+/** Get a list of PIDs from a CGroup. The sources are tried in order, so
+    the cgroup filesystem is used when we can find our group in it and
+    CGManager otherwise. Either way the group can change as soon as we've
+    looked at it, so you should take that into account in your usage of it. */
 std::vector<pid_t> Registry::Impl::pidsFromCgroup(const std::string& jobpath)
 {
-    initCGManager();
-    auto lmanager = cgManager_; /* Grab a local copy so we ensure it lasts through our lifetime */
+    std::string groupname;
+    if (!jobpath.empty())
+    {
+        groupname = "upstart/" + jobpath;
+    }
 
-    return thread.executeOnThread<std::vector<pid_t>>([&jobpath, lmanager]() -> std::vector<pid_t> {
-        GError* error = nullptr;
-        const gchar* name = g_getenv("UBUNTU_APP_LAUNCH_CG_MANAGER_NAME");
-        std::string groupname;
-        if (!jobpath.empty())
+    for (const auto& source : pidSources_)
+    {
+        std::vector<pid_t> pids;
+        if (source->pidsForGroup(groupname, pids))
         {
-            groupname = "upstart/" + jobpath;
+            return pids;
         }
+    }
 
-        g_debug("Looking for cg manager '%s' group '%s'", name, groupname.c_str());
-
-        GVariant* vtpids = g_dbus_connection_call_sync(
-            lmanager.get(),                     /* connection */
-            name,                               /* bus name for direct connection is NULL */
-            "/org/linuxcontainers/cgmanager",   /* object */
-            "org.linuxcontainers.cgmanager0_0", /* interface */
-            "GetTasksRecursive",                /* method */
-            g_variant_new("(ss)", "freezer", groupname.empty() ? "" : groupname.c_str()), /* params */
-            G_VARIANT_TYPE("(ai)"),                                                       /* output */
-            G_DBUS_CALL_FLAGS_NONE,                                                       /* flags */
-            -1,                                                                           /* default timeout */
-            nullptr,                                                                      /* cancellable */
-            &error);                                                                      /* error */
+    return {};
+}
 
-        if (error != nullptr)
-        {
-            g_warning("Unable to get PID list from cgroup manager: %s", error->message);
-            g_error_free(error);
-            return {};
-        }
+/** Freezes or thaws all the processes of a job in one go using the
+    freezer cgroup. Returns false if that can't be done, or has been
+    disabled by setting UBUNTU_APP_LAUNCH_DISABLE_FREEZER, in which case
+    the processes need to be signaled. Setting UBUNTU_APP_LAUNCH_FREEZER_WAIT
+    makes this wait until the kernel has frozen them all.
 
-        GVariant* vpids = g_variant_get_child_value(vtpids, 0);
-        GVariantIter iter;
-        g_variant_iter_init(&iter, vpids);
-        gint32 pid;
-        std::vector<pid_t> pids;
+    \param jobpath Name of the job's cgroup
+    \param freeze Whether to freeze or thaw the job
+*/
+bool Registry::Impl::freezeCgroup(const std::string& jobpath, bool freeze)
+{
+    if (!useFreezer_ || jobpath.empty())
+    {
+        return false;
+    }
 
-        while (g_variant_iter_loop(&iter, "i", &pid))
+    for (const auto& source : pidSources_)
+    {
+        if (source->freezeGroup("upstart/" + jobpath, freeze, waitFreezer_))
         {
-            pids.push_back(pid);
+            return true;
         }
+    }
 
-        g_variant_unref(vpids);
-        g_variant_unref(vtpids);
-
-        return pids;
-    });
+    return false;
 }
 
 /** Looks to find the Upstart object path for a specific Upstart job. This first
@@ -369,164 +405,2136 @@ std::string Registry::Impl::upstartJobPath(const std::string& job)
     }
 }
 
-/** Queries Upstart to get all the instances of a given job. This
-    can take a while as the number of dbus calls is n+1. It is
-    rare that apps have many instances though. */
-std::list<std::string> Registry::Impl::upstartInstancesForJob(const std::string& job)
+/** A GetAll call on an Upstart instance made by fetchUpstartInstance() */
+struct UpstartInstanceCall
 {
-    std::string jobpath = upstartJobPath(job);
-    if (jobpath.empty())
+    Registry::Impl* impl;  /**< Registry to put the results in */
+    std::string job;       /**< Job the instance is of */
+    std::string path;      /**< Object path of the instance */
+    unsigned int* pending; /**< Counter to decrement when done, may be null */
+};
+
+/** Asks Upstart for the properties of an instance and updates our cache
+    of instances when they return. The instance is put in the cache now,
+    without a name, so that if it is removed before the reply comes back
+    the reply is dropped. If a pending counter is passed it is incremented
+    now and decremented when the call completes. Must be called on the
+    thread. */
+void Registry::Impl::fetchUpstartInstance(const std::string& job, const std::string& path, unsigned int* pending)
+{
+    if (pending != nullptr)
     {
-        return {};
+        (*pending)++;
     }
 
-    return thread.executeOnThread<std::list<std::string>>([this, &job, &jobpath]() -> std::list<std::string> {
-        GError* error = nullptr;
-        GVariant* instance_tuple = g_dbus_connection_call_sync(_dbus.get(),                   /* connection */
-                                                               DBUS_SERVICE_UPSTART,          /* service */
-                                                               jobpath.c_str(),               /* object path */
-                                                               DBUS_INTERFACE_UPSTART_JOB,    /* iface */
-                                                               "GetAllInstances",             /* method */
-                                                               nullptr,                       /* params */
-                                                               G_VARIANT_TYPE("(ao)"),        /* return type */
-                                                               G_DBUS_CALL_FLAGS_NONE,        /* flags */
-                                                               -1,                            /* timeout: default */
-                                                               thread.getCancellable().get(), /* cancellable */
-                                                               &error);
+    upstartInstances_[path].job = job;
+
+    g_dbus_connection_call(_dbus.get(),                                           /* connection */
+                           DBUS_SERVICE_UPSTART,                                  /* service */
+                           path.c_str(),                                          /* object path */
+                           "org.freedesktop.DBus.Properties",                     /* interface */
+                           "GetAll",                                              /* method */
+                           g_variant_new("(s)", DBUS_INTERFACE_UPSTART_INSTANCE), /* params */
+                           G_VARIANT_TYPE("(a{sv})"),                             /* return type */
+                           G_DBUS_CALL_FLAGS_NONE,                                /* flags */
+                           -1,                                                    /* timeout: default */
+                           thread.getCancellable().get(),                         /* cancellable */
+                           upstartInstanceFetched,                                /* callback */
+                           new UpstartInstanceCall{this, job, path, pending});    /* user data */
+}
 
-        if (error != nullptr)
+/** Callback for the GetAll calls from fetchUpstartInstance() */
+void Registry::Impl::upstartInstanceFetched(GObject* obj, GAsyncResult* res, gpointer user_data)
+{
+    auto call = std::unique_ptr<UpstartInstanceCall>(static_cast<UpstartInstanceCall*>(user_data));
+    if (call->pending != nullptr)
+    {
+        (*call->pending)--;
+    }
+
+    GError* error = nullptr;
+    GVariant* props_tuple = g_dbus_connection_call_finish(G_DBUS_CONNECTION(obj), res, &error);
+
+    if (error != nullptr)
+    {
+        /* Cancelled means we're shutting down, so the impl may be gone */
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
         {
-            g_warning("Unable to get instances of job '%s': %s", job.c_str(), error->message);
-            g_error_free(error);
-            return {};
+            g_debug("Unable to get properties of instance '%s': %s", call->path.c_str(), error->message);
+            call->impl->upstartInstances_.erase(call->path);
         }
+        g_error_free(error);
+        return;
+    }
+
+    GVariant* props_dict = g_variant_get_child_value(props_tuple, 0);
+    call->impl->updateUpstartInstance(call->job, call->path, props_dict);
+
+    g_variant_unref(props_dict);
+    g_variant_unref(props_tuple);
+}
+
+/** Updates an instance in our cache with the properties we've got from
+    Upstart, which may be all of them or just the ones that changed.
+    Instances that aren't in the cache have been removed, and are left
+    out. Must be called on the thread. */
+void Registry::Impl::updateUpstartInstance(const std::string& job, const std::string& path, GVariant* props)
+{
+    auto found = upstartInstances_.find(path);
+    if (found == upstartInstances_.end())
+    {
+        g_debug("Instance '%s' of job '%s' was removed, ignoring its properties", path.c_str(), job.c_str());
+        return;
+    }
+    auto& info = found->second;
+
+    GVariant* namev = g_variant_lookup_value(props, "name", G_VARIANT_TYPE_STRING);
+    if (namev != nullptr)
+    {
+        info.name = g_variant_get_string(namev, nullptr);
+        g_variant_unref(namev);
+    }
 
-        if (instance_tuple == nullptr)
+    GVariant* processes = g_variant_lookup_value(props, "processes", G_VARIANT_TYPE("a(si)"));
+    if (processes != nullptr)
+    {
+        info.primaryPid = 0;
+        if (g_variant_n_children(processes) > 0)
         {
-            return {};
+            gint32 pid = 0;
+            g_variant_get_child(processes, 0, "(&si)", nullptr, &pid);
+            info.primaryPid = pid;
         }
+        g_variant_unref(processes);
+    }
 
-        GVariant* instance_list = g_variant_get_child_value(instance_tuple, 0);
-        g_variant_unref(instance_tuple);
+    g_debug("Instance '%s' of job '%s' has primary PID %d", info.name.c_str(), job.c_str(), int(info.primaryPid));
+}
 
-        GVariantIter instance_iter;
-        g_variant_iter_init(&instance_iter, instance_list);
-        const gchar* instance_path = nullptr;
-        std::list<std::string> instances;
+/** Drops everything we know about Upstart instances, typically because
+    Upstart has gone away. Jobs will be enumerated again the next time
+    they're asked about. Must be called on the thread. */
+void Registry::Impl::clearUpstartInstances()
+{
+    for (const auto& job : upstartWatchedJobs_)
+    {
+        g_dbus_connection_signal_unsubscribe(_dbus.get(), job.second.signal);
+    }
+    upstartWatchedJobs_.clear();
+    upstartInstances_.clear();
+}
+
+/** Subscribes to the signals for instances of a job being added and
+    removed, without asking about the instances that already exist. Those
+    can be fetched all at once by watchUpstartJob() or one at a time by
+    upstartHasInstance(). Must be called on the thread. */
+void Registry::Impl::subscribeUpstartJob(const std::string& job, const std::string& jobpath)
+{
+    if (upstartWatchedJobs_.find(job) != upstartWatchedJobs_.end())
+    {
+        return;
+    }
 
-        while (g_variant_iter_loop(&instance_iter, "&o", &instance_path))
-        {
-            GVariant* props_tuple =
-                g_dbus_connection_call_sync(_dbus.get(),                                           /* connection */
-                                            DBUS_SERVICE_UPSTART,                                  /* service */
-                                            instance_path,                                         /* object path */
-                                            "org.freedesktop.DBus.Properties",                     /* interface */
-                                            "GetAll",                                              /* method */
-                                            g_variant_new("(s)", DBUS_INTERFACE_UPSTART_INSTANCE), /* params */
-                                            G_VARIANT_TYPE("(a{sv})"),                             /* return type */
-                                            G_DBUS_CALL_FLAGS_NONE,                                /* flags */
-                                            -1,                            /* timeout: default */
-                                            thread.getCancellable().get(), /* cancellable */
-                                            &error);
+    if (upstartInstanceSignals_.empty())
+    {
+        /* Processes change as the instance goes through its states */
+        upstartInstanceSignals_.push_back(g_dbus_connection_signal_subscribe(
+            _dbus.get(),                     /* bus */
+            DBUS_SERVICE_UPSTART,            /* sender */
+            DBUS_INTERFACE_UPSTART_INSTANCE, /* interface */
+            "StateChanged",                  /* signal */
+            nullptr,                         /* path */
+            nullptr,                         /* arg0 */
+            G_DBUS_SIGNAL_FLAGS_NONE,
+            [](GDBusConnection*, const gchar*, const gchar* path, const gchar*, const gchar*, GVariant*,
+               gpointer user_data) -> void {
+                auto impl = static_cast<Registry::Impl*>(user_data);
+                auto instance = impl->upstartInstances_.find(path);
+                if (instance != impl->upstartInstances_.end())
+                {
+                    impl->fetchUpstartInstance(instance->second.job, path, nullptr);
+                }
+            },        /* callback */
+            this,     /* user data */
+            nullptr)); /* user data destroy */
+
+        upstartInstanceSignals_.push_back(g_dbus_connection_signal_subscribe(
+            _dbus.get(),                       /* bus */
+            DBUS_SERVICE_UPSTART,              /* sender */
+            "org.freedesktop.DBus.Properties", /* interface */
+            "PropertiesChanged",               /* signal */
+            nullptr,                           /* path */
+            DBUS_INTERFACE_UPSTART_INSTANCE,   /* arg0 */
+            G_DBUS_SIGNAL_FLAGS_NONE,
+            [](GDBusConnection*, const gchar*, const gchar* path, const gchar*, const gchar*, GVariant* params,
+               gpointer user_data) -> void {
+                auto impl = static_cast<Registry::Impl*>(user_data);
+                auto instance = impl->upstartInstances_.find(path);
+                if (instance != impl->upstartInstances_.end())
+                {
+                    GVariant* changed = g_variant_get_child_value(params, 1);
+                    impl->updateUpstartInstance(instance->second.job, path, changed);
+                    g_variant_unref(changed);
+                }
+            },        /* callback */
+            this,     /* user data */
+            nullptr)); /* user data destroy */
+
+        /* If Upstart restarts none of our information is valid */
+        upstartInstanceSignals_.push_back(g_dbus_connection_signal_subscribe(
+            _dbus.get(),                          /* bus */
+            "org.freedesktop.DBus",               /* sender */
+            "org.freedesktop.DBus",               /* interface */
+            "NameOwnerChanged",                   /* signal */
+            "/org/freedesktop/DBus",              /* path */
+            DBUS_SERVICE_UPSTART,                 /* arg0 */
+            G_DBUS_SIGNAL_FLAGS_NONE,
+            [](GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*, GVariant*,
+               gpointer user_data) -> void {
+                auto impl = static_cast<Registry::Impl*>(user_data);
+                g_debug("Upstart owner changed, clearing instance cache");
+                impl->clearUpstartInstances();
+            },        /* callback */
+            this,     /* user data */
+            nullptr)); /* user data destroy */
+    }
 
-            if (error != nullptr)
+    /* The job name is shared with the signal handler and freed with the subscription */
+    auto jobsignal = g_dbus_connection_signal_subscribe(
+        _dbus.get(),                /* bus */
+        DBUS_SERVICE_UPSTART,       /* sender */
+        DBUS_INTERFACE_UPSTART_JOB, /* interface */
+        nullptr,                    /* signal */
+        jobpath.c_str(),            /* path */
+        nullptr,                    /* arg0 */
+        G_DBUS_SIGNAL_FLAGS_NONE,
+        [](GDBusConnection* connection, const gchar*, const gchar*, const gchar*, const gchar* signal,
+           GVariant* params, gpointer user_data) -> void {
+            auto data = static_cast<std::pair<Registry::Impl*, std::string>*>(user_data);
+            auto impl = data->first;
+
+            if (!g_variant_is_of_type(params, G_VARIANT_TYPE("(o)")))
             {
-                g_warning("Unable to name of instance '%s': %s", instance_path, error->message);
-                g_error_free(error);
-                error = nullptr;
-                continue;
+                return;
             }
 
-            GVariant* props_dict = g_variant_get_child_value(props_tuple, 0);
+            const gchar* path = nullptr;
+            g_variant_get(params, "(&o)", &path);
 
-            GVariant* namev = g_variant_lookup_value(props_dict, "name", G_VARIANT_TYPE_STRING);
-            if (namev != nullptr)
+            if (g_strcmp0(signal, "InstanceAdded") == 0)
+            {
+                g_debug("Instance added to job '%s': %s", data->second.c_str(), path);
+                impl->fetchUpstartInstance(data->second, path, nullptr);
+            }
+            else if (g_strcmp0(signal, "InstanceRemoved") == 0)
             {
-                auto name = g_variant_get_string(namev, NULL);
-                g_debug("Adding instance for job '%s': %s", job.c_str(), name);
-                instances.push_back(name);
-                g_variant_unref(namev);
+                g_debug("Instance removed from job '%s': %s", data->second.c_str(), path);
+                impl->upstartInstances_.erase(path);
             }
+        },                                                      /* callback */
+        new std::pair<Registry::Impl*, std::string>(this, job), /* user data */
+        [](gpointer user_data) -> void {
+            delete static_cast<std::pair<Registry::Impl*, std::string>*>(user_data);
+        }); /* user data destroy */
+
+    upstartWatchedJobs_[job].signal = jobsignal;
+}
+
+/** Starts tracking the instances of a job. It subscribes to the signals
+    for instances being added and removed and then gets all the current
+    instances, so that nothing is missed between the two. The properties
+    of all the instances are fetched in parallel and gathered together, so
+    it only takes two round trips to Upstart. Must be called on the thread.
+
+    Returns false if the instances couldn't be listed.
+*/
+bool Registry::Impl::watchUpstartJob(const std::string& job, const std::string& jobpath)
+{
+    auto watched = upstartWatchedJobs_.find(job);
+    if (watched != upstartWatchedJobs_.end() && watched->second.enumerated)
+    {
+        return true;
+    }
+
+    subscribeUpstartJob(job, jobpath);
+
+    GError* error = nullptr;
+    GVariant* instance_tuple = g_dbus_connection_call_sync(_dbus.get(),                   /* connection */
+                                                           DBUS_SERVICE_UPSTART,          /* service */
+                                                           jobpath.c_str(),               /* object path */
+                                                           DBUS_INTERFACE_UPSTART_JOB,    /* iface */
+                                                           "GetAllInstances",             /* method */
+                                                           nullptr,                       /* params */
+                                                           G_VARIANT_TYPE("(ao)"),        /* return type */
+                                                           G_DBUS_CALL_FLAGS_NONE,        /* flags */
+                                                           -1,                            /* timeout: default */
+                                                           thread.getCancellable().get(), /* cancellable */
+                                                           &error);
+
+    if (error != nullptr)
+    {
+        g_warning("Unable to get instances of job '%s': %s", job.c_str(), error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    auto& watch = upstartWatchedJobs_[job];
+    watch.enumerated = true;
+    watch.lookedUpNames.clear();
+
+    GVariant* instance_list = g_variant_get_child_value(instance_tuple, 0);
+    g_variant_unref(instance_tuple);
+
+    /* We use a private context for the replies so that we only process
+       them while we wait, and not any of the other events on the thread.
+       Signals that come in while we wait will be handled after on the
+       thread's context, which is fine as they're newer information. */
+    auto context = std::shared_ptr<GMainContext>(g_main_context_new(), g_main_context_unref);
+    g_main_context_push_thread_default(context.get());
+
+    unsigned int pending = 0;
+    GVariantIter instance_iter;
+    g_variant_iter_init(&instance_iter, instance_list);
+    const gchar* instance_path = nullptr;
+
+    while (g_variant_iter_loop(&instance_iter, "&o", &instance_path))
+    {
+        fetchUpstartInstance(job, instance_path, &pending);
+    }
+
+    while (pending > 0)
+    {
+        g_main_context_iteration(context.get(), TRUE);
+    }
 
-            g_variant_unref(props_dict);
-            g_variant_unref(props_tuple);
+    g_main_context_pop_thread_default(context.get());
+    g_variant_unref(instance_list);
+
+    return true;
+}
+
+/** Gets all the instances of a given job. The first time a job is asked
+    about we ask Upstart for all of its instances, after that they are
+    tracked using the signals from Upstart so no DBus calls are needed. */
+std::list<std::string> Registry::Impl::upstartInstancesForJob(const std::string& job)
+{
+    std::string jobpath = upstartJobPath(job);
+    if (jobpath.empty())
+    {
+        return {};
+    }
+
+    return thread.executeOnThread<std::list<std::string>>([this, &job, &jobpath]() -> std::list<std::string> {
+        if (!watchUpstartJob(job, jobpath))
+        {
+            return {};
         }
 
-        g_variant_unref(instance_list);
+        std::list<std::string> instances;
+        for (const auto& instance : upstartInstances_)
+        {
+            /* Instances without a name are still being fetched */
+            if (instance.second.job == job && !instance.second.name.empty())
+            {
+                g_debug("Adding instance for job '%s': %s", job.c_str(), instance.second.name.c_str());
+                instances.push_back(instance.second.name);
+            }
+        }
 
         return instances;
     });
 }
 
-/** Send an event to Zietgeist using the registry thread so that
-        the callback comes back in the right place. */
-void Registry::Impl::zgSendEvent(AppID appid, const std::string& eventtype)
+/** Gets the primary PID of an instance of a job. This comes from the
+    instances we're tracking, which are kept up to date by the signals
+    from Upstart. We only ask Upstart directly if we couldn't get all the
+    instances of the job, and then only once for each name, so asking
+    about an instance that isn't running doesn't need any calls.
+
+    \param job Name of the Upstart job
+    \param instance Full name of the instance
+*/
+pid_t Registry::Impl::upstartInstancePrimaryPid(const std::string& job, const std::string& instance)
 {
-    thread.executeOnThread([this, appid, eventtype] {
-        std::string uri;
+    auto jobpath = upstartJobPath(job);
+    if (jobpath.empty())
+    {
+        g_debug("Unable to get a valid job path");
+        return 0;
+    }
 
-        if (appid.package.value().empty())
+    return thread.executeOnThread<pid_t>([this, &job, &jobpath, &instance]() -> pid_t {
+        watchUpstartJob(job, jobpath);
+
+        for (const auto& info : upstartInstances_)
         {
-            uri = "application://" + appid.appname.value() + ".desktop";
+            if (info.second.job == job && info.second.name == instance)
+            {
+                return info.second.primaryPid;
+            }
         }
-        else
+
+        /* Anything added since we started watching we've been told about */
+        auto& watch = upstartWatchedJobs_[job];
+        if (watch.enumerated || !watch.lookedUpNames.insert(instance).second)
         {
-            uri = "application://" + appid.package.value() + "_" + appid.appname.value() + ".desktop";
+            return 0;
         }
 
-        g_debug("Sending ZG event for '%s': %s", uri.c_str(), eventtype.c_str());
+        auto instance_path = fetchUpstartInstanceByName(job, jobpath, instance);
+        auto info = upstartInstances_.find(instance_path);
+        if (info == upstartInstances_.end())
+        {
+            return 0;
+        }
 
-        if (!zgLog_)
+        if (info->second.primaryPid == 0)
         {
-            zgLog_ =
-                std::shared_ptr<ZeitgeistLog>(zeitgeist_log_new(), /* create a new log for us */
-                                              [](ZeitgeistLog* log) { g_clear_object(&log); }); /* Free as a GObject */
+            g_debug("Unable to get 'processes' from properties of instance at path: %s", instance_path.c_str());
         }
 
-        ZeitgeistEvent* event = zeitgeist_event_new();
-        zeitgeist_event_set_actor(event, "application://ubuntu-app-launch.desktop");
-        zeitgeist_event_set_interpretation(event, eventtype.c_str());
-        zeitgeist_event_set_manifestation(event, ZEITGEIST_ZG_USER_ACTIVITY);
+        return info->second.primaryPid;
+    });
+}
 
-        ZeitgeistSubject* subject = zeitgeist_subject_new();
-        zeitgeist_subject_set_interpretation(subject, ZEITGEIST_NFO_SOFTWARE);
-        zeitgeist_subject_set_manifestation(subject, ZEITGEIST_NFO_SOFTWARE_ITEM);
-        zeitgeist_subject_set_mimetype(subject, "application/x-desktop");
-        zeitgeist_subject_set_uri(subject, uri.c_str());
+/** Checks whether a job has an instance with a given name. If we've
+    fetched all the instances of the job it is answered from those,
+    otherwise we ask Upstart about just that instance. Either way the
+    job is watched, so each name only needs to be asked about once.
+    This keeps looking at a single application from needing a call
+    for every running instance of its job.
+
+    \param job Name of the Upstart job
+    \param instance Full name of the instance
+*/
+bool Registry::Impl::upstartHasInstance(const std::string& job, const std::string& instance)
+{
+    auto jobpath = upstartJobPath(job);
+    if (jobpath.empty())
+    {
+        return false;
+    }
 
-        zeitgeist_event_add_subject(event, subject);
+    return thread.executeOnThread<bool>([this, &job, &jobpath, &instance]() -> bool {
+        subscribeUpstartJob(job, jobpath);
 
-        zeitgeist_log_insert_event(zgLog_.get(), /* log */
-                                   event,        /* event */
-                                   nullptr,      /* cancellable */
-                                   [](GObject* obj, GAsyncResult* res, gpointer user_data) -> void {
-                                       GError* error = nullptr;
-                                       GArray* result = nullptr;
+        for (const auto& info : upstartInstances_)
+        {
+            if (info.second.job == job && info.second.name == instance)
+            {
+                return true;
+            }
+        }
 
-                                       result = zeitgeist_log_insert_event_finish(ZEITGEIST_LOG(obj), res, &error);
+        /* Anything added since we started watching we've been told about */
+        auto& watch = upstartWatchedJobs_[job];
+        if (watch.enumerated || !watch.lookedUpNames.insert(instance).second)
+        {
+            return false;
+        }
 
-                                       if (error != nullptr)
-                                       {
-                                           g_warning("Unable to submit Zeitgeist Event: %s", error->message);
-                                           g_error_free(error);
-                                       }
+        auto instance_path = fetchUpstartInstanceByName(job, jobpath, instance);
+        auto info = upstartInstances_.find(instance_path);
+        return info != upstartInstances_.end() && info->second.name == instance;
+    });
+}
 
-                                       g_array_free(result, TRUE);
-                                   },        /* callback */
-                                   nullptr); /* userdata */
+/** Asks Upstart for an instance by its name and puts its properties
+    in our cache of instances. Returns the object path of the instance,
+    or an empty string if there isn't one. Must be called on the thread.
+
+    \param job Name of the Upstart job
+    \param jobpath Object path of the job
+    \param instance Full name of the instance
+*/
+std::string Registry::Impl::fetchUpstartInstanceByName(const std::string& job,
+                                                       const std::string& jobpath,
+                                                       const std::string& instance)
+{
+    GError* error = nullptr;
+
+    g_debug("Getting instance by name: %s", instance.c_str());
+    GVariant* vinstance_path =
+        g_dbus_connection_call_sync(_dbus.get(),                            /* connection */
+                                    DBUS_SERVICE_UPSTART,                   /* service */
+                                    jobpath.c_str(),                        /* object path */
+                                    DBUS_INTERFACE_UPSTART_JOB,             /* iface */
+                                    "GetInstanceByName",                    /* method */
+                                    g_variant_new("(s)", instance.c_str()), /* params */
+                                    G_VARIANT_TYPE("(o)"),                  /* return type */
+                                    G_DBUS_CALL_FLAGS_NONE,                 /* flags */
+                                    -1,                                     /* timeout: default */
+                                    thread.getCancellable().get(),          /* cancellable */
+                                    &error);
+
+    if (error != nullptr)
+    {
+        g_debug("Unable to get instance '%s' of job '%s': %s", instance.c_str(), job.c_str(), error->message);
+        g_error_free(error);
+        return {};
+    }
 
-        g_object_unref(event);
-        g_object_unref(subject);
-    });
+    /* Jump rope to make this into a C++ type */
+    std::string instance_path;
+    gchar* cinstance_path = nullptr;
+    g_variant_get(vinstance_path, "(o)", &cinstance_path);
+    g_variant_unref(vinstance_path);
+    if (cinstance_path != nullptr)
+    {
+        instance_path = cinstance_path;
+        g_free(cinstance_path);
+    }
+
+    if (instance_path.empty())
+    {
+        g_debug("No instance object for instance name: %s", instance.c_str());
+        return {};
+    }
+
+    GVariant* props_tuple =
+        g_dbus_connection_call_sync(_dbus.get(),                                           /* connection */
+                                    DBUS_SERVICE_UPSTART,                                  /* service */
+                                    instance_path.c_str(),                                 /* object path */
+                                    "org.freedesktop.DBus.Properties",                     /* interface */
+                                    "GetAll",                                              /* method */
+                                    g_variant_new("(s)", DBUS_INTERFACE_UPSTART_INSTANCE), /* params */
+                                    G_VARIANT_TYPE("(a{sv})"),                             /* return type */
+                                    G_DBUS_CALL_FLAGS_NONE,                                /* flags */
+                                    -1,                                                    /* timeout: default */
+                                    thread.getCancellable().get(),                         /* cancellable */
+                                    &error);
+
+    if (error != nullptr)
+    {
+        g_warning("Unable to name of properties '%s': %s", instance_path.c_str(), error->message);
+        g_error_free(error);
+        return {};
+    }
+
+    GVariant* props_dict = g_variant_get_child_value(props_tuple, 0);
+
+    /* Put it in the cache so the next time we have it */
+    upstartInstances_[instance_path].job = job;
+    updateUpstartInstance(job, instance_path, props_dict);
+
+    g_variant_unref(props_dict);
+    g_variant_unref(props_tuple);
+
+    return instance_path;
 }
 
-std::shared_ptr<IconFinder> Registry::Impl::getIconFinder(std::string basePath)
+/** The time now in clock ticks after boot, which is what the start times
+    of processes are in. Suspend is counted, so a process that started
+    before now never looks like it started after. */
+static unsigned long long bootTicks()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+
+    auto ticks = (unsigned long long)sysconf(_SC_CLK_TCK);
+    return now.tv_sec * ticks + now.tv_nsec * ticks / 1000000000ull;
+}
+
+/** A GetConnectionUnixProcessID call made by fetchBusNamePid() */
+struct BusNamePidCall
+{
+    Registry::Impl* impl;          /**< Registry to put the results in */
+    std::string name;              /**< Unique name we're asking about */
+    std::function<void()> fetched; /**< Called once the index is updated */
+};
+
+/** Asks the bus which PID owns a unique name and puts it in our index
+    when the reply comes back, then calls \a fetched. Must be called on
+    the thread. */
+void Registry::Impl::fetchBusNamePid(const std::string& name, std::function<void()> fetched)
+{
+    g_dbus_connection_call(_dbus.get(),                              /* connection */
+                           "org.freedesktop.DBus",                   /* service */
+                           "/",                                      /* object path */
+                           "org.freedesktop.DBus",                   /* interface */
+                           "GetConnectionUnixProcessID",             /* method */
+                           g_variant_new("(s)", name.c_str()),       /* params */
+                           G_VARIANT_TYPE("(u)"),                    /* return type */
+                           G_DBUS_CALL_FLAGS_NONE,                   /* flags */
+                           -1,                                       /* timeout: default */
+                           thread.getCancellable().get(),            /* cancellable */
+                           busNamePidFetched,                        /* callback */
+                           new BusNamePidCall{this, name, fetched}); /* user data */
+}
+
+/** Callback for the calls from fetchBusNamePid() */
+void Registry::Impl::busNamePidFetched(GObject* obj, GAsyncResult* res, gpointer user_data)
 {
-    if (_iconFinders.find(basePath) == _iconFinders.end())
+    auto call = std::unique_ptr<BusNamePidCall>(static_cast<BusNamePidCall*>(user_data));
+
+    GError* error = nullptr;
+    GVariant* vpid = g_dbus_connection_call_finish(G_DBUS_CONNECTION(obj), res, &error);
+
+    if (error != nullptr)
+    {
+        /* Cancelled means we're shutting down, so the impl may be gone */
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_error_free(error);
+            return;
+        }
+
+        g_debug("Unable to get PID of bus name '%s': %s", call->name.c_str(), error->message);
+        g_error_free(error);
+        call->impl->busNamePids_.erase(call->name);
+        call->impl->busNamesUnresolved_.erase(call->name);
+    }
+    else
+    {
+        guint32 pid = 0;
+        g_variant_get(vpid, "(u)", &pid);
+        g_variant_unref(vpid);
+
+        /* It may have left the bus while we were asking */
+        auto entry = call->impl->busNamePids_.find(call->name);
+        if (entry != call->impl->busNamePids_.end())
+        {
+            entry->second = pid;
+        }
+        call->impl->busNamesUnresolved_.erase(call->name);
+    }
+
+    if (call->fetched)
+    {
+        call->fetched();
+    }
+}
+
+/** Starts tracking the unique names on the session bus. We subscribe to
+    NameOwnerChanged first and then list the names so that nothing is
+    missed. New connections have their PID asked for as they show up, so
+    lookups don't wait on them. The PIDs of the listed names are only
+    asked for when a lookup needs them. Must be called on the thread.
+
+    \param ready Called with whether the names are being tracked, once
+                 they have been listed
+*/
+void Registry::Impl::watchBusNames(std::function<void(bool)> ready)
+{
+    if (busNameSignal_ != 0 && !busNamesListing_)
+    {
+        ready(true);
+        return;
+    }
+
+    busNamesWaiting_.push_back(ready);
+    if (busNamesListing_)
+    {
+        return;
+    }
+
+    busNameSignal_ = g_dbus_connection_signal_subscribe(
+        _dbus.get(),             /* bus */
+        "org.freedesktop.DBus",  /* sender */
+        "org.freedesktop.DBus",  /* interface */
+        "NameOwnerChanged",      /* signal */
+        "/org/freedesktop/DBus", /* path */
+        nullptr,                 /* arg0 */
+        G_DBUS_SIGNAL_FLAGS_NONE,
+        [](GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*, GVariant* params,
+           gpointer user_data) -> void {
+            auto impl = static_cast<Registry::Impl*>(user_data);
+
+            const gchar* name = nullptr;
+            const gchar* oldOwner = nullptr;
+            const gchar* newOwner = nullptr;
+            g_variant_get(params, "(&s&s&s)", &name, &oldOwner, &newOwner);
+
+            /* Well known names just move between connections we already know about */
+            if (!g_dbus_is_unique_name(name))
+            {
+                return;
+            }
+
+            if (newOwner[0] == '\0')
+            {
+                impl->busNamePids_.erase(name);
+                impl->busNamesUnresolved_.erase(name);
+            }
+            else if (impl->busNamePids_.emplace(name, 0).second)
+            {
+                impl->fetchBusNamePid(name, nullptr);
+            }
+        },        /* callback */
+        this,     /* user data */
+        nullptr); /* user data destroy */
+
+    busNamesListing_ = true;
+    busNamesListedAt_ = bootTicks();
+    g_dbus_connection_call(_dbus.get(),                   /* connection */
+                           "org.freedesktop.DBus",        /* service */
+                           "/",                           /* object path */
+                           "org.freedesktop.DBus",        /* iface */
+                           "ListNames",                   /* method */
+                           nullptr,                       /* params */
+                           G_VARIANT_TYPE("(as)"),        /* return type */
+                           G_DBUS_CALL_FLAGS_NONE,        /* flags */
+                           -1,                            /* timeout: default */
+                           thread.getCancellable().get(), /* cancellable */
+                           busNamesListCb,                /* callback */
+                           this);                         /* user data */
+}
+
+/** Callback for the ListNames call from watchBusNames() */
+void Registry::Impl::busNamesListCb(GObject* obj, GAsyncResult* res, gpointer user_data)
+{
+    GError* error = nullptr;
+    GVariant* listnames = g_dbus_connection_call_finish(G_DBUS_CONNECTION(obj), res, &error);
+
+    if (error != nullptr)
+    {
+        /* Cancelled means we're shutting down, so the impl may be gone */
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+            g_warning("Unable to get list of names from DBus: %s", error->message);
+            static_cast<Registry::Impl*>(user_data)->busNamesListed(false);
+        }
+        g_error_free(error);
+        return;
+    }
+
+    auto impl = static_cast<Registry::Impl*>(user_data);
+    GVariant* names = g_variant_get_child_value(listnames, 0);
+    GVariantIter iter;
+    g_variant_iter_init(&iter, names);
+    const gchar* name = nullptr;
+
+    while (g_variant_iter_loop(&iter, "&s", &name))
+    {
+        if (g_dbus_is_unique_name(name) && impl->busNamePids_.emplace(name, 0).second)
+        {
+            impl->busNamesUnresolved_.insert(name);
+        }
+    }
+
+    g_variant_unref(names);
+    g_variant_unref(listnames);
+
+    impl->busNamesListed(true);
+}
+
+/** Tells everyone waiting in watchBusNames() how the listing went. If it
+    failed we stop watching so the next lookup tries again. */
+void Registry::Impl::busNamesListed(bool listed)
+{
+    busNamesListing_ = false;
+
+    if (!listed)
+    {
+        g_dbus_connection_signal_unsubscribe(_dbus.get(), busNameSignal_);
+        busNameSignal_ = 0;
+        busNamePids_.clear();
+        busNamesUnresolved_.clear();
+    }
+
+    auto waiting = std::move(busNamesWaiting_);
+    busNamesWaiting_.clear();
+    for (const auto& ready : waiting)
+    {
+        ready(listed);
+    }
+}
+
+/** Called as each lookup finishes. When nobody has been looking for a
+    while we drop the subscription, otherwise every connection on the
+    bus would be tracked for the rest of our life. */
+void Registry::Impl::busNamesLookupDone()
+{
+    if (--busNamesLookups_ > 0)
+    {
+        return;
+    }
+
+    thread.timeout(busNamesIdleTime_, [this]() {
+        if (busNamesLookups_ > 0 || busNamesListing_ || busNameSignal_ == 0)
+        {
+            return;
+        }
+
+        g_dbus_connection_signal_unsubscribe(_dbus.get(), busNameSignal_);
+        busNameSignal_ = 0;
+        busNamePids_.clear();
+        busNamesUnresolved_.clear();
+    });
+}
+
+/** Finds the unique names on the session bus that are owned by any of
+    a set of PIDs, typically all the processes in an application's cgroup.
+    Uses our index of names, only asking the bus about the PIDs of names
+    we haven't looked up yet. The names that were listed when we started
+    watching can only belong to processes that were running by then, so
+    they're left alone if all of the PIDs started later. None of the
+    calls block the thread.
+
+    \param pids PIDs to look for connections of
+    \param found Called on the thread with the names
+*/
+void Registry::Impl::busNamesForPids(const std::vector<pid_t>& pids,
+                                     std::function<void(const std::vector<std::string>&)> found)
+{
+    if (pids.empty())
+    {
+        found({});
+        return;
+    }
+
+    thread.executeOnThread([this, pids, found]() {
+        busNamesLookups_++;
+
+        watchBusNames([this, pids, found](bool watching) {
+            if (!watching)
+            {
+                busNamesLookupDone();
+                found({});
+                return;
+            }
+
+            /* One extra so that we can't finish before all the calls are out */
+            auto remaining = std::make_shared<unsigned int>(1);
+            auto fetched = [this, pids, found, remaining]() {
+                if (--(*remaining) > 0)
+                {
+                    return;
+                }
+
+                std::set<pid_t> wanted(pids.begin(), pids.end());
+                std::vector<std::string> names;
+                for (const auto& entry : busNamePids_)
+                {
+                    if (entry.second != 0 && wanted.find(entry.second) != wanted.end())
+                    {
+                        names.push_back(entry.first);
+                    }
+                }
+
+                busNamesLookupDone();
+                found(names);
+            };
+
+            bool startedBefore = false;
+            for (auto pid : pids)
+            {
+                unsigned long long starttime = 0;
+                if (!pidJobCache_->startTime(pid, starttime) || starttime <= busNamesListedAt_)
+                {
+                    startedBefore = true;
+                    break;
+                }
+            }
+
+            for (const auto& entry : busNamePids_)
+            {
+                if (entry.second != 0 ||
+                    (!startedBefore && busNamesUnresolved_.find(entry.first) != busNamesUnresolved_.end()))
+                {
+                    continue;
+                }
+
+                (*remaining)++;
+                fetchBusNamePid(entry.first, fetched);
+            }
+
+            fetched();
+        });
+    });
+}
+
+/** Blocking version of busNamesForPids() for callers that aren't on the
+    thread, which would deadlock.
+
+    \param pids PIDs to look for connections of
+*/
+std::vector<std::string> Registry::Impl::busNamesForPids(const std::vector<pid_t>& pids)
+{
+    auto promise = std::make_shared<std::promise<std::vector<std::string>>>();
+    auto future = promise->get_future();
+
+    busNamesForPids(pids, [promise](const std::vector<std::string>& names) { promise->set_value(names); });
+
+    return future.get();
+}
+
+/** Whether we're currently subscribed to NameOwnerChanged */
+bool Registry::Impl::watchingBusNames()
+{
+    return thread.executeOnThread<bool>([this]() { return busNameSignal_ != 0; });
+}
+
+/** Sets how long the bus names stay watched after the last lookup,
+    mostly so the tests don't have to wait */
+void Registry::Impl::setBusNamesIdleTime(const std::chrono::milliseconds& idle)
+{
+    thread.executeOnThread<bool>([this, idle]() {
+        busNamesIdleTime_ = idle;
+        return true;
+    });
+}
+
+/** Send an event to Zietgeist using the registry thread so that
+        the callback comes back in the right place. */
+void Registry::Impl::zgSendEvent(AppID appid, const std::string& eventtype)
+{
+    thread.executeOnThread([this, appid, eventtype] {
+        std::string uri;
+
+        if (appid.package.value().empty())
+        {
+            uri = "application://" + appid.appname.value() + ".desktop";
+        }
+        else
+        {
+            uri = "application://" + appid.package.value() + "_" + appid.appname.value() + ".desktop";
+        }
+
+        g_debug("Sending ZG event for '%s': %s", uri.c_str(), eventtype.c_str());
+
+        if (!zgLog_)
+        {
+            zgLog_ =
+                std::shared_ptr<ZeitgeistLog>(zeitgeist_log_new(), /* create a new log for us */
+                                              [](ZeitgeistLog* log) { g_clear_object(&log); }); /* Free as a GObject */
+        }
+
+        ZeitgeistEvent* event = zeitgeist_event_new();
+        zeitgeist_event_set_actor(event, "application://ubuntu-app-launch.desktop");
+        zeitgeist_event_set_interpretation(event, eventtype.c_str());
+        zeitgeist_event_set_manifestation(event, ZEITGEIST_ZG_USER_ACTIVITY);
+
+        ZeitgeistSubject* subject = zeitgeist_subject_new();
+        zeitgeist_subject_set_interpretation(subject, ZEITGEIST_NFO_SOFTWARE);
+        zeitgeist_subject_set_manifestation(subject, ZEITGEIST_NFO_SOFTWARE_ITEM);
+        zeitgeist_subject_set_mimetype(subject, "application/x-desktop");
+        zeitgeist_subject_set_uri(subject, uri.c_str());
+
+        zeitgeist_event_add_subject(event, subject);
+
+        zeitgeist_log_insert_event(zgLog_.get(), /* log */
+                                   event,        /* event */
+                                   nullptr,      /* cancellable */
+                                   [](GObject* obj, GAsyncResult* res, gpointer user_data) -> void {
+                                       GError* error = nullptr;
+                                       GArray* result = nullptr;
+
+                                       result = zeitgeist_log_insert_event_finish(ZEITGEIST_LOG(obj), res, &error);
+
+                                       if (error != nullptr)
+                                       {
+                                           g_warning("Unable to submit Zeitgeist Event: %s", error->message);
+                                           g_error_free(error);
+                                       }
+
+                                       g_array_free(result, TRUE);
+                                   },        /* callback */
+                                   nullptr); /* userdata */
+
+        g_object_unref(event);
+        g_object_unref(subject);
+    });
+}
+
+std::shared_ptr<IconFinder> Registry::Impl::getIconFinder(std::string basePath)
+{
+    /* Built on our thread so that its file monitors are dispatched there */
+    return thread.executeOnThread<std::shared_ptr<IconFinder>>([this, &basePath]() -> std::shared_ptr<IconFinder> {
+        auto found = _iconFinders.find(basePath);
+        if (found != _iconFinders.end())
+        {
+            return found->second;
+        }
+
+        auto finder = std::make_shared<IconFinder>(basePath);
+        _iconFinders[basePath] = finder;
+        return finder;
+    });
+}
+
+/** Gets the cache of parsed desktop files */
+std::shared_ptr<KeyfileCache> Registry::Impl::getKeyfileCache()
+{
+    return keyfileCache_;
+}
+
+/** Gets the cache of which Upstart job each process is in */
+std::shared_ptr<PidJobCache> Registry::Impl::getPidJobCache()
+{
+    return pidJobCache_;
+}
+
+/** Gets the cache of open OOM adjustment files. It is made the first time
+    it is used as the test suite changes where proc is after making the
+    registry. */
+std::shared_ptr<OomFdCache> Registry::Impl::getOomFdCache()
+{
+    if (!oomFdCache_)
+    {
+        /* Set by the test suite, probably not anyone else */
+        auto procpath = g_getenv("UBUNTU_APP_LAUNCH_OOM_PROC_PATH");
+        oomFdCache_ = std::make_shared<OomFdCache>(OOM_FD_CACHE_SIZE, procpath != nullptr ? procpath : "/proc");
+    }
+
+    return oomFdCache_;
+}
+
+/** Gets the index of installed applications, which may be null
+    if it has been disabled in the environment */
+std::shared_ptr<ApplicationIndex> Registry::Impl::getApplicationIndex()
+{
+    return appIndex_;
+}
+
+/** Gets the files and directories that the backends find installed
+    applications in, so that they can be stamped and watched for changes
+
+    \param containers Whether to include the directories inside the
+                      Libertine containers, which need Libertine to
+                      list the containers
+*/
+std::list<Registry::Impl::InstalledPath> Registry::Impl::installedAppsPaths(bool containers)
+{
+    std::list<InstalledPath> paths;
+
+    /* Desktop files in subdirectories get the subdirectory in their name,
+       kde4/foo.desktop is kde4-foo, so those are watched as well */
+    std::function<void(const InstalledPath&)> addSubdirs;
+    addSubdirs = [&paths, &addSubdirs](const InstalledPath& parent) {
+        auto dir = g_dir_open(parent.path.c_str(), 0, nullptr);
+        if (dir == nullptr)
+        {
+            return;
+        }
+
+        const gchar* name;
+        while ((name = g_dir_read_name(dir)) != nullptr)
+        {
+            auto subdir = g_build_filename(parent.path.c_str(), name, nullptr);
+            if (g_file_test(subdir, G_FILE_TEST_IS_DIR) && !g_file_test(subdir, G_FILE_TEST_IS_SYMLINK))
+            {
+                paths.emplace_back(
+                    InstalledPath{subdir, parent.backend, true, parent.idPrefix + name + "-", parent.container});
+                addSubdirs(paths.back());
+            }
+            g_free(subdir);
+        }
+
+        g_dir_close(dir);
+    };
+
+    auto addPath = [&paths, &addSubdirs](const gchar* path, ApplicationIndex::Backend backend, bool directory,
+                                         const gchar* container) {
+        paths.emplace_back(InstalledPath{path, backend, directory, {}, container != nullptr ? container : ""});
+        if (directory)
+        {
+            addSubdirs(paths.back());
+        }
+    };
+
+    /* Click: the desktop hook keeps a link in the link farm for every app */
+    const gchar* link_farm_dir = g_getenv("UBUNTU_APP_LAUNCH_LINK_FARM");
+    if (G_LIKELY(link_farm_dir == nullptr))
+    {
+        auto linkfarm = g_build_filename(g_get_user_cache_dir(), "ubuntu-app-launch", "desktop", nullptr);
+        addPath(linkfarm, ApplicationIndex::Backend::CLICK, true, nullptr);
+        g_free(linkfarm);
+    }
+    else
+    {
+        addPath(link_farm_dir, ApplicationIndex::Backend::CLICK, true, nullptr);
+    }
+
+    /* Legacy: the applications directories in the XDG data dirs */
+    auto userapps = g_build_filename(g_get_user_data_dir(), "applications", nullptr);
+    addPath(userapps, ApplicationIndex::Backend::LEGACY, true, nullptr);
+    g_free(userapps);
+
+    auto systemDirs = g_get_system_data_dirs();
+    for (auto i = 0; systemDirs[i] != nullptr; i++)
+    {
+        auto sysapps = g_build_filename(systemDirs[i], "applications", nullptr);
+        addPath(sysapps, ApplicationIndex::Backend::LEGACY, true, nullptr);
+        g_free(sysapps);
+    }
+
+    /* Libertine: the container config and the applications directories
+       of each container */
+    auto libertineconfig = g_build_filename(g_get_user_data_dir(), "libertine", "ContainersConfig.json", nullptr);
+    addPath(libertineconfig, ApplicationIndex::Backend::LIBERTINE, false, nullptr);
+    g_free(libertineconfig);
+
+    auto containerlist = std::shared_ptr<gchar*>(containers ? libertine_list_containers() : nullptr, g_strfreev);
+    for (int i = 0; containerlist && containerlist.get()[i] != nullptr; i++)
+    {
+        auto container = containerlist.get()[i];
+
+        auto container_path = libertine_container_path(container);
+        if (container_path != nullptr)
+        {
+            auto apps = g_build_filename(container_path, "usr", "share", "applications", nullptr);
+            addPath(apps, ApplicationIndex::Backend::LIBERTINE, true, container);
+            g_free(apps);
+            g_free(container_path);
+        }
+
+        auto container_home_path = libertine_container_home_path(container);
+        if (container_home_path != nullptr)
+        {
+            auto apps = g_build_filename(container_home_path, ".local", "share", "applications", nullptr);
+            addPath(apps, ApplicationIndex::Backend::LIBERTINE, true, container);
+            g_free(apps);
+            g_free(container_home_path);
+        }
+    }
+
+#ifdef ENABLE_SNAPPY
+    /* Snap: snapd rewrites its state file on every change it makes */
+    if (!snapdInfo.statePath().empty())
+    {
+        addPath(snapdInfo.statePath().c_str(), ApplicationIndex::Backend::SNAP, false, nullptr);
+    }
+#endif
+
+    return paths;
+}
+
+/** Works out which application a desktop file in one of the watched
+    directories belongs to.
+
+    \param path Watched directory the desktop file is in
+    \param name Name of the desktop file without the .desktop
+    \param appid Set to the application ID if there is one
+    \returns Whether the desktop file could be mapped to an application
+*/
+bool Registry::Impl::installedAppIdForFile(const InstalledPath& path, const std::string& name, AppID& appid)
+{
+    switch (path.backend)
+    {
+        case ApplicationIndex::Backend::CLICK:
+            /* The link farm has a link named after the full AppID */
+            if (!path.idPrefix.empty() || !AppID::valid(name))
+            {
+                return false;
+            }
+            appid = AppID::parse(name);
+            return true;
+        case ApplicationIndex::Backend::LEGACY:
+            appid = AppID{AppID::Package::from_raw({}), AppID::AppName::from_raw(path.idPrefix + name),
+                          AppID::Version::from_raw({})};
+            return true;
+        case ApplicationIndex::Backend::LIBERTINE:
+            /* Libertine doesn't name applications after their subdirectory */
+            if (!path.idPrefix.empty() || path.container.empty())
+            {
+                return false;
+            }
+            appid = AppID{AppID::Package::from_raw(path.container), AppID::AppName::from_raw(name),
+                          AppID::Version::from_raw("0.0")};
+            return true;
+        default:
+            return false;
+    }
+}
+
+/** Builds the set of stamps that the installed application index
+    is validated against. These are the modification times of the
+    directories that the backends look in for applications, and of the
+    newest desktop file in each, so that adding, removing or editing an
+    application changes them. Libertine records what is installed in
+    its container config and snapd in its state file, so those are
+    stamped without asking either of them. Throws an exception if one
+    of the stamps can not be determined, in which case the index
+    shouldn't be used. */
+ApplicationIndex::Stamps Registry::Impl::installedAppsStamps()
+{
+    ApplicationIndex::Stamps stamps;
+
+    for (const auto& path : installedAppsPaths(false))
+    {
+        /* Snaps are stamped with the change ID instead */
+        if (path.backend == ApplicationIndex::Backend::SNAP)
+        {
+            continue;
+        }
+
+        stamps[path.path] =
+            path.directory ? ApplicationIndex::directoryStamp(path.path) : ApplicationIndex::fileStamp(path.path);
+    }
+
+#ifdef ENABLE_SNAPPY
+    /* Snap: snapd changes its state on every install, removal and
+       interface connection */
+    auto changeid = snapdInfo.changeId();
+    if (changeid.empty())
+    {
+        throw std::runtime_error("Unable to get the change ID from snapd");
+    }
+    stamps["snapd"] = changeid;
+#endif
+
+    return stamps;
+}
+
+/** All of the backends with installed applications. The applications of
+    each are put at the start of the list, so the last one comes first. */
+std::vector<Registry::Impl::InstalledBackend> Registry::Impl::installedBackends()
+{
+    auto noInterface = [](const std::shared_ptr<Application>& app) -> std::string { return {}; };
+
+    return {
+        /* Click reads its database on the registry thread */
+        {ApplicationIndex::Backend::CLICK, app_impls::Click::list, noInterface, app_impls::Click::listed, true},
+        {ApplicationIndex::Backend::LEGACY, app_impls::Legacy::list, noInterface, app_impls::Legacy::listed, false},
+        {ApplicationIndex::Backend::LIBERTINE, app_impls::Libertine::list, noInterface, app_impls::Libertine::listed,
+         false},
+#ifdef ENABLE_SNAPPY
+        /* Snaps only change through the snapd state file, so they're always listed */
+        {ApplicationIndex::Backend::SNAP, app_impls::Snap::list,
+         [](const std::shared_ptr<Application>& app) -> std::string {
+             return std::static_pointer_cast<app_impls::Snap>(app)->interface();
+         },
+         {}, false},
+#endif
+    };
+}
+
+/** Builds the entries in the installed application index for the
+    applications of a backend */
+std::list<ApplicationIndex::Entry> Registry::Impl::indexEntries(const InstalledBackend& backend,
+                                                                const std::list<std::shared_ptr<Application>>& apps)
+{
+    std::list<ApplicationIndex::Entry> entries;
+    for (const auto& app : apps)
+    {
+        entries.emplace_back(ApplicationIndex::Entry{backend.backend, app->appId(), backend.interface(app)});
+    }
+    return entries;
+}
+
+core::Signal<const std::shared_ptr<Application>&>& Registry::Impl::appInstalled(const std::shared_ptr<Registry>& reg)
+{
+    watchInstalled(reg);
+    return sig_appInstalled;
+}
+
+core::Signal<const AppID&>& Registry::Impl::appRemoved(const std::shared_ptr<Registry>& reg)
+{
+    watchInstalled(reg);
+    return sig_appRemoved;
+}
+
+core::Signal<const std::shared_ptr<Application>&>& Registry::Impl::appUpdated(const std::shared_ptr<Registry>& reg)
+{
+    watchInstalled(reg);
+    return sig_appUpdated;
+}
+
+/** Gets the installed applications from what we've found while watching
+    for changes. Returns false if we're not watching, or if something has
+    changed that hasn't been listed yet.
+
+    \param entries List to put the index entries of the applications into,
+                   in the same order that installedApps() returns them
+*/
+bool Registry::Impl::watchedInstalledApps(std::list<ApplicationIndex::Entry>& entries)
+{
+    if (!installedWatching_)
+    {
+        return false;
+    }
+
+    return thread.executeOnThread<bool>([this, &entries]() {
+        if (installedRescanQueued_ || installedRescanRunning_)
+        {
+            return false;
+        }
+
+        std::list<ApplicationIndex::Entry> watched;
+        for (const auto& backend : installedBackends())
+        {
+            auto state = installedStates_.find(backend.backend);
+            if (state == installedStates_.end() || !state->second.listed || state->second.dirty ||
+                !state->second.changedApps.empty())
+            {
+                return false;
+            }
+
+            auto backendentries = state->second.entries;
+            watched.splice(watched.begin(), backendentries);
+        }
+
+        entries.splice(entries.end(), watched);
+        return true;
+    });
+}
+
+/** Starts watching the paths that installed applications come from the
+    first time anyone asks for one of the installed application signals.
+    The backends are listed in the background to find what is installed
+    to begin with, which isn't signaled.
+
+    \param reg Registry to build the Application objects with
+*/
+void Registry::Impl::watchInstalled(const std::shared_ptr<Registry>& reg)
+{
+    thread.executeOnThread<bool>([this, &reg]() {
+        if (!installedStates_.empty())
+        {
+            return true;
+        }
+
+        installedRegistry_ = reg;
+        for (const auto& backend : installedBackends())
+        {
+            installedStates_[backend.backend] = InstalledState{};
+        }
+
+        syncInstalledMonitors();
+        startInstalledRescan();
+
+        installedWatching_ = true;
+        return true;
+    });
+}
+
+/** Makes sure there is a monitor on each of the paths that applications
+    come from, removing the ones that are no longer used. The paths change
+    as Libertine containers are added and removed. Must be called on the
+    thread. */
+void Registry::Impl::syncInstalledMonitors()
+{
+    std::map<std::string, std::pair<InstalledPath, std::shared_ptr<GFileMonitor>>> monitors;
+
+    for (const auto& path : installedAppsPaths())
+    {
+        if (monitors.find(path.path) != monitors.end())
+        {
+            continue;
+        }
+
+        auto current = installedMonitors_.find(path.path);
+        if (current != installedMonitors_.end())
+        {
+            monitors.emplace(*current);
+            continue;
+        }
+
+        /* Paths that don't exist yet are still watched so we notice
+           them being created */
+        auto file = g_file_new_for_path(path.path.c_str());
+        GError* error = nullptr;
+        GFileMonitor* monitor = nullptr;
+        if (path.directory)
+        {
+            monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, thread.getCancellable().get(), &error);
+        }
+        else
+        {
+            monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, thread.getCancellable().get(), &error);
+        }
+        g_object_unref(file);
+
+        if (error != nullptr)
+        {
+            g_debug("Unable to monitor '%s' for installed applications: %s", path.path.c_str(), error->message);
+            g_error_free(error);
+            continue;
+        }
+
+        g_signal_connect(monitor, "changed", G_CALLBACK(installedPathChanged), this);
+        auto smonitor = std::shared_ptr<GFileMonitor>(monitor, [this](GFileMonitor* monitor) {
+            g_signal_handlers_disconnect_by_data(monitor, this);
+            g_file_monitor_cancel(monitor);
+            g_object_unref(monitor);
+        });
+
+        monitors.emplace(path.path, std::make_pair(path, smonitor));
+    }
+
+    installedMonitors_ = std::move(monitors);
+}
+
+/** Marks the application whose desktop file changed in a watched path
+    so that only it gets looked at again. Anything that can't be tied to
+    an application, like the directory going away or a new subdirectory,
+    marks the whole backend to be listed again instead. */
+void Registry::Impl::installedPathChanged(
+    GFileMonitor* monitor, GFile* file, GFile* otherfile, GFileMonitorEvent event, gpointer user_data)
+{
+    auto impl = static_cast<Registry::Impl*>(user_data);
+
+    if (event == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED || event == G_FILE_MONITOR_EVENT_PRE_UNMOUNT)
+    {
+        return;
+    }
+
+    auto watched = std::find_if(impl->installedMonitors_.begin(), impl->installedMonitors_.end(),
+                                [monitor](const decltype(impl->installedMonitors_)::value_type& entry) {
+                                    return entry.second.second.get() == monitor;
+                                });
+    if (watched == impl->installedMonitors_.end())
+    {
+        return;
+    }
+    const auto& path = watched->second.first;
+
+    auto statefind = impl->installedStates_.find(path.backend);
+    if (statefind == impl->installedStates_.end())
+    {
+        return;
+    }
+    auto& state = statefind->second;
+
+    /* GLib doesn't tell monitors when inotify overflows, so unmounting
+       is the only time we know we've missed something */
+    if (event == G_FILE_MONITOR_EVENT_UNMOUNTED || !path.directory || !state.listed)
+    {
+        state.dirty = true;
+        impl->queueInstalledRescan();
+        return;
+    }
+
+    bool changed = false;
+    for (auto changedfile : {file, otherfile})
+    {
+        if (changedfile == nullptr)
+        {
+            continue;
+        }
+
+        auto basename = std::shared_ptr<gchar>(g_file_get_basename(changedfile), g_free);
+        if (basename && g_str_has_suffix(basename.get(), ".desktop"))
+        {
+            AppID appid;
+            if (installedAppIdForFile(path, std::string(basename.get(), strlen(basename.get()) - strlen(".desktop")),
+                                      appid))
+            {
+                state.changedApps.insert(appid);
+            }
+            else
+            {
+                state.dirty = true;
+            }
+            changed = true;
+            continue;
+        }
+
+        /* Subdirectories, and the directory itself, change which paths we
+           watch and which desktop files there are */
+        auto filepath = std::shared_ptr<gchar>(g_file_get_path(changedfile), g_free);
+        auto watchedpath = filepath && impl->installedMonitors_.find(filepath.get()) != impl->installedMonitors_.end();
+        auto newdir = event == G_FILE_MONITOR_EVENT_CREATED &&
+                      g_file_query_file_type(changedfile, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, nullptr) ==
+                          G_FILE_TYPE_DIRECTORY;
+        if (watchedpath || newdir)
+        {
+            state.dirty = true;
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        impl->queueInstalledRescan();
+    }
+}
+
+/** Lists the backends that have changed once things settle down, unless
+    that is already going to happen. Must be called on the thread. */
+void Registry::Impl::queueInstalledRescan()
+{
+    if (installedRescanQueued_)
+    {
+        return;
+    }
+
+    installedRescanQueued_ = true;
+    thread.timeout(INSTALLED_SETTLE_TIME, [this]() {
+        installedRescanQueued_ = false;
+        startInstalledRescan();
+    });
+}
+
+/** Looks at the backends that have changed on another thread, as that
+    needs this thread to do some of the work. Backends that need to be
+    listed again are listed in full, otherwise only the applications whose
+    desktop files changed are looked up. Only one of these runs at a time,
+    anything that changes while it is running gets picked up by the next
+    one. It hands everything it holds, including the registry, back to
+    this thread so that it never has the last reference and can always be
+    waited on. Must be called on the thread. */
+void Registry::Impl::startInstalledRescan()
+{
+    if (installedRescanRunning_)
+    {
+        return;
+    }
+
+    auto rescan = std::make_shared<InstalledRescan>();
+    for (const auto& backend : installedBackends())
+    {
+        auto statefind = installedStates_.find(backend.backend);
+        if (statefind == installedStates_.end())
+        {
+            continue;
+        }
+        auto& state = statefind->second;
+
+        if (state.dirty || (!state.changedApps.empty() && !backend.listed))
+        {
+            rescan->full.insert(backend.backend);
+        }
+        else if (state.changedApps.empty())
+        {
+            continue;
+        }
+
+        rescan->changedApps[backend.backend] = std::move(state.changedApps);
+        state.changedApps.clear();
+        state.dirty = false;
+    }
+
+    if (rescan->changedApps.empty())
+    {
+        return;
+    }
+
+    if (installedRegistry_.expired())
+    {
+        return;
+    }
+
+    installedRescanRunning_ = true;
+
+    std::weak_ptr<Registry> weakReg = installedRegistry_;
+    installedRescan_ = std::async(std::launch::async, [weakReg, rescan]() {
+        auto reg = weakReg.lock();
+        if (!reg)
+        {
+            return;
+        }
+
+        if (reg->impl->getApplicationIndex())
+        {
+            try
+            {
+                rescan->stamps = reg->impl->installedAppsStamps();
+            }
+            catch (std::runtime_error& e)
+            {
+                g_debug("Not updating the installed application index: %s", e.what());
+            }
+        }
+
+        for (const auto& backend : installedBackends())
+        {
+            auto changed = rescan->changedApps.find(backend.backend);
+            if (changed == rescan->changedApps.end())
+            {
+                continue;
+            }
+
+            try
+            {
+                if (rescan->full.find(backend.backend) != rescan->full.end())
+                {
+                    auto apps = backend.list(reg);
+                    rescan->entries[backend.backend] = indexEntries(backend, apps);
+                    rescan->apps[backend.backend] = std::move(apps);
+                }
+                else
+                {
+                    std::list<std::pair<AppID, std::shared_ptr<Application>>> updates;
+                    for (const auto& appid : changed->second)
+                    {
+                        updates.emplace_back(appid, backend.listed(appid, reg));
+                    }
+                    rescan->updates[backend.backend] = std::move(updates);
+                }
+            }
+            catch (std::runtime_error& e)
+            {
+                g_warning("Unable to list installed applications: %s", e.what());
+            }
+        }
+
+        /* The registry can't go away while we're holding it, so the thread
+           is still running to take the result, and the registry with it */
+        auto impl = reg->impl.get();
+        rescan->registry = std::move(reg);
+        impl->thread.executeOnThread([impl, rescan]() {
+            impl->applyInstalledRescan(*rescan);
+
+            /* We may have the last reference to the registry */
+            rescan->apps.clear();
+            rescan->updates.clear();
+            rescan->registry.reset();
+        });
+    });
+}
+
+/** Identifies an application across the versions of its package */
+static std::string installedKey(const AppID& appid)
+{
+    return appid.package.value() + "_" + appid.appname.value();
+}
+
+/** Compares what the backends listed to what we knew about before and
+    signals the applications that were installed, removed and updated.
+    The first listing of a backend is only what was there to begin with,
+    so it isn't signaled. Once everything is up to date the index is
+    written so that other processes don't need to list it all again.
+    Must be called on the thread. */
+void Registry::Impl::applyInstalledRescan(const InstalledRescan& rescan)
+{
+    installedRescanRunning_ = false;
+
+    if (installedStates_.empty())
+    {
+        return;
+    }
+
+    /* Backends that couldn't be looked at are listed in full next time */
+    for (const auto& changed : rescan.changedApps)
+    {
+        auto statefind = installedStates_.find(changed.first);
+        if (statefind == installedStates_.end() || rescan.entries.find(changed.first) != rescan.entries.end() ||
+            rescan.updates.find(changed.first) != rescan.updates.end())
+        {
+            continue;
+        }
+
+        statefind->second.dirty = true;
+        statefind->second.changedApps.insert(changed.second.begin(), changed.second.end());
+    }
+
+    for (const auto& listed : rescan.entries)
+    {
+        auto statefind = installedStates_.find(listed.first);
+        if (statefind == installedStates_.end())
+        {
+            continue;
+        }
+        auto& state = statefind->second;
+
+        std::set<std::string> changedKeys;
+        for (const auto& appid : rescan.changedApps.at(listed.first))
+        {
+            changedKeys.insert(installedKey(appid));
+        }
+
+        std::map<std::string, AppID> removed;
+        for (const auto& entry : state.entries)
+        {
+            removed.emplace(installedKey(entry.appid), entry.appid);
+        }
+
+        std::set<AppID> installed;
+        std::set<AppID> updated;
+        for (const auto& entry : listed.second)
+        {
+            auto key = installedKey(entry.appid);
+            auto previous = removed.find(key);
+            if (previous == removed.end())
+            {
+                installed.insert(entry.appid);
+                continue;
+            }
+
+            if (previous->second != entry.appid || changedKeys.find(key) != changedKeys.end())
+            {
+                updated.insert(entry.appid);
+            }
+            removed.erase(previous);
+        }
+
+        auto initial = !state.listed;
+        state.entries = listed.second;
+        state.listed = true;
+
+        if (initial)
+        {
+            continue;
+        }
+
+        for (const auto& appid : removed)
+        {
+            sig_appRemoved(appid.second);
+        }
+
+        for (const auto& app : rescan.apps.at(listed.first))
+        {
+            if (installed.find(app->appId()) != installed.end())
+            {
+                sig_appInstalled(app);
+            }
+            else if (updated.find(app->appId()) != updated.end())
+            {
+                sig_appUpdated(app);
+            }
+        }
+    }
+
+    for (const auto& backend : installedBackends())
+    {
+        auto update = rescan.updates.find(backend.backend);
+        auto statefind = installedStates_.find(backend.backend);
+        if (update == rescan.updates.end() || statefind == installedStates_.end())
+        {
+            continue;
+        }
+        auto& state = statefind->second;
+
+        /* Add or replace the ones that are there, the old version of a
+           Click package is removed after the new one is added */
+        for (const auto& found : update->second)
+        {
+            if (!found.second)
+            {
+                continue;
+            }
+
+            auto entry = ApplicationIndex::Entry{backend.backend, found.first, backend.interface(found.second)};
+            auto key = installedKey(found.first);
+            auto previous =
+                std::find_if(state.entries.begin(), state.entries.end(),
+                             [&key](const ApplicationIndex::Entry& entry) { return installedKey(entry.appid) == key; });
+            if (previous != state.entries.end())
+            {
+                *previous = entry;
+                sig_appUpdated(found.second);
+            }
+            else
+            {
+                state.entries.push_back(entry);
+                sig_appInstalled(found.second);
+            }
+        }
+
+        for (const auto& found : update->second)
+        {
+            if (found.second)
+            {
+                continue;
+            }
+
+            auto previous =
+                std::find_if(state.entries.begin(), state.entries.end(),
+                             [&found](const ApplicationIndex::Entry& entry) { return entry.appid == found.first; });
+            if (previous != state.entries.end())
+            {
+                state.entries.erase(previous);
+                sig_appRemoved(found.first);
+            }
+        }
+    }
+
+    /* Libertine containers may have come or gone */
+    syncInstalledMonitors();
+
+    for (const auto& state : installedStates_)
+    {
+        if (state.second.dirty || !state.second.changedApps.empty())
+        {
+            queueInstalledRescan();
+            return;
+        }
+    }
+
+    if (!appIndex_ || rescan.stamps.empty() ||
+        rescan.entries.size() + rescan.updates.size() != rescan.changedApps.size())
+    {
+        return;
+    }
+
+    std::list<ApplicationIndex::Entry> entries;
+    for (const auto& backend : installedBackends())
+    {
+        auto state = installedStates_[backend.backend];
+        if (!state.listed)
+        {
+            return;
+        }
+        entries.splice(entries.begin(), state.entries);
+    }
+
+    appIndex_->write(rescan.stamps, entries);
+}
+
+core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>&
+    Registry::Impl::appStarted(const std::shared_ptr<Registry>& reg)
+{
+    watchLifecycle(reg);
+    return sig_appStarted;
+}
+
+core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>&
+    Registry::Impl::appStopped(const std::shared_ptr<Registry>& reg)
+{
+    watchLifecycle(reg);
+    return sig_appStopped;
+}
+
+core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&, Registry::FailureType>&
+    Registry::Impl::appFailed(const std::shared_ptr<Registry>& reg)
+{
+    watchLifecycle(reg);
+    return sig_appFailed;
+}
+
+core::Signal<const std::shared_ptr<Application>&,
+             const std::shared_ptr<Application::Instance>&,
+             const std::vector<pid_t>&>&
+    Registry::Impl::appPaused(const std::shared_ptr<Registry>& reg)
+{
+    watchLifecycle(reg);
+    return sig_appPaused;
+}
+
+core::Signal<const std::shared_ptr<Application>&,
+             const std::shared_ptr<Application::Instance>&,
+             const std::vector<pid_t>&>&
+    Registry::Impl::appResumed(const std::shared_ptr<Registry>& reg)
+{
+    watchLifecycle(reg);
+    return sig_appResumed;
+}
+
+/** Reads the PIDs out of an 'at' array in a paused or resumed signal */
+static std::vector<pid_t> lifecyclePids(GVariant* vpids)
+{
+    std::vector<pid_t> pids;
+    GVariantIter iter;
+    guint64 pid;
+
+    g_variant_iter_init(&iter, vpids);
+    while (g_variant_iter_loop(&iter, "t", &pid))
+    {
+        pids.push_back(pid_t(pid));
+    }
+
+    return pids;
+}
+
+/** Subscribes to the signals that tell us about application lifecycle
+    events the first time anyone asks for one of the C++ signals. Each
+    bus signal is decoded once here, no matter how many are connected
+    to our signals.
+
+    \param reg Registry to build the Application objects with
+*/
+void Registry::Impl::watchLifecycle(const std::shared_ptr<Registry>& reg)
+{
+    thread.executeOnThread<bool>([this, &reg]() {
+        if (!lifecycleSignals_.empty())
+        {
+            return true;
+        }
+
+        lifecycleRegistry_ = reg;
+
+        /* Application jobs starting and stopping */
+        auto eventCb = [](GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*, GVariant* params,
+                          gpointer user_data) -> void {
+            auto impl = static_cast<Registry::Impl*>(user_data);
+
+            const gchar* signalname = nullptr;
+            g_variant_get_child(params, 0, "&s", &signalname);
+
+            LifecycleEvent event;
+            if (g_strcmp0(signalname, "started") == 0)
+            {
+                event.type = LifecycleEvent::Type::STARTED;
+            }
+            else if (g_strcmp0(signalname, "stopped") == 0)
+            {
+                event.type = LifecycleEvent::Type::STOPPED;
+            }
+            else
+            {
+                return;
+            }
+
+            GVariant* envs = g_variant_get_child_value(params, 1);
+            GVariantIter iter;
+            const gchar* env = nullptr;
+            std::string instance;
+
+            g_variant_iter_init(&iter, envs);
+            while (g_variant_iter_loop(&iter, "&s", &env))
+            {
+                if (g_str_has_prefix(env, "JOB="))
+                {
+                    event.job = env + strlen("JOB=");
+                }
+                else if (g_str_has_prefix(env, "INSTANCE="))
+                {
+                    instance = env + strlen("INSTANCE=");
+                }
+            }
+            g_variant_unref(envs);
+
+            if (instance.empty())
+            {
+                return;
+            }
+
+            if (event.job == "application-click")
+            {
+                event.appid = instance;
+            }
+            else if (event.job == "application-legacy" || event.job == "application-snap")
+            {
+                /* Instance names are the application ID and the instance ID
+                   joined by a dash */
+                auto dash = instance.rfind('-');
+                if (dash == std::string::npos)
+                {
+                    return;
+                }
+                event.appid = instance.substr(0, dash);
+                event.instance = instance.substr(dash + 1);
+            }
+            else
+            {
+                return;
+            }
+
+            impl->queueLifecycleEvent(std::move(event));
+        };
+
+        lifecycleSignals_.push_back(g_dbus_connection_signal_subscribe(_dbus.get(),            /* bus */
+                                                                       nullptr,                /* sender */
+                                                                       DBUS_INTERFACE_UPSTART, /* interface */
+                                                                       "EventEmitted",         /* signal */
+                                                                       DBUS_PATH_UPSTART,      /* path */
+                                                                       "started",              /* arg0 */
+                                                                       G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                       eventCb,  /* callback */
+                                                                       this,     /* user data */
+                                                                       nullptr)); /* user data destroy */
+
+        lifecycleSignals_.push_back(g_dbus_connection_signal_subscribe(_dbus.get(),            /* bus */
+                                                                       nullptr,                /* sender */
+                                                                       DBUS_INTERFACE_UPSTART, /* interface */
+                                                                       "EventEmitted",         /* signal */
+                                                                       DBUS_PATH_UPSTART,      /* path */
+                                                                       "stopped",              /* arg0 */
+                                                                       G_DBUS_SIGNAL_FLAGS_NONE,
+                                                                       eventCb,  /* callback */
+                                                                       this,     /* user data */
+                                                                       nullptr)); /* user data destroy */
+
+        /* Applications failing */
+        lifecycleSignals_.push_back(g_dbus_connection_signal_subscribe(
+            _dbus.get(),                     /* bus */
+            nullptr,                         /* sender */
+            "com.canonical.UbuntuAppLaunch", /* interface */
+            "ApplicationFailed",             /* signal */
+            "/",                             /* path */
+            nullptr,                         /* arg0 */
+            G_DBUS_SIGNAL_FLAGS_NONE,
+            [](GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*, GVariant* params,
+               gpointer user_data) -> void {
+                auto impl = static_cast<Registry::Impl*>(user_data);
+
+                const gchar* appid = nullptr;
+                const gchar* typestr = nullptr;
+                g_variant_get(params, "(&s&s)", &appid, &typestr);
+
+                LifecycleEvent event;
+                event.type = LifecycleEvent::Type::FAILED;
+                event.appid = appid;
+
+                if (g_strcmp0("start-failure", typestr) == 0)
+                {
+                    event.failure = FailureType::START_FAILURE;
+                }
+                else if (g_strcmp0("crash", typestr) != 0)
+                {
+                    g_warning("Application failure type '%s' unknown, reporting as a crash", typestr);
+                }
+
+                impl->queueLifecycleEvent(std::move(event));
+            },        /* callback */
+            this,     /* user data */
+            nullptr)); /* user data destroy */
+
+        /* Applications being paused and resumed. The bulk signals are always
+           followed by these, so listening to both would report them twice. */
+        auto pausedCb = [](GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar* signal,
+                           GVariant* params, gpointer user_data) -> void {
+            auto impl = static_cast<Registry::Impl*>(user_data);
+
+            const gchar* appid = nullptr;
+            GVariant* vpids = nullptr;
+            g_variant_get(params, "(&s@at)", &appid, &vpids);
+
+            LifecycleEvent event;
+            event.type = g_strcmp0(signal, "ApplicationPaused") == 0 ? LifecycleEvent::Type::PAUSED
+                                                                     : LifecycleEvent::Type::RESUMED;
+            event.appid = appid;
+            event.pids = lifecyclePids(vpids);
+            g_variant_unref(vpids);
+
+            impl->queueLifecycleEvent(std::move(event));
+        };
+
+        for (auto signal : {"ApplicationPaused", "ApplicationResumed"})
+        {
+            lifecycleSignals_.push_back(g_dbus_connection_signal_subscribe(
+                _dbus.get(),                     /* bus */
+                nullptr,                         /* sender */
+                "com.canonical.UbuntuAppLaunch", /* interface */
+                signal,                          /* signal */
+                "/",                             /* path */
+                nullptr,                         /* arg0 */
+                G_DBUS_SIGNAL_FLAGS_NONE,
+                pausedCb, /* callback */
+                this,     /* user data */
+                nullptr)); /* user data destroy */
+        }
+
+        return true;
+    });
+}
+
+/** Sets how long lifecycle signals are held to be merged with the ones
+    that come after them */
+void Registry::Impl::setSignalCoalescing(std::chrono::milliseconds window)
+{
+    thread.executeOnThread<bool>([this, window]() {
+        lifecycleWindow_ = window;
+
+        if (window == std::chrono::milliseconds::zero())
+        {
+            flushLifecycleEvents();
+        }
+
+        return true;
+    });
+}
+
+/** Takes a signal that has come off the bus and either sends it right
+    away, or if we're coalescing, holds it until the window closes. A
+    signal that repeats the last one we're holding for the same instance
+    is merged into it. We only look at the last one so that a pause
+    followed by a resume and another pause still ends up paused. */
+void Registry::Impl::queueLifecycleEvent(LifecycleEvent&& event)
+{
+    if (lifecycleWindow_ == std::chrono::milliseconds::zero())
+    {
+        emitLifecycleEvent(event);
+        return;
+    }
+
+    auto last = std::find_if(lifecyclePending_.rbegin(), lifecyclePending_.rend(),
+                             [&event](const LifecycleEvent& pending) {
+                                 return pending.appid == event.appid && pending.instance == event.instance;
+                             });
+
+    if (last != lifecyclePending_.rend() && last->type == event.type)
+    {
+        for (auto pid : event.pids)
+        {
+            if (std::find(last->pids.begin(), last->pids.end(), pid) == last->pids.end())
+            {
+                last->pids.push_back(pid);
+            }
+        }
+        last->failure = event.failure;
+        return;
+    }
+
+    if (lifecyclePending_.empty())
+    {
+        thread.timeout(lifecycleWindow_, [this]() { flushLifecycleEvents(); });
+    }
+
+    lifecyclePending_.emplace_back(std::move(event));
+}
+
+/** Sends all the signals that we've been holding */
+void Registry::Impl::flushLifecycleEvents()
+{
+    auto pending = std::move(lifecyclePending_);
+    lifecyclePending_.clear();
+
+    for (const auto& event : pending)
+    {
+        emitLifecycleEvent(event);
+    }
+}
+
+/** Builds the Application and Instance objects for a signal from the bus
+    and signals them to our subscribers */
+void Registry::Impl::emitLifecycleEvent(const LifecycleEvent& event)
+{
+    auto reg = lifecycleRegistry_.lock();
+    if (!reg)
+    {
+        return;
+    }
+
+    std::shared_ptr<Application> app;
+    try
+    {
+        app = Application::create(AppID::find(reg, event.appid), reg);
+    }
+    catch (std::runtime_error& e)
+    {
+        g_warning("Unable to find application for lifecycle signal '%s': %s", event.appid.c_str(), e.what());
+        return;
+    }
+
+    /* Upstart tells us about the instance, the others only give us the
+       application, so we find the instance that has the processes */
+    std::shared_ptr<Application::Instance> instance;
+    if (!event.job.empty())
+    {
+        instance = std::make_shared<app_impls::UpstartInstance>(app->appId(), event.job, event.instance,
+                                                                std::vector<Application::URL>{}, reg);
+    }
+    else
+    {
+        try
+        {
+            for (const auto& candidate : app->instances())
+            {
+                if (event.pids.empty() ||
+                    std::find(event.pids.begin(), event.pids.end(), candidate->primaryPid()) != event.pids.end())
+                {
+                    instance = candidate;
+                    break;
+                }
+            }
+        }
+        catch (std::runtime_error& e)
+        {
+            g_debug("Unable to get instances of '%s': %s", event.appid.c_str(), e.what());
+        }
+    }
+
+    switch (event.type)
     {
-        _iconFinders[basePath] = std::make_shared<IconFinder>(basePath);
+        case LifecycleEvent::Type::STARTED:
+            sig_appStarted(app, instance);
+            break;
+        case LifecycleEvent::Type::STOPPED:
+            sig_appStopped(app, instance);
+            break;
+        case LifecycleEvent::Type::FAILED:
+            sig_appFailed(app, instance, event.failure);
+            break;
+        case LifecycleEvent::Type::PAUSED:
+            sig_appPaused(app, instance, event.pids);
+            break;
+        case LifecycleEvent::Type::RESUMED:
+            sig_appResumed(app, instance, event.pids);
+            break;
     }
-    return _iconFinders[basePath];
 }
 
 #if 0
@@ -17,13 +17,20 @@
  *     Ted Gould <ted.gould@canonical.com>
  */
 
+#include "application-index.h"
 #include "glib-thread.h"
+#include "keyfile-cache.h"
+#include "oom-fd-cache.h"
+#include "pid-job-cache.h"
+#include "pid-source.h"
 #include "registry.h"
 #include "snapd-info.h"
+#include <atomic>
 #include <click.h>
 #include <gio/gio.h>
 #include <json-glib/json-glib.h>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <zeitgeist.h>
 
@@ -71,13 +78,74 @@ public:
 
     std::shared_ptr<IconFinder> getIconFinder(std::string basePath);
 
+    /* Parsed desktop files shared by all the applications */
+    std::shared_ptr<KeyfileCache> getKeyfileCache();
+
+    /* Installed application index */
+    std::shared_ptr<ApplicationIndex> getApplicationIndex();
+    ApplicationIndex::Stamps installedAppsStamps();
+
+    /** A packaging scheme that installed applications come from */
+    struct InstalledBackend
+    {
+        ApplicationIndex::Backend backend; /**< Which backend it is in the index */
+        std::function<std::list<std::shared_ptr<Application>>(const std::shared_ptr<Registry>&)>
+            list;                                                                  /**< Lists its applications */
+        std::function<std::string(const std::shared_ptr<Application>&)> interface; /**< Interface to save in the index */
+        /** Builds one application the way list() would, or nullptr if list()
+            wouldn't have it. Empty if the backend can only be listed. */
+        std::function<std::shared_ptr<Application>(const AppID&, const std::shared_ptr<Registry>&)> listed;
+        /** Whether listing gets things from the registry thread, so it
+            can't be waited on from there */
+        bool usesThread;
+    };
+    static std::vector<InstalledBackend> installedBackends();
+    static std::list<ApplicationIndex::Entry> indexEntries(const InstalledBackend& backend,
+                                                           const std::list<std::shared_ptr<Application>>& apps);
+
+    /* Installed application changes */
+    core::Signal<const std::shared_ptr<Application>&>& appInstalled(const std::shared_ptr<Registry>& reg);
+    core::Signal<const AppID&>& appRemoved(const std::shared_ptr<Registry>& reg);
+    core::Signal<const std::shared_ptr<Application>&>& appUpdated(const std::shared_ptr<Registry>& reg);
+    bool watchedInstalledApps(std::list<ApplicationIndex::Entry>& entries);
+
     void zgSendEvent(AppID appid, const std::string& eventtype);
 
     std::vector<pid_t> pidsFromCgroup(const std::string& jobpath);
+    bool freezeCgroup(const std::string& jobpath, bool freeze);
+    /* Upstart job of each process, shared by all the lookups */
+    std::shared_ptr<PidJobCache> getPidJobCache();
+    /* Open OOM adjustment files, only used on the registry thread */
+    std::shared_ptr<OomFdCache> getOomFdCache();
 
     /* Upstart Jobs */
     std::list<std::string> upstartInstancesForJob(const std::string& job);
+    bool upstartHasInstance(const std::string& job, const std::string& instance);
     std::string upstartJobPath(const std::string& job);
+    pid_t upstartInstancePrimaryPid(const std::string& job, const std::string& instance);
+
+    /* Session bus names */
+    void busNamesForPids(const std::vector<pid_t>& pids, std::function<void(const std::vector<std::string>&)> found);
+    std::vector<std::string> busNamesForPids(const std::vector<pid_t>& pids);
+    bool watchingBusNames();
+    void setBusNamesIdleTime(const std::chrono::milliseconds& idle);
+
+    /* Application lifecycle signals */
+    core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>& appStarted(
+        const std::shared_ptr<Registry>& reg);
+    core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>& appStopped(
+        const std::shared_ptr<Registry>& reg);
+    core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&, FailureType>&
+        appFailed(const std::shared_ptr<Registry>& reg);
+    core::Signal<const std::shared_ptr<Application>&,
+                 const std::shared_ptr<Application::Instance>&,
+                 const std::vector<pid_t>&>&
+        appPaused(const std::shared_ptr<Registry>& reg);
+    core::Signal<const std::shared_ptr<Application>&,
+                 const std::shared_ptr<Application::Instance>&,
+                 const std::vector<pid_t>&>&
+        appResumed(const std::shared_ptr<Registry>& reg);
+    void setSignalCoalescing(std::chrono::milliseconds window);
 
     static std::string printJson(std::shared_ptr<JsonObject> jsonobj);
     static std::string printJson(std::shared_ptr<JsonNode> jsonnode);
@@ -101,15 +169,218 @@ private:
 
     std::shared_ptr<ZeitgeistLog> zgLog_;
 
-    std::shared_ptr<GDBusConnection> cgManager_;
-
-    void initCGManager();
+    /** Where to get the PIDs of a cgroup from, in order of preference */
+    std::list<std::shared_ptr<PidSource>> pidSources_;
+    /** Whether to pause with the freezer when we can, instead of signals */
+    bool useFreezer_ = true;
+    /** Whether to wait for the freezer to say a group is frozen */
+    bool waitFreezer_ = false;
 
     std::unordered_map<std::string, std::shared_ptr<IconFinder>> _iconFinders;
 
+    /** Cache of the desktop files we've parsed */
+    std::shared_ptr<KeyfileCache> keyfileCache_;
+
+    /** Jobs of the processes we've been asked about */
+    std::shared_ptr<PidJobCache> pidJobCache_;
+
+    /** OOM adjustment files of the processes we've set, made when first used */
+    std::shared_ptr<OomFdCache> oomFdCache_;
+
+    /** Index of the installed applications, null if it is disabled */
+    std::shared_ptr<ApplicationIndex> appIndex_;
+
     /** Getting the Upstart job path is relatively expensive in
         that it requires a DBus call. Worth keeping a cache of. */
     std::map<std::string, std::string> upstartJobPathCache_;
+
+    /** What we know about an instance of an Upstart job */
+    struct UpstartInstanceInfo
+    {
+        std::string job;      /**< Name of the job the instance is of */
+        std::string name;     /**< Name of the instance */
+        pid_t primaryPid = 0; /**< First PID in the processes, 0 if there are none */
+    };
+    /** Instances of the jobs we're watching indexed by their object path. This is
+        kept up to date using the signals from Upstart so that we don't need to
+        make DBus calls to know what is running. Only used on the thread. */
+    std::map<std::string, UpstartInstanceInfo> upstartInstances_;
+    /** A job that we're watching for instances being added and removed */
+    struct UpstartJobWatch
+    {
+        guint signal = 0;                    /**< Subscription to the signals of the job */
+        bool enumerated = false;             /**< Whether we've fetched all of its instances */
+        std::set<std::string> lookedUpNames; /**< Instance names asked about with upstartHasInstance() */
+    };
+    /** Jobs that we are watching for changes on. Only used on the thread. */
+    std::map<std::string, UpstartJobWatch> upstartWatchedJobs_;
+    /** Signal subscriptions that are shared by all watched jobs */
+    std::list<guint> upstartInstanceSignals_;
+
+    bool watchUpstartJob(const std::string& job, const std::string& jobpath);
+    void subscribeUpstartJob(const std::string& job, const std::string& jobpath);
+    std::string fetchUpstartInstanceByName(const std::string& job,
+                                           const std::string& jobpath,
+                                           const std::string& instance);
+    void clearUpstartInstances();
+    void fetchUpstartInstance(const std::string& job, const std::string& path, unsigned int* pending);
+    void updateUpstartInstance(const std::string& job, const std::string& path, GVariant* props);
+    static void upstartInstanceFetched(GObject* obj, GAsyncResult* res, gpointer user_data);
+
+    /** The PID owning each unique name on the session bus, 0 while we're
+        waiting to hear from the bus. Kept up to date with NameOwnerChanged
+        so that finding the connections of a process doesn't require asking
+        about every connection on the bus. Only used on the thread. */
+    std::map<std::string, pid_t> busNamePids_;
+    /** Subscription to NameOwnerChanged for busNamePids_, zero if we're not watching */
+    guint busNameSignal_ = 0;
+    /** Names from the ListNames call that we haven't asked the PID of.
+        The ones that come later are asked about as they show up. */
+    std::set<std::string> busNamesUnresolved_;
+    /** When the names were listed, in clock ticks after boot like the
+        start times of processes */
+    unsigned long long busNamesListedAt_ = 0;
+    /** Whether the ListNames call that fills busNamePids_ is still out */
+    bool busNamesListing_ = false;
+    /** Lookups waiting on the ListNames call */
+    std::list<std::function<void(bool)>> busNamesWaiting_;
+    /** Number of lookups that haven't found their names yet */
+    unsigned int busNamesLookups_ = 0;
+    /** How long to keep watching after the last lookup */
+    std::chrono::milliseconds busNamesIdleTime_{10000};
+
+    void watchBusNames(std::function<void(bool)> ready);
+    void busNamesListed(bool listed);
+    void busNamesLookupDone();
+    static void busNamesListCb(GObject* obj, GAsyncResult* res, gpointer user_data);
+
+    core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&> sig_appStarted;
+    core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&> sig_appStopped;
+    core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&, FailureType>
+        sig_appFailed;
+    core::Signal<const std::shared_ptr<Application>&,
+                 const std::shared_ptr<Application::Instance>&,
+                 const std::vector<pid_t>&>
+        sig_appPaused;
+    core::Signal<const std::shared_ptr<Application>&,
+                 const std::shared_ptr<Application::Instance>&,
+                 const std::vector<pid_t>&>
+        sig_appResumed;
+
+    /** An application signal that has been decoded from the bus but
+        not yet delivered */
+    struct LifecycleEvent
+    {
+        enum class Type
+        {
+            STARTED,
+            STOPPED,
+            FAILED,
+            PAUSED,
+            RESUMED
+        };
+        Type type;
+        std::string appid;                        /**< Application ID from the signal */
+        std::string job;                          /**< Upstart job, empty if the signal doesn't say */
+        std::string instance;                     /**< Instance ID, empty for single instance apps */
+        FailureType failure = FailureType::CRASH; /**< Why it failed, only for FAILED */
+        std::vector<pid_t> pids;                  /**< PIDs paused or resumed */
+    };
+
+    /** Registry the lifecycle signals build their objects with, it owns us
+        so we can't hold a reference to it */
+    std::weak_ptr<Registry> lifecycleRegistry_;
+    /** Subscriptions for the lifecycle signals, made when one of them is first
+        asked for. Only used on the thread. */
+    std::list<guint> lifecycleSignals_;
+    /** How long to hold lifecycle signals for merging, zero to send them
+        right away. Only used on the thread. */
+    std::chrono::milliseconds lifecycleWindow_{0};
+    /** Signals waiting for the window to close, oldest first. Only used
+        on the thread. */
+    std::list<LifecycleEvent> lifecyclePending_;
+
+    void watchLifecycle(const std::shared_ptr<Registry>& reg);
+    void queueLifecycleEvent(LifecycleEvent&& event);
+    void flushLifecycleEvents();
+    void emitLifecycleEvent(const LifecycleEvent& event);
+    void fetchBusNamePid(const std::string& name, std::function<void()> fetched);
+    static void busNamePidFetched(GObject* obj, GAsyncResult* res, gpointer user_data);
+
+    core::Signal<const std::shared_ptr<Application>&> sig_appInstalled;
+    core::Signal<const AppID&> sig_appRemoved;
+    core::Signal<const std::shared_ptr<Application>&> sig_appUpdated;
+
+    /** A path that the applications of a backend come from */
+    struct InstalledPath
+    {
+        std::string path;                  /**< Full path of the file or directory */
+        ApplicationIndex::Backend backend; /**< Backend whose applications it has */
+        bool directory;                    /**< Whether it is a directory of desktop files */
+        std::string idPrefix;              /**< Put in front of the desktop file names in a subdirectory */
+        std::string container;             /**< Libertine container the desktop files are in */
+    };
+    /** What we know about the installed applications of a backend while
+        we're watching for changes. These are kept as index entries as
+        the application objects hold on to the registry. */
+    struct InstalledState
+    {
+        std::list<ApplicationIndex::Entry> entries; /**< Applications in the order the backend listed them */
+        bool listed = false;                        /**< Whether the apps have been listed yet */
+        bool dirty = true;                          /**< Whether it needs to be listed again in full */
+        std::set<AppID> changedApps;                /**< Applications whose desktop files changed */
+    };
+    /** The result of looking at some of the backends again */
+    struct InstalledRescan
+    {
+        /** Backends to look at along with the applications that changed in each */
+        std::map<ApplicationIndex::Backend, std::set<AppID>> changedApps;
+        /** Backends that are listed in full instead of by application */
+        std::set<ApplicationIndex::Backend> full;
+        /** What each of the backends listed in full, missing if listing failed */
+        std::map<ApplicationIndex::Backend, std::list<std::shared_ptr<Application>>> apps;
+        /** Index entries for each of the applications listed in full */
+        std::map<ApplicationIndex::Backend, std::list<ApplicationIndex::Entry>> entries;
+        /** Each changed application of the other backends, null if it is no
+            longer installed. Missing if looking them up failed. */
+        std::map<ApplicationIndex::Backend, std::list<std::pair<AppID, std::shared_ptr<Application>>>> updates;
+        /** Stamps from before listing, empty if they're unavailable */
+        ApplicationIndex::Stamps stamps;
+        /** Registry the listing used, only let go of on the thread */
+        std::shared_ptr<Registry> registry;
+    };
+
+    /** Registry the installed application signals build their objects with,
+        it owns us so we can't hold a reference to it */
+    std::weak_ptr<Registry> installedRegistry_;
+    /** Installed applications of each backend, only has entries once we've
+        started watching. Only used on the thread. */
+    std::map<ApplicationIndex::Backend, InstalledState> installedStates_;
+    /** Monitors on the paths in installedAppsPaths() by path. Only used on
+        the thread. */
+    std::map<std::string, std::pair<InstalledPath, std::shared_ptr<GFileMonitor>>> installedMonitors_;
+    /** Whether we've started watching, so that installedApps() doesn't
+        need to go to the thread to find out */
+    std::atomic<bool> installedWatching_{false};
+    /** Whether a rescan has been scheduled to run after the changes settle */
+    bool installedRescanQueued_ = false;
+    /** Whether the backends are being listed on another thread */
+    bool installedRescanRunning_ = false;
+    /** The thread listing the backends, waited on when our thread exits */
+    std::future<void> installedRescan_;
+
+    std::list<InstalledPath> installedAppsPaths(bool containers = true);
+    static bool installedAppIdForFile(const InstalledPath& path, const std::string& name, AppID& appid);
+    void watchInstalled(const std::shared_ptr<Registry>& reg);
+    void syncInstalledMonitors();
+    static void installedPathChanged(GFileMonitor* monitor,
+                                     GFile* file,
+                                     GFile* otherfile,
+                                     GFileMonitorEvent event,
+                                     gpointer user_data);
+    void queueInstalledRescan();
+    void startInstalledRescan();
+    void applyInstalledRescan(const InstalledRescan& rescan);
 };
 
 }  // namespace app_launch
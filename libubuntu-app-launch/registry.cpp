@@ -18,12 +18,18 @@
  */
 
 #include <algorithm>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <numeric>
-#include <regex>
+#include <signal.h>
+#include <thread>
 
 #include "registry-impl.h"
 #include "registry.h"
 
+#include "appid-parser.h"
+#include "application-impl-base.h"
 #include "application-impl-click.h"
 #include "application-impl-legacy.h"
 #include "application-impl-libertine.h"
@@ -58,11 +64,10 @@ std::list<std::shared_ptr<Application>> Registry::runningApps(std::shared_ptr<Re
 
     /* Remove the instance ID */
     std::transform(instances.begin(), instances.end(), instances.begin(), [](std::string &instancename) -> std::string {
-        static const std::regex instanceregex("^(.*)-[0-9]*$");
-        std::smatch match;
-        if (std::regex_match(instancename, match, instanceregex))
+        appid_parser::Range appid{0, 0};
+        if (appid_parser::splitInstance(instancename, appid))
         {
-            return match[1].str();
+            return appid.of(instancename);
         }
         else
         {
@@ -104,20 +109,357 @@ std::list<std::shared_ptr<Application>> Registry::runningApps(std::shared_ptr<Re
     return apps;
 }
 
+/** Creates the application object for an entry in the installed
+    application index, using the backend that originally found it so
+    that we don't need to search for it again.
+
+    \param entry Entry from the index
+    \param connection Registry to use for persistent connections
+*/
+static std::shared_ptr<Application> appFromIndexEntry(const ApplicationIndex::Entry& entry,
+                                                      const std::shared_ptr<Registry>& connection)
+{
+    switch (entry.backend)
+    {
+        case ApplicationIndex::Backend::CLICK:
+            return std::make_shared<app_impls::Click>(entry.appid, connection);
+        case ApplicationIndex::Backend::LEGACY:
+            return std::make_shared<app_impls::Legacy>(entry.appid.appname, connection);
+        case ApplicationIndex::Backend::LIBERTINE:
+            return std::make_shared<app_impls::Libertine>(entry.appid.package, entry.appid.appname, connection);
+        case ApplicationIndex::Backend::SNAP:
+#ifdef ENABLE_SNAPPY
+            return std::make_shared<app_impls::Snap>(entry.appid, connection, entry.interface);
+#else
+            break;
+#endif
+    }
+
+    throw std::runtime_error("Application index has an entry for an unsupported backend: " +
+                             std::string(entry.appid));
+}
+
+/** Gets the installed applications from the ones we're watching for
+    changes, or from the index if it is up to date. If it isn't, the
+    index and the stamps to write it with are left set so it can be
+    written once the backends have been listed.
+
+    \param connection Registry to use for persistent connections
+    \param index Index of installed applications, reset if it can't be used
+    \param stamps Stamps of the application directories
+    \param list Applications from the index
+*/
+static bool installedAppsFromIndex(const std::shared_ptr<Registry>& connection,
+                                   std::shared_ptr<ApplicationIndex>& index,
+                                   ApplicationIndex::Stamps& stamps,
+                                   std::list<std::shared_ptr<Application>>& list)
+{
+    auto fromEntries = [&list, &connection](const std::list<ApplicationIndex::Entry>& entries) {
+        for (const auto& entry : entries)
+        {
+            list.emplace_back(appFromIndexEntry(entry, connection));
+        }
+    };
+
+    /* If we're watching for changes we already know what is installed */
+    std::list<ApplicationIndex::Entry> entries;
+    if (connection->impl->watchedInstalledApps(entries))
+    {
+        try
+        {
+            fromEntries(entries);
+            return true;
+        }
+        catch (std::runtime_error& e)
+        {
+            g_debug("Installed applications changed before we noticed, listing them: %s", e.what());
+            list.clear();
+            entries.clear();
+        }
+    }
+
+    index = connection->impl->getApplicationIndex();
+
+    /* NOTE: The stamps need to be taken before looking at the backends so that
+       if something changes while we're building the list the index is invalid
+       the next time instead of missing the change. */
+    if (index)
+    {
+        try
+        {
+            stamps = connection->impl->installedAppsStamps();
+        }
+        catch (std::runtime_error& e)
+        {
+            g_debug("Not using the installed application index: %s", e.what());
+            index.reset();
+        }
+    }
+
+    if (index && index->read(stamps, entries))
+    {
+        try
+        {
+            fromEntries(entries);
+            return true;
+        }
+        catch (std::runtime_error& e)
+        {
+            g_debug("Installed application index is out of date, rebuilding: %s", e.what());
+            list.clear();
+        }
+    }
+
+    return false;
+}
+
 std::list<std::shared_ptr<Application>> Registry::installedApps(std::shared_ptr<Registry> connection)
 {
+    std::shared_ptr<ApplicationIndex> index;
+    ApplicationIndex::Stamps stamps;
     std::list<std::shared_ptr<Application>> list;
 
-    list.splice(list.begin(), app_impls::Click::list(connection));
-    list.splice(list.begin(), app_impls::Legacy::list(connection));
-    list.splice(list.begin(), app_impls::Libertine::list(connection));
-#ifdef ENABLE_SNAPPY
-    list.splice(list.begin(), app_impls::Snap::list(connection));
-#endif
+    if (installedAppsFromIndex(connection, index, stamps, list))
+    {
+        return list;
+    }
+
+    /* The backends don't depend on each other and are mostly waiting on
+       files and services, so they're all listed at the same time on their
+       own threads. The results are added in the same order as always.
+       On the registry thread the ones that get things from it are listed
+       there instead, as it can't do that while waiting on them. */
+    auto backends = Registry::Impl::installedBackends();
+    auto onThread = connection->impl->thread.isCurrentThread();
+    std::vector<std::future<std::list<std::shared_ptr<Application>>>> lists;
+    for (const auto& backend : backends)
+    {
+        auto policy = onThread && backend.usesThread ? std::launch::deferred : std::launch::async;
+        lists.emplace_back(std::async(policy, backend.list, connection));
+    }
+
+    std::list<ApplicationIndex::Entry> entries;
+    for (size_t i = 0; i < backends.size(); i++)
+    {
+        auto apps = lists[i].get();
+        entries.splice(entries.begin(), Registry::Impl::indexEntries(backends[i], apps));
+        list.splice(list.begin(), apps);
+    }
+
+    if (index)
+    {
+        index->write(stamps, entries);
+    }
 
     return list;
 }
 
+/** Lists the installed applications for installedAppsAsync(), handing
+    each backend's applications to the callback as they're found
+
+    \param found Called with each set of applications that are found
+    \param connection Registry to use for persistent connections
+*/
+static void installedAppsFound(const std::function<void(const std::list<std::shared_ptr<Application>>&)>& found,
+                               const std::shared_ptr<Registry>& connection)
+{
+    std::shared_ptr<ApplicationIndex> index;
+    ApplicationIndex::Stamps stamps;
+    std::list<std::shared_ptr<Application>> list;
+
+    if (installedAppsFromIndex(connection, index, stamps, list))
+    {
+        found(list);
+        return;
+    }
+
+    /* Each backend hands over its applications as soon as it has them,
+       but only one at a time so the caller doesn't need to lock */
+    std::mutex foundLock;
+    auto backends = Registry::Impl::installedBackends();
+    std::vector<std::future<std::list<ApplicationIndex::Entry>>> lists;
+    for (const auto& backend : backends)
+    {
+        lists.emplace_back(std::async(std::launch::async, [&found, &foundLock, connection, backend]() {
+            auto apps = backend.list(connection);
+            auto entries = Registry::Impl::indexEntries(backend, apps);
+
+            if (!apps.empty())
+            {
+                std::lock_guard<std::mutex> guard(foundLock);
+                found(apps);
+            }
+
+            return entries;
+        }));
+    }
+
+    std::list<ApplicationIndex::Entry> entries;
+    for (auto& backendentries : lists)
+    {
+        entries.splice(entries.begin(), backendentries.get());
+    }
+
+    if (index)
+    {
+        index->write(stamps, entries);
+    }
+}
+
+std::future<void> Registry::installedAppsAsync(
+    std::function<void(const std::list<std::shared_ptr<Application>>&)> found, std::shared_ptr<Registry> connection)
+{
+    auto promise = std::make_shared<std::promise<void>>();
+    auto done = promise->get_future();
+
+    /* Not a std::async future, which would wait for the listing when it is
+       dropped. That would block the caller, and deadlock on the registry
+       thread, which the backends need to finish. */
+    std::thread([found, connection, promise]() {
+        try
+        {
+            installedAppsFound(found, connection);
+            promise->set_value();
+        }
+        catch (...)
+        {
+            promise->set_exception(std::current_exception());
+        }
+    }).detach();
+
+    return done;
+}
+
+/** Gets the instances that can be handled together by the Upstart backend,
+    and does the single instance operation on any that we don't know */
+static std::vector<std::shared_ptr<app_impls::UpstartInstance>> bulkInstances(
+    const std::vector<std::shared_ptr<Application::Instance>>& instances,
+    std::function<void(const std::shared_ptr<Application::Instance>&)> fallback)
+{
+    std::vector<std::shared_ptr<app_impls::UpstartInstance>> upstart;
+
+    for (const auto& instance : instances)
+    {
+        auto upinstance = std::dynamic_pointer_cast<app_impls::UpstartInstance>(instance);
+        if (upinstance)
+        {
+            upstart.push_back(upinstance);
+        }
+        else if (instance)
+        {
+            fallback(instance);
+        }
+    }
+
+    return upstart;
+}
+
+std::shared_ptr<Application> Registry::appForPid(pid_t pid, std::shared_ptr<Registry> registry)
+{
+    auto appid = PidJobCache::appIdFromJob(registry->impl->getPidJobCache()->get(pid));
+    if (appid.empty())
+    {
+        return {};
+    }
+
+    try
+    {
+        return Application::create(AppID::find(registry, appid), registry);
+    }
+    catch (std::runtime_error& e)
+    {
+        g_debug("Unable to find application '%s' for PID %d: %s", appid.c_str(), int(pid), e.what());
+        return {};
+    }
+}
+
+void Registry::pauseInstances(const std::vector<std::shared_ptr<Application::Instance>>& instances,
+                              std::shared_ptr<Registry> registry)
+{
+    auto upstart = bulkInstances(instances, [](const std::shared_ptr<Application::Instance>& instance) {
+        instance->pause();
+    });
+
+    app_impls::UpstartInstance::bulkLifecycle(registry, upstart, SIGSTOP, oom::paused(), "ApplicationsPaused",
+                                              "ApplicationPaused", ZEITGEIST_ZG_LEAVE_EVENT);
+}
+
+void Registry::resumeInstances(const std::vector<std::shared_ptr<Application::Instance>>& instances,
+                               std::shared_ptr<Registry> registry)
+{
+    auto upstart = bulkInstances(instances, [](const std::shared_ptr<Application::Instance>& instance) {
+        instance->resume();
+    });
+
+    app_impls::UpstartInstance::bulkLifecycle(registry, upstart, SIGCONT, oom::focused(), "ApplicationsResumed",
+                                              "ApplicationResumed", ZEITGEIST_ZG_ACCESS_EVENT);
+}
+
+void Registry::setOomAdjustment(const std::vector<std::shared_ptr<Application::Instance>>& instances,
+                                const oom::Score score,
+                                std::shared_ptr<Registry> registry)
+{
+    auto upstart = bulkInstances(instances, [score](const std::shared_ptr<Application::Instance>& instance) {
+        instance->setOomAdjustment(score);
+    });
+
+    app_impls::UpstartInstance::bulkLifecycle(registry, upstart, 0, score, {}, {}, nullptr);
+}
+
+core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>& Registry::appStarted(
+    std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appStarted(registry);
+}
+
+core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>& Registry::appStopped(
+    std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appStopped(registry);
+}
+
+core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&, Registry::FailureType>&
+    Registry::appFailed(std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appFailed(registry);
+}
+
+core::Signal<const std::shared_ptr<Application>&,
+             const std::shared_ptr<Application::Instance>&,
+             const std::vector<pid_t>&>&
+    Registry::appPaused(std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appPaused(registry);
+}
+
+core::Signal<const std::shared_ptr<Application>&,
+             const std::shared_ptr<Application::Instance>&,
+             const std::vector<pid_t>&>&
+    Registry::appResumed(std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appResumed(registry);
+}
+
+void Registry::setSignalCoalescing(std::chrono::milliseconds window, std::shared_ptr<Registry> registry)
+{
+    registry->impl->setSignalCoalescing(window);
+}
+
+core::Signal<const std::shared_ptr<Application>&>& Registry::appInstalled(std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appInstalled(registry);
+}
+
+core::Signal<const AppID&>& Registry::appRemoved(std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appRemoved(registry);
+}
+
+core::Signal<const std::shared_ptr<Application>&>& Registry::appUpdated(std::shared_ptr<Registry> registry)
+{
+    return registry->impl->appUpdated(registry);
+}
+
 std::list<std::shared_ptr<Helper>> Registry::runningHelpers(Helper::Type type, std::shared_ptr<Registry> connection)
 {
     std::list<std::shared_ptr<Helper>> list;
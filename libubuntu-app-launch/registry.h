@@ -17,8 +17,10 @@
  *     Ted Gould <ted.gould@canonical.com>
  */
 
+#include <chrono>
 #include <core/signal.h>
 #include <functional>
+#include <future>
 #include <list>
 #include <memory>
 
@@ -72,15 +74,123 @@ public:
         \param registry Shared registry for the tracking
     */
     static std::list<std::shared_ptr<Application>> installedApps(std::shared_ptr<Registry> registry = getDefault());
+    /** List all of the installed applications, handing them over as each
+        packaging scheme finds them instead of waiting for all of them. The
+        callback is called on a worker thread, never by more than one thread
+        at a time, and gets each application only once. When the list comes
+        from the cached index the applications are all in a single call.
+
+        The listing carries on if the returned future is dropped, so the
+        call never waits for it.
+
+        \param found Called with each set of applications that are found
+        \param registry Shared registry for the tracking
+
+        \return Future that is ready once all the applications have been found
+    */
+    static std::future<void> installedAppsAsync(
+        std::function<void(const std::list<std::shared_ptr<Application>>&)> found,
+        std::shared_ptr<Registry> registry = getDefault());
+    /** Find the application that a process belongs to. This looks at the
+        cgroup the process is in, so it doesn't need to look at the processes
+        of every application. Returns nullptr if the process isn't part of
+        an application, or its cgroup can't be read.
+
+        \param pid Process to look for
+        \param registry Shared registry for the tracking
+    */
+    static std::shared_ptr<Application> appForPid(pid_t pid, std::shared_ptr<Registry> registry = getDefault());
 
-#if 0 /* TODO -- In next MR */
     /* Signals to discover what is happening to apps */
-    core::Signal<std::shared_ptr<Application>, std::shared_ptr<Application::Instance>> appStarted;
-    core::Signal<std::shared_ptr<Application>, std::shared_ptr<Application::Instance>> appStopped;
-    core::Signal<std::shared_ptr<Application>, std::shared_ptr<Application::Instance>, FailureType> appFailed;
-    core::Signal<std::shared_ptr<Application>, std::shared_ptr<Application::Instance>> appPaused;
-    core::Signal<std::shared_ptr<Application>, std::shared_ptr<Application::Instance>> appResumed;
+    /** Get the signal object that is signaled when an application has been
+        started.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>&
+        appStarted(std::shared_ptr<Registry> registry = getDefault());
+    /** Get the signal object that is signaled when an application has stopped.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const std::shared_ptr<Application>&, const std::shared_ptr<Application::Instance>&>&
+        appStopped(std::shared_ptr<Registry> registry = getDefault());
+    /** Get the signal object that is signaled when an application has failed.
+        The instance is nullptr if it could no longer be found.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const std::shared_ptr<Application>&,
+                        const std::shared_ptr<Application::Instance>&,
+                        FailureType>&
+        appFailed(std::shared_ptr<Registry> registry = getDefault());
+    /** Get the signal object that is signaled when an application has been
+        paused, along with the PIDs that were paused. The instance is nullptr
+        if it could not be found.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const std::shared_ptr<Application>&,
+                        const std::shared_ptr<Application::Instance>&,
+                        const std::vector<pid_t>&>&
+        appPaused(std::shared_ptr<Registry> registry = getDefault());
+    /** Get the signal object that is signaled when an application has been
+        resumed, along with the PIDs that were resumed. The instance is nullptr
+        if it could not be found.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const std::shared_ptr<Application>&,
+                        const std::shared_ptr<Application::Instance>&,
+                        const std::vector<pid_t>&>&
+        appResumed(std::shared_ptr<Registry> registry = getDefault());
+    /** Holds the application signals for a window of time after the first
+        one arrives, so that a burst of them, like everything being paused
+        when the screen turns off, is delivered together. Repeats of the same
+        event for an instance within the window are merged into a single
+        signal. A window of zero, the default, delivers each signal as soon
+        as it arrives.
 
+        \param window Length of time to hold the signals for
+        \param registry Shared registry for the tracking
+    */
+    static void setSignalCoalescing(std::chrono::milliseconds window, std::shared_ptr<Registry> registry = getDefault());
+
+    /* Signals to discover what is happening to the installed apps */
+    /** Get the signal object that is signaled when an application has been
+        installed. Asking for any of the installed application signals
+        starts watching the directories that applications come from, after
+        which installedApps() is answered from what has been found.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const std::shared_ptr<Application>&>& appInstalled(
+        std::shared_ptr<Registry> registry = getDefault());
+    /** Get the signal object that is signaled when an application has been
+        removed. Only the ID is given, as there is nothing left to build an
+        application object with.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const AppID&>& appRemoved(std::shared_ptr<Registry> registry = getDefault());
+    /** Get the signal object that is signaled when an installed application
+        has changed, either a new version of its package or a change to its
+        desktop file.
+
+        \note This signal handler is activated on the UAL thread
+        \param registry Shared registry for the tracking
+    */
+    static core::Signal<const std::shared_ptr<Application>&>& appUpdated(
+        std::shared_ptr<Registry> registry = getDefault());
+
+#if 0 /* TODO -- In next MR */
     /* The Application Manager, almost always if you're not Unity8, don't
        use this API. Testing is a special case. */
     class Manager
@@ -96,6 +206,39 @@ public:
     void clearManager ();
 #endif
 
+    /* Bulk lifecycle */
+    /** Pause a set of application instances. This does the same thing as
+        calling Application::Instance::pause() on each of them, but finds and
+        signals all of the PIDs in one pass. A single ApplicationsPaused
+        notification is sent for all of them, followed by the usual
+        ApplicationPaused for each.
+
+        \param instances Instances to pause
+        \param registry Shared registry for the tracking
+    */
+    static void pauseInstances(const std::vector<std::shared_ptr<Application::Instance>>& instances,
+                               std::shared_ptr<Registry> registry = getDefault());
+    /** Resume a set of application instances. This does the same thing as
+        calling Application::Instance::resume() on each of them, but in
+        one pass. A single ApplicationsResumed notification is sent for all
+        of them, followed by the usual ApplicationResumed for each.
+
+        \param instances Instances to resume
+        \param registry Shared registry for the tracking
+    */
+    static void resumeInstances(const std::vector<std::shared_ptr<Application::Instance>>& instances,
+                                std::shared_ptr<Registry> registry = getDefault());
+    /** Set the OOM score of all the processes in a set of application
+        instances in one pass.
+
+        \param instances Instances to adjust
+        \param score OOM Score to set
+        \param registry Shared registry for the tracking
+    */
+    static void setOomAdjustment(const std::vector<std::shared_ptr<Application::Instance>>& instances,
+                                 const oom::Score score,
+                                 std::shared_ptr<Registry> registry = getDefault());
+
     /* Helper Lists */
     /** Get a list of all the helpers for a given helper type
 
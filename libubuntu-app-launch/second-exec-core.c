@@ -30,7 +30,6 @@ typedef struct {
 	GDBusConnection * bus;
 	gchar * appid;
 	gchar ** input_uris;
-	GPid app_pid;
 	guint connections_open;
 	GVariant * app_data;
 	gchar * dbus_path;
@@ -232,130 +231,28 @@ contact_app (GDBusConnection * bus, const gchar * dbus_name, second_exec_t * dat
 	return;
 }
 
-typedef struct {
-	gchar * name;
-	second_exec_t * data;
-} get_pid_t;
-
-/* Gets the PID for a connection, and if it matches the one we're looking
-   for then it tries to send a message to that connection */
-static void
-get_pid_cb (GObject * object, GAsyncResult * res, gpointer user_data)
-{
-	get_pid_t * data = (get_pid_t *)user_data;
-	GError * error = NULL;
-	GVariant * vpid = NULL;
-
-	ual_tracepoint(second_exec_got_pid, data->data->appid, data->name);
-
-	vpid = g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), res, &error);
-
-	if (error != NULL) {
-		g_warning("Unable to query PID for dbus name '%s': %s", data->name, error->message);
-		g_error_free(error);
-
-		/* Lowering the connection count, this one is terminal, even if in error */
-		connection_count_dec(data->data);
-
-		g_free(data->name);
-		g_free(data);
-
-		return;
-	}
-
-	guint pid = 0;
-	g_variant_get(vpid, "(u)", &pid);
-	g_variant_unref(vpid);
-
-	if (pid == data->data->app_pid) {
-		/* Trying to send a message to the connection */
-		contact_app(G_DBUS_CONNECTION(object), data->name, data->data);
-	} else {
-		/* See if we can quit now */
-		connection_count_dec(data->data);
-	}
-
-	g_free(data->name);
-	g_free(data);
-
-	return;
-}
-
-/* Starts to look for the PID and the connections for that PID */
+/* Sends the URIs to all the connections of the application */
 static void
-find_appid_pid (GDBusConnection * session, second_exec_t * data)
+contact_app_names (GDBusConnection * session, const gchar * const * dbus_names, second_exec_t * data)
 {
-	GError * error = NULL;
-
-	/* List all the connections on dbus.  This sucks that we have to do
-	   this, but in the future we should add DBus API to do this lookup
-	   instead of having to do it with a bunch of requests */
-	GVariant * listnames = g_dbus_connection_call_sync(session,
-		"org.freedesktop.DBus",
-		"/",
-		"org.freedesktop.DBus",
-		"ListNames",
-		NULL,
-		G_VARIANT_TYPE("(as)"),
-		G_DBUS_CALL_FLAGS_NONE,
-		-1,
-		NULL,
-		&error);
-
-	if (error != NULL) {
-		g_warning("Unable to get list of names from DBus: %s", error->message);
-		g_error_free(error);
-		return;
-	}
-
 	g_debug("Got bus names");
 	ual_tracepoint(second_exec_got_dbus_names, data->appid);
 
-	g_debug("Primary PID: %d", data->app_pid);
-	ual_tracepoint(second_exec_got_primary_pid, data->appid);
-
-	/* Get the names */
-	GVariant * names = g_variant_get_child_value(listnames, 0);
-	GVariantIter iter;
-	g_variant_iter_init(&iter, names);
-	gchar * name = NULL;
-
-	while (g_variant_iter_loop(&iter, "s", &name)) {
-		/* We only want to ask each connection once, this makes that so */
-		if (!g_dbus_is_unique_name(name)) {
-			continue;
-		}
-		
-		get_pid_t * pid_data = g_new0(get_pid_t, 1);
-		pid_data->data = data;
-		pid_data->name = g_strdup(name);
-
-		ual_tracepoint(second_exec_request_pid, data->appid, pid_data->name);
-
-		/* Get the PIDs */
-		g_dbus_connection_call(session,
-			"org.freedesktop.DBus",
-			"/",
-			"org.freedesktop.DBus",
-			"GetConnectionUnixProcessID",
-			g_variant_new("(s)", name),
-			G_VARIANT_TYPE("(u)"),
-			G_DBUS_CALL_FLAGS_NONE,
-			-1,
-			NULL,
-			get_pid_cb, pid_data);
+	if (dbus_names == NULL) {
+		return;
+	}
 
+	int i;
+	for (i = 0; dbus_names[i] != NULL; i++) {
 		data->connections_open++;
+		contact_app(session, dbus_names[i], data);
 	}
 
-	g_variant_unref(names);
-	g_variant_unref(listnames);
-
 	return;
 }
 
 gboolean
-second_exec (GDBusConnection * session, GCancellable * cancel, GPid pid, const gchar * app_id, gchar ** appuris)
+second_exec (GDBusConnection * session, GCancellable * cancel, const gchar * const * dbus_names, const gchar * app_id, gchar ** appuris)
 {
 	ual_tracepoint(second_exec_start, app_id);
 	GError * error = NULL;
@@ -365,7 +262,6 @@ second_exec (GDBusConnection * session, GCancellable * cancel, GPid pid, const g
 	data->appid = g_strdup(app_id);
 	data->input_uris = g_strdupv(appuris);
 	data->bus = g_object_ref(session);
-	data->app_pid = pid;
 
 	/* Set up listening for the unfrozen signal from Unity */
 	data->signal = g_dbus_connection_signal_subscribe(session,
@@ -403,9 +299,9 @@ second_exec (GDBusConnection * session, GCancellable * cancel, GPid pid, const g
 		data->unity_starttime = 0;
 	}
 
-	/* If we've got something to give out, start looking for how */
+	/* If we've got something to give out, send it to the app */
 	if (data->input_uris != NULL) {
-		find_appid_pid(session, data);
+		contact_app_names(session, dbus_names, data);
 	} else {
 		g_debug("No URIs to send");
 	}
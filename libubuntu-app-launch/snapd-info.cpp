@@ -21,7 +21,7 @@
 
 #include "registry-impl.h"
 
-#include <curl/curl.h>
+#include <sys/stat.h>
 #include <vector>
 
 namespace ubuntu
@@ -56,6 +56,18 @@ Info::Info()
         snapBasedir = "/snap";
     }
 
+    /* The state file goes with the system snapd, so we only use the default
+       if we're talking to the system snapd */
+    auto snapdStateEnv = g_getenv("UBUNTU_APP_LAUNCH_SNAPD_STATE");
+    if (G_UNLIKELY(snapdStateEnv != nullptr))
+    {
+        snapdState = snapdStateEnv;
+    }
+    else if (snapdEnv == nullptr)
+    {
+        snapdState = "/var/lib/snapd/state.json";
+    }
+
     if (g_file_test(snapdSocket.c_str(), G_FILE_TEST_EXISTS))
     {
         snapdExists = true;
@@ -81,7 +93,7 @@ std::shared_ptr<Info::PkgInfo> Info::pkgInfo(const AppID::Package &package) cons
 
     try
     {
-        auto snapnode = snapdJson("/v2/snaps/" + package.value());
+        auto snapnode = snapdJson("/v2/snaps/" + package.value(), true);
         auto snapobject = json_node_get_object(snapnode.get());
         if (snapobject == nullptr)
         {
@@ -190,23 +202,88 @@ static size_t snapd_writefunc(char *ptr, size_t size, size_t nmemb, void *userda
     return size * nmemb;
 }
 
+/** Function that gets each header line of the response from cURL
+    so that we can pick out the ETag.
+
+    \param ptr header line, not null terminated
+    \param size block size
+    \param nmemb number of blocks
+    \param userdata string to store the ETag in
+*/
+static size_t snapd_headerfunc(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    auto etag = static_cast<std::string *>(userdata);
+    std::string header(ptr, size * nmemb);
+
+    if (g_ascii_strncasecmp(header.c_str(), "ETag:", 5) == 0)
+    {
+        auto value = g_strdup(header.c_str() + 5);
+        *etag = g_strstrip(value);
+        g_free(value);
+    }
+
+    return size * nmemb;
+}
+
+/** Builds a stamp out of the state file of snapd that changes whenever
+    snapd changes its state. Returns an empty string if there is no state
+    file to use. */
+std::string Info::stateStamp() const
+{
+    struct stat buf;
+    if (snapdState.empty() || stat(snapdState.c_str(), &buf) != 0)
+    {
+        return {};
+    }
+
+    return std::to_string(buf.st_ino) + ":" + std::to_string(buf.st_size) + ":" + std::to_string(buf.st_mtim.tv_sec) +
+           "." + std::to_string(buf.st_mtim.tv_nsec);
+}
+
 /** Asks the snapd process for some JSON. This function parses the basic
     response JSON that snapd returns and will error if a return code error
     is in the JSON. It then passes on the "result" part of the response
     to the caller.
 
     \param endpoint End of the URL to pass to snapd
+    \param cacheable Whether the result can be cached and reused until
+        snapd changes
 */
-std::shared_ptr<JsonNode> Info::snapdJson(const std::string &endpoint) const
+std::shared_ptr<JsonNode> Info::snapdJson(const std::string &endpoint, bool cacheable) const
 {
-    /* Setup the CURL connection and suck some data */
-    CURL *curl = curl_easy_init();
-    if (curl == nullptr)
+    std::lock_guard<std::mutex> lock(snapdLock);
+
+    /* Get the stamp before the request so that anything that changes
+       while we're asking gets noticed next time */
+    auto stamp = cacheable ? stateStamp() : std::string{};
+
+    auto cached = cacheable ? snapdCache.find(endpoint) : snapdCache.end();
+    if (cached != snapdCache.end() && !stamp.empty() && cached->second.stateStamp == stamp)
     {
-        throw std::runtime_error("Unable to create new cURL connection");
+        return cached->second.result;
     }
 
+    /* Setup the CURL connection, reusing the last one if we can */
+    if (!snapdConnection)
+    {
+        auto curl = curl_easy_init();
+        if (curl == nullptr)
+        {
+            throw std::runtime_error("Unable to create new cURL connection");
+        }
+        snapdConnection = std::shared_ptr<CURL>(curl, curl_easy_cleanup);
+    }
+    auto curl = snapdConnection.get();
+
     std::vector<char> data;
+    std::string etag;
+
+    std::shared_ptr<curl_slist> headers;
+    if (cached != snapdCache.end() && !cached->second.etag.empty())
+    {
+        headers = std::shared_ptr<curl_slist>(
+            curl_slist_append(nullptr, ("If-None-Match: " + cached->second.etag).c_str()), curl_slist_free_all);
+    }
 
     /* Configure the command */
     // curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
@@ -215,6 +292,9 @@ std::shared_ptr<JsonNode> Info::snapdJson(const std::string &endpoint) const
     curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, snapdSocket.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, snapd_writefunc);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &etag);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, snapd_headerfunc);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers.get());
 
     /* Overridable timeout */
     if (g_getenv("UBUNTU_APP_LAUNCH_DISABLE_SNAPD_TIMEOUT") == nullptr)
@@ -225,9 +305,15 @@ std::shared_ptr<JsonNode> Info::snapdJson(const std::string &endpoint) const
     /* Run the actual request (blocking) */
     auto res = curl_easy_perform(curl);
 
+    /* Don't leave pointers to our stack in the handle */
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, nullptr);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, nullptr);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr);
+
     if (res != CURLE_OK)
     {
-        curl_easy_cleanup(curl);
+        /* Start again with a fresh connection next time */
+        snapdConnection.reset();
         throw std::runtime_error("snapd HTTP server returned an error: " + std::string(curl_easy_strerror(res)));
     }
     else
@@ -235,7 +321,13 @@ std::shared_ptr<JsonNode> Info::snapdJson(const std::string &endpoint) const
         g_debug("Got %d bytes from snapd", int(data.size()));
     }
 
-    curl_easy_cleanup(curl);
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    if (code == 304 && cached != snapdCache.end())
+    {
+        cached->second.stateStamp = stamp;
+        return cached->second.result;
+    }
 
     /* Cool, we have data */
     auto parser = std::shared_ptr<JsonParser>(json_parser_new(), [](JsonParser *parser) { g_clear_object(&parser); });
@@ -308,6 +400,15 @@ std::shared_ptr<JsonNode> Info::snapdJson(const std::string &endpoint) const
 
     auto result = std::shared_ptr<JsonNode>(json_node_ref(json_object_get_member(rootobj, "result")), json_node_unref);
 
+    if (cacheable && (!stamp.empty() || !etag.empty()))
+    {
+        snapdCache[endpoint] = CacheEntry{etag, stamp, result};
+    }
+    else if (cached != snapdCache.end())
+    {
+        snapdCache.erase(cached);
+    }
+
     return result;
 }
 
@@ -325,7 +426,7 @@ void Info::forAllPlugs(std::function<void(JsonObject *plugobj)> plugfunc) const
         return;
     }
 
-    auto interfacesnode = snapdJson("/v2/interfaces");
+    auto interfacesnode = snapdJson("/v2/interfaces", true);
     auto interface = json_node_get_object(interfacesnode.get());
     if (interface == nullptr)
     {
@@ -373,19 +474,34 @@ void Info::forAllPlugs(std::function<void(JsonObject *plugobj)> plugfunc) const
 */
 std::set<AppID> Info::appsForInterface(const std::string &in_interface) const
 {
-    bool interfacefound = false;
-    std::set<AppID> appids;
+    std::map<std::string, std::shared_ptr<PkgInfo>> pkginfos;
+    return appsForInterfaces({in_interface}, pkginfos)[in_interface];
+}
+
+/** Gets all the apps that are available for a set of interfaces with a
+    single look at the list of interfaces. Each package is only asked
+    about once, and the package information is passed back so that the
+    caller doesn't need to ask again.
+
+    \param in_interfaces Which interfaces to get the sets of apps for
+    \param pkginfos Package information by package name for all the
+        packages that were found, packages already in it aren't asked for
+*/
+std::map<std::string, std::set<AppID>> Info::appsForInterfaces(
+    const std::set<std::string> &in_interfaces, std::map<std::string, std::shared_ptr<PkgInfo>> &pkginfos) const
+{
+    std::map<std::string, std::set<AppID>> appids;
 
     try
     {
-        forAllPlugs([this, &interfacefound, &appids, in_interface](JsonObject *ifaceobj) {
+        forAllPlugs([this, &appids, &pkginfos, &in_interfaces](JsonObject *ifaceobj) {
             std::string interfacename = json_object_get_string_member(ifaceobj, "interface");
-            if (interfacename != in_interface)
+            if (in_interfaces.find(interfacename) == in_interfaces.end())
             {
                 return;
             }
 
-            interfacefound = true;
+            auto &ifaceappids = appids[interfacename];
 
             auto cname = json_object_get_string_member(ifaceobj, "snap");
             if (cname == nullptr)
@@ -394,7 +510,13 @@ std::set<AppID> Info::appsForInterface(const std::string &in_interface) const
             }
             std::string snapname(cname);
 
-            auto pkginfo = pkgInfo(AppID::Package::from_raw(snapname));
+            auto pkginfoentry = pkginfos.find(snapname);
+            if (pkginfoentry == pkginfos.end())
+            {
+                pkginfoentry = pkginfos.emplace(snapname, pkgInfo(AppID::Package::from_raw(snapname))).first;
+            }
+
+            auto pkginfo = pkginfoentry->second;
             if (!pkginfo)
             {
                 return;
@@ -407,15 +529,18 @@ std::set<AppID> Info::appsForInterface(const std::string &in_interface) const
             {
                 std::string appname = json_array_get_string_element(apps, k);
 
-                appids.emplace(AppID(AppID::Package::from_raw(snapname),   /* package */
-                                     AppID::AppName::from_raw(appname),    /* appname */
-                                     AppID::Version::from_raw(revision))); /* version */
+                ifaceappids.emplace(AppID(AppID::Package::from_raw(snapname),   /* package */
+                                          AppID::AppName::from_raw(appname),    /* appname */
+                                          AppID::Version::from_raw(revision))); /* version */
             }
         });
 
-        if (!interfacefound)
+        for (const auto &interface : in_interfaces)
         {
-            g_debug("Unable to find information on interface '%s'", in_interface.c_str());
+            if (appids.find(interface) == appids.end())
+            {
+                g_debug("Unable to find information on interface '%s'", interface.c_str());
+            }
         }
     }
     catch (std::runtime_error &e)
@@ -471,6 +596,78 @@ std::set<std::string> Info::interfacesForAppId(const AppID &appid) const
     return interfaces;
 }
 
+/** Gets an identifier for the most recent change that snapd has made
+    to the system. Every install, removal, refresh or interface connection
+    is a change in snapd with an always incrementing ID, so this can be
+    used to know whether cached information from snapd is still valid.
+    The status is included so that changes that were in progress are
+    also noticed when they complete.
+
+    When we know where the state file of snapd is its stamp is used
+    instead, as snapd rewrites it with every change and it doesn't need
+    a request to snapd.
+
+    Returns an empty string if snapd couldn't be asked, which should be
+    treated as unknown. If there isn't a snapd on the system a constant
+    value is returned.
+*/
+std::string Info::changeId() const
+{
+    if (!snapdExists)
+    {
+        return "no-snapd";
+    }
+
+    auto stamp = stateStamp();
+    if (!stamp.empty())
+    {
+        return "state:" + stamp;
+    }
+
+    try
+    {
+        auto changesnode = snapdJson("/v2/changes?select=all", false);
+        auto changes = json_node_get_array(changesnode.get());
+        if (changes == nullptr)
+        {
+            throw std::runtime_error("Changes result isn't an array: " + Registry::Impl::printJson(changesnode));
+        }
+
+        guint64 lastid = 0;
+        std::string laststatus;
+        for (unsigned int i = 0; i < json_array_get_length(changes); i++)
+        {
+            auto changeobj = json_array_get_object_element(changes, i);
+            if (changeobj == nullptr || !json_object_has_member(changeobj, "id") ||
+                !json_object_has_member(changeobj, "status"))
+            {
+                continue;
+            }
+
+            auto cid = json_object_get_string_member(changeobj, "id");
+            auto cstatus = json_object_get_string_member(changeobj, "status");
+            if (cid == nullptr || cstatus == nullptr)
+            {
+                continue;
+            }
+
+            auto id = g_ascii_strtoull(cid, nullptr, 10);
+            if (id >= lastid)
+            {
+                lastid = id;
+                laststatus = cstatus;
+            }
+        }
+
+        return std::to_string(lastid) + ":" + laststatus;
+    }
+    catch (std::runtime_error &e)
+    {
+        g_warning("Unable to get change information: %s", e.what());
+        return {};
+    }
+}
+
 }  // namespace snapd
 }  // namespace app_launch
 }  // namespace ubuntu
@@ -20,9 +20,12 @@
 #pragma once
 
 #include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 
+#include <curl/curl.h>
 #include <json-glib/json-glib.h>
 
 #include "appid.h"
@@ -35,7 +38,14 @@ namespace snapd
 {
 
 /** Class that implements the connection to Snapd allowing us to get info
-    from it in a C++ friendly way. */
+    from it in a C++ friendly way.
+
+    The connection to snapd is kept open between requests, and the responses
+    for the interfaces and the packages are cached. A cached response is used
+    as long as snapd's state file hasn't changed since it was received, which
+    snapd rewrites on every change it makes. If snapd sends an ETag with a
+    response it is used to revalidate the response when the state file can't
+    be used. */
 class Info
 {
 public:
@@ -55,8 +65,20 @@ public:
 
     std::set<AppID> appsForInterface(const std::string &interface) const;
 
+    std::map<std::string, std::set<AppID>> appsForInterfaces(
+        const std::set<std::string> &interfaces, std::map<std::string, std::shared_ptr<PkgInfo>> &pkginfos) const;
+
     std::set<std::string> interfacesForAppId(const AppID &appid) const;
 
+    std::string changeId() const;
+
+    /** Path to the state file that snapd rewrites on every change, empty
+        if we don't know where it is */
+    const std::string &statePath() const
+    {
+        return snapdState;
+    }
+
 private:
     /** Path to the socket of snapd */
     std::string snapdSocket;
@@ -66,8 +88,28 @@ private:
     /** Result of a check at init to see if the socket is available. If
         not all functions will return null results. */
     bool snapdExists = false;
+    /** Path to the state file of snapd, empty if we can't use it to validate
+        our cache. This can be overridden with UBUNTU_APP_LAUNCH_SNAPD_STATE */
+    std::string snapdState;
+
+    /** A response from snapd along with what we need to check it is still valid */
+    struct CacheEntry
+    {
+        std::string etag;                 /**< ETag header of the response, empty if there wasn't one */
+        std::string stateStamp;           /**< Stamp of the state file when we made the request */
+        std::shared_ptr<JsonNode> result; /**< The 'result' part of the response */
+    };
+
+    /** Protects the connection and the cache, as a cURL handle can only be
+        used by one request at a time */
+    mutable std::mutex snapdLock;
+    /** Connection to snapd that we reuse between requests */
+    mutable std::shared_ptr<CURL> snapdConnection;
+    /** Cached responses by endpoint */
+    mutable std::map<std::string, CacheEntry> snapdCache;
 
-    std::shared_ptr<JsonNode> snapdJson(const std::string &endpoint) const;
+    std::string stateStamp() const;
+    std::shared_ptr<JsonNode> snapdJson(const std::string &endpoint, bool cacheable) const;
     void forAllPlugs(std::function<void(JsonObject *plugobj)> plugfunc) const;
 };
 
@@ -231,56 +231,46 @@ ubuntu_app_launch_application_log_path (const gchar * appid)
 	}
 }
 
-static GDBusConnection *
-gdbus_upstart_ref (void) {
-	static GDBusConnection * gdbus_upstart = NULL;
-
-	if (gdbus_upstart != NULL) {
-		return G_DBUS_CONNECTION(g_object_ref(gdbus_upstart));
-	}
-
-	GError * error = NULL;
-	gdbus_upstart = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
-
-	if (error != NULL) {
-		g_warning("Unable to connect to Upstart bus: %s", error->message);
-		g_error_free(error);
-		return NULL;
-	}
-
-	g_object_add_weak_pointer(G_OBJECT(gdbus_upstart), (void **)(&gdbus_upstart));
-
-	return gdbus_upstart;
-}
-
-/* The data we keep for each observer */
+/* The data we keep for each observer, the function is cast back to
+   the type of observer for the list that it is on */
 typedef struct _observer_t observer_t;
 struct _observer_t {
-	GDBusConnection * conn;
-	guint sighandle;
-	UbuntuAppLaunchAppObserver func;
+	GCallback func;
 	gpointer user_data;
+	gchar * type; /* Helper type with a ':' on the end, NULL for app observers */
+	GMainContext * context; /* Thread default context when it was added, called there */
 };
 
-/* The data we keep for each failed observer */
-typedef struct _failed_observer_t failed_observer_t;
-struct _failed_observer_t {
-	GDBusConnection * conn;
-	guint sighandle;
-	UbuntuAppLaunchAppFailedObserver func;
-	gpointer user_data;
+/* A signal on the session bus that observers need. Observers are called
+   on the thread default main context they were added in, so there is one
+   subscription for each context with observers. It is made when the first
+   observer in that context is added and dropped with the last one, so the
+   signal is only decoded once per context no matter how many observers
+   there are. */
+typedef struct _signal_sub_t signal_sub_t;
+struct _signal_sub_t {
+	const gchar * interface;
+	const gchar * signal;
+	const gchar * path;
+	const gchar * arg0;
+	GDBusSignalCallback callback;
+	GList * contexts; /* context_sub_t for each context with observers */
 };
 
-/* The data we keep for each failed observer */
-typedef struct _paused_resumed_observer_t paused_resumed_observer_t;
-struct _paused_resumed_observer_t {
+/* The subscription to a signal for one main context, this is the user
+   data of the signal callback */
+typedef struct _context_sub_t context_sub_t;
+struct _context_sub_t {
+	GMainContext * context;
 	GDBusConnection * conn;
-	guint sighandle;
-	UbuntuAppLaunchAppPausedResumedObserver func;
-	gpointer user_data;
-	const gchar * lttng_signal;
+	guint handle;
+	guint users;
 };
 
+/* Protects the lists of observers and the subscriptions, observers can
+   be added and removed from any thread */
+static GMutex observers_lock;
+
 /* The lists of Observers */
 static GList * starting_array = NULL;
 static GList * started_array = NULL;
@@ -290,485 +280,586 @@ static GList * resume_array = NULL;
 static GList * failed_array = NULL;
 static GList * paused_array = NULL;
 static GList * resumed_array = NULL;
+static GList * helper_started_obs = NULL;
+static GList * helper_stopped_obs = NULL;
 
+/* Freed by GDBus once no more callbacks can happen with it */
 static void
-observer_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+context_sub_free (gpointer data)
+{
+	context_sub_t * csub = (context_sub_t *)data;
+
+	g_clear_object(&csub->conn);
+	g_main_context_unref(csub->context);
+	g_free(csub);
+}
+
+static context_sub_t *
+context_sub_find (signal_sub_t * sub, GMainContext * context)
+{
+	for (GList * look = sub->contexts; look != NULL; look = g_list_next(look)) {
+		context_sub_t * csub = (context_sub_t *)look->data;
+		if (csub->context == context) {
+			return csub;
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with the observers lock held */
+static gboolean
+signal_sub_ref (signal_sub_t * sub, GMainContext * context)
+{
+	context_sub_t * csub = context_sub_find(sub, context);
+
+	if (csub == NULL) {
+		GDBusConnection * conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+		if (conn == NULL) {
+			return FALSE;
+		}
+
+		csub = g_new0(context_sub_t, 1);
+		csub->context = g_main_context_ref(context);
+		csub->conn = conn;
+
+		/* Subscribing uses the thread default context, which is the one
+		   the observer was added in */
+		csub->handle = g_dbus_connection_signal_subscribe(conn,
+			NULL, /* sender */
+			sub->interface, /* interface */
+			sub->signal, /* signal */
+			sub->path, /* path */
+			sub->arg0, /* arg0 */
+			G_DBUS_SIGNAL_FLAGS_NONE,
+			sub->callback,
+			csub,
+			context_sub_free); /* user data destroy */
+
+		sub->contexts = g_list_prepend(sub->contexts, csub);
+	}
+
+	csub->users++;
+	return TRUE;
+}
+
+/* Must be called with the observers lock held */
+static void
+signal_sub_unref (signal_sub_t * sub, GMainContext * context)
+{
+	context_sub_t * csub = context_sub_find(sub, context);
+
+	if (csub == NULL) {
+		return;
+	}
+
+	csub->users--;
+
+	if (csub->users == 0) {
+		sub->contexts = g_list_remove(sub->contexts, csub);
+		g_dbus_connection_signal_unsubscribe(csub->conn, csub->handle);
+	}
+}
+
+/* Adds an observer to a list, subscribing to the signal it needs if
+   it is the first one in this main context that needs it */
+static gboolean
+observer_add (GList ** list, signal_sub_t * sub, GCallback func, gpointer user_data, const gchar * helper_type)
+{
+	GMainContext * context = g_main_context_ref_thread_default();
+	gboolean added = FALSE;
+
+	g_mutex_lock(&observers_lock);
+
+	if (signal_sub_ref(sub, context)) {
+		observer_t * observert = g_new0(observer_t, 1);
+
+		observert->func = func;
+		observert->user_data = user_data;
+		observert->context = g_main_context_ref(context);
+		if (helper_type != NULL) {
+			observert->type = g_strdup_printf("%s:", helper_type);
+		}
+
+		*list = g_list_prepend(*list, observert);
+		added = TRUE;
+	}
+
+	g_mutex_unlock(&observers_lock);
+	g_main_context_unref(context);
+
+	return added;
+}
+
+/* Removes an observer from a list, and the subscriptions if nothing
+   else in its main context needs them */
+static gboolean
+observer_delete (GList ** list, signal_sub_t * sub, GCallback func, gpointer user_data, const gchar * helper_type)
+{
+	observer_t * observert = NULL;
+	GList * look;
+
+	g_mutex_lock(&observers_lock);
+
+	for (look = *list; look != NULL; look = g_list_next(look)) {
+		observert = (observer_t *)look->data;
+
+		if (observert->func == func && observert->user_data == user_data &&
+				(helper_type == NULL || g_str_has_prefix(observert->type, helper_type))) {
+			break;
+		}
+	}
+
+	if (look == NULL) {
+		g_mutex_unlock(&observers_lock);
+		return FALSE;
+	}
+
+	*list = g_list_delete_link(*list, look);
+
+	signal_sub_unref(sub, observert->context);
+
+	g_mutex_unlock(&observers_lock);
+
+	g_main_context_unref(observert->context);
+	g_free(observert->type);
+	g_free(observert);
+
+	return TRUE;
+}
+
+/* Observers can remove themselves, or each other, when they're called,
+   and other threads can change the lists. So we call from a copy of the
+   list and check each observer is still registered before calling it. */
+static GList *
+observers_snapshot (GList ** list)
 {
-	observer_t * observer = (observer_t *)user_data;
+	g_mutex_lock(&observers_lock);
+	GList * snapshot = g_list_copy(*list);
+	g_mutex_unlock(&observers_lock);
 
+	return snapshot;
+}
+
+/* Copies out an observer from a snapshot if it is still registered and
+   was added in the context we're dispatching on. Helper observers are
+   only current when the instance starts with their type. The copy is
+   made with the lock held as another thread could free the observer
+   as soon as it is released. */
+static gboolean
+observer_current (GList ** list, observer_t * observer, GMainContext * context, const gchar * instance, observer_t * current)
+{
+	gboolean found = FALSE;
+
+	g_mutex_lock(&observers_lock);
+
+	if (g_list_find(*list, observer) != NULL && observer->context == context &&
+			(instance == NULL || g_str_has_prefix(instance, observer->type))) {
+		current->func = observer->func;
+		current->user_data = observer->user_data;
+		found = TRUE;
+	}
+
+	g_mutex_unlock(&observers_lock);
+
+	return found;
+}
+
+/* Handles the Upstart started and stopped events for both applications
+   and helpers. The environment of the event is only walked once and
+   then everyone interested is told about it. */
+static void
+upstart_event_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+{
+	GMainContext * context = ((context_sub_t *)user_data)->context;
 	const gchar * signalname = NULL;
 	g_variant_get_child(params, 0, "&s", &signalname);
 
+	GList ** app_list = NULL;
+	GList ** helper_list = NULL;
+	if (g_strcmp0(signalname, "started") == 0) {
+		app_list = &started_array;
+		helper_list = &helper_started_obs;
+	} else if (g_strcmp0(signalname, "stopped") == 0) {
+		app_list = &stop_array;
+		helper_list = &helper_stopped_obs;
+	} else {
+		return;
+	}
+
 	ual_tracepoint(observer_start, signalname);
 
-	gchar * env = NULL;
+	const gchar * env = NULL;
 	GVariant * envs = g_variant_get_child_value(params, 1);
 	GVariantIter iter;
 	g_variant_iter_init(&iter, envs);
 
-	gboolean job_found = FALSE;
+	gboolean app_job = FALSE;
 	gboolean job_legacy = FALSE;
+	gboolean helper_job = FALSE;
 	gchar * instance = NULL;
 
-	while (g_variant_iter_loop(&iter, "s", &env)) {
+	while (g_variant_iter_loop(&iter, "&s", &env)) {
 		if (g_strcmp0(env, "JOB=application-click") == 0) {
-			job_found = TRUE;
+			app_job = TRUE;
 		} else if (g_strcmp0(env, "JOB=application-legacy") == 0) {
-			job_found = TRUE;
+			app_job = TRUE;
 			job_legacy = TRUE;
 		} else if (g_strcmp0(env, "JOB=application-snap") == 0) {
-			job_found = TRUE;
+			app_job = TRUE;
 			job_legacy = TRUE;
+		} else if (g_strcmp0(env, "JOB=untrusted-helper") == 0) {
+			helper_job = TRUE;
 		} else if (g_str_has_prefix(env, "INSTANCE=")) {
+			g_free(instance);
 			instance = g_strdup(env + strlen("INSTANCE="));
 		}
 	}
 
 	g_variant_unref(envs);
 
-	if (job_legacy && instance != NULL) {
-		gchar * dash = g_strrstr(instance, "-");
-		if (dash != NULL) {
-			dash[0] = '\0';
+	GList * observers = NULL;
+	if (app_job && instance != NULL && (observers = observers_snapshot(app_list)) != NULL) {
+		if (job_legacy) {
+			gchar * dash = g_strrstr(instance, "-");
+			if (dash != NULL) {
+				dash[0] = '\0';
+			}
 		}
-	}
-
-	if (job_found && instance != NULL) {
-		observer->func(instance, observer->user_data);
-	}
 
-	ual_tracepoint(observer_finish, signalname);
+		for (GList * item = observers; item != NULL; item = g_list_next(item)) {
+			observer_t observer;
+			if (!observer_current(app_list, (observer_t *)item->data, context, NULL, &observer)) {
+				continue;
+			}
 
-	g_free(instance);
-}
+			((UbuntuAppLaunchAppObserver)observer.func)(instance, observer.user_data);
+		}
+		g_list_free(observers);
+	}
 
-/* Creates the observer structure and registers for the signal with
-   GDBus so that we can get a callback */
-static gboolean
-add_app_generic (UbuntuAppLaunchAppObserver observer, gpointer user_data, const gchar * signal, GList ** list)
-{
-	GDBusConnection * conn = gdbus_upstart_ref();
+	if (helper_job && instance != NULL && (observers = observers_snapshot(helper_list)) != NULL) {
+		gchar ** split = g_strsplit(instance, ":", 3);
 
-	if (conn == NULL) {
-		return FALSE;
-	}
+		if (g_strv_length(split) == 3) {
+			const gchar * type = split[0];
+			const gchar * instanceid = split[1][0] == '\0' ? NULL : split[1];
+			const gchar * appid = split[2];
 
-	observer_t * observert = g_new0(observer_t, 1);
+			for (GList * item = observers; item != NULL; item = g_list_next(item)) {
+				observer_t observer;
+				if (!observer_current(helper_list, (observer_t *)item->data, context, instance, &observer)) {
+					continue;
+				}
 
-	observert->conn = conn;
-	observert->func = observer;
-	observert->user_data = user_data;
+				((UbuntuAppLaunchHelperObserver)observer.func)(appid, instanceid, type, observer.user_data);
+			}
+		}
 
-	*list = g_list_prepend(*list, observert);
+		g_list_free(observers);
+		g_strfreev(split);
+	}
 
-	observert->sighandle = g_dbus_connection_signal_subscribe(conn,
-		NULL, /* sender */
-		DBUS_INTERFACE_UPSTART, /* interface */
-		"EventEmitted", /* signal */
-		DBUS_PATH_UPSTART, /* path */
-		signal, /* arg0 */
-		G_DBUS_SIGNAL_FLAGS_NONE,
-		observer_cb,
-		observert,
-		NULL); /* user data destroy */
+	ual_tracepoint(observer_finish, signalname);
 
-	return TRUE;
+	g_free(instance);
 }
 
+static signal_sub_t upstart_started_sub = {
+	DBUS_INTERFACE_UPSTART, "EventEmitted", DBUS_PATH_UPSTART, "started", upstart_event_cb, NULL
+};
+static signal_sub_t upstart_stopped_sub = {
+	DBUS_INTERFACE_UPSTART, "EventEmitted", DBUS_PATH_UPSTART, "stopped", upstart_event_cb, NULL
+};
+
 gboolean
 ubuntu_app_launch_observer_add_app_started (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return add_app_generic(observer, user_data, "started", &started_array);
+	return observer_add(&started_array, &upstart_started_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_add_app_stop (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return add_app_generic(observer, user_data, "stopped", &stop_array);
+	return observer_add(&stop_array, &upstart_stopped_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
-/* Creates the observer structure and registers for the signal with
-   GDBus so that we can get a callback */
-static gboolean
-add_session_generic (UbuntuAppLaunchAppObserver observer, gpointer user_data, const gchar * signal, GList ** list, GDBusSignalCallback session_cb)
+/* Calls all the observers on a list in a main context with the
+   application ID that is the parameter of the signal */
+static void
+app_id_signal_dispatch (GList ** list, gpointer user_data, GVariant * params)
 {
-	GDBusConnection * conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
-
-	if (conn == NULL) {
-		return FALSE;
-	}
-
-	observer_t * observert = g_new0(observer_t, 1);
-
-	observert->conn = conn;
-	observert->func = observer;
-	observert->user_data = user_data;
-
-	*list = g_list_prepend(*list, observert);
+	GMainContext * context = ((context_sub_t *)user_data)->context;
+	const gchar * appid = NULL;
+	g_variant_get(params, "(&s)", &appid);
 
-	observert->sighandle = g_dbus_connection_signal_subscribe(conn,
-		NULL, /* sender */
-		"com.canonical.UbuntuAppLaunch", /* interface */
-		signal, /* signal */
-		"/", /* path */
-		NULL, /* arg0 */
-		G_DBUS_SIGNAL_FLAGS_NONE,
-		session_cb,
-		observert,
-		NULL); /* user data destroy */
+	GList * observers = observers_snapshot(list);
+	for (GList * item = observers; item != NULL; item = g_list_next(item)) {
+		observer_t observer;
+		if (!observer_current(list, (observer_t *)item->data, context, NULL, &observer)) {
+			continue;
+		}
 
-	return TRUE;
+		((UbuntuAppLaunchAppObserver)observer.func)(appid, observer.user_data);
+	}
+	g_list_free(observers);
 }
 
-/* Generic handler for a bunch of our signals */
-static inline void
-generic_signal_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+/* Lets whoever sent the request know that all of our observers in a
+   main context are done with it, by sending the same parameters back */
+static void
+app_id_signal_respond (GDBusConnection * conn, const gchar * sender, const gchar * response, GVariant * params)
 {
-	observer_t * observer = (observer_t *)user_data;
-	const gchar * appid = NULL;
+	GError * error = NULL;
+	g_dbus_connection_emit_signal(conn,
+		sender, /* destination */
+		"/", /* path */
+		"com.canonical.UbuntuAppLaunch", /* interface */
+		response, /* signal */
+		params, /* params, the same */
+		&error);
 
-	if (observer->func != NULL) {
-		g_variant_get(params, "(&s)", &appid);
-		observer->func(appid, observer->user_data);
+	if (error != NULL) {
+		g_warning("Unable to emit response signal: %s", error->message);
+		g_error_free(error);
 	}
 }
 
-/* Handle the focus signal when it occurs, call the observer */
+/* Handle the focus signal when it occurs, call the observers */
 static void
 focus_signal_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
 {
 	ual_tracepoint(observer_start, "focus");
 
-	generic_signal_cb(conn, sender, object, interface, signal, params, user_data);
+	app_id_signal_dispatch(&focus_array, user_data, params);
 
 	ual_tracepoint(observer_finish, "focus");
 }
 
+static signal_sub_t focus_sub = {
+	"com.canonical.UbuntuAppLaunch", "UnityFocusRequest", "/", NULL, focus_signal_cb, NULL
+};
+
 gboolean
 ubuntu_app_launch_observer_add_app_focus (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return add_session_generic(observer, user_data, "UnityFocusRequest", &focus_array, focus_signal_cb);
+	return observer_add(&focus_array, &focus_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
-/* Handle the resume signal when it occurs, call the observer, then send a signal back when we're done */
+/* Handle the resume signal when it occurs, call the observers, then send a signal back when we're done */
 static void
 resume_signal_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
 {
 	ual_tracepoint(observer_start, "resume");
 
-	generic_signal_cb(conn, sender, object, interface, signal, params, user_data);
-
-	GError * error = NULL;
-	g_dbus_connection_emit_signal(conn,
-		sender, /* destination */
-		"/", /* path */
-		"com.canonical.UbuntuAppLaunch", /* interface */
-		"UnityResumeResponse", /* signal */
-		params, /* params, the same */
-		&error);
-
-	if (error != NULL) {
-		g_warning("Unable to emit response signal: %s", error->message);
-		g_error_free(error);
-	}
+	app_id_signal_dispatch(&resume_array, user_data, params);
+	app_id_signal_respond(conn, sender, "UnityResumeResponse", params);
 
 	ual_tracepoint(observer_finish, "resume");
 }
 
+static signal_sub_t resume_sub = {
+	"com.canonical.UbuntuAppLaunch", "UnityResumeRequest", "/", NULL, resume_signal_cb, NULL
+};
+
 gboolean
 ubuntu_app_launch_observer_add_app_resume (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return add_session_generic(observer, user_data, "UnityResumeRequest", &resume_array, resume_signal_cb);
+	return observer_add(&resume_array, &resume_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
-/* Handle the starting signal when it occurs, call the observer, then send a signal back when we're done */
+/* Handle the starting signal when it occurs, call the observers, then send a signal back when we're done */
 static void
 starting_signal_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
 {
 	ual_tracepoint(observer_start, "starting");
 
-	generic_signal_cb(conn, sender, object, interface, signal, params, user_data);
-
-	GError * error = NULL;
-	g_dbus_connection_emit_signal(conn,
-		sender, /* destination */
-		"/", /* path */
-		"com.canonical.UbuntuAppLaunch", /* interface */
-		"UnityStartingSignal", /* signal */
-		params, /* params, the same */
-		&error);
-
-	if (error != NULL) {
-		g_warning("Unable to emit response signal: %s", error->message);
-		g_error_free(error);
-	}
+	app_id_signal_dispatch(&starting_array, user_data, params);
+	app_id_signal_respond(conn, sender, "UnityStartingSignal", params);
 
 	ual_tracepoint(observer_finish, "starting");
 }
 
+static signal_sub_t starting_sub = {
+	"com.canonical.UbuntuAppLaunch", "UnityStartingBroadcast", "/", NULL, starting_signal_cb, NULL
+};
+
 gboolean
 ubuntu_app_launch_observer_add_app_starting (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
+	if (!observer_add(&starting_array, &starting_sub, G_CALLBACK(observer), user_data, NULL)) {
+		return FALSE;
+	}
+
 	ubuntu::app_launch::Registry::Impl::watchingAppStarting(true);
-	return add_session_generic(observer, user_data, "UnityStartingBroadcast", &starting_array, starting_signal_cb);
+	return TRUE;
 }
 
-/* Handle the failed signal when it occurs, call the observer */
+/* Handle the failed signal when it occurs, call the observers */
 static void
 failed_signal_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
 {
-	failed_observer_t * observer = (failed_observer_t *)user_data;
 	const gchar * appid = NULL;
 	const gchar * typestr = NULL;
 
 	ual_tracepoint(observer_start, "failed");
 
-	if (observer->func != NULL) {
-		UbuntuAppLaunchAppFailed type = UBUNTU_APP_LAUNCH_APP_FAILED_CRASH;
-		g_variant_get(params, "(&s&s)", &appid, &typestr);
+	UbuntuAppLaunchAppFailed type = UBUNTU_APP_LAUNCH_APP_FAILED_CRASH;
+	g_variant_get(params, "(&s&s)", &appid, &typestr);
 
-		if (g_strcmp0("crash", typestr) == 0) {
-			type = UBUNTU_APP_LAUNCH_APP_FAILED_CRASH;
-		} else if (g_strcmp0("start-failure", typestr) == 0) {
-			type = UBUNTU_APP_LAUNCH_APP_FAILED_START_FAILURE;
-		} else {
-			g_warning("Application failure type '%s' unknown, reporting as a crash", typestr);
+	if (g_strcmp0("crash", typestr) == 0) {
+		type = UBUNTU_APP_LAUNCH_APP_FAILED_CRASH;
+	} else if (g_strcmp0("start-failure", typestr) == 0) {
+		type = UBUNTU_APP_LAUNCH_APP_FAILED_START_FAILURE;
+	} else {
+		g_warning("Application failure type '%s' unknown, reporting as a crash", typestr);
+	}
+
+	GMainContext * context = ((context_sub_t *)user_data)->context;
+	GList * observers = observers_snapshot(&failed_array);
+	for (GList * item = observers; item != NULL; item = g_list_next(item)) {
+		observer_t observer;
+		if (!observer_current(&failed_array, (observer_t *)item->data, context, NULL, &observer)) {
+			continue;
 		}
 
-		observer->func(appid, type, observer->user_data);
+		((UbuntuAppLaunchAppFailedObserver)observer.func)(appid, type, observer.user_data);
 	}
+	g_list_free(observers);
 
 	ual_tracepoint(observer_finish, "failed");
 }
 
+static signal_sub_t failed_sub = {
+	"com.canonical.UbuntuAppLaunch", "ApplicationFailed", "/", NULL, failed_signal_cb, NULL
+};
+
 gboolean
 ubuntu_app_launch_observer_add_app_failed (UbuntuAppLaunchAppFailedObserver observer, gpointer user_data)
 {
-	GDBusConnection * conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
-
-	if (conn == NULL) {
-		return FALSE;
-	}
-
-	failed_observer_t * observert = g_new0(failed_observer_t, 1);
-
-	observert->conn = conn;
-	observert->func = observer;
-	observert->user_data = user_data;
-
-	failed_array = g_list_prepend(failed_array, observert);
-
-	observert->sighandle = g_dbus_connection_signal_subscribe(conn,
-		NULL, /* sender */
-		"com.canonical.UbuntuAppLaunch", /* interface */
-		"ApplicationFailed", /* signal */
-		"/", /* path */
-		NULL, /* arg0 */
-		G_DBUS_SIGNAL_FLAGS_NONE,
-		failed_signal_cb,
-		observert,
-		NULL); /* user data destroy */
-
-	return TRUE;
+	return observer_add(&failed_array, &failed_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
-/* Handle the paused signal when it occurs, call the observer */
+/* Calls all the observers on a paused or resumed list in a main context
+   for one app */
 static void
-paused_signal_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
+paused_resumed_dispatch (GList ** list, GMainContext * context, const gchar * appid, GVariantIter * pids)
 {
-	paused_resumed_observer_t * observer = (paused_resumed_observer_t *)user_data;
-
-	ual_tracepoint(observer_start, observer->lttng_signal);
+	GArray * pidarray = g_array_new(TRUE, TRUE, sizeof(GPid));
+	guint64 pid;
 
-	if (observer->func != NULL) {
-		GArray * pidarray = g_array_new(TRUE, TRUE, sizeof(GPid));
-		GVariant * appid = g_variant_get_child_value(params, 0);
-		GVariant * pids = g_variant_get_child_value(params, 1);
-		guint64 pid;
-		GVariantIter thispid;
-		g_variant_iter_init(&thispid, pids);
+	while (g_variant_iter_loop(pids, "t", &pid)) {
+		GPid gpid = (GPid)pid; /* Should be a no-op for most architectures, but just in case */
+		g_array_append_val(pidarray, gpid);
+	}
 
-		while (g_variant_iter_loop(&thispid, "t", &pid)) {
-			GPid gpid = (GPid)pid; /* Should be a no-op for most architectures, but just in case */
-			g_array_append_val(pidarray, gpid);
+	GList * observers = observers_snapshot(list);
+	for (GList * item = observers; item != NULL; item = g_list_next(item)) {
+		observer_t observer;
+		if (!observer_current(list, (observer_t *)item->data, context, NULL, &observer)) {
+			continue;
 		}
 
-		observer->func(g_variant_get_string(appid, NULL), (GPid *)pidarray->data, observer->user_data);
-
-		g_array_free(pidarray, TRUE);
-		g_variant_unref(appid);
-		g_variant_unref(pids);
+		((UbuntuAppLaunchAppPausedResumedObserver)observer.func)(appid, (GPid *)pidarray->data, observer.user_data);
 	}
+	g_list_free(observers);
 
-	ual_tracepoint(observer_finish, observer->lttng_signal);
+	g_array_free(pidarray, TRUE);
 }
 
-static gboolean
-paused_resumed_generic (UbuntuAppLaunchAppPausedResumedObserver observer, gpointer user_data, GList ** queue, const gchar * signal_name, const gchar * lttng_signal)
+/* Handle the paused or resumed signal when it occurs, call the observers */
+static void
+paused_signal_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
 {
-	GDBusConnection * conn = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	gboolean paused = g_strcmp0(signal, "ApplicationPaused") == 0;
+	const gchar * lttng_signal = paused ? "paused" : "resumed";
 
-	if (conn == NULL) {
-		return FALSE;
-	}
-
-	paused_resumed_observer_t * observert = g_new0(paused_resumed_observer_t, 1);
+	ual_tracepoint(observer_start, lttng_signal);
 
-	observert->conn = conn;
-	observert->func = observer;
-	observert->user_data = user_data;
-	observert->lttng_signal = lttng_signal;
+	const gchar * appid = NULL;
+	GVariantIter * pids = NULL;
+	g_variant_get(params, "(&sat)", &appid, &pids);
 
-	*queue = g_list_prepend(*queue, observert);
+	paused_resumed_dispatch(paused ? &paused_array : &resumed_array, ((context_sub_t *)user_data)->context, appid, pids);
 
-	observert->sighandle = g_dbus_connection_signal_subscribe(conn,
-		NULL, /* sender */
-		"com.canonical.UbuntuAppLaunch", /* interface */
-		signal_name, /* signal */
-		"/", /* path */
-		NULL, /* arg0 */
-		G_DBUS_SIGNAL_FLAGS_NONE,
-		paused_signal_cb,
-		observert,
-		NULL); /* user data destroy */
+	g_variant_iter_free(pids);
 
-	return TRUE;
+	ual_tracepoint(observer_finish, lttng_signal);
 }
 
+static signal_sub_t paused_sub = {
+	"com.canonical.UbuntuAppLaunch", "ApplicationPaused", "/", NULL, paused_signal_cb, NULL
+};
+static signal_sub_t resumed_sub = {
+	"com.canonical.UbuntuAppLaunch", "ApplicationResumed", "/", NULL, paused_signal_cb, NULL
+};
+
 gboolean
 ubuntu_app_launch_observer_add_app_paused (UbuntuAppLaunchAppPausedResumedObserver observer, gpointer user_data)
 {
-	return paused_resumed_generic(observer, user_data, &paused_array, "ApplicationPaused", "paused");
+	return observer_add(&paused_array, &paused_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_add_app_resumed (UbuntuAppLaunchAppPausedResumedObserver observer, gpointer user_data)
 {
-	return paused_resumed_generic(observer, user_data, &resumed_array, "ApplicationResumed", "resumed");
-}
-
-static gboolean
-delete_app_generic (UbuntuAppLaunchAppObserver observer, gpointer user_data, GList ** list)
-{
-	observer_t * observert = NULL;
-	GList * look;
-
-	for (look = *list; look != NULL; look = g_list_next(look)) {
-		observert = (observer_t *)look->data;
-
-		if (observert->func == observer && observert->user_data == user_data) {
-			break;
-		}
-	}
-
-	if (look == NULL) {
-		return FALSE;
-	}
-
-	g_dbus_connection_signal_unsubscribe(observert->conn, observert->sighandle);
-	g_object_unref(observert->conn);
-
-	g_free(observert);
-	*list = g_list_delete_link(*list, look);
-
-	return TRUE;
+	return observer_add(&resumed_array, &resumed_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_started (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return delete_app_generic(observer, user_data, &started_array);
+	return observer_delete(&started_array, &upstart_started_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_stop (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return delete_app_generic(observer, user_data, &stop_array);
+	return observer_delete(&stop_array, &upstart_stopped_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_resume (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return delete_app_generic(observer, user_data, &resume_array);
+	return observer_delete(&resume_array, &resume_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_focus (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	return delete_app_generic(observer, user_data, &focus_array);
+	return observer_delete(&focus_array, &focus_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_starting (UbuntuAppLaunchAppObserver observer, gpointer user_data)
 {
-	ubuntu::app_launch::Registry::Impl::watchingAppStarting(false);
-	return delete_app_generic(observer, user_data, &starting_array);
+	gboolean retval = observer_delete(&starting_array, &starting_sub, G_CALLBACK(observer), user_data, NULL);
+
+	g_mutex_lock(&observers_lock);
+	gboolean watching = starting_array != NULL;
+	g_mutex_unlock(&observers_lock);
+
+	ubuntu::app_launch::Registry::Impl::watchingAppStarting(watching);
+	return retval;
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_failed (UbuntuAppLaunchAppFailedObserver observer, gpointer user_data)
 {
-	failed_observer_t * observert = NULL;
-	GList * look;
-
-	for (look = failed_array; look != NULL; look = g_list_next(look)) {
-		observert = (failed_observer_t *)look->data;
-
-		if (observert->func == observer && observert->user_data == user_data) {
-			break;
-		}
-	}
-
-	if (look == NULL) {
-		return FALSE;
-	}
-
-	g_dbus_connection_signal_unsubscribe(observert->conn, observert->sighandle);
-	g_object_unref(observert->conn);
-
-	g_free(observert);
-	failed_array = g_list_delete_link(failed_array, look);
-
-	return TRUE;
-}
-
-static gboolean
-paused_resumed_delete (UbuntuAppLaunchAppPausedResumedObserver observer, gpointer user_data, GList ** list)
-{
-	paused_resumed_observer_t * observert = NULL;
-	GList * look;
-
-	for (look = *list; look != NULL; look = g_list_next(look)) {
-		observert = (paused_resumed_observer_t *)look->data;
-
-		if (observert->func == observer && observert->user_data == user_data) {
-			break;
-		}
-	}
-
-	if (look == NULL) {
-		return FALSE;
-	}
-
-	g_dbus_connection_signal_unsubscribe(observert->conn, observert->sighandle);
-	g_object_unref(observert->conn);
-
-	g_free(observert);
-	*list = g_list_delete_link(*list, look);
-
-	return TRUE;
+	return observer_delete(&failed_array, &failed_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_paused (UbuntuAppLaunchAppPausedResumedObserver observer, gpointer user_data)
 {
-	return paused_resumed_delete(observer, user_data, &paused_array);
+	return observer_delete(&paused_array, &paused_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 gboolean
 ubuntu_app_launch_observer_delete_app_resumed (UbuntuAppLaunchAppPausedResumedObserver observer, gpointer user_data)
 {
-	return paused_resumed_delete(observer, user_data, &resumed_array);
+	return observer_delete(&resumed_array, &resumed_sub, G_CALLBACK(observer), user_data, NULL);
 }
 
 typedef void (*per_instance_func_t) (GDBusConnection * con, GVariant * prop_dict, gpointer user_data);
@@ -900,7 +991,20 @@ ubuntu_app_launch_pid_in_app_id (GPid pid, const gchar * appid)
 	g_return_val_if_fail(appid != NULL, FALSE);
 	try {
 		auto registry = ubuntu::app_launch::Registry::getDefault();
-		auto appId = ubuntu::app_launch::AppID::find(appid);
+
+		/* Quick check of the cgroup the PID is in, the job has the full
+		   application ID in it so we only need to look up short ones */
+		auto job = registry->impl->getPidJobCache()->get(pid);
+		auto jobappid = ubuntu::app_launch::PidJobCache::appIdFromJob(job);
+		if (!jobappid.empty() && jobappid == appid) {
+			return TRUE;
+		}
+
+		auto appId = ubuntu::app_launch::AppID::find(registry, appid);
+		if (!jobappid.empty()) {
+			return jobappid == std::string(appId) ? TRUE : FALSE;
+		}
+
 		auto app = ubuntu::app_launch::Application::create(appId, registry);
 
 		if (app->instances().at(0)->hasPid(pid)) {
@@ -1519,137 +1623,6 @@ ubuntu_app_launch_list_helper_instances (const gchar * type, const gchar * appid
 	return (gchar **)g_array_free(helper_instances_data.retappids, FALSE);
 }
 
-/* The data we keep for each observer */
-typedef struct _helper_observer_t helper_observer_t;
-struct _helper_observer_t {
-	GDBusConnection * conn;
-	guint sighandle;
-	gchar * type;
-	UbuntuAppLaunchHelperObserver func;
-	gpointer user_data;
-};
-
-/* The lists of helper observers */
-static GList * helper_started_obs = NULL;
-static GList * helper_stopped_obs = NULL;
-
-static void
-helper_observer_cb (GDBusConnection * conn, const gchar * sender, const gchar * object, const gchar * interface, const gchar * signal, GVariant * params, gpointer user_data)
-{
-	helper_observer_t * observer = (helper_observer_t *)user_data;
-
-	gchar * env = NULL;
-	GVariant * envs = g_variant_get_child_value(params, 1);
-	GVariantIter iter;
-	g_variant_iter_init(&iter, envs);
-
-	gboolean job_found = FALSE;
-	gchar * instance = NULL;
-
-	while (g_variant_iter_loop(&iter, "s", &env)) {
-		if (g_strcmp0(env, "JOB=untrusted-helper") == 0) {
-			job_found = TRUE;
-		} else if (g_str_has_prefix(env, "INSTANCE=")) {
-			instance = g_strdup(env + strlen("INSTANCE="));
-		}
-	}
-
-	g_variant_unref(envs);
-
-	if (instance != NULL && !g_str_has_prefix(instance, observer->type)) {
-		g_free(instance);
-		instance = NULL;
-	}
-
-	gchar * appid = NULL;
-	gchar * instanceid = NULL;
-	gchar * type = NULL;
-
-	if (instance != NULL) {
-		gchar ** split = g_strsplit(instance, ":", 3);
-		type = split[0];
-		instanceid = split[1];
-		appid = split[2];
-		g_free(split);
-	}
-	g_free(instance);
-
-	if (instanceid != NULL && instanceid[0] == '\0') {
-		g_free(instanceid);
-		instanceid = NULL;
-	}
-
-	if (job_found && appid != NULL) {
-		observer->func(appid, instanceid, type, observer->user_data);
-	}
-
-	g_free(appid);
-	g_free(instanceid);
-	g_free(type);
-}
-
-/* Creates the observer structure and registers for the signal with
-   GDBus so that we can get a callback */
-static gboolean
-add_helper_generic (UbuntuAppLaunchHelperObserver observer, const gchar * helper_type, gpointer user_data, const gchar * signal, GList ** list)
-{
-	GDBusConnection * conn = gdbus_upstart_ref();
-
-	if (conn == NULL) {
-		return FALSE;
-	}
-
-	helper_observer_t * observert = g_new0(helper_observer_t, 1);
-
-	observert->conn = conn;
-	observert->func = observer;
-	observert->user_data = user_data;
-	observert->type = g_strdup_printf("%s:", helper_type);
-
-	*list = g_list_prepend(*list, observert);
-
-	observert->sighandle = g_dbus_connection_signal_subscribe(conn,
-		NULL, /* sender */
-		DBUS_INTERFACE_UPSTART, /* interface */
-		"EventEmitted", /* signal */
-		DBUS_PATH_UPSTART, /* path */
-		signal, /* arg0 */
-		G_DBUS_SIGNAL_FLAGS_NONE,
-		helper_observer_cb,
-		observert,
-		NULL); /* user data destroy */
-
-	return TRUE;
-}
-
-static gboolean
-delete_helper_generic (UbuntuAppLaunchHelperObserver observer, const gchar * type, gpointer user_data, GList ** list)
-{
-	helper_observer_t * observert = NULL;
-	GList * look;
-
-	for (look = *list; look != NULL; look = g_list_next(look)) {
-		observert = (helper_observer_t *)look->data;
-
-		if (observert->func == observer && observert->user_data == user_data && g_str_has_prefix(observert->type, type)) {
-			break;
-		}
-	}
-
-	if (look == NULL) {
-		return FALSE;
-	}
-
-	g_dbus_connection_signal_unsubscribe(observert->conn, observert->sighandle);
-	g_object_unref(observert->conn);
-
-	g_free(observert->type);
-	g_free(observert);
-	*list = g_list_delete_link(*list, look);
-
-	return TRUE;
-}
-
 gboolean
 ubuntu_app_launch_observer_add_helper_started (UbuntuAppLaunchHelperObserver observer, const gchar * helper_type, gpointer user_data)
 {
@@ -1657,7 +1630,7 @@ ubuntu_app_launch_observer_add_helper_started (UbuntuAppLaunchHelperObserver obs
 	g_return_val_if_fail(helper_type != NULL, FALSE);
 	g_return_val_if_fail(g_strstr_len(helper_type, -1, ":") == NULL, FALSE);
 
-	return add_helper_generic(observer, helper_type, user_data, "started", &helper_started_obs);
+	return observer_add(&helper_started_obs, &upstart_started_sub, G_CALLBACK(observer), user_data, helper_type);
 }
 
 gboolean
@@ -1667,7 +1640,7 @@ ubuntu_app_launch_observer_add_helper_stop (UbuntuAppLaunchHelperObserver observ
 	g_return_val_if_fail(helper_type != NULL, FALSE);
 	g_return_val_if_fail(g_strstr_len(helper_type, -1, ":") == NULL, FALSE);
 
-	return add_helper_generic(observer, helper_type, user_data, "stopped", &helper_stopped_obs);
+	return observer_add(&helper_stopped_obs, &upstart_stopped_sub, G_CALLBACK(observer), user_data, helper_type);
 }
 
 gboolean
@@ -1677,7 +1650,7 @@ ubuntu_app_launch_observer_delete_helper_started (UbuntuAppLaunchHelperObserver
 	g_return_val_if_fail(helper_type != NULL, FALSE);
 	g_return_val_if_fail(g_strstr_len(helper_type, -1, ":") == NULL, FALSE);
 
-	return delete_helper_generic(observer, helper_type, user_data, &helper_started_obs);
+	return observer_delete(&helper_started_obs, &upstart_started_sub, G_CALLBACK(observer), user_data, helper_type);
 }
 
 gboolean
@@ -1687,7 +1660,7 @@ ubuntu_app_launch_observer_delete_helper_stop (UbuntuAppLaunchHelperObserver obs
 	g_return_val_if_fail(helper_type != NULL, FALSE);
 	g_return_val_if_fail(g_strstr_len(helper_type, -1, ":") == NULL, FALSE);
 
-	return delete_helper_generic(observer, helper_type, user_data, &helper_stopped_obs);
+	return observer_delete(&helper_stopped_obs, &upstart_stopped_sub, G_CALLBACK(observer), user_data, helper_type);
 }
 
 /* Sets an environment variable in Upstart */
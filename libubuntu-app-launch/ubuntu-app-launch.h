@@ -166,6 +166,10 @@ gboolean   ubuntu_app_launch_application_info         (const gchar *
  * is about to start.  The application will not start until the
  * function returns.
  *
+ * The observer is called on the thread default main context of the
+ * thread that added it. The response is sent once all of the observers
+ * in a main context have returned, not after each observer.
+ *
  * Return value: Whether adding the observer was successful.
  */
 gboolean   ubuntu_app_launch_observer_add_app_starting (UbuntuAppLaunchAppObserver       observer,
@@ -217,6 +221,10 @@ gboolean   ubuntu_app_launch_observer_add_app_focus    (UbuntuAppLaunchAppObserv
  * that is already running, so we request it to be given CPU time.
  * At the end of the observer running the app as assumed to be active.
  *
+ * The observer is called on the thread default main context of the
+ * thread that added it. The response is sent once all of the observers
+ * in a main context have returned, not after each observer.
+ *
  * Return value: Whether adding the observer was successful.
  */
 gboolean   ubuntu_app_launch_observer_add_app_resume   (UbuntuAppLaunchAppObserver       observer,
@@ -19,6 +19,8 @@
 
 #define _POSIX_C_SOURCE 200809L
 
+#include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -27,28 +29,26 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
-int
-main (int argc, char * argv[])
-{
-	if (argc != 3) {
-		fprintf(stderr, "Usage: %s <pid> <value>\n", argv[0]);
-		exit(EXIT_FAILURE);
-	}
+/* Most PID and value pairs we'll take on stdin, more than any app
+   should have processes */
+#define MAX_PAIRS 1024
 
+/* Sets the OOM value of a PID, returns zero on success */
+static int
+set_oom_value (int pidval, int oomval)
+{
 	/* Not we turn the pid into an integer and back so that we can ensure we don't
 	   get used for nefarious tasks. */
-	int pidval = atoi(argv[1]);
 	if ((pidval < 1) || (pidval >= 32768)) {
 		fprintf(stderr, "PID passed is invalid: %d\n", pidval);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 
 	/* Not we turn the oom value into an integer and back so that we can ensure we don't
 	   get used for nefarious tasks. */
-	int oomval = atoi(argv[2]);
 	if ((oomval < -1000) || (oomval >= 1000)) {
 		fprintf(stderr, "OOM Value passed is invalid: %d\n", oomval);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 
 	/* Open up the PID directory first, to ensure that it is actually one of
@@ -59,20 +59,20 @@ main (int argc, char * argv[])
 	int piddir = open(pidpath, O_RDONLY | O_DIRECTORY);
 	if (piddir < 0) {
 		fprintf(stderr, "Unable open PID directory '%s' for '%d': %s\n", pidpath, pidval, strerror(errno));
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 
 	struct stat piddirstat = {0};
 	if (fstat(piddir, &piddirstat) < 0) {
 		close(piddir);
 		fprintf(stderr, "Unable stat PID directory '%s' for '%d': %s\n", pidpath, pidval, strerror(errno));
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 
 	if (getuid() != piddirstat.st_uid) {
 		close(piddir);
 		fprintf(stderr, "PID directory '%s' is not owned by %d but by %d\n", pidpath, getuid(), piddirstat.st_uid);
-		exit(EXIT_FAILURE);
+		return -1;
 	}
 
 	/* Looks good, let's try to get the actual oom_adj_score file to write
@@ -87,9 +87,9 @@ main (int argc, char * argv[])
 		   worth printing a warning about */
 		if (openerr != ENOENT) {
 			fprintf(stderr, "Unable to set OOM value of '%d' on '%d': %s\n", oomval, pidval, strerror(openerr));
-			exit(EXIT_FAILURE);
+			return -1;
 		} else {
-			exit(EXIT_SUCCESS);
+			return 0;
 		}
 	}
 
@@ -103,7 +103,7 @@ main (int argc, char * argv[])
 	close(piddir);
 
 	if (writesize == strlen(oomstring))
-		exit(EXIT_SUCCESS);
+		return 0;
 	
 	if (writeerr != 0)
 		fprintf(stderr, "Unable to set OOM value of '%d' on '%d': %s\n", oomval, pidval, strerror(writeerr));
@@ -111,5 +111,106 @@ main (int argc, char * argv[])
 		/* No error, but yet, wrong size. Not sure, what could cause this. */
 		fprintf(stderr, "Unable to set OOM value of '%d' on '%d': Wrote %d bytes\n", oomval, pidval, (int)writesize);
 
-	exit(EXIT_FAILURE);
+	return -1;
+}
+
+/* Parses an integer that has to be followed by whitespace or the end
+   of the line, returns zero on success */
+static int
+parse_int (const char * str, const char ** end, int * val)
+{
+	char * intend = NULL;
+
+	errno = 0;
+	long lval = strtol(str, &intend, 10);
+	if (intend == str || errno != 0 || lval < INT_MIN || lval > INT_MAX) {
+		return -1;
+	}
+
+	if (*intend != '\0' && !isspace((unsigned char)*intend)) {
+		return -1;
+	}
+
+	*val = (int)lval;
+	*end = intend;
+	return 0;
+}
+
+/* Parses a 'pid value' line, returns zero on success. Anything else on
+   the line makes it invalid. */
+static int
+parse_pair (const char * line, int * pidval, int * oomval)
+{
+	const char * end = NULL;
+
+	if (parse_int(line, &end, pidval) != 0 || parse_int(end, &end, oomval) != 0) {
+		return -1;
+	}
+
+	while (isspace((unsigned char)*end)) {
+		end++;
+	}
+
+	return *end == '\0' ? 0 : -1;
+}
+
+int
+main (int argc, char * argv[])
+{
+	if (argc == 3) {
+		if (set_oom_value(atoi(argv[1]), atoi(argv[2])) != 0)
+			exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
+	}
+
+	if (argc != 1) {
+		fprintf(stderr, "Usage: %s <pid> <value>\n", argv[0]);
+		fprintf(stderr, "       %s < 'pid value' lines\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Read everything before we start so that the library writing
+	   to us never finds the pipe closed */
+	static int pids[MAX_PAIRS];
+	static int values[MAX_PAIRS];
+	int count = 0;
+	char line[64];
+
+	while (fgets(line, sizeof(line), stdin) != NULL) {
+		int pidval = 0;
+		int oomval = 0;
+
+		/* No pair is this long, and the rest of it must not be read as
+		   another line */
+		size_t len = strlen(line);
+		if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+			int c;
+			while ((c = getchar()) != EOF && c != '\n');
+
+			fprintf(stderr, "Line too long, ignoring\n");
+			continue;
+		}
+
+		if (parse_pair(line, &pidval, &oomval) != 0) {
+			fprintf(stderr, "Invalid line: %s\n", line);
+			continue;
+		}
+
+		if (count < MAX_PAIRS) {
+			pids[count] = pidval;
+			values[count] = oomval;
+			count++;
+		} else {
+			fprintf(stderr, "Too many PIDs, ignoring: %d\n", pidval);
+		}
+	}
+
+	int retval = EXIT_SUCCESS;
+	int i;
+	for (i = 0; i < count; i++) {
+		if (set_oom_value(pids[i], values[i]) != 0)
+			retval = EXIT_FAILURE;
+	}
+
+	exit(retval);
 }
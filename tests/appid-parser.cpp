@@ -0,0 +1,229 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "appid-parser.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <regex>
+
+using namespace ubuntu::app_launch;
+
+/* The regular expressions that the parser replaced, the parser should
+   agree with them on everything */
+#define REGEX_PKGNAME "([a-z0-9][a-z0-9+.-]+)"
+#define REGEX_APPNAME "([A-Za-z0-9+-.:~-][\\sA-Za-z0-9+-.:~-]+)"
+#define REGEX_VERSION "([\\d+:]?[A-Za-z0-9.+:~-]+?(?:-[A-Za-z0-9+.~]+)?)"
+
+class AppIDParser : public ::testing::Test
+{
+protected:
+    const std::regex full_appid_regex{"^" REGEX_PKGNAME "_" REGEX_APPNAME "_" REGEX_VERSION "$"};
+    const std::regex short_appid_regex{"^" REGEX_PKGNAME "_" REGEX_APPNAME "$"};
+    const std::regex legacy_appid_regex{"^" REGEX_APPNAME "$"};
+    const std::regex instance_regex{"^(.*)-[0-9]*$"};
+    const std::regex snap_appname_regex{"^[a-zA-Z0-9](?:-?[a-zA-Z0-9])*$"};
+
+    /* Fixed seed so that a failure can be reproduced */
+    std::mt19937 rand{1234};
+
+    char pick(const std::string& alphabet)
+    {
+        return alphabet[std::uniform_int_distribution<size_t>(0, alphabet.size() - 1)(rand)];
+    }
+
+    std::string random(const std::string& alphabet, size_t maxlen)
+    {
+        std::string str(std::uniform_int_distribution<size_t>(0, maxlen)(rand), ' ');
+        for (auto& c : str)
+        {
+            c = pick(alphabet);
+        }
+        return str;
+    }
+
+    /* Something that looks like an application ID, with a few characters
+       swapped out so that it is sometimes not quite one */
+    std::string structured()
+    {
+        const std::string pkgchars{"abcz09+.-"};
+        const std::string appchars{"aZ09+,-.:~ \t_"};
+        const std::string verchars{"aZ09.+:~-_"};
+        const std::string anychars{"aA0_-+,.:~ \t\n/\\\xe2"};
+
+        auto str = random(pkgchars, 6) + "_" + random(appchars, 6);
+        if (rand() % 2)
+        {
+            str += "_" + random(verchars, 6);
+        }
+
+        for (auto mutations = rand() % 3; mutations > 0 && !str.empty(); mutations--)
+        {
+            str[rand() % str.size()] = pick(anychars);
+        }
+
+        return str;
+    }
+
+    void checkSplit(const std::string& sappid)
+    {
+        SCOPED_TRACE("AppID: '" + sappid + "'");
+        auto parts = appid_parser::split(sappid);
+        std::smatch match;
+
+        if (std::regex_match(sappid, match, full_appid_regex))
+        {
+            ASSERT_EQ(appid_parser::Form::FULL, parts.form);
+            EXPECT_EQ(match[1].str(), parts.package.of(sappid));
+            EXPECT_EQ(match[2].str(), parts.appname.of(sappid));
+            EXPECT_EQ(match[3].str(), parts.version.of(sappid));
+        }
+        else if (std::regex_match(sappid, match, short_appid_regex))
+        {
+            ASSERT_EQ(appid_parser::Form::SHORT, parts.form);
+            EXPECT_EQ(match[1].str(), parts.package.of(sappid));
+            EXPECT_EQ(match[2].str(), parts.appname.of(sappid));
+        }
+        else if (std::regex_match(sappid, match, legacy_appid_regex))
+        {
+            ASSERT_EQ(appid_parser::Form::LEGACY, parts.form);
+            EXPECT_EQ(sappid, parts.appname.of(sappid));
+        }
+        else
+        {
+            EXPECT_EQ(appid_parser::Form::INVALID, parts.form);
+        }
+    }
+
+    void checkInstance(const std::string& instance)
+    {
+        SCOPED_TRACE("Instance: '" + instance + "'");
+        appid_parser::Range appid{0, 0};
+        std::smatch match;
+
+        auto found = appid_parser::splitInstance(instance, appid);
+        ASSERT_EQ(std::regex_match(instance, match, instance_regex), found);
+        if (found)
+        {
+            EXPECT_EQ(match[1].str(), appid.of(instance));
+        }
+    }
+};
+
+TEST_F(AppIDParser, Known)
+{
+    auto parts = appid_parser::split("com.test.good_application_1.2.3");
+    EXPECT_EQ(appid_parser::Form::FULL, parts.form);
+    EXPECT_EQ(0u, parts.package.start);
+    EXPECT_EQ(13u, parts.package.length);
+    EXPECT_EQ(14u, parts.appname.start);
+    EXPECT_EQ(11u, parts.appname.length);
+    EXPECT_EQ(26u, parts.version.start);
+    EXPECT_EQ(5u, parts.version.length);
+
+    EXPECT_EQ(appid_parser::Form::SHORT, appid_parser::split("com.test.good_application").form);
+    EXPECT_EQ(appid_parser::Form::LEGACY, appid_parser::split("gedit").form);
+    EXPECT_EQ(appid_parser::Form::LEGACY, appid_parser::split("my app").form);
+
+    EXPECT_EQ(appid_parser::Form::INVALID, appid_parser::split("").form);
+    EXPECT_EQ(appid_parser::Form::INVALID, appid_parser::split("a").form);
+    EXPECT_EQ(appid_parser::Form::INVALID, appid_parser::split("Com.test_application_1").form);
+    EXPECT_EQ(appid_parser::Form::INVALID, appid_parser::split("com.test_application_").form);
+    EXPECT_EQ(appid_parser::Form::INVALID, appid_parser::split("com.test_application_1_2").form);
+
+    appid_parser::Range range{0, 0};
+    EXPECT_TRUE(appid_parser::splitInstance("com.test.good_application_1.2.3-1234", range));
+    EXPECT_EQ("com.test.good_application_1.2.3", range.of("com.test.good_application_1.2.3-1234"));
+    EXPECT_TRUE(appid_parser::splitInstance("gedit-", range));
+    EXPECT_EQ(5u, range.length);
+    EXPECT_FALSE(appid_parser::splitInstance("gedit", range));
+    EXPECT_FALSE(appid_parser::splitInstance("gedit-1a", range));
+
+    EXPECT_TRUE(appid_parser::matchInstance("c++-ide-42", "c++-ide", range));
+    EXPECT_EQ("42", range.of("c++-ide-42"));
+    EXPECT_FALSE(appid_parser::matchInstance("c++-ide-42", "c++", range));
+    EXPECT_FALSE(appid_parser::matchInstance("c++-ide", "c++-ide", range));
+
+    EXPECT_TRUE(appid_parser::validSnapAppName("foo-bar2"));
+    EXPECT_FALSE(appid_parser::validSnapAppName("foo--bar"));
+    EXPECT_FALSE(appid_parser::validSnapAppName("-foo"));
+    EXPECT_FALSE(appid_parser::validSnapAppName("foo-"));
+    EXPECT_FALSE(appid_parser::validSnapAppName(""));
+}
+
+TEST_F(AppIDParser, MatchesRegexRandom)
+{
+    const std::string alphabet{"azAZ09_-+,.:~ \t\n/"};
+
+    for (int i = 0; i < 20000; i++)
+    {
+        checkSplit(random(alphabet, 12));
+        checkInstance(random(alphabet, 12));
+
+        auto appname = random(alphabet, 8);
+        EXPECT_EQ(std::regex_match(appname, snap_appname_regex), appid_parser::validSnapAppName(appname))
+            << "Appname: '" << appname << "'";
+
+        if (HasFatalFailure())
+        {
+            return;
+        }
+    }
+}
+
+TEST_F(AppIDParser, MatchesRegexStructured)
+{
+    for (int i = 0; i < 20000; i++)
+    {
+        auto sappid = structured();
+        checkSplit(sappid);
+        checkInstance(sappid + "-" + random("0123456789a", 4));
+
+        if (HasFatalFailure())
+        {
+            return;
+        }
+    }
+}
+
+/* The legacy instance regex escaped only '.' and '-' in the application
+   name, so only compare with it on names made of those */
+TEST_F(AppIDParser, MatchesLegacyInstanceRegex)
+{
+    const std::string appchars{"aZ09.-"};
+    const std::regex regexCharacters{"([\\.\\-])"};
+
+    for (int i = 0; i < 2000; i++)
+    {
+        auto appname = random(appchars, 6);
+        auto instance = (rand() % 2 ? appname : random(appchars, 6)) + random("-0a.", 4);
+        SCOPED_TRACE("Appname: '" + appname + "' Instance: '" + instance + "'");
+
+        std::regex instanceregex("^(?:" + std::regex_replace(appname, regexCharacters, "\\$&") +
+                                 ")\\-(\\d*)$");
+        std::smatch match;
+        appid_parser::Range instanceid{0, 0};
+
+        auto found = appid_parser::matchInstance(instance, appname, instanceid);
+        ASSERT_EQ(std::regex_match(instance, match, instanceregex), found);
+        if (found)
+        {
+            EXPECT_EQ(match[1].str(), instanceid.of(instance));
+        }
+    }
+}
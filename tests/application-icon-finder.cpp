@@ -18,7 +18,9 @@
  */
 
 #include "application-icon-finder.h"
+#include <glib/gstdio.h>
 #include <gtest/gtest.h>
+#include <utime.h>
 
 using namespace ubuntu::app_launch;
 
@@ -98,3 +100,153 @@ TEST(ApplicationIconFinder, FindsHumanityIcon)
     IconFinder finder(basePath);
     EXPECT_EQ(basePath + "/icons/Humanity/16x16/apps/gedit.png", finder.find("gedit.png").value());
 }
+
+/* Builds a theme in a temporary directory so that we can change it */
+class ApplicationIconFinderTheme : public ::testing::Test
+{
+protected:
+    std::string basePath;
+    std::string themePath;
+    std::string appsPath;
+
+    virtual void SetUp()
+    {
+        auto ctmpdir = g_dir_make_tmp("ual-icon-finder-XXXXXX", nullptr);
+        ASSERT_NE(nullptr, ctmpdir);
+        basePath = ctmpdir;
+        g_free(ctmpdir);
+
+        themePath = basePath + "/icons/hicolor";
+        appsPath = themePath + "/16x16/apps";
+        g_mkdir_with_parents(appsPath.c_str(), 0700);
+    }
+
+    virtual void TearDown()
+    {
+        for (const auto& name : {"app.png", "new.png", "cached.png"})
+        {
+            g_unlink((appsPath + "/" + name).c_str());
+        }
+        g_unlink((themePath + "/icon-theme.cache").c_str());
+        g_rmdir(appsPath.c_str());
+        g_rmdir((themePath + "/16x16").c_str());
+        g_rmdir(themePath.c_str());
+        g_rmdir((basePath + "/icons").c_str());
+        g_rmdir(basePath.c_str());
+    }
+
+    void touch(const std::string& path)
+    {
+        ASSERT_TRUE(g_file_set_contents(path.c_str(), "", 0, nullptr));
+    }
+
+    void setTime(const std::string& path, time_t time)
+    {
+        struct utimbuf times = {time, time};
+        ASSERT_EQ(0, utime(path.c_str(), &times));
+    }
+
+    /* Writes an icon-theme.cache with a single PNG icon in 16x16/apps */
+    void writeCache(const std::string& iconName)
+    {
+        std::string data;
+        auto add16 = [&data](guint16 value) {
+            data.push_back(char(value >> 8));
+            data.push_back(char(value));
+        };
+        auto add32 = [&data](guint32 value) {
+            data.push_back(char(value >> 24));
+            data.push_back(char(value >> 16));
+            data.push_back(char(value >> 8));
+            data.push_back(char(value));
+        };
+
+        /* Header: version, hash offset, directory list offset */
+        add16(1);
+        add16(0);
+        add32(12);
+        add32(44);
+        /* Hash: one bucket pointing at the icon */
+        add32(1);
+        add32(20);
+        /* Icon: no chain, name, image list */
+        add32(0xFFFFFFFF);
+        add32(63);
+        add32(32);
+        /* Image list: one image in directory zero that is a PNG */
+        add32(1);
+        add16(0);
+        add16(4);
+        add32(0);
+        /* Directory list */
+        add32(1);
+        add32(52);
+        /* Strings */
+        data += "16x16/apps";
+        data.push_back('\0');
+        data += iconName;
+        data.push_back('\0');
+
+        auto path = themePath + "/icon-theme.cache";
+        ASSERT_TRUE(g_file_set_contents(path.c_str(), data.c_str(), data.size(), nullptr));
+    }
+};
+
+TEST_F(ApplicationIconFinderTheme, UsesThemeCache)
+{
+    /* Only in the cache, so if we find it the cache was used */
+    writeCache("cached");
+    setTime(themePath, 0);
+
+    IconFinder finder(basePath);
+    EXPECT_EQ(appsPath + "/cached.png", finder.find("cached").value());
+    EXPECT_EQ(appsPath + "/cached.png", finder.find("cached.png").value());
+    EXPECT_TRUE(finder.find("cached.svg").value().empty());
+}
+
+TEST_F(ApplicationIconFinderTheme, IgnoresStaleThemeCache)
+{
+    touch(appsPath + "/app.png");
+    writeCache("cached");
+    setTime(themePath + "/icon-theme.cache", 0);
+
+    IconFinder finder(basePath);
+    EXPECT_TRUE(finder.find("cached").value().empty());
+    EXPECT_EQ(appsPath + "/app.png", finder.find("app").value());
+}
+
+TEST_F(ApplicationIconFinderTheme, IgnoresCorruptThemeCache)
+{
+    touch(appsPath + "/app.png");
+    auto path = themePath + "/icon-theme.cache";
+    ASSERT_TRUE(g_file_set_contents(path.c_str(), "\0\1\0\0\xff\xff\xff\xff", 8, nullptr));
+    setTime(themePath, 0);
+
+    IconFinder finder(basePath);
+    EXPECT_EQ(appsPath + "/app.png", finder.find("app").value());
+}
+
+TEST_F(ApplicationIconFinderTheme, UpdatesOnDirectoryChanges)
+{
+    touch(appsPath + "/app.png");
+
+    IconFinder finder(basePath);
+    EXPECT_EQ(appsPath + "/app.png", finder.find("app").value());
+    EXPECT_TRUE(finder.find("new").value().empty());
+
+    touch(appsPath + "/new.png");
+    g_unlink((appsPath + "/app.png").c_str());
+
+    /* The monitors are on the default context, give them a chance to run */
+    for (auto i = 0; i < 500 && (finder.find("new").value().empty() || !finder.find("app").value().empty()); i++)
+    {
+        while (g_main_context_pending(nullptr))
+        {
+            g_main_context_iteration(nullptr, TRUE);
+        }
+        g_usleep(10 * 1000);
+    }
+
+    EXPECT_EQ(appsPath + "/new.png", finder.find("new").value());
+    EXPECT_TRUE(finder.find("app").value().empty());
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "application-index.h"
+#include <glib/gstdio.h>
+#include <gtest/gtest.h>
+#include <utime.h>
+
+using namespace ubuntu::app_launch;
+
+class ApplicationIndexTest : public ::testing::Test
+{
+protected:
+    std::string tmpdir;
+    std::string indexpath;
+
+    virtual void SetUp()
+    {
+        auto ctmpdir = g_dir_make_tmp("ual-app-index-XXXXXX", nullptr);
+        ASSERT_NE(nullptr, ctmpdir);
+        tmpdir = ctmpdir;
+        g_free(ctmpdir);
+
+        indexpath = tmpdir + "/cache/installed-apps.index";
+    }
+
+    virtual void TearDown()
+    {
+        g_unlink(indexpath.c_str());
+        g_rmdir((tmpdir + "/cache").c_str());
+        g_rmdir((tmpdir + "/apps").c_str());
+        g_rmdir(tmpdir.c_str());
+    }
+
+    std::list<ApplicationIndex::Entry> testEntries()
+    {
+        return {
+            {ApplicationIndex::Backend::CLICK, AppID::parse("com.test.good_application_1.2.3"), {}},
+            {ApplicationIndex::Backend::LEGACY,
+             AppID{AppID::Package::from_raw({}), AppID::AppName::from_raw("no-exec"), AppID::Version::from_raw({})},
+             {}},
+            {ApplicationIndex::Backend::LIBERTINE, AppID::parse("container-name_test_0.0"), {}},
+            {ApplicationIndex::Backend::SNAP, AppID::parse("unity8-package_foo_x123"), "unity8"},
+        };
+    }
+};
+
+TEST_F(ApplicationIndexTest, MissingFile)
+{
+    ApplicationIndex index(indexpath);
+    std::list<ApplicationIndex::Entry> entries;
+
+    EXPECT_FALSE(index.read({}, entries));
+    EXPECT_TRUE(entries.empty());
+}
+
+TEST_F(ApplicationIndexTest, RoundTrip)
+{
+    ApplicationIndex index(indexpath);
+    ApplicationIndex::Stamps stamps{{"/some/dir", "1:1234.5678"}, {"snapd", "42:Done"}};
+
+    index.write(stamps, testEntries());
+
+    std::list<ApplicationIndex::Entry> entries;
+    ASSERT_TRUE(index.read(stamps, entries));
+
+    auto expected = testEntries();
+    ASSERT_EQ(expected.size(), entries.size());
+
+    auto entry = entries.begin();
+    for (const auto& exentry : expected)
+    {
+        EXPECT_EQ(exentry.backend, entry->backend);
+        EXPECT_EQ(exentry.appid, entry->appid);
+        EXPECT_EQ(exentry.interface, entry->interface);
+        entry++;
+    }
+}
+
+TEST_F(ApplicationIndexTest, StampsChanged)
+{
+    ApplicationIndex index(indexpath);
+    index.write({{"/some/dir", "1:1234.5678"}, {"snapd", "42:Done"}}, testEntries());
+
+    std::list<ApplicationIndex::Entry> entries;
+
+    /* New snapd change */
+    EXPECT_FALSE(index.read({{"/some/dir", "1:1234.5678"}, {"snapd", "43:Doing"}}, entries));
+    /* Directory modified */
+    EXPECT_FALSE(index.read({{"/some/dir", "1:1234.9999"}, {"snapd", "42:Done"}}, entries));
+    /* New directory to look at */
+    EXPECT_FALSE(index.read({{"/some/dir", "1:1234.5678"}, {"/other/dir", "none"}, {"snapd", "42:Done"}}, entries));
+    EXPECT_TRUE(entries.empty());
+
+    EXPECT_TRUE(index.read({{"/some/dir", "1:1234.5678"}, {"snapd", "42:Done"}}, entries));
+    EXPECT_EQ(4, entries.size());
+}
+
+TEST_F(ApplicationIndexTest, Invalidate)
+{
+    ApplicationIndex index(indexpath);
+    index.write({}, testEntries());
+    index.invalidate();
+
+    std::list<ApplicationIndex::Entry> entries;
+    EXPECT_FALSE(index.read({}, entries));
+
+    /* Shouldn't complain when there is nothing to remove */
+    index.invalidate();
+}
+
+TEST_F(ApplicationIndexTest, CorruptFile)
+{
+    ApplicationIndex index(indexpath);
+    index.write({}, testEntries());
+
+    ASSERT_TRUE(g_file_set_contents(indexpath.c_str(), "This is not an index", -1, nullptr));
+
+    std::list<ApplicationIndex::Entry> entries;
+    EXPECT_FALSE(index.read({}, entries));
+    EXPECT_TRUE(entries.empty());
+}
+
+TEST_F(ApplicationIndexTest, FileStamp)
+{
+    auto appsdir = tmpdir + "/apps";
+
+    EXPECT_EQ("none", ApplicationIndex::fileStamp(appsdir));
+
+    ASSERT_EQ(0, g_mkdir(appsdir.c_str(), 0700));
+    auto created = ApplicationIndex::fileStamp(appsdir);
+    EXPECT_NE("none", created);
+    EXPECT_EQ(created, ApplicationIndex::fileStamp(appsdir));
+
+    /* Modifying the directory changes its stamp, setting the time explicitly
+       as the filesystem may not have a fine enough resolution to notice */
+    auto desktop = appsdir + "/foo.desktop";
+    ASSERT_TRUE(g_file_set_contents(desktop.c_str(), "[Desktop Entry]", -1, nullptr));
+    struct utimbuf times = {0, 0};
+    utime(appsdir.c_str(), &times);
+    EXPECT_NE(created, ApplicationIndex::fileStamp(appsdir));
+
+    g_unlink(desktop.c_str());
+}
+
+TEST_F(ApplicationIndexTest, DirectoryStamp)
+{
+    auto appsdir = tmpdir + "/apps";
+
+    EXPECT_EQ("none", ApplicationIndex::directoryStamp(appsdir));
+
+    ASSERT_EQ(0, g_mkdir(appsdir.c_str(), 0700));
+    auto desktop = appsdir + "/foo.desktop";
+    ASSERT_TRUE(g_file_set_contents(desktop.c_str(), "[Desktop Entry]", -1, nullptr));
+    auto created = ApplicationIndex::directoryStamp(appsdir);
+    EXPECT_EQ(created, ApplicationIndex::directoryStamp(appsdir));
+
+    /* Editing the desktop file in place doesn't touch the directory */
+    auto dirstamp = ApplicationIndex::fileStamp(appsdir);
+    struct utimbuf times = {0, 0};
+    utime(desktop.c_str(), &times);
+    EXPECT_EQ(dirstamp, ApplicationIndex::fileStamp(appsdir));
+    EXPECT_NE(created, ApplicationIndex::directoryStamp(appsdir));
+
+    g_unlink(desktop.c_str());
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <json-glib/json-glib.h>
+
+/** Collects the timings of all the benchmarks that are run and writes
+    them out as JSON when all the tests are done. The file is written
+    to UBUNTU_APP_LAUNCH_BENCHMARK_OUTPUT if it is set, otherwise to
+    ual-benchmark.json in the current directory. */
+class BenchmarkResults : public ::testing::Environment
+{
+public:
+    /** Timings of a single benchmark */
+    struct Result
+    {
+        std::string name;                              /**< Name of the benchmark */
+        std::map<std::string, std::string> params;     /**< Parameters that the benchmark was run with */
+        std::vector<std::chrono::nanoseconds> samples; /**< Time for each iteration */
+    };
+
+    static BenchmarkResults* instance()
+    {
+        static BenchmarkResults* results = nullptr;
+        if (results == nullptr)
+        {
+            results = new BenchmarkResults();
+            ::testing::AddGlobalTestEnvironment(results); /* takes ownership */
+        }
+        return results;
+    }
+
+    void add(const Result& result)
+    {
+        g_print("%-50s median %10lld ns (%d iterations)\n", fullName(result).c_str(),
+                (long long)median(result.samples).count(), int(result.samples.size()));
+        results_.push_back(result);
+    }
+
+    virtual void TearDown() override
+    {
+        auto builder = std::shared_ptr<JsonBuilder>(json_builder_new(), g_object_unref);
+
+        json_builder_begin_object(builder.get());
+
+        json_builder_set_member_name(builder.get(), "timestamp");
+        json_builder_add_int_value(builder.get(), g_get_real_time() / G_USEC_PER_SEC);
+
+        json_builder_set_member_name(builder.get(), "benchmarks");
+        json_builder_begin_array(builder.get());
+
+        for (const auto& result : results_)
+        {
+            json_builder_begin_object(builder.get());
+
+            json_builder_set_member_name(builder.get(), "name");
+            json_builder_add_string_value(builder.get(), result.name.c_str());
+
+            json_builder_set_member_name(builder.get(), "params");
+            json_builder_begin_object(builder.get());
+            for (const auto& param : result.params)
+            {
+                json_builder_set_member_name(builder.get(), param.first.c_str());
+                json_builder_add_string_value(builder.get(), param.second.c_str());
+            }
+            json_builder_end_object(builder.get());
+
+            json_builder_set_member_name(builder.get(), "iterations");
+            json_builder_add_int_value(builder.get(), result.samples.size());
+
+            auto sorted = result.samples;
+            std::sort(sorted.begin(), sorted.end());
+            auto total = std::accumulate(sorted.begin(), sorted.end(), std::chrono::nanoseconds{0});
+
+            json_builder_set_member_name(builder.get(), "min_ns");
+            json_builder_add_int_value(builder.get(), sorted.empty() ? 0 : sorted.front().count());
+            json_builder_set_member_name(builder.get(), "median_ns");
+            json_builder_add_int_value(builder.get(), median(sorted).count());
+            json_builder_set_member_name(builder.get(), "mean_ns");
+            json_builder_add_int_value(builder.get(), sorted.empty() ? 0 : total.count() / sorted.size());
+            json_builder_set_member_name(builder.get(), "max_ns");
+            json_builder_add_int_value(builder.get(), sorted.empty() ? 0 : sorted.back().count());
+
+            json_builder_end_object(builder.get());
+        }
+
+        json_builder_end_array(builder.get());
+        json_builder_end_object(builder.get());
+
+        auto root = std::shared_ptr<JsonNode>(json_builder_get_root(builder.get()), json_node_unref);
+        auto generator = std::shared_ptr<JsonGenerator>(json_generator_new(), g_object_unref);
+        json_generator_set_pretty(generator.get(), TRUE);
+        json_generator_set_root(generator.get(), root.get());
+
+        auto output = g_getenv("UBUNTU_APP_LAUNCH_BENCHMARK_OUTPUT");
+        std::string path = output != nullptr ? output : "ual-benchmark.json";
+
+        GError* error = nullptr;
+        json_generator_to_file(generator.get(), path.c_str(), &error);
+        if (error != nullptr)
+        {
+            g_warning("Unable to write benchmark results to '%s': %s", path.c_str(), error->message);
+            g_error_free(error);
+            return;
+        }
+
+        g_print("Benchmark results written to: %s\n", path.c_str());
+    }
+
+private:
+    std::list<Result> results_;
+
+    static std::chrono::nanoseconds median(std::vector<std::chrono::nanoseconds> samples)
+    {
+        if (samples.empty())
+        {
+            return std::chrono::nanoseconds{0};
+        }
+
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    static std::string fullName(const Result& result)
+    {
+        std::string name = result.name;
+        for (const auto& param : result.params)
+        {
+            name += " " + param.first + "=" + param.second;
+        }
+        return name;
+    }
+};
+
+/** Runs a piece of work once to warm up any caches and connections,
+    and then the number of iterations that are asked for, timing each
+    of them. The timings are added to the results that get written out.
+
+    \param name Name of the benchmark in the results
+    \param iterations How many times to time the work
+    \param work The work to time
+    \param params Any parameters that the benchmark was run with
+*/
+inline void benchmark(const std::string& name,
+                      int iterations,
+                      std::function<void()> work,
+                      const std::map<std::string, std::string>& params = {})
+{
+    work();
+
+    BenchmarkResults::Result result{name, params, {}};
+    result.samples.reserve(iterations);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        result.samples.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start));
+    }
+
+    BenchmarkResults::instance()->add(result);
+}
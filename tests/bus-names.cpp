@@ -0,0 +1,145 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include <algorithm>
+#include <future>
+#include <gio/gio.h>
+#include <gtest/gtest.h>
+#include <libdbustest/dbus-test.h>
+
+#include "registry-impl.h"
+#include "registry.h"
+
+#include "eventually-fixture.h"
+
+class BusNames : public EventuallyFixture
+{
+protected:
+    DbusTestService* service = nullptr;
+    GDBusConnection* bus = nullptr;
+    std::shared_ptr<ubuntu::app_launch::Registry> registry;
+
+    virtual void SetUp()
+    {
+        g_setenv("UBUNTU_APP_LAUNCH_CGROUP_ROOT", "/this/should/not/exist", TRUE);
+
+        service = dbus_test_service_new(nullptr);
+        dbus_test_service_start_tasks(service);
+
+        bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+        g_dbus_connection_set_exit_on_close(bus, FALSE);
+        g_object_add_weak_pointer(G_OBJECT(bus), (gpointer*)&bus);
+
+        registry = std::make_shared<ubuntu::app_launch::Registry>();
+    }
+
+    virtual void TearDown()
+    {
+        registry.reset();
+
+        g_clear_object(&service);
+
+        g_object_unref(bus);
+
+        ASSERT_EVENTUALLY_EQ(nullptr, bus);
+    }
+
+    bool hasName(const std::vector<std::string>& names, const std::string& name)
+    {
+        return std::find(names.begin(), names.end(), name) != names.end();
+    }
+
+    std::shared_ptr<GDBusConnection> newConnection()
+    {
+        auto address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+        auto con = g_dbus_connection_new_for_address_sync(
+            address, GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+            nullptr, nullptr, nullptr);
+        g_free(address);
+
+        return std::shared_ptr<GDBusConnection>(con, [](GDBusConnection* con) {
+            g_dbus_connection_close_sync(con, nullptr, nullptr);
+            g_object_unref(con);
+        });
+    }
+};
+
+TEST_F(BusNames, OwnConnections)
+{
+    auto names = registry->impl->busNamesForPids({getpid()});
+
+    EXPECT_TRUE(hasName(names, g_dbus_connection_get_unique_name(bus)));
+    EXPECT_TRUE(hasName(names, g_dbus_connection_get_unique_name(registry->impl->_dbus.get())));
+
+    /* The bus itself has a name, but not one we should find */
+    EXPECT_FALSE(hasName(names, "org.freedesktop.DBus"));
+
+    EXPECT_TRUE(registry->impl->busNamesForPids({}).empty());
+    EXPECT_TRUE(registry->impl->busNamesForPids({1}).empty());
+}
+
+TEST_F(BusNames, TracksConnections)
+{
+    /* Start watching before the connection exists */
+    registry->impl->busNamesForPids({getpid()});
+
+    auto con = newConnection();
+    ASSERT_NE(nullptr, con);
+    std::string name = g_dbus_connection_get_unique_name(con.get());
+
+    /* Found if we've heard about it or not */
+    EXPECT_TRUE(hasName(registry->impl->busNamesForPids({getpid()}), name));
+
+    /* Give the registry a chance to hear it leave */
+    con.reset();
+    pause(100);
+
+    EXPECT_FALSE(hasName(registry->impl->busNamesForPids({getpid()}), name));
+}
+
+TEST_F(BusNames, AsyncLookup)
+{
+    std::promise<std::vector<std::string>> found;
+    auto future = found.get_future();
+
+    registry->impl->busNamesForPids({getpid()},
+                                    [&found](const std::vector<std::string>& names) { found.set_value(names); });
+
+    ASSERT_EQ(std::future_status::ready, future.wait_for(std::chrono::seconds{5}));
+    EXPECT_TRUE(hasName(future.get(), g_dbus_connection_get_unique_name(bus)));
+}
+
+TEST_F(BusNames, StopsWatchingWhenIdle)
+{
+    registry->impl->setBusNamesIdleTime(std::chrono::milliseconds{100});
+    EXPECT_FALSE(registry->impl->watchingBusNames());
+
+    registry->impl->busNamesForPids({getpid()});
+
+    /* Nobody else is looking, so the subscription goes away */
+    pause(500);
+    EXPECT_FALSE(registry->impl->watchingBusNames());
+
+    /* And comes back for the next lookup */
+    registry->impl->setBusNamesIdleTime(std::chrono::seconds{10});
+    auto names = registry->impl->busNamesForPids({getpid()});
+    EXPECT_TRUE(hasName(names, g_dbus_connection_get_unique_name(bus)));
+    EXPECT_TRUE(registry->impl->watchingBusNames());
+}
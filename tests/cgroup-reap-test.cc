@@ -20,6 +20,9 @@
 #include <gtest/gtest.h>
 #include <gio/gio.h>
 #include <libdbustest/dbus-test.h>
+#include <stdio.h>
+#include <string>
+#include <sys/wait.h>
 
 class CGroupReap : public ::testing::Test
 {
@@ -40,6 +43,9 @@ class CGroupReap : public ::testing::Test
 			              NULL); /* error */
 			ASSERT_NE(0, sleeppid);
 
+			/* Don't let it find our real cgroup, only the mock */
+			g_setenv("UBUNTU_APP_LAUNCH_CGROUP_ROOT", "/this/should/not/exist", TRUE);
+
 			service = dbus_test_service_new(NULL);
 
 			/* Create the cgroup manager mock */
@@ -143,3 +149,158 @@ TEST_F(CGroupReap, KillSleep)
 	ASSERT_TRUE(dbus_test_dbus_mock_object_clear_method_calls(cgmock, cgobject, NULL));
 }
 
+
+/* Runs the reaper against a fake cgroup filesystem in the build
+   directory. The test plays the kernel, updating the control files
+   as the processes go away. */
+class CGroupReapFs : public ::testing::Test
+{
+	protected:
+		std::string root = CMAKE_BINARY_DIR "/cgroup-reap-fs";
+		std::string groupdir;
+		GPid sleeppid = 0;
+		GPid reappid = 0;
+
+		virtual void SetUp() {
+			g_spawn_command_line_sync(("rm -rf " + root).c_str(), NULL, NULL, NULL, NULL);
+
+			const gchar * argv[] = { "sleep", "30", NULL };
+			g_spawn_async(NULL,
+			              (gchar **)argv,
+			              NULL, /* env */
+			              G_SPAWN_SEARCH_PATH,
+			              NULL, NULL, /* child setup */
+			              &sleeppid,
+			              NULL); /* error */
+			ASSERT_NE(0, sleeppid);
+
+			g_setenv("UBUNTU_APP_LAUNCH_CGROUP_ROOT", root.c_str(), TRUE);
+			g_setenv("UBUNTU_APP_LAUNCH_CGROUP_SELF", (root + "/self-cgroup").c_str(), TRUE);
+			/* Nothing to fall back to */
+			g_setenv("UBUNTU_APP_LAUNCH_CG_MANAGER_NAME", "org.test.nothere", TRUE);
+		}
+
+		virtual void TearDown() {
+			if (reappid != 0) {
+				kill(reappid, SIGKILL);
+				waitpid(reappid, NULL, 0);
+			}
+
+			kill(sleeppid, SIGKILL);
+
+			g_unsetenv("UBUNTU_APP_LAUNCH_CGROUP_SELF");
+			g_spawn_command_line_sync(("rm -rf " + root).c_str(), NULL, NULL, NULL, NULL);
+		}
+
+		/* Written in place, like the kernel does, so that the watch on
+		   cgroup.events sees it change */
+		void setFile (const std::string& dir, const std::string& file, const std::string& contents) {
+			FILE * out = fopen((dir + "/" + file).c_str(), "w");
+			ASSERT_NE(nullptr, out);
+			EXPECT_EQ(contents.size(), fwrite(contents.c_str(), 1, contents.size(), out));
+			fclose(out);
+		}
+
+		std::string getFile (const std::string& dir, const std::string& file) {
+			gchar * contents = NULL;
+			std::string retval;
+
+			if (g_file_get_contents((dir + "/" + file).c_str(), &contents, NULL, NULL)) {
+				retval = contents;
+			}
+
+			g_free(contents);
+			return retval;
+		}
+
+		/* Builds the group for our job with the sleeper in it */
+		void makeGroup (const std::string& hierarchy, const std::string& selfcgroup) {
+			groupdir = root + hierarchy + "/upstart/application-legacy-foo-1234";
+			ASSERT_EQ(0, g_mkdir_with_parents(groupdir.c_str(), 0700));
+
+			setFile(root, "self-cgroup", selfcgroup);
+			setFile(root + hierarchy + "/upstart", "cgroup.procs", "");
+			setFile(groupdir, "cgroup.procs", std::to_string(sleeppid) + "\n");
+		}
+
+		void startReap (void) {
+			const gchar * argv[] = { CG_REAP_TOOL, NULL };
+			g_spawn_async(NULL,
+			              (gchar **)argv,
+			              NULL, /* env */
+			              G_SPAWN_DO_NOT_REAP_CHILD,
+			              NULL, NULL, /* child setup */
+			              &reappid,
+			              NULL); /* error */
+			ASSERT_NE(0, reappid);
+		}
+
+		/* Whether the reaper has exited, waiting for up to the timeout */
+		bool reapDone (int timeout) {
+			for (int i = 0; i <= timeout / 10; i++) {
+				if (waitpid(reappid, NULL, WNOHANG) == reappid) {
+					reappid = 0;
+					return true;
+				}
+				g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+			}
+
+			return false;
+		}
+
+		/* It isn't our child, so it might be a zombie for a bit */
+		bool sleepRunning (void) {
+			return kill(sleeppid, 0) == 0 &&
+				getFile("/proc/" + std::to_string(sleeppid), "stat").find(") Z") == std::string::npos;
+		}
+
+		bool waitSleepDead (int timeout) {
+			for (int i = 0; i <= timeout / 10 && sleepRunning(); i++) {
+				g_usleep(10 * G_TIME_SPAN_MILLISECOND);
+			}
+
+			return !sleepRunning();
+		}
+};
+
+TEST_F(CGroupReapFs, FreezerV1)
+{
+	makeGroup("/freezer", "10:freezer:/upstart/application-legacy-foo-1234\n1:name=systemd:/user/1000.user\n");
+	setFile(groupdir, "freezer.state", "THAWED\n");
+
+	startReap();
+	ASSERT_TRUE(waitSleepDead(5000));
+
+	/* There are no events on v1, so it keeps looking at the group */
+	EXPECT_FALSE(reapDone(500));
+
+	/* The kernel empties the group */
+	setFile(groupdir, "cgroup.procs", "");
+	EXPECT_TRUE(reapDone(5000));
+
+	/* It left the group before freezing it, and thawed it at the end */
+	EXPECT_NE(std::string::npos, getFile(root + "/freezer/upstart", "cgroup.procs").find_first_of("0123456789"));
+	EXPECT_EQ("THAWED", getFile(groupdir, "freezer.state"));
+}
+
+TEST_F(CGroupReapFs, UnifiedV2)
+{
+	makeGroup("", "0::/upstart/application-legacy-foo-1234\n");
+	setFile(root, "cgroup.controllers", "freezer\n");
+	setFile(groupdir, "cgroup.freeze", "0\n");
+	setFile(groupdir, "cgroup.events", "populated 1\nfrozen 1\n");
+
+	startReap();
+	ASSERT_TRUE(waitSleepDead(5000));
+
+	/* Until the kernel says the group is empty it keeps going */
+	EXPECT_FALSE(reapDone(500));
+
+	/* Which it is told about through cgroup.events, even though the
+	   stale PID is still in cgroup.procs */
+	setFile(groupdir, "cgroup.events", "populated 0\nfrozen 0\n");
+	EXPECT_TRUE(reapDone(5000));
+
+	EXPECT_NE(std::string::npos, getFile(root + "/upstart", "cgroup.procs").find_first_of("0123456789"));
+	EXPECT_EQ("0", getFile(groupdir, "cgroup.freeze"));
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "keyfile-cache.h"
+#include <glib/gstdio.h>
+#include <gtest/gtest.h>
+#include <utime.h>
+
+using namespace ubuntu::app_launch;
+
+class KeyfileCacheTest : public ::testing::Test
+{
+protected:
+    std::string tmpdir;
+
+    virtual void SetUp()
+    {
+        auto ctmpdir = g_dir_make_tmp("ual-keyfile-cache-XXXXXX", nullptr);
+        ASSERT_NE(nullptr, ctmpdir);
+        tmpdir = ctmpdir;
+        g_free(ctmpdir);
+    }
+
+    virtual void TearDown()
+    {
+        for (const auto& name : {"a.desktop", "b.desktop", "c.desktop"})
+        {
+            g_unlink((tmpdir + "/" + name).c_str());
+        }
+        g_rmdir(tmpdir.c_str());
+    }
+
+    std::string writeDesktop(const std::string& name, const std::string& appname)
+    {
+        auto path = tmpdir + "/" + name;
+        auto contents = "[Desktop Entry]\nName=" + appname + "\n";
+        g_file_set_contents(path.c_str(), contents.c_str(), contents.size(), nullptr);
+        return path;
+    }
+
+    std::string nameOf(const std::shared_ptr<GKeyFile>& keyfile)
+    {
+        auto name = g_key_file_get_string(keyfile.get(), "Desktop Entry", "Name", nullptr);
+        std::string retval(name != nullptr ? name : "");
+        g_free(name);
+        return retval;
+    }
+};
+
+TEST_F(KeyfileCacheTest, Hits)
+{
+    KeyfileCache cache(10);
+    auto path = writeDesktop("a.desktop", "A");
+
+    auto first = cache.get(path);
+    ASSERT_NE(nullptr, first);
+    EXPECT_EQ("A", nameOf(first));
+    EXPECT_EQ(0, cache.hits());
+    EXPECT_EQ(1, cache.misses());
+
+    /* Same object back without loading it again */
+    auto second = cache.get(path);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(1, cache.hits());
+    EXPECT_EQ(1, cache.misses());
+}
+
+TEST_F(KeyfileCacheTest, Changed)
+{
+    KeyfileCache cache(10);
+    auto path = writeDesktop("a.desktop", "A");
+
+    auto first = cache.get(path);
+    ASSERT_NE(nullptr, first);
+
+    /* Set the time explicitly as the filesystem may not have
+       a fine enough resolution to notice */
+    writeDesktop("a.desktop", "Changed");
+    struct utimbuf times = {0, 0};
+    utime(path.c_str(), &times);
+
+    auto second = cache.get(path);
+    ASSERT_NE(nullptr, second);
+    EXPECT_NE(first, second);
+    EXPECT_EQ("Changed", nameOf(second));
+    EXPECT_EQ(0, cache.hits());
+    EXPECT_EQ(2, cache.misses());
+}
+
+TEST_F(KeyfileCacheTest, Missing)
+{
+    KeyfileCache cache(10);
+    auto path = writeDesktop("a.desktop", "A");
+
+    ASSERT_NE(nullptr, cache.get(path));
+    g_unlink(path.c_str());
+
+    EXPECT_EQ(nullptr, cache.get(path));
+    EXPECT_EQ(nullptr, cache.get(tmpdir + "/not-there.desktop"));
+}
+
+TEST_F(KeyfileCacheTest, Invalid)
+{
+    KeyfileCache cache(10);
+    auto path = tmpdir + "/b.desktop";
+    ASSERT_TRUE(g_file_set_contents(path.c_str(), "This is not a keyfile", -1, nullptr));
+
+    EXPECT_EQ(nullptr, cache.get(path));
+}
+
+TEST_F(KeyfileCacheTest, Eviction)
+{
+    KeyfileCache cache(2);
+    auto a = writeDesktop("a.desktop", "A");
+    auto b = writeDesktop("b.desktop", "B");
+    auto c = writeDesktop("c.desktop", "C");
+
+    cache.get(a);
+    cache.get(b);
+    cache.get(a); /* A is now more recent than B */
+    cache.get(c); /* Pushes out B */
+    EXPECT_EQ(1, cache.hits());
+    EXPECT_EQ(3, cache.misses());
+
+    cache.get(a);
+    cache.get(c);
+    EXPECT_EQ(3, cache.hits());
+    EXPECT_EQ(3, cache.misses());
+
+    cache.get(b);
+    EXPECT_EQ(3, cache.hits());
+    EXPECT_EQ(4, cache.misses());
+
+    cache.clear();
+    cache.get(a);
+    EXPECT_EQ(5, cache.misses());
+}
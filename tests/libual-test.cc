@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <future>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <gtest/gtest.h>
 #include <libdbustest/dbus-test.h>
 #include <thread>
@@ -515,6 +516,81 @@ TEST_F(LibUAL, ApplicationPid)
 	EXPECT_EQ(0, ubuntu_app_launch_get_primary_pid("chatter.robert-ancell_chatter_2"));
 }
 
+/* Puts a process in a fake proc filesystem, in the cgroup of @job */
+static void
+add_job_process (const gchar * procdir, GPid pid, const gchar * job)
+{
+	gchar * dir = g_strdup_printf("%s/%d", procdir, pid);
+	ASSERT_EQ(0, g_mkdir_with_parents(dir, 0700));
+
+	gchar * statpath = g_build_filename(dir, "stat", NULL);
+	gchar * stat = g_strdup_printf("%d (app) S 1 %d %d 0 -1 4194560 1 0 0 0 0 0 0 0 20 0 1 0 5000 4096 100 18446744073709551615\n", pid, pid, pid);
+	EXPECT_TRUE(g_file_set_contents(statpath, stat, -1, NULL));
+
+	gchar * cgrouppath = g_build_filename(dir, "cgroup", NULL);
+	gchar * cgroup = g_strdup_printf("10:freezer:/user/1000.user/c2.session/upstart/%s\n", job);
+	EXPECT_TRUE(g_file_set_contents(cgrouppath, cgroup, -1, NULL));
+
+	g_free(cgroup);
+	g_free(cgrouppath);
+	g_free(stat);
+	g_free(statpath);
+	g_free(dir);
+}
+
+static void
+remove_job_process (const gchar * procdir, GPid pid)
+{
+	gchar * dir = g_strdup_printf("%s/%d", procdir, pid);
+	gchar * statpath = g_build_filename(dir, "stat", NULL);
+	gchar * cgrouppath = g_build_filename(dir, "cgroup", NULL);
+
+	g_unlink(statpath);
+	g_unlink(cgrouppath);
+	g_rmdir(dir);
+
+	g_free(cgrouppath);
+	g_free(statpath);
+	g_free(dir);
+}
+
+TEST_F(LibUAL, ApplicationPidFromJob)
+{
+	const gchar * procdir = CMAKE_BINARY_DIR "/libual-pid-proc";
+	add_job_process(procdir, 100, "application-click-com.test.good_application_1.2.3");
+	add_job_process(procdir, 200, "application-legacy-multiple-2342345");
+	add_job_process(procdir, 300, "application-legacy-container-name_test_0.0-");
+
+	/* Read when the default registry is made by the first call */
+	g_setenv("UBUNTU_APP_LAUNCH_PID_PROC_PATH", procdir, TRUE);
+
+	DbusTestDbusMockObject * cgobject = dbus_test_dbus_mock_get_object(cgmock, "/org/linuxcontainers/cgmanager", "org.linuxcontainers.cgmanager0_0", NULL);
+	guint len = 0;
+	ASSERT_TRUE(dbus_test_dbus_mock_object_clear_method_calls(cgmock, cgobject, NULL));
+
+	/* Full application IDs match the job */
+	EXPECT_TRUE(ubuntu_app_launch_pid_in_app_id(100, "com.test.good_application_1.2.3"));
+	EXPECT_TRUE(ubuntu_app_launch_pid_in_app_id(300, "container-name_test_0.0"));
+
+	/* Short ones are found first */
+	EXPECT_TRUE(ubuntu_app_launch_pid_in_app_id(200, "multiple"));
+
+	/* In the job of another application */
+	EXPECT_FALSE(ubuntu_app_launch_pid_in_app_id(100, "multiple"));
+	EXPECT_FALSE(ubuntu_app_launch_pid_in_app_id(200, "single"));
+	EXPECT_FALSE(ubuntu_app_launch_pid_in_app_id(300, "com.test.good_application_1.2.3"));
+
+	/* None of that needed the PIDs of the jobs */
+	dbus_test_dbus_mock_object_get_method_calls(cgmock, cgobject, "GetTasksRecursive", &len, NULL);
+	EXPECT_EQ(0, len);
+
+	g_unsetenv("UBUNTU_APP_LAUNCH_PID_PROC_PATH");
+	remove_job_process(procdir, 100);
+	remove_job_process(procdir, 200);
+	remove_job_process(procdir, 300);
+	g_rmdir(procdir);
+}
+
 TEST_F(LibUAL, ApplicationId)
 {
 	g_setenv("TEST_CLICK_DB", "click-db-dir", TRUE);
@@ -766,6 +842,98 @@ TEST_F(LibUAL, StartingResponses)
 	g_object_unref(session);
 }
 
+TEST_F(LibUAL, SharedObservers)
+{
+	std::string first_observer;
+	std::string second_observer;
+	unsigned int starting_count = 0;
+	GDBusConnection * session = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	guint filter = g_dbus_connection_add_filter(session,
+		filter_starting,
+		&starting_count,
+		NULL);
+
+	EXPECT_TRUE(ubuntu_app_launch_observer_add_app_starting(starting_observer, &first_observer));
+	EXPECT_TRUE(ubuntu_app_launch_observer_add_app_starting(starting_observer, &second_observer));
+
+	g_dbus_connection_emit_signal(session,
+		NULL, /* destination */
+		"/", /* path */
+		"com.canonical.UbuntuAppLaunch", /* interface */
+		"UnityStartingBroadcast", /* signal */
+		g_variant_new("(s)", "com.test.good_application_1.2.3"), /* params, the same */
+		NULL);
+
+	/* Both observers hear about it, but only one response is sent */
+	EXPECT_EVENTUALLY_EQ("com.test.good_application_1.2.3", first_observer);
+	EXPECT_EVENTUALLY_EQ("com.test.good_application_1.2.3", second_observer);
+	EXPECT_EVENTUALLY_EQ(1, starting_count);
+
+	/* Removing one leaves the other subscribed */
+	EXPECT_TRUE(ubuntu_app_launch_observer_delete_app_starting(starting_observer, &first_observer));
+	first_observer.clear();
+
+	g_dbus_connection_emit_signal(session,
+		NULL, /* destination */
+		"/", /* path */
+		"com.canonical.UbuntuAppLaunch", /* interface */
+		"UnityStartingBroadcast", /* signal */
+		g_variant_new("(s)", "com.test.multiple_first_1.2.3"), /* params, the same */
+		NULL);
+
+	EXPECT_EVENTUALLY_EQ("com.test.multiple_first_1.2.3", second_observer);
+	EXPECT_EVENTUALLY_EQ(2, starting_count);
+	EXPECT_EQ("", first_observer);
+
+	EXPECT_TRUE(ubuntu_app_launch_observer_delete_app_starting(starting_observer, &second_observer));
+	EXPECT_FALSE(ubuntu_app_launch_observer_delete_app_starting(starting_observer, &second_observer));
+
+	g_dbus_connection_remove_filter(session, filter);
+	g_object_unref(session);
+}
+
+TEST_F(LibUAL, ObserverContexts)
+{
+	std::string main_observer;
+	std::string other_observer;
+	GDBusConnection * session = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+	/* Added while another context is the thread default */
+	GMainContext * other = g_main_context_new();
+	g_main_context_push_thread_default(other);
+	EXPECT_TRUE(ubuntu_app_launch_observer_add_app_focus(starting_observer, &other_observer));
+	g_main_context_pop_thread_default(other);
+
+	EXPECT_TRUE(ubuntu_app_launch_observer_add_app_focus(starting_observer, &main_observer));
+
+	g_dbus_connection_emit_signal(session,
+		NULL, /* destination */
+		"/", /* path */
+		"com.canonical.UbuntuAppLaunch", /* interface */
+		"UnityFocusRequest", /* signal */
+		g_variant_new("(s)", "com.test.good_application_1.2.3"), /* params */
+		NULL);
+
+	/* Each observer is only called on its own context */
+	EXPECT_EVENTUALLY_EQ("com.test.good_application_1.2.3", main_observer);
+	EXPECT_EQ("", other_observer);
+
+	for (int i = 0; i < 100 && other_observer.empty(); i++) {
+		g_main_context_iteration(other, FALSE);
+		pause(10);
+	}
+	EXPECT_EQ("com.test.good_application_1.2.3", other_observer);
+
+	EXPECT_TRUE(ubuntu_app_launch_observer_delete_app_focus(starting_observer, &main_observer));
+	EXPECT_TRUE(ubuntu_app_launch_observer_delete_app_focus(starting_observer, &other_observer));
+
+	while (g_main_context_pending(other)) {
+		g_main_context_iteration(other, FALSE);
+	}
+	g_main_context_unref(other);
+	g_object_unref(session);
+}
+
 TEST_F(LibUAL, AppIdTest)
 {
 	ASSERT_TRUE(ubuntu_app_launch_start_application("com.test.good_application_1.2.3", NULL));
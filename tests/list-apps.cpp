@@ -17,6 +17,7 @@
  *     Ted Gould <ted.gould@canonical.com>
  */
 
+#include <atomic>
 #include <gio/gio.h>
 #include <glib/gstdio.h>
 #include <gtest/gtest.h>
@@ -29,6 +30,7 @@
 #include "application-impl-libertine.h"
 #include "application-impl-snap.h"
 #include "application.h"
+#include "registry-impl.h"
 #include "registry.h"
 
 #ifdef ENABLE_SNAPPY
@@ -36,6 +38,9 @@
 #define SNAPD_LIST_APPS_SOCKET SNAPD_TEST_SOCKET "-list-apps"
 #endif
 
+/* Kept out of the source tree as the tests write to it */
+#define WATCHED_DATA_DIR CMAKE_BINARY_DIR "/list-apps-data"
+
 class ListApps : public EventuallyFixture
 {
 protected:
@@ -57,10 +62,15 @@ protected:
         g_setenv("UBUNTU_APP_LAUNCH_LINK_FARM", linkfarmpath, TRUE);
         g_free(linkfarmpath);
 
-        g_setenv("XDG_DATA_DIRS", CMAKE_SOURCE_DIR, TRUE);
+        /* GLib only reads these once, so the directory that WatchInstalled
+           adds applications to is in the list for everyone */
+        g_setenv("XDG_DATA_DIRS", CMAKE_SOURCE_DIR ":" WATCHED_DATA_DIR, TRUE);
         g_setenv("XDG_CACHE_HOME", CMAKE_SOURCE_DIR "/libertine-data", TRUE);
         g_setenv("XDG_DATA_HOME", CMAKE_SOURCE_DIR "/libertine-home", TRUE);
 
+        /* Always look at the backends, not a cached index */
+        g_setenv("UBUNTU_APP_LAUNCH_DISABLE_APP_INDEX", "1", TRUE);
+
 #ifdef ENABLE_SNAPPY
         g_setenv("UBUNTU_APP_LAUNCH_SNAPD_SOCKET", SNAPD_LIST_APPS_SOCKET, TRUE);
         g_setenv("UBUNTU_APP_LAUNCH_SNAP_BASEDIR", SNAP_BASEDIR, TRUE);
@@ -205,9 +215,8 @@ static std::pair<std::string, std::string> x11Package{
 TEST_F(ListApps, ListSnap)
 {
     SnapdMock mock{SNAPD_LIST_APPS_SOCKET,
-                   {interfaces, u7Package, u7Package, u7Package,      /* unity7 check */
-                    interfaces, u8Package, u8Package, u8Package,      /* unity8 check */
-                    interfaces, x11Package, x11Package, x11Package}}; /* x11 check */
+                   {interfaces,                           /* all the interfaces at once */
+                    u8Package, u7Package, x11Package}}; /* each package once, in the order of the plugs */
     auto registry = std::make_shared<ubuntu::app_launch::Registry>();
 
     auto apps = ubuntu::app_launch::app_impls::Snap::list(registry);
@@ -232,9 +241,8 @@ TEST_F(ListApps, DISABLED_ListAll)
 {
 #ifdef ENABLE_SNAPPY
     SnapdMock mock{SNAPD_LIST_APPS_SOCKET,
-                   {interfaces, u7Package, u7Package, u7Package,      /* unity7 check */
-                    interfaces, u8Package, u8Package, u8Package,      /* unity8 check */
-                    interfaces, x11Package, x11Package, x11Package}}; /* x11 check */
+                   {interfaces,                           /* all the interfaces at once */
+                    u8Package, u7Package, x11Package}}; /* each package once, in the order of the plugs */
 #endif
     auto registry = std::make_shared<ubuntu::app_launch::Registry>();
 
@@ -249,3 +257,189 @@ TEST_F(ListApps, DISABLED_ListAll)
     EXPECT_EQ(15, apps.size());
 #endif
 }
+
+TEST_F(ListApps, ListAllAsync)
+{
+#ifdef ENABLE_SNAPPY
+    SnapdMock mock{SNAPD_LIST_APPS_SOCKET,
+                   {interfaces, u8Package, u7Package, x11Package,   /* installedApps() */
+                    interfaces, u8Package, u7Package, x11Package}}; /* installedAppsAsync() */
+#endif
+    auto registry = std::make_shared<ubuntu::app_launch::Registry>();
+
+    auto apps = ubuntu::app_launch::Registry::installedApps(registry);
+
+    /* Get them again as they're found */
+    std::list<std::shared_ptr<ubuntu::app_launch::Application>> found;
+    int calls = 0;
+    auto done = ubuntu::app_launch::Registry::installedAppsAsync(
+        [&found, &calls](const std::list<std::shared_ptr<ubuntu::app_launch::Application>>& apps) {
+            found.insert(found.end(), apps.begin(), apps.end());
+            calls++;
+        },
+        registry);
+
+    ASSERT_EQ(std::future_status::ready, done.wait_for(std::chrono::seconds{10}));
+    done.get();
+
+    printApps(found);
+
+    /* Without the index each backend hands over its own applications */
+    EXPECT_LT(1, calls);
+    EXPECT_EQ(apps.size(), found.size());
+    for (const auto& app : apps)
+    {
+        EXPECT_TRUE(findApp(found, app->appId()));
+    }
+}
+
+TEST_F(ListApps, ListAllAsyncDropped)
+{
+#ifdef ENABLE_SNAPPY
+    SnapdMock mock{SNAPD_LIST_APPS_SOCKET, {interfaces, u8Package, u7Package, x11Package}};
+#endif
+    auto registry = std::make_shared<ubuntu::app_launch::Registry>();
+
+    /* The callback holds up the listing until we've returned */
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    auto calls = std::make_shared<std::atomic<int>>(0);
+
+    auto start = std::chrono::steady_clock::now();
+    ubuntu::app_launch::Registry::installedAppsAsync(
+        [released, calls](const std::list<std::shared_ptr<ubuntu::app_launch::Application>>& apps) {
+            released.wait_for(std::chrono::seconds{5});
+            (*calls)++;
+        },
+        registry);
+    EXPECT_GT(std::chrono::seconds{1}, std::chrono::steady_clock::now() - start);
+    EXPECT_EQ(0, *calls);
+
+    release.set_value();
+    EXPECT_EVENTUALLY_LT(1, *calls);
+
+    /* Let it finish writing up before the bus goes away */
+    pause(100);
+}
+
+TEST_F(ListApps, ListOnRegistryThread)
+{
+#ifdef ENABLE_SNAPPY
+    SnapdMock mock{SNAPD_LIST_APPS_SOCKET,
+                   {interfaces, u8Package, u7Package, x11Package,   /* in parallel */
+                    interfaces, u8Package, u7Package, x11Package}}; /* on the registry thread */
+#endif
+    auto registry = std::make_shared<ubuntu::app_launch::Registry>();
+
+    auto apps = ubuntu::app_launch::Registry::installedApps(registry);
+
+    /* Click uses the registry thread, so on it that is listed there while
+       the other backends still get their own threads */
+    auto onthread = std::async(std::launch::async, [registry]() {
+        return registry->impl->thread.executeOnThread<std::list<std::shared_ptr<ubuntu::app_launch::Application>>>(
+            [registry]() { return ubuntu::app_launch::Registry::installedApps(registry); });
+    });
+    ASSERT_EQ(std::future_status::ready, onthread.wait_for(std::chrono::seconds{10}));
+    auto serial = onthread.get();
+
+    printApps(serial);
+
+    /* Same applications in the same order */
+    ASSERT_EQ(apps.size(), serial.size());
+    auto app = apps.begin();
+    for (const auto& serialapp : serial)
+    {
+        EXPECT_EQ(std::string((*app)->appId()), std::string(serialapp->appId()));
+        app++;
+    }
+}
+
+TEST_F(ListApps, WatchInstalled)
+{
+    /* Counts of the signals for the app we add, they come from the
+       registry thread */
+    std::atomic<int> installed{0};
+    std::atomic<bool> installedListed{false};
+    std::atomic<int> removed{0};
+    std::atomic<int> updated{0};
+
+    auto appsdir = std::string{WATCHED_DATA_DIR "/applications"};
+    ASSERT_EQ(0, g_mkdir_with_parents(appsdir.c_str(), 0700));
+
+    auto registry = std::make_shared<ubuntu::app_launch::Registry>();
+    std::weak_ptr<ubuntu::app_launch::Registry> weakRegistry = registry;
+    ubuntu::app_launch::Registry::appInstalled(registry).connect(
+        [this, &installed, &installedListed,
+         weakRegistry](const std::shared_ptr<ubuntu::app_launch::Application>& app) {
+            if (std::string(app->appId()) != "watched")
+            {
+                return;
+            }
+
+            /* Signaled on the registry thread, which listing can't wait on */
+            auto reg = weakRegistry.lock();
+            installedListed = reg && findApp(ubuntu::app_launch::Registry::installedApps(reg), app->appId());
+            installed++;
+        });
+    ubuntu::app_launch::Registry::appRemoved(registry).connect([&removed](const ubuntu::app_launch::AppID& appid) {
+        if (std::string(appid) == "watched")
+        {
+            removed++;
+        }
+    });
+    ubuntu::app_launch::Registry::appUpdated(registry).connect(
+        [&updated](const std::shared_ptr<ubuntu::app_launch::Application>& app) {
+            if (std::string(app->appId()) == "watched")
+            {
+                updated++;
+            }
+        });
+
+    /* Wait for it to find what is there to start with */
+    std::list<ubuntu::app_launch::ApplicationIndex::Entry> watched;
+    for (int i = 0; i < 100 && !registry->impl->watchedInstalledApps(watched); i++)
+    {
+        pause(50);
+    }
+    ASSERT_FALSE(watched.empty());
+
+    auto apps = ubuntu::app_launch::Registry::installedApps(registry);
+    EXPECT_EQ(watched.size(), apps.size());
+    EXPECT_FALSE(findApp(apps, "watched"));
+
+    /* Install a legacy app */
+    auto desktop = appsdir + "/watched.desktop";
+    std::string contents =
+        "[Desktop Entry]\n"
+        "Name=Watched\n"
+        "Type=Application\n"
+        "Exec=watched\n";
+    ASSERT_TRUE(g_file_set_contents(desktop.c_str(), contents.c_str(), contents.size(), nullptr));
+
+    EXPECT_EVENTUALLY_EQ(1, installed);
+    EXPECT_TRUE(installedListed);
+    EXPECT_TRUE(findApp(ubuntu::app_launch::Registry::installedApps(registry), "watched"));
+
+    /* Only the new app was added to what we're watching */
+    std::list<ubuntu::app_launch::ApplicationIndex::Entry> added;
+    for (int i = 0; i < 100 && !registry->impl->watchedInstalledApps(added); i++)
+    {
+        pause(50);
+    }
+    EXPECT_EQ(watched.size() + 1, added.size());
+
+    /* Change it */
+    contents += "Icon=watched.png\n";
+    ASSERT_TRUE(g_file_set_contents(desktop.c_str(), contents.c_str(), contents.size(), nullptr));
+
+    EXPECT_EVENTUALLY_LT(0, updated);
+
+    /* And remove it */
+    g_unlink(desktop.c_str());
+
+    EXPECT_EVENTUALLY_EQ(1, removed);
+    EXPECT_FALSE(findApp(ubuntu::app_launch::Registry::installedApps(registry), "watched"));
+
+    g_rmdir(appsdir.c_str());
+    g_rmdir(WATCHED_DATA_DIR);
+}
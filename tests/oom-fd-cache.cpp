@@ -0,0 +1,177 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "oom-fd-cache.h"
+#include <glib/gstdio.h>
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ubuntu::app_launch;
+
+/* Builds a fake proc filesystem in a temporary directory */
+class OomFdCacheTest : public ::testing::Test
+{
+protected:
+    std::string tmpdir;
+
+    virtual void SetUp()
+    {
+        auto ctmpdir = g_dir_make_tmp("ual-oom-fd-cache-XXXXXX", nullptr);
+        ASSERT_NE(nullptr, ctmpdir);
+        tmpdir = ctmpdir;
+        g_free(ctmpdir);
+    }
+
+    virtual void TearDown()
+    {
+        for (const auto& pid : {"100", "200", "300"})
+        {
+            removeProcess(pid);
+        }
+        g_rmdir(tmpdir.c_str());
+    }
+
+    void addProcess(const std::string& pid, const std::string& value)
+    {
+        auto dir = tmpdir + "/" + pid;
+        g_mkdir_with_parents(dir.c_str(), 0700);
+        ASSERT_TRUE(g_file_set_contents((dir + "/oom_score_adj").c_str(), value.c_str(), value.size(), nullptr));
+    }
+
+    void removeProcess(const std::string& pid)
+    {
+        auto dir = tmpdir + "/" + pid;
+        g_unlink((dir + "/oom_score_adj").c_str());
+        g_rmdir(dir.c_str());
+    }
+
+    std::string value(const std::string& pid)
+    {
+        gchar* contents = nullptr;
+        if (!g_file_get_contents((tmpdir + "/" + pid + "/oom_score_adj").c_str(), &contents, nullptr, nullptr))
+        {
+            return {};
+        }
+        std::string retval = contents;
+        g_free(contents);
+        return retval;
+    }
+};
+
+TEST_F(OomFdCacheTest, SetValues)
+{
+    OomFdCache cache(10, tmpdir);
+
+    addProcess("100", "0");
+
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(100, 900));
+    EXPECT_EQ("900", value("100"));
+
+    /* Same value doesn't get written */
+    EXPECT_EQ(OomFdCache::Result::UNCHANGED, cache.set(100, 900));
+
+    /* Shorter value replaces the whole thing */
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(100, 50));
+    EXPECT_EQ("50", value("100"));
+
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(100, -100));
+    EXPECT_EQ("-100", value("100"));
+
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST_F(OomFdCacheTest, MissingProcess)
+{
+    OomFdCache cache(10, tmpdir);
+
+    EXPECT_EQ(OomFdCache::Result::GONE, cache.set(100, 900));
+    EXPECT_EQ(OomFdCache::Result::GONE, cache.set(0, 900));
+    EXPECT_EQ(0u, cache.size());
+
+    /* No proc directory at all */
+    OomFdCache nocache(10, tmpdir + "/not-here");
+    EXPECT_EQ(OomFdCache::Result::GONE, nocache.set(100, 900));
+}
+
+TEST_F(OomFdCacheTest, NoAccess)
+{
+    if (geteuid() == 0)
+    {
+        /* Root can write to anything */
+        return;
+    }
+
+    OomFdCache cache(10, tmpdir);
+
+    addProcess("100", "0");
+    g_chmod((tmpdir + "/100/oom_score_adj").c_str(), 0400);
+
+    EXPECT_EQ(OomFdCache::Result::NO_ACCESS, cache.set(100, 900));
+    EXPECT_EQ("0", value("100"));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(OomFdCacheTest, Eviction)
+{
+    OomFdCache cache(2, tmpdir);
+
+    addProcess("100", "0");
+    addProcess("200", "0");
+    addProcess("300", "0");
+
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(100, 100));
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(200, 100));
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(300, 100));
+    EXPECT_EQ(2u, cache.size());
+
+    /* Reopened after being evicted */
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(100, 200));
+    EXPECT_EQ("200", value("100"));
+    EXPECT_EQ(2u, cache.size());
+
+    cache.clear();
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(OomFdCacheTest, ProcessExit)
+{
+    /* Uses the real proc with a child that we can kill */
+    OomFdCache cache(10);
+
+    auto child = fork();
+    ASSERT_LE(0, child);
+    if (child == 0)
+    {
+        pause();
+        _exit(0);
+    }
+
+    /* Children can always be made more killable */
+    EXPECT_EQ(OomFdCache::Result::WRITTEN, cache.set(child, 500));
+    EXPECT_EQ(OomFdCache::Result::UNCHANGED, cache.set(child, 500));
+    EXPECT_EQ(1u, cache.size());
+
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+
+    EXPECT_EQ(OomFdCache::Result::GONE, cache.set(child, 600));
+    EXPECT_EQ(0u, cache.size());
+}
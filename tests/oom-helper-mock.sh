@@ -0,0 +1,5 @@
+#!/bin/sh
+
+# Stands in for the OOM helper, recording the input of each run
+cat >> "${OOM_HELPER_MOCK_OUTPUT}"
+echo "done" >> "${OOM_HELPER_MOCK_OUTPUT}"
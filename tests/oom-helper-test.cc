@@ -0,0 +1,218 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include <gtest/gtest.h>
+#include <gio/gio.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+
+/* Same as in the helper */
+#define MAX_PAIRS 1024
+
+/* Runs the OOM helper on sleeping processes of our own, so that it
+   can set their values without being setuid */
+class OomHelper : public ::testing::Test
+{
+	protected:
+		std::vector<GPid> sleepers;
+		std::vector<std::string> initial; /* Inherited from us */
+		std::string errors;
+
+		virtual void SetUp() {
+			for (int i = 0; i < 3; i++) {
+				const gchar * argv[] = { "sleep", "30", NULL };
+				GPid sleeppid = 0;
+				g_spawn_async(NULL,
+				              (gchar **)argv,
+				              NULL, /* env */
+				              G_SPAWN_SEARCH_PATH,
+				              NULL, NULL, /* child setup */
+				              &sleeppid,
+				              NULL); /* error */
+				ASSERT_NE(0, sleeppid);
+				sleepers.push_back(sleeppid);
+				initial.push_back(oomValue(sleeppid));
+			}
+		}
+
+		virtual void TearDown() {
+			for (auto sleeppid : sleepers) {
+				kill(sleeppid, SIGKILL);
+				g_spawn_close_pid(sleeppid);
+			}
+		}
+
+		/* The helper only takes PIDs it thinks could be real */
+		bool usablePids (void) {
+			for (auto sleeppid : sleepers) {
+				if (sleeppid >= 32768) {
+					g_warning("PID %d is too big for the helper, skipping test", sleeppid);
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/* Runs the helper with its input on stdin, returns the exit status */
+		int runHelper (const std::string& input) {
+			GError * error = NULL;
+			GSubprocess * helper = g_subprocess_new(GSubprocessFlags(G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDERR_PIPE),
+				&error,
+				OOM_HELPER_TOOL,
+				NULL);
+			EXPECT_EQ(nullptr, error);
+			if (helper == NULL) {
+				g_clear_error(&error);
+				return -1;
+			}
+
+			gchar * stderrstr = NULL;
+			g_subprocess_communicate_utf8(helper, input.c_str(), NULL, NULL, &stderrstr, &error);
+			EXPECT_EQ(nullptr, error);
+			g_clear_error(&error);
+
+			errors = stderrstr != NULL ? stderrstr : "";
+			g_free(stderrstr);
+
+			int status = g_subprocess_get_if_exited(helper) ? g_subprocess_get_exit_status(helper) : -1;
+			g_object_unref(helper);
+			return status;
+		}
+
+		std::string oomValue (GPid pid) {
+			gchar * path = g_strdup_printf("/proc/%d/oom_score_adj", pid);
+			gchar * contents = NULL;
+			std::string value;
+
+			if (g_file_get_contents(path, &contents, NULL, NULL)) {
+				value = g_strstrip(contents);
+			}
+
+			g_free(contents);
+			g_free(path);
+			return value;
+		}
+
+		std::string pair (GPid pid, int value) {
+			return std::to_string(pid) + " " + std::to_string(value) + "\n";
+		}
+
+		unsigned int countErrors (const std::string& message) {
+			unsigned int count = 0;
+			for (auto pos = errors.find(message); pos != std::string::npos; pos = errors.find(message, pos + 1)) {
+				count++;
+			}
+			return count;
+		}
+};
+
+TEST_F(OomHelper, Batch)
+{
+	if (!usablePids()) {
+		return;
+	}
+
+	EXPECT_EQ(0, runHelper(pair(sleepers[0], 300) + pair(sleepers[1], 400) + pair(sleepers[2], 500)));
+	EXPECT_EQ("", errors);
+
+	EXPECT_EQ("300", oomValue(sleepers[0]));
+	EXPECT_EQ("400", oomValue(sleepers[1]));
+	EXPECT_EQ("500", oomValue(sleepers[2]));
+}
+
+TEST_F(OomHelper, MalformedLines)
+{
+	if (!usablePids()) {
+		return;
+	}
+
+	auto pid = std::to_string(sleepers[0]);
+	EXPECT_EQ(0, runHelper("garbage\n" +
+	                       pid + "\n" +
+	                       pid + " 5x\n" +
+	                       pid + " 400 7\n" +
+	                       pid + " 99999999999\n" +
+	                       "\n" +
+	                       pair(sleepers[1], 300)));
+
+	/* Only the last line is good */
+	EXPECT_EQ(6u, countErrors("Invalid line"));
+	EXPECT_EQ(initial[0], oomValue(sleepers[0]));
+	EXPECT_EQ("300", oomValue(sleepers[1]));
+}
+
+TEST_F(OomHelper, OverlongLine)
+{
+	if (!usablePids()) {
+		return;
+	}
+
+	/* The end of the long line would look like a pair if it was read
+	   on its own */
+	EXPECT_EQ(0, runHelper(pair(sleepers[0], 300) +
+	                       std::string(100, ' ') + pair(sleepers[0], 600) +
+	                       pair(sleepers[1], 400)));
+
+	EXPECT_EQ(1u, countErrors("Line too long"));
+	EXPECT_EQ("300", oomValue(sleepers[0]));
+	EXPECT_EQ("400", oomValue(sleepers[1]));
+}
+
+TEST_F(OomHelper, TooManyPairs)
+{
+	if (!usablePids()) {
+		return;
+	}
+
+	std::string input;
+	for (int i = 0; i < MAX_PAIRS; i++) {
+		input += pair(sleepers[0], 300);
+	}
+	input += pair(sleepers[1], 400);
+	input += pair(sleepers[2], 500);
+
+	EXPECT_EQ(0, runHelper(input));
+
+	EXPECT_EQ(2u, countErrors("Too many PIDs"));
+	EXPECT_EQ("300", oomValue(sleepers[0]));
+	EXPECT_EQ(initial[1], oomValue(sleepers[1]));
+	EXPECT_EQ(initial[2], oomValue(sleepers[2]));
+}
+
+TEST_F(OomHelper, InvalidPids)
+{
+	if (!usablePids()) {
+		return;
+	}
+
+	/* The bad ones fail the run, but don't stop the good ones */
+	EXPECT_NE(0, runHelper(std::string("0 300\n") +
+	                       "-5 300\n" +
+	                       "40000 300\n" +
+	                       pair(sleepers[0], 300) +
+	                       pair(sleepers[1], 2000) +
+	                       pair(sleepers[2], 500)));
+
+	EXPECT_EQ(3u, countErrors("PID passed is invalid"));
+	EXPECT_EQ(1u, countErrors("OOM Value passed is invalid"));
+	EXPECT_EQ("300", oomValue(sleepers[0]));
+	EXPECT_EQ(initial[1], oomValue(sleepers[1]));
+	EXPECT_EQ("500", oomValue(sleepers[2]));
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "pid-job-cache.h"
+#include <glib/gstdio.h>
+#include <gtest/gtest.h>
+
+using namespace ubuntu::app_launch;
+
+/* Builds a fake proc filesystem in a temporary directory */
+class PidJobCacheTest : public ::testing::Test
+{
+protected:
+    std::string tmpdir;
+
+    virtual void SetUp()
+    {
+        auto ctmpdir = g_dir_make_tmp("ual-pid-job-cache-XXXXXX", nullptr);
+        ASSERT_NE(nullptr, ctmpdir);
+        tmpdir = ctmpdir;
+        g_free(ctmpdir);
+    }
+
+    virtual void TearDown()
+    {
+        for (const auto& pid : {"100", "200", "300"})
+        {
+            removeProcess(pid);
+        }
+        g_rmdir(tmpdir.c_str());
+    }
+
+    void addProcess(const std::string& pid,
+                    unsigned long long starttime,
+                    const std::string& cgroups,
+                    unsigned long long vsize = 4096)
+    {
+        auto dir = tmpdir + "/" + pid;
+        g_mkdir_with_parents(dir.c_str(), 0700);
+
+        /* Name with spaces and parens to make sure we find the right field */
+        auto stat = pid + " (my (app) name) S 1 100 100 0 -1 4194560 1 0 0 0 0 0 0 0 20 0 1 0 " +
+                    std::to_string(starttime) + " " + std::to_string(vsize) + " 100 18446744073709551615\n";
+        ASSERT_TRUE(g_file_set_contents((dir + "/stat").c_str(), stat.c_str(), stat.size(), nullptr));
+        ASSERT_TRUE(g_file_set_contents((dir + "/cgroup").c_str(), cgroups.c_str(), cgroups.size(), nullptr));
+    }
+
+    void removeProcess(const std::string& pid)
+    {
+        auto dir = tmpdir + "/" + pid;
+        g_unlink((dir + "/stat").c_str());
+        g_unlink((dir + "/cgroup").c_str());
+        g_rmdir(dir.c_str());
+    }
+};
+
+TEST_F(PidJobCacheTest, JobFromCgroups)
+{
+    EXPECT_EQ("application-click-com.test.good_application_1.2.3",
+              PidJobCache::jobFromCgroups("10:freezer:/user/1000.user/c2.session/upstart/"
+                                          "application-click-com.test.good_application_1.2.3\n"
+                                          "1:name=systemd:/user/1000.user/c2.session\n"));
+
+    /* Child groups belong to the job */
+    EXPECT_EQ("application-legacy-foo-1234",
+              PidJobCache::jobFromCgroups("10:freezer:/upstart/application-legacy-foo-1234/child\n"));
+
+    /* Unified hierarchy, and the freezer wins in hybrid setups */
+    EXPECT_EQ("application-snap-foo-", PidJobCache::jobFromCgroups("0::/session.scope/upstart/application-snap-foo-\n"));
+    EXPECT_EQ("freezer-job", PidJobCache::jobFromCgroups("10:freezer:/upstart/freezer-job\n"
+                                                         "0::/upstart/unified-job\n"));
+
+    /* Not in a job */
+    EXPECT_EQ("", PidJobCache::jobFromCgroups("10:freezer:/user/1000.user/c2.session\n"));
+    EXPECT_EQ("", PidJobCache::jobFromCgroups(""));
+}
+
+TEST_F(PidJobCacheTest, AppIdFromJob)
+{
+    EXPECT_EQ("com.test.good_application_1.2.3",
+              PidJobCache::appIdFromJob("application-click-com.test.good_application_1.2.3"));
+    EXPECT_EQ("foo", PidJobCache::appIdFromJob("application-legacy-foo-1234"));
+    EXPECT_EQ("foo-bar", PidJobCache::appIdFromJob("application-legacy-foo-bar-"));
+    EXPECT_EQ("foo_bar_x1", PidJobCache::appIdFromJob("application-snap-foo_bar_x1-"));
+
+    EXPECT_EQ("", PidJobCache::appIdFromJob("untrusted-helper"));
+    EXPECT_EQ("", PidJobCache::appIdFromJob(""));
+}
+
+TEST_F(PidJobCacheTest, Lookup)
+{
+    addProcess("100", 5000, "10:freezer:/upstart/application-click-foo\n");
+    addProcess("200", 6000, "10:freezer:/user/1000.user\n");
+
+    PidJobCache cache(10, tmpdir);
+
+    EXPECT_EQ("application-click-foo", cache.get(100));
+    EXPECT_EQ("", cache.get(200));
+    EXPECT_EQ("", cache.get(300));
+    EXPECT_EQ("", cache.get(0));
+    EXPECT_EQ(0u, cache.hits());
+
+    /* Answered without reading the cgroups again */
+    EXPECT_EQ("application-click-foo", cache.get(100));
+    EXPECT_EQ("", cache.get(200));
+    EXPECT_EQ(2u, cache.hits());
+}
+
+TEST_F(PidJobCacheTest, ProcessExit)
+{
+    addProcess("100", 5000, "10:freezer:/upstart/application-click-foo\n");
+
+    PidJobCache cache(10, tmpdir);
+    EXPECT_EQ("application-click-foo", cache.get(100));
+
+    /* Gone */
+    removeProcess("100");
+    EXPECT_EQ("", cache.get(100));
+
+    /* The PID is reused by a process in another job */
+    addProcess("100", 7000, "10:freezer:/upstart/application-click-bar\n");
+    EXPECT_EQ("application-click-bar", cache.get(100));
+    EXPECT_EQ(0u, cache.hits());
+}
+
+TEST_F(PidJobCacheTest, OtherStatFields)
+{
+    addProcess("100", 5000, "10:freezer:/upstart/application-click-foo\n", 8192);
+
+    PidJobCache cache(10, tmpdir);
+    EXPECT_EQ("application-click-foo", cache.get(100));
+
+    /* The same process growing doesn't change when it started */
+    addProcess("100", 5000, "10:freezer:/upstart/application-click-foo\n", 16384);
+    EXPECT_EQ("application-click-foo", cache.get(100));
+    EXPECT_EQ(1u, cache.hits());
+}
+
+TEST_F(PidJobCacheTest, LeastRecentlyUsed)
+{
+    addProcess("100", 1, "10:freezer:/upstart/job-a\n");
+    addProcess("200", 2, "10:freezer:/upstart/job-b\n");
+    addProcess("300", 3, "10:freezer:/upstart/job-c\n");
+
+    PidJobCache cache(2, tmpdir);
+
+    cache.get(100);
+    cache.get(200);
+    cache.get(100); /* 100 is now the most recent */
+    cache.get(300); /* drops 200 */
+    EXPECT_EQ(1u, cache.hits());
+
+    EXPECT_EQ("job-a", cache.get(100));
+    EXPECT_EQ(2u, cache.hits());
+    EXPECT_EQ("job-b", cache.get(200));
+    EXPECT_EQ(2u, cache.hits());
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include "pid-source.h"
+#include <algorithm>
+#include <glib/gstdio.h>
+#include <gtest/gtest.h>
+
+using namespace ubuntu::app_launch;
+
+/* Builds a fake cgroup hierarchy in a temporary directory */
+class PidSourceTest : public ::testing::Test
+{
+protected:
+    std::string tmpdir;
+    std::string selfcgroup;
+
+    virtual void SetUp()
+    {
+        auto ctmpdir = g_dir_make_tmp("ual-pid-source-XXXXXX", nullptr);
+        ASSERT_NE(nullptr, ctmpdir);
+        tmpdir = ctmpdir;
+        g_free(ctmpdir);
+
+        selfcgroup = tmpdir + "/self-cgroup";
+    }
+
+    virtual void TearDown()
+    {
+        removeDir(tmpdir);
+    }
+
+    void removeDir(const std::string& dir)
+    {
+        auto gdir = g_dir_open(dir.c_str(), 0, nullptr);
+        if (gdir != nullptr)
+        {
+            const gchar* name;
+            while ((name = g_dir_read_name(gdir)) != nullptr)
+            {
+                auto child = dir + "/" + name;
+                if (g_file_test(child.c_str(), G_FILE_TEST_IS_DIR))
+                {
+                    removeDir(child);
+                }
+                else
+                {
+                    g_unlink(child.c_str());
+                }
+            }
+            g_dir_close(gdir);
+        }
+        g_rmdir(dir.c_str());
+    }
+
+    void writeFile(const std::string& path, const std::string& contents)
+    {
+        auto dirname = g_path_get_dirname(path.c_str());
+        g_mkdir_with_parents(dirname, 0700);
+        g_free(dirname);
+
+        ASSERT_TRUE(g_file_set_contents(path.c_str(), contents.c_str(), contents.size(), nullptr));
+    }
+
+    std::string readFile(const std::string& path)
+    {
+        gchar* contents = nullptr;
+        g_file_get_contents(path.c_str(), &contents, nullptr, nullptr);
+        std::string retval(contents != nullptr ? contents : "");
+        g_free(contents);
+        return retval;
+    }
+
+    std::vector<pid_t> sorted(std::vector<pid_t> pids)
+    {
+        std::sort(pids.begin(), pids.end());
+        return pids;
+    }
+};
+
+TEST_F(PidSourceTest, FreezerV1)
+{
+    writeFile(selfcgroup,
+              "10:freezer:/user/1000.user/c2.session\n"
+              "4:cpu,cpuacct:/user/1000.user/c2.session\n"
+              "1:name=systemd:/user/1000.user/c2.session\n");
+
+    auto jobdir = tmpdir + "/freezer/user/1000.user/c2.session/upstart/application-click-foo";
+    writeFile(jobdir + "/cgroup.procs", "100\n200\n");
+    writeFile(jobdir + "/freezer.state", "THAWED\n");
+    writeFile(jobdir + "/child/cgroup.procs", "300\n");
+    writeFile(jobdir + "/child/grandchild/cgroup.procs", "");
+
+    auto source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    std::vector<pid_t> pids;
+    EXPECT_TRUE(source->pidsForGroup("upstart/application-click-foo", pids));
+    EXPECT_EQ((std::vector<pid_t>{100, 200, 300}), sorted(pids));
+
+    /* Our own group includes everything below it */
+    pids.clear();
+    EXPECT_TRUE(source->pidsForGroup("", pids));
+    EXPECT_EQ((std::vector<pid_t>{100, 200, 300}), sorted(pids));
+}
+
+TEST_F(PidSourceTest, UnifiedV2)
+{
+    writeFile(selfcgroup, "0::/user.slice/user-1000.slice/session-2.scope\n");
+    writeFile(tmpdir + "/cgroup.controllers", "cpu io memory pids\n");
+
+    auto jobdir = tmpdir + "/user.slice/user-1000.slice/session-2.scope/upstart/application-legacy-foo-";
+    writeFile(jobdir + "/cgroup.procs", "1234\n");
+
+    auto source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    std::vector<pid_t> pids;
+    EXPECT_TRUE(source->pidsForGroup("upstart/application-legacy-foo-", pids));
+    EXPECT_EQ((std::vector<pid_t>{1234}), pids);
+}
+
+TEST_F(PidSourceTest, HybridPrefersFreezer)
+{
+    writeFile(selfcgroup,
+              "10:freezer:/\n"
+              "0::/session.scope\n");
+    writeFile(tmpdir + "/unified/cgroup.controllers", "");
+    writeFile(tmpdir + "/unified/session.scope/upstart/job/cgroup.procs", "1\n");
+    writeFile(tmpdir + "/freezer/upstart/job/cgroup.procs", "2\n");
+
+    auto source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    std::vector<pid_t> pids;
+    EXPECT_TRUE(source->pidsForGroup("upstart/job", pids));
+    EXPECT_EQ((std::vector<pid_t>{2}), pids);
+
+    /* Without the freezer hierarchy mounted we use the unified one */
+    removeDir(tmpdir + "/freezer");
+
+    source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    pids.clear();
+    EXPECT_TRUE(source->pidsForGroup("upstart/job", pids));
+    EXPECT_EQ((std::vector<pid_t>{1}), pids);
+}
+
+TEST_F(PidSourceTest, NotRunning)
+{
+    writeFile(selfcgroup, "10:freezer:/\n");
+    g_mkdir_with_parents((tmpdir + "/freezer/upstart").c_str(), 0700);
+
+    auto source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    /* No group for the job, so CGManager gets asked instead */
+    std::vector<pid_t> pids;
+    EXPECT_FALSE(source->pidsForGroup("upstart/application-click-foo", pids));
+    EXPECT_TRUE(pids.empty());
+
+    /* Same if our group goes away */
+    removeDir(tmpdir + "/freezer");
+    EXPECT_FALSE(source->pidsForGroup("upstart/application-click-foo", pids));
+}
+
+TEST_F(PidSourceTest, NoHierarchy)
+{
+    EXPECT_EQ(nullptr, CgroupfsPidSource::forSelf(tmpdir, selfcgroup));
+
+    writeFile(selfcgroup, "10:freezer:/user/1000.user\n0::/\n");
+    EXPECT_EQ(nullptr, CgroupfsPidSource::forSelf(tmpdir, selfcgroup));
+
+    writeFile(selfcgroup, "This is not a cgroup file");
+    EXPECT_EQ(nullptr, CgroupfsPidSource::forSelf(tmpdir, selfcgroup));
+}
+
+TEST_F(PidSourceTest, FreezeV1)
+{
+    writeFile(selfcgroup, "10:freezer:/\n");
+    auto jobdir = tmpdir + "/freezer/upstart/application-click-foo";
+    writeFile(jobdir + "/cgroup.procs", "100\n");
+    writeFile(jobdir + "/freezer.state", "THAWED\n");
+
+    auto source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    EXPECT_TRUE(source->freezeGroup("upstart/application-click-foo", true, true));
+    EXPECT_EQ("FROZEN", readFile(jobdir + "/freezer.state"));
+
+    EXPECT_TRUE(source->freezeGroup("upstart/application-click-foo", false, false));
+    EXPECT_EQ("THAWED", readFile(jobdir + "/freezer.state"));
+
+    /* Jobs that aren't running can't be frozen */
+    EXPECT_FALSE(source->freezeGroup("upstart/application-click-bar", true, false));
+}
+
+TEST_F(PidSourceTest, FreezeV2)
+{
+    writeFile(selfcgroup, "0::/session.scope\n");
+    writeFile(tmpdir + "/cgroup.controllers", "");
+    auto jobdir = tmpdir + "/session.scope/upstart/application-legacy-foo-";
+    writeFile(jobdir + "/cgroup.procs", "100\n");
+    writeFile(jobdir + "/cgroup.freeze", "0\n");
+    writeFile(jobdir + "/cgroup.events", "populated 1\nfrozen 1\n");
+
+    auto source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    EXPECT_TRUE(source->freezeGroup("upstart/application-legacy-foo-", true, true));
+    EXPECT_EQ("1", readFile(jobdir + "/cgroup.freeze"));
+
+    EXPECT_TRUE(source->freezeGroup("upstart/application-legacy-foo-", false, false));
+    EXPECT_EQ("0", readFile(jobdir + "/cgroup.freeze"));
+}
+
+TEST_F(PidSourceTest, FreezeTimeout)
+{
+    writeFile(selfcgroup, "0::/session.scope\n");
+    writeFile(tmpdir + "/cgroup.controllers", "");
+    auto jobdir = tmpdir + "/session.scope/upstart/application-legacy-foo-";
+    writeFile(jobdir + "/cgroup.procs", "100\n");
+    writeFile(jobdir + "/cgroup.freeze", "0\n");
+    writeFile(jobdir + "/cgroup.events", "populated 1\nfrozen 0\n");
+
+    auto source = CgroupfsPidSource::forSelf(tmpdir, selfcgroup);
+    ASSERT_NE(nullptr, source);
+
+    /* Never gets frozen, so it is thawed again for the PIDs to be signaled */
+    EXPECT_FALSE(source->freezeGroup("upstart/application-legacy-foo-", true, true));
+    EXPECT_EQ("0", readFile(jobdir + "/cgroup.freeze"));
+}
@@ -34,9 +34,15 @@ protected:
     virtual void TearDown()
     {
         g_unlink(SNAPD_TEST_SOCKET);
+        g_unsetenv("UBUNTU_APP_LAUNCH_SNAPD_STATE");
     }
 };
 
+static std::pair<std::string, std::string> testPackage{
+    "GET /v2/snaps/test-package HTTP/1.1\r\nHost: snapd\r\nAccept: */*\r\n\r\n",
+    SnapdMock::httpJsonResponse(SnapdMock::snapdOkay(
+        SnapdMock::packageJson("test-package", "active", "app", "1.2.3.4", "x123", {"foo", "bar"})))};
+
 TEST_F(SnapdInfo, Init)
 {
     auto info = std::make_shared<ubuntu::app_launch::snapd::Info>();
@@ -148,3 +154,64 @@ TEST_F(SnapdInfo, NoSocket)
 
     EXPECT_EQ(nullptr, nosocket);
 }
+
+TEST_F(SnapdInfo, CacheWithState)
+{
+    auto statefile = std::string{CMAKE_BINARY_DIR} + "/snapd-state.json";
+    ASSERT_TRUE(g_file_set_contents(statefile.c_str(), "{}", -1, nullptr));
+    g_setenv("UBUNTU_APP_LAUNCH_SNAPD_STATE", statefile.c_str(), TRUE);
+
+    SnapdMock mock{SNAPD_TEST_SOCKET, {testPackage, testPackage}};
+    auto info = std::make_shared<ubuntu::app_launch::snapd::Info>();
+    auto package = ubuntu::app_launch::AppID::Package::from_raw("test-package");
+
+    /* Second one comes out of the cache */
+    auto first = info->pkgInfo(package);
+    auto second = info->pkgInfo(package);
+    ASSERT_NE(nullptr, first);
+    ASSERT_NE(nullptr, second);
+    EXPECT_EQ("x123", second->revision);
+
+    /* snapd changed something, so we need to ask again */
+    ASSERT_TRUE(g_file_set_contents(statefile.c_str(), "{ 'changed': true }", -1, nullptr));
+    auto third = info->pkgInfo(package);
+    ASSERT_NE(nullptr, third);
+    EXPECT_EQ("x123", third->revision);
+
+    mock.result();
+
+    g_unlink(statefile.c_str());
+}
+
+TEST_F(SnapdInfo, CacheWithETag)
+{
+    auto json = SnapdMock::snapdOkay(
+        SnapdMock::packageJson("test-package", "active", "app", "1.2.3.4", "x123", {"foo", "bar"}));
+
+    SnapdMock mock{SNAPD_TEST_SOCKET,
+                   {{"GET /v2/snaps/test-package HTTP/1.1\r\nHost: snapd\r\nAccept: */*\r\n\r\n",
+                     "HTTP/1.1 200 OK\r\n"
+                     "Connection: close\r\n"
+                     "Content-Type: application/json\r\n"
+                     "ETag: \"test-etag\"\r\n"
+                     "Content-Length: " +
+                         std::to_string(json.size()) + "\r\n\r\n" + json},
+                    {"GET /v2/snaps/test-package HTTP/1.1\r\nHost: snapd\r\nAccept: */*\r\n"
+                     "If-None-Match: \"test-etag\"\r\n\r\n",
+                     "HTTP/1.1 304 Not Modified\r\n"
+                     "Connection: close\r\n"
+                     "ETag: \"test-etag\"\r\n"
+                     "Content-Length: 0\r\n\r\n"}}};
+    auto info = std::make_shared<ubuntu::app_launch::snapd::Info>();
+    auto package = ubuntu::app_launch::AppID::Package::from_raw("test-package");
+
+    auto first = info->pkgInfo(package);
+    auto second = info->pkgInfo(package);
+
+    mock.result();
+
+    ASSERT_NE(nullptr, first);
+    ASSERT_NE(nullptr, second);
+    EXPECT_EQ("x123", second->revision);
+    EXPECT_NE(second->appnames.end(), second->appnames.find("foo"));
+}
@@ -283,6 +283,7 @@ public:
     static std::string httpJsonResponse(const std::string &json)
     {
         return "HTTP/1.1 200 OK\r\n"                /* okay */
+               "Connection: close\r\n"              /* one request per connection */
                "Content-Type: application/json\r\n" /* json stuff */
                "Content-Length: " +
                std::to_string(json.size()) + "\r\n\r\n" + /* size of data */
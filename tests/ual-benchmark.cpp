@@ -0,0 +1,541 @@
+/*
+ * Copyright © 2016 Canonical Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *     Ted Gould <ted.gould@canonical.com>
+ */
+
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <gtest/gtest.h>
+#include <libdbustest/dbus-test.h>
+#include <regex>
+
+#include "application-icon-finder.h"
+#include "application-info-desktop.h"
+#include "application.h"
+#include "registry-impl.h"
+#include "registry.h"
+
+extern "C" {
+#include "../helpers.h"
+}
+
+#include "benchmark.h"
+#include "eventually-fixture.h"
+
+#ifdef ENABLE_SNAPPY
+#include "snapd-mock.h"
+#endif
+
+/* Where the registry benchmarks keep their installed application index */
+#define APP_INDEX_PATH CMAKE_BINARY_DIR "/ual-benchmark-installed-apps.index"
+
+/* Make sure the results get written even if no benchmark runs */
+static auto benchmarkResults = BenchmarkResults::instance();
+
+/**************************************************
+ * Benchmarks that don't need any services
+ **************************************************/
+
+TEST(StandaloneBenchmark, AppIDParse)
+{
+    benchmark("AppID::parse", 10000, []() {
+        auto appid = ubuntu::app_launch::AppID::parse("com.test.good_application_1.2.3");
+        ASSERT_FALSE(appid.empty());
+    });
+}
+
+TEST(StandaloneBenchmark, AppIDValid)
+{
+    /* The regular expression AppID::valid() used before the parser, as
+       a baseline to compare with */
+    const std::regex full_appid_regex{"^([a-z0-9][a-z0-9+.-]+)"
+                                      "_([A-Za-z0-9+-.:~-][\\sA-Za-z0-9+-.:~-]+)"
+                                      "_([\\d+:]?[A-Za-z0-9.+:~-]+?(?:-[A-Za-z0-9+.~]+)?)$"};
+
+    for (auto id : {"com.test.good_application_1.2.3", "com.test.good_application", "gedit", "Not an AppID!"})
+    {
+        auto expected = (std::string(id) == "com.test.good_application_1.2.3");
+        bool regexValid = false;
+        bool splitValid = false;
+
+        benchmark("AppID::valid", 10000,
+                  [id, &full_appid_regex, &regexValid]() { regexValid = std::regex_match(id, full_appid_regex); },
+                  {{"appid", id}, {"parser", "regex"}});
+        benchmark("AppID::valid", 10000, [id, &splitValid]() { splitValid = ubuntu::app_launch::AppID::valid(id); },
+                  {{"appid", id}, {"parser", "split"}});
+
+        EXPECT_EQ(expected, regexValid);
+        EXPECT_EQ(expected, splitValid);
+    }
+}
+
+TEST(StandaloneBenchmark, DesktopExecParse)
+{
+    benchmark("desktop_exec_parse", 10000, []() {
+        auto argv = desktop_exec_parse("foo --option \"quoted arg\" %U", "http://ubuntu.com file:///tmp/foo");
+        ASSERT_NE(nullptr, argv);
+        g_array_free(argv, TRUE);
+    });
+}
+
+TEST(StandaloneBenchmark, DesktopInfo)
+{
+    auto keyfile = std::shared_ptr<GKeyFile>(g_key_file_new(), g_key_file_free);
+    ASSERT_TRUE(g_key_file_load_from_file(keyfile.get(), CMAKE_SOURCE_DIR "/applications/foo.desktop",
+                                          G_KEY_FILE_NONE, nullptr));
+
+    benchmark("app_info::Desktop", 1000, [&keyfile]() {
+        ubuntu::app_launch::app_info::Desktop info(keyfile, CMAKE_SOURCE_DIR, {},
+                                                    ubuntu::app_launch::app_info::DesktopFlags::NONE, nullptr);
+    });
+}
+
+TEST(StandaloneBenchmark, IconFinder)
+{
+    auto basePath = std::string(CMAKE_SOURCE_DIR) + "/data/usr/share";
+
+    benchmark("IconFinder::IconFinder", 100, [&basePath]() { ubuntu::app_launch::IconFinder finder(basePath); });
+
+    ubuntu::app_launch::IconFinder finder(basePath);
+    for (const auto& icon : {"app", "app2.png", "app_unknown"})
+    {
+        benchmark("IconFinder::find", 10000, [&finder, icon]() { finder.find(icon); }, {{"icon", icon}});
+    }
+}
+
+/**************************************************
+ * Benchmarks against a mocked Upstart and click
+ **************************************************/
+
+/* Builds the same Upstart mock as the libUAL tests, with a variable
+   number of instances of the legacy application so we can see how
+   the cost of things grows with the number of running instances. */
+class RegistryBenchmark : public EventuallyFixture
+{
+protected:
+    DbusTestService* service = nullptr;
+    DbusTestDbusMock* mock = nullptr;
+    DbusTestDbusMock* cgmock = nullptr;
+    GDBusConnection* bus = nullptr;
+    std::shared_ptr<ubuntu::app_launch::Registry> registry;
+
+    virtual int legacyInstances()
+    {
+        return 1;
+    }
+
+    virtual void SetUp()
+    {
+        g_setenv("TEST_CLICK_DB", "click-db-dir", TRUE);
+        g_setenv("TEST_CLICK_USER", "test-user", TRUE);
+
+        g_setenv("XDG_DATA_DIRS", CMAKE_SOURCE_DIR, TRUE);
+        g_setenv("XDG_CACHE_HOME", CMAKE_SOURCE_DIR "/libertine-data", TRUE);
+        g_setenv("XDG_DATA_HOME", CMAKE_SOURCE_DIR "/libertine-home", TRUE);
+
+        /* Keep the index out of the source tree and start without one */
+        g_setenv("UBUNTU_APP_LAUNCH_APP_INDEX", APP_INDEX_PATH, TRUE);
+        g_unlink(APP_INDEX_PATH);
+
+#ifdef ENABLE_SNAPPY
+        g_setenv("UBUNTU_APP_LAUNCH_SNAPD_SOCKET", SNAPD_TEST_SOCKET, TRUE);
+        g_setenv("UBUNTU_APP_LAUNCH_SNAP_BASEDIR", SNAP_BASEDIR, TRUE);
+        g_setenv("UBUNTU_APP_LAUNCH_DISABLE_SNAPD_TIMEOUT", "You betcha!", TRUE);
+        g_unlink(SNAPD_TEST_SOCKET);
+#endif
+
+        service = dbus_test_service_new(nullptr);
+        mock = dbus_test_dbus_mock_new("com.ubuntu.Upstart");
+
+        auto obj = dbus_test_dbus_mock_get_object(mock, "/com/ubuntu/Upstart", "com.ubuntu.Upstart0_6", nullptr);
+        dbus_test_dbus_mock_object_add_method(mock, obj, "GetJobByName", G_VARIANT_TYPE("s"), G_VARIANT_TYPE("o"),
+                                              "if args[0] == 'application-click':\n"
+                                              "	ret = dbus.ObjectPath('/com/test/application_click')\n"
+                                              "elif args[0] == 'application-snap':\n"
+                                              "	ret = dbus.ObjectPath('/com/test/application_snap')\n"
+                                              "elif args[0] == 'application-legacy':\n"
+                                              "	ret = dbus.ObjectPath('/com/test/application_legacy')\n",
+                                              nullptr);
+
+        /* Click App */
+        auto jobobj =
+            dbus_test_dbus_mock_get_object(mock, "/com/test/application_click", "com.ubuntu.Upstart0_6.Job", nullptr);
+        dbus_test_dbus_mock_object_add_method(mock, jobobj, "GetAllInstances", nullptr, G_VARIANT_TYPE("ao"),
+                                              "ret = [ dbus.ObjectPath('/com/test/app_instance') ]", nullptr);
+        dbus_test_dbus_mock_object_add_method(mock, jobobj, "GetInstanceByName", G_VARIANT_TYPE_STRING,
+                                              G_VARIANT_TYPE("o"), "ret = dbus.ObjectPath('/com/test/app_instance')",
+                                              nullptr);
+
+        auto instobj =
+            dbus_test_dbus_mock_get_object(mock, "/com/test/app_instance", "com.ubuntu.Upstart0_6.Instance", nullptr);
+        dbus_test_dbus_mock_object_add_property(mock, instobj, "name", G_VARIANT_TYPE_STRING,
+                                                g_variant_new_string("com.test.good_application_1.2.3"), nullptr);
+        auto process_var = g_strdup_printf("[('main', %d)]", getpid());
+        dbus_test_dbus_mock_object_add_property(mock, instobj, "processes", G_VARIANT_TYPE("a(si)"),
+                                                g_variant_new_parsed(process_var), nullptr);
+        g_free(process_var);
+
+        /* Snap App, nothing running */
+        auto snapjobobj =
+            dbus_test_dbus_mock_get_object(mock, "/com/test/application_snap", "com.ubuntu.Upstart0_6.Job", nullptr);
+        dbus_test_dbus_mock_object_add_method(mock, snapjobobj, "GetAllInstances", nullptr, G_VARIANT_TYPE("ao"),
+                                              "ret = [ ]", nullptr);
+
+        /* Legacy App */
+        std::string instances;
+        for (int i = 0; i < legacyInstances(); i++)
+        {
+            auto path = "/com/test/legacy_app_instance" + std::to_string(i);
+            instances += "dbus.ObjectPath('" + path + "'), ";
+
+            auto linstobj =
+                dbus_test_dbus_mock_get_object(mock, path.c_str(), "com.ubuntu.Upstart0_6.Instance", nullptr);
+            dbus_test_dbus_mock_object_add_property(
+                mock, linstobj, "name", G_VARIANT_TYPE_STRING,
+                g_variant_new_string(("multiple-" + std::to_string(1000 + i)).c_str()), nullptr);
+            dbus_test_dbus_mock_object_add_property(mock, linstobj, "processes", G_VARIANT_TYPE("a(si)"),
+                                                    g_variant_new_parsed("[('main', 5678)]"), nullptr);
+        }
+
+        auto ljobobj =
+            dbus_test_dbus_mock_get_object(mock, "/com/test/application_legacy", "com.ubuntu.Upstart0_6.Job", nullptr);
+        dbus_test_dbus_mock_object_add_method(mock, ljobobj, "GetAllInstances", nullptr, G_VARIANT_TYPE("ao"),
+                                              ("ret = [ " + instances + "]").c_str(), nullptr);
+        dbus_test_dbus_mock_object_add_method(
+            mock, ljobobj, "GetInstanceByName", G_VARIANT_TYPE_STRING, G_VARIANT_TYPE("o"),
+            "if args[0].startswith('multiple-'):\n"
+            "	ret = dbus.ObjectPath('/com/test/legacy_app_instance' + str(int(args[0][9:]) - 1000))\n"
+            "else:\n"
+            "	raise dbus.exceptions.DBusException('Unknown', name='com.ubuntu.Upstart0_6.Error.UnknownInstance')\n",
+            nullptr);
+
+        /* Create the cgroup manager mock */
+        cgmock = dbus_test_dbus_mock_new("org.test.cgmock");
+        g_setenv("UBUNTU_APP_LAUNCH_CG_MANAGER_NAME", "org.test.cgmock", TRUE);
+
+        auto cgobject = dbus_test_dbus_mock_get_object(cgmock, "/org/linuxcontainers/cgmanager",
+                                                       "org.linuxcontainers.cgmanager0_0", nullptr);
+        dbus_test_dbus_mock_object_add_method(cgmock, cgobject, "GetTasksRecursive", G_VARIANT_TYPE("(ss)"),
+                                              G_VARIANT_TYPE("ai"), "ret = [100, 200, 300]", nullptr);
+
+        /* Put it together */
+        dbus_test_service_add_task(service, DBUS_TEST_TASK(mock));
+        dbus_test_service_add_task(service, DBUS_TEST_TASK(cgmock));
+        dbus_test_service_start_tasks(service);
+
+        bus = g_bus_get_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+        g_dbus_connection_set_exit_on_close(bus, FALSE);
+        g_object_add_weak_pointer(G_OBJECT(bus), (gpointer*)&bus);
+
+        g_setenv("UBUNTU_APP_LAUNCH_CG_MANAGER_SESSION_BUS", "YES", TRUE);
+        g_setenv("UBUNTU_APP_LAUNCH_CGROUP_ROOT", "/this/should/not/exist", TRUE);
+
+        registry = std::make_shared<ubuntu::app_launch::Registry>();
+    }
+
+    virtual void TearDown()
+    {
+        registry.reset();
+
+        g_clear_object(&mock);
+        g_clear_object(&cgmock);
+        g_clear_object(&service);
+
+        g_object_unref(bus);
+
+        ASSERT_EVENTUALLY_EQ(nullptr, bus);
+
+        g_unlink(APP_INDEX_PATH);
+        g_unsetenv("UBUNTU_APP_LAUNCH_APP_INDEX");
+
+#ifdef ENABLE_SNAPPY
+        g_unlink(SNAPD_TEST_SOCKET);
+#endif
+    }
+};
+
+TEST_F(RegistryBenchmark, AppIDFind)
+{
+    for (const auto& id : {"com.test.good_application_1.2.3", "com.test.good_application", "multiple"})
+    {
+        benchmark("AppID::find", 100,
+                  [this, id]() { ASSERT_FALSE(ubuntu::app_launch::AppID::find(registry, id).empty()); },
+                  {{"appid", id}});
+    }
+}
+
+TEST_F(RegistryBenchmark, AppIDDiscover)
+{
+    benchmark("AppID::discover", 100, [this]() {
+        ASSERT_FALSE(ubuntu::app_launch::AppID::discover(registry, "com.test.good", "application").empty());
+    });
+    benchmark("AppID::discover", 100, [this]() {
+        ASSERT_FALSE(ubuntu::app_launch::AppID::discover(
+                         registry, "com.test.multiple", ubuntu::app_launch::AppID::ApplicationWildcard::LAST_LISTED)
+                         .empty());
+    }, {{"wildcard", "last-listed"}});
+}
+
+TEST_F(RegistryBenchmark, ApplicationCreate)
+{
+    for (const auto& backend : std::map<std::string, std::string>{{"click", "com.test.good_application_1.2.3"},
+                                                                  {"legacy", "multiple"},
+                                                                  {"libertine", "container-name_test_0.0"}})
+    {
+        auto appid = ubuntu::app_launch::AppID::find(registry, backend.second);
+        ASSERT_FALSE(appid.empty());
+
+        benchmark("Application::create", 100,
+                  [this, &appid]() { ASSERT_NE(nullptr, ubuntu::app_launch::Application::create(appid, registry)); },
+                  {{"backend", backend.first}});
+    }
+}
+
+#ifdef ENABLE_SNAPPY
+TEST_F(RegistryBenchmark, ApplicationCreateSnap)
+{
+    const int iterations = 20;
+
+    std::pair<std::string, std::string> interfaces{
+        "GET /v2/interfaces HTTP/1.1\r\nHost: snapd\r\nAccept: */*\r\n\r\n",
+        SnapdMock::httpJsonResponse(
+            SnapdMock::snapdOkay(SnapdMock::interfacesJson({{"unity8", "unity8-package", {"foo", "single"}}})))};
+    std::pair<std::string, std::string> u8Package{
+        "GET /v2/snaps/unity8-package HTTP/1.1\r\nHost: snapd\r\nAccept: */*\r\n\r\n",
+        SnapdMock::httpJsonResponse(SnapdMock::snapdOkay(
+            SnapdMock::packageJson("unity8-package", "active", "app", "1.2.3.4", "x123", {"foo", "single"})))};
+
+    /* The mock takes a connection per request, and there isn't any state
+       file so nothing gets cached */
+    std::list<std::pair<std::string, std::string>> interactions;
+    for (int i = 0; i < iterations + 1; i++)
+    {
+        interactions.push_back(u8Package);
+        interactions.push_back(interfaces);
+        interactions.push_back(u8Package);
+    }
+
+    SnapdMock snapd{SNAPD_TEST_SOCKET, interactions};
+    registry = std::make_shared<ubuntu::app_launch::Registry>();
+
+    auto appid = ubuntu::app_launch::AppID::parse("unity8-package_foo_x123");
+    benchmark("Application::create", iterations,
+              [this, &appid]() { ASSERT_NE(nullptr, ubuntu::app_launch::Application::create(appid, registry)); },
+              {{"backend", "snap"}});
+
+    snapd.result();
+}
+#endif
+
+TEST_F(RegistryBenchmark, InstalledApps)
+{
+    /* Cold: no index, so every backend is listed and the index written */
+    benchmark("Registry::installedApps", 20,
+              [this]() {
+                  g_unlink(APP_INDEX_PATH);
+                  ASSERT_FALSE(ubuntu::app_launch::Registry::installedApps(registry).empty());
+              },
+              {{"index", "cold"}});
+
+    /* Warm: the index is up to date and read instead */
+    ASSERT_FALSE(ubuntu::app_launch::Registry::installedApps(registry).empty());
+    ASSERT_TRUE(g_file_test(APP_INDEX_PATH, G_FILE_TEST_EXISTS));
+    benchmark("Registry::installedApps", 20,
+              [this]() { ASSERT_FALSE(ubuntu::app_launch::Registry::installedApps(registry).empty()); },
+              {{"index", "warm"}});
+}
+
+TEST_F(RegistryBenchmark, InstancePids)
+{
+    auto app = ubuntu::app_launch::Application::create(
+        ubuntu::app_launch::AppID::parse("com.test.good_application_1.2.3"), registry);
+    auto instances = app->instances();
+    ASSERT_EQ(1, instances.size());
+    auto instance = instances[0];
+
+    benchmark("UpstartInstance::primaryPid", 100, [&instance]() { ASSERT_EQ(getpid(), instance->primaryPid()); });
+    benchmark("UpstartInstance::pids", 100, [&instance]() { ASSERT_EQ(3, instance->pids().size()); });
+}
+
+/* Runs the list of running apps with an increasing number of instances */
+class RunningAppsBenchmark : public RegistryBenchmark, public ::testing::WithParamInterface<int>
+{
+protected:
+    virtual int legacyInstances() override
+    {
+        return GetParam();
+    }
+};
+
+TEST_P(RunningAppsBenchmark, RunningApps)
+{
+    benchmark("Registry::runningApps", 20,
+              [this]() { ASSERT_EQ(2, ubuntu::app_launch::Registry::runningApps(registry).size()); },
+              {{"instances", std::to_string(GetParam())}});
+}
+
+/* Looking at a single application shouldn't cost more as other
+   applications run, both the first time and once it is cached */
+TEST_P(RunningAppsBenchmark, ApplicationInstances)
+{
+    for (const auto& backend : std::map<std::string, std::pair<std::string, size_t>>{
+             {"click", {"com.test.good_application_1.2.3", 1}}, {"libertine", {"container-name_test_0.0", 0}}})
+    {
+        auto appid = ubuntu::app_launch::AppID::parse(backend.second.first);
+        auto expected = backend.second.second;
+        std::map<std::string, std::string> params{{"instances", std::to_string(GetParam())},
+                                                  {"backend", backend.first}};
+
+        params["cache"] = "cold";
+        benchmark("Application::instances", 20, [&appid, expected]() {
+            auto coldregistry = std::make_shared<ubuntu::app_launch::Registry>();
+            auto app = ubuntu::app_launch::Application::create(appid, coldregistry);
+            ASSERT_EQ(expected, app->instances().size());
+        }, params);
+
+        params["cache"] = "warm";
+        auto app = ubuntu::app_launch::Application::create(appid, registry);
+        benchmark("Application::instances", 100, [&app, expected]() { ASSERT_EQ(expected, app->instances().size()); },
+                  params);
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(Instances, RunningAppsBenchmark, ::testing::Values(1, 10, 30, 60));
+
+/* Finds the connections of an application with an increasing number of
+   other connections on the bus, which is what second exec needs to do
+   when sending URLs to an application that is already running. */
+class BusNamesBenchmark : public RegistryBenchmark, public ::testing::WithParamInterface<int>
+{
+protected:
+    std::list<std::shared_ptr<GDBusConnection>> connections;
+
+    virtual void SetUp() override
+    {
+        RegistryBenchmark::SetUp();
+
+        auto address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, nullptr, nullptr);
+        for (int i = 0; i < GetParam(); i++)
+        {
+            auto con = g_dbus_connection_new_for_address_sync(
+                address, GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                              G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION),
+                nullptr, nullptr, nullptr);
+            ASSERT_NE(nullptr, con);
+            connections.emplace_back(con, [](GDBusConnection* con) {
+                g_dbus_connection_close_sync(con, nullptr, nullptr);
+                g_object_unref(con);
+            });
+        }
+        g_free(address);
+    }
+
+    virtual void TearDown() override
+    {
+        connections.clear();
+        RegistryBenchmark::TearDown();
+    }
+
+    /* What second exec used to do, ask the bus about every name
+       in parallel and keep the ones that match */
+    std::vector<std::string> scanBusNames(pid_t pid)
+    {
+        auto listnames = g_dbus_connection_call_sync(bus, "org.freedesktop.DBus", "/", "org.freedesktop.DBus",
+                                                     "ListNames", nullptr, G_VARIANT_TYPE("(as)"),
+                                                     G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+        if (listnames == nullptr)
+        {
+            return {};
+        }
+
+        struct Scan
+        {
+            pid_t pid;
+            unsigned int pending;
+            std::vector<std::string> names;
+        } scan{pid, 0, {}};
+        struct Call
+        {
+            Scan* scan;
+            std::string name;
+        };
+
+        auto context = std::shared_ptr<GMainContext>(g_main_context_new(), g_main_context_unref);
+        g_main_context_push_thread_default(context.get());
+
+        auto names = g_variant_get_child_value(listnames, 0);
+        GVariantIter iter;
+        g_variant_iter_init(&iter, names);
+        const gchar* name = nullptr;
+        while (g_variant_iter_loop(&iter, "&s", &name))
+        {
+            if (!g_dbus_is_unique_name(name))
+            {
+                continue;
+            }
+
+            scan.pending++;
+            g_dbus_connection_call(bus, "org.freedesktop.DBus", "/", "org.freedesktop.DBus",
+                                   "GetConnectionUnixProcessID", g_variant_new("(s)", name), G_VARIANT_TYPE("(u)"),
+                                   G_DBUS_CALL_FLAGS_NONE, -1, nullptr,
+                                   [](GObject* obj, GAsyncResult* res, gpointer user_data) {
+                                       auto call = std::unique_ptr<Call>(static_cast<Call*>(user_data));
+                                       call->scan->pending--;
+
+                                       auto vpid = g_dbus_connection_call_finish(G_DBUS_CONNECTION(obj), res, nullptr);
+                                       if (vpid == nullptr)
+                                       {
+                                           return;
+                                       }
+
+                                       guint32 pid = 0;
+                                       g_variant_get(vpid, "(u)", &pid);
+                                       g_variant_unref(vpid);
+
+                                       if (pid_t(pid) == call->scan->pid)
+                                       {
+                                           call->scan->names.push_back(call->name);
+                                       }
+                                   },
+                                   new Call{&scan, name});
+        }
+
+        while (scan.pending > 0)
+        {
+            g_main_context_iteration(context.get(), TRUE);
+        }
+
+        g_main_context_pop_thread_default(context.get());
+        g_variant_unref(names);
+        g_variant_unref(listnames);
+
+        return scan.names;
+    }
+};
+
+TEST_P(BusNamesBenchmark, FindConnections)
+{
+    std::map<std::string, std::string> params{{"connections", std::to_string(GetParam())}};
+
+    /* The legacy app's PID doesn't have any connections, so every name
+       gets looked at and nothing is found */
+    benchmark("Registry::Impl::busNamesForPids", 100,
+              [this]() { ASSERT_TRUE(registry->impl->busNamesForPids({5678}).empty()); }, params);
+    benchmark("ListNames scan", 20, [this]() { ASSERT_TRUE(scanBusNames(5678).empty()); }, params);
+}
+
+INSTANTIATE_TEST_CASE_P(Connections, BusNamesBenchmark, ::testing::Values(10, 100, 300));